@@ -0,0 +1,120 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Function to get the current position of the object a track moves
+static glm::vec3 objectPosition(const Scene& scene, GLuint target, GLuint object) {
+    if (target == TRACK_SPHERE) return scene.spheres[object].center;
+    if (target == TRACK_LIGHT) return scene.lights[object].position;
+    const MeshInstance& instance = scene.instances[object];
+    return glm::vec3(instance.objectToWorld[0].w, instance.objectToWorld[1].w, instance.objectToWorld[2].w);
+}
+
+// Function to get the track of an object, adding one if it has none
+GLuint addTrack(Scene& scene, GLuint target, GLuint object) {
+    for (size_t i = 0; i < scene.tracks.size(); i++) {
+        if (scene.tracks[i].target == target && scene.tracks[i].object == object) return GLuint(i);
+    }
+    AnimationTrack track(target, object);
+    track.firstKey = GLuint(scene.trackKeys.size());
+    track.keyCount = 1;
+    scene.trackKeys.push_back(TrackKey(0.0f, objectPosition(scene, target, object)));
+    scene.tracks.push_back(track);
+    return GLuint(scene.tracks.size() - 1);
+}
+
+// Function to add a key to a track in time order, replacing a key at the same time
+void addTrackKey(Scene& scene, GLuint track, const TrackKey& key) {
+    AnimationTrack& animated = scene.tracks[track];
+    std::vector<TrackKey>::iterator first = scene.trackKeys.begin() + animated.firstKey;
+    std::vector<TrackKey>::iterator last = first + animated.keyCount;
+    std::vector<TrackKey>::iterator at = std::lower_bound(first, last, key.time,
+        [](const TrackKey& existing, float time) { return existing.time < time; });
+    if (at != last && at->time == key.time) {
+        at->position = key.position;
+        return;
+    }
+
+    // The keys of the tracks after this one move up by one
+    GLuint end = animated.firstKey + animated.keyCount;
+    for (AnimationTrack& other : scene.tracks) {
+        if (other.keyCount > 0 && other.firstKey >= end && &other != &animated) other.firstKey++;
+    }
+    scene.trackKeys.insert(at, key);
+    animated.keyCount++;
+}
+
+// Function to set the procedural sine wave added to the keyed position of a track
+void setTrackWave(Scene& scene, GLuint track, const glm::vec3& amplitude, const glm::vec3& frequency, const glm::vec3& phase) {
+    scene.tracks[track].amplitude = amplitude;
+    scene.tracks[track].frequency = frequency;
+    scene.tracks[track].phase = phase;
+}
+
+// Function to get the position of the object of a track at a time in seconds
+glm::vec3 evaluateTrack(const Scene& scene, const AnimationTrack& track, double time) {
+    glm::dvec3 position(0.0);
+    if (track.keyCount > 0) {
+        const TrackKey* first = &scene.trackKeys[track.firstKey];
+        const TrackKey* last = first + track.keyCount - 1;
+        // Hold the first and last keys outside of the keyed range
+        const TrackKey* next = std::upper_bound(first, last + 1, time,
+            [](double t, const TrackKey& key) { return t < double(key.time); });
+        if (next == first) {
+            position = glm::dvec3(first->position);
+        } else if (next > last) {
+            position = glm::dvec3(last->position);
+        } else {
+            const TrackKey* previous = next - 1;
+            double blend = (time - double(previous->time)) / (double(next->time) - double(previous->time));
+            position = glm::dvec3(previous->position) + blend * (glm::dvec3(next->position) - glm::dvec3(previous->position));
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (track.amplitude[axis] == 0.0f) continue;
+        position[axis] += double(track.amplitude[axis]) * std::sin(double(track.frequency[axis]) * time + double(track.phase[axis]));
+    }
+    return glm::vec3(position);
+}
+
+// Function to move every animated object to its position at a time in seconds
+void animateScene(Scene& scene, double time, SceneChanges& changes) {
+    for (const AnimationTrack& track : scene.tracks) {
+        glm::vec3 position = evaluateTrack(scene, track, time);
+        if (position == objectPosition(scene, track.target, track.object)) continue;
+
+        if (track.target == TRACK_SPHERE) {
+            scene.spheres[track.object].center = position;
+            changes.spheres.push_back(track.object);
+        } else if (track.target == TRACK_LIGHT) {
+            scene.lights[track.object].position = position;
+            changes.lights.push_back(track.object);
+        } else {
+            // Only the translation changes, so the inverse keeps its rotation and scale and only gets the
+            // translation that maps the new position back to the mesh origin
+            MeshInstance& instance = scene.instances[track.object];
+            for (int row = 0; row < 3; row++) {
+                instance.objectToWorld[row].w = position[row];
+                instance.worldToObject[row].w = -glm::dot(glm::vec3(instance.worldToObject[row]), position);
+            }
+            changes.instances.push_back(track.object);
+        }
+    }
+}
+
+// Function to check that the tracks of a scene refer to existing objects and keys and that their keys are sorted
+bool validTracks(const Scene& scene) {
+    for (const AnimationTrack& track : scene.tracks) {
+        size_t objects = track.target == TRACK_SPHERE ? scene.spheres.size()
+                       : track.target == TRACK_LIGHT ? scene.lights.size()
+                       : track.target == TRACK_INSTANCE ? scene.instances.size() : 0;
+        if (track.object >= objects || uint64_t(track.firstKey) + track.keyCount > scene.trackKeys.size()) return false;
+        for (GLuint k = 1; k < track.keyCount; k++) {
+            if (!(scene.trackKeys[track.firstKey + k - 1].time < scene.trackKeys[track.firstKey + k].time)) return false;
+        }
+    }
+    return true;
+}
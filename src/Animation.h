@@ -0,0 +1,41 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "Geometry.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Structure for the objects an animation step moved, by their index in the arrays of the scene
+struct SceneChanges {
+    std::vector<GLuint> spheres;
+    std::vector<GLuint> lights;
+    std::vector<GLuint> instances;
+
+    bool empty() const { return spheres.empty() && lights.empty() && instances.empty(); }
+};
+
+// Function to get the track of an object, adding one if it has none. A new track gets the current position
+// of the object as its key at time 0, so the object rests there until keys or a wave are added.
+GLuint addTrack(Scene& scene, GLuint target, GLuint object);
+
+// Function to add a key to a track in time order, replacing a key at the same time
+void addTrackKey(Scene& scene, GLuint track, const TrackKey& key);
+
+// Function to set the procedural sine wave added to the keyed position of a track
+void setTrackWave(Scene& scene, GLuint track, const glm::vec3& amplitude, const glm::vec3& frequency, const glm::vec3& phase);
+
+// Function to get the position of the object of a track at a time in seconds. The wave is evaluated in double
+// precision, so the same time gives the same position on every frame and every machine.
+glm::vec3 evaluateTrack(const Scene& scene, const AnimationTrack& track, double time);
+
+// Function to move every animated object to its position at a time in seconds. The objects that actually
+// moved are appended to changes, objects already in place are left untouched.
+void animateScene(Scene& scene, double time, SceneChanges& changes);
+
+// Function to check that the tracks of a scene refer to existing objects and keys and that their keys are
+// sorted, so a corrupt scene file can not make the animation write out of bounds
+bool validTracks(const Scene& scene);
+
+#endif // ANIMATION_H
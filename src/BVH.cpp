@@ -0,0 +1,335 @@
+#include "BVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <queue>
+
+// Number of bins per axis for the SAH split search
+const int BVH_BINS = 16;
+// Cost of traversing a node relative to intersecting one primitive
+const float BVH_TRAVERSAL_COST = 1.0f;
+// Rebuild once refitting has made the tree this much more expensive than after the build
+const float BVH_REBUILD_THRESHOLD = 1.5f;
+
+// Function to create an empty box that any point will expand
+static AABB emptyAABB() {
+    AABB box;
+    box.min = glm::vec3(FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX);
+    return box;
+}
+
+// Function to grow a box to contain another box
+static void growAABB(AABB& box, const AABB& other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+// Function to compute the surface area of a box, 0 for empty boxes
+static float areaAABB(const AABB& box) {
+    glm::vec3 extent = box.max - box.min;
+    if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f) return 0.0f;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Structure for one bin of the SAH split search
+struct BVHBin {
+    AABB bounds;
+    GLuint count;
+};
+
+// Structure holding the state shared by all recursive build steps
+struct BVHBuilder {
+    const std::vector<AABB>& primBounds;
+    std::vector<glm::vec3> centroids;
+    BVH& bvh;
+
+    BVHBuilder(const std::vector<AABB>& bounds, BVH& target) : primBounds(bounds), bvh(target) {}
+};
+
+// Function to count the levels below a node of count primitives when every split halves them until they fit a leaf
+static int medianSplitLevels(GLuint count) {
+    int levels = 0;
+    for (; count > BVH_MAX_LEAF_SIZE; count = (count + 1) / 2) levels++;
+    return levels;
+}
+
+// Function to build the subtree over primIndices[first, first + count) at a level of the tree and return its node index
+static GLuint buildNode(BVHBuilder& builder, GLuint first, GLuint count, int depth) {
+    std::vector<GLuint>& indices = builder.bvh.primIndices;
+    GLuint nodeIndex = GLuint(builder.bvh.nodes.size());
+    builder.bvh.nodes.push_back(BVHNode());
+
+    AABB bounds = emptyAABB();
+    AABB centroidBounds = emptyAABB();
+    for (GLuint i = first; i < first + count; i++) {
+        growAABB(bounds, builder.primBounds[indices[i]]);
+        const glm::vec3& centroid = builder.centroids[indices[i]];
+        centroidBounds.min = glm::min(centroidBounds.min, centroid);
+        centroidBounds.max = glm::max(centroidBounds.max, centroid);
+    }
+    builder.bvh.nodes[nodeIndex].boundsMin = bounds.min;
+    builder.bvh.nodes[nodeIndex].boundsMax = bounds.max;
+
+    // Find the cheapest binned split over all three axes
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = FLT_MAX;
+    float parentArea = areaAABB(bounds);
+    for (int axis = 0; axis < 3 && count > 1; axis++) {
+        float axisMin = centroidBounds.min[axis];
+        float axisExtent = centroidBounds.max[axis] - axisMin;
+        if (axisExtent <= 0.0f) continue;
+
+        BVHBin bins[BVH_BINS];
+        for (int b = 0; b < BVH_BINS; b++) {
+            bins[b].bounds = emptyAABB();
+            bins[b].count = 0;
+        }
+        float scale = BVH_BINS / axisExtent;
+        for (GLuint i = first; i < first + count; i++) {
+            int b = std::min(BVH_BINS - 1, int((builder.centroids[indices[i]][axis] - axisMin) * scale));
+            growAABB(bins[b].bounds, builder.primBounds[indices[i]]);
+            bins[b].count++;
+        }
+
+        // Sweep from the right to get the cost of everything above each split plane
+        float rightCost[BVH_BINS];
+        AABB rightBounds = emptyAABB();
+        GLuint rightCount = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--) {
+            growAABB(rightBounds, bins[b].bounds);
+            rightCount += bins[b].count;
+            rightCost[b] = areaAABB(rightBounds) * rightCount;
+        }
+        AABB leftBounds = emptyAABB();
+        GLuint leftCount = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++) {
+            growAABB(leftBounds, bins[b].bounds);
+            leftCount += bins[b].count;
+            if (leftCount == 0 || leftCount == count) continue;
+            float cost = areaAABB(leftBounds) * leftCount + rightCost[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // Compare the split against intersecting all primitives in a leaf. Once halving the primitives takes all the
+    // levels left, only median splits keep the leaves within BVH_MAX_DEPTH.
+    bool depthLimited = depth + medianSplitLevels(count) >= BVH_MAX_DEPTH;
+    float splitCost = BVH_TRAVERSAL_COST + (parentArea > 0.0f ? bestCost / parentArea : 0.0f);
+    bool makeLeaf = count == 1 || (count <= BVH_MAX_LEAF_SIZE && (bestAxis < 0 || splitCost >= float(count) || depthLimited));
+    if (makeLeaf) {
+        builder.bvh.nodes[nodeIndex].rightOrFirst = first;
+        builder.bvh.nodes[nodeIndex].count = count;
+        return nodeIndex;
+    }
+
+    GLuint leftCount;
+    if (depthLimited) {
+        // Split at the median centroid along the widest axis
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        leftCount = count / 2;
+        std::nth_element(indices.begin() + first, indices.begin() + first + leftCount, indices.begin() + first + count,
+                         [&](GLuint a, GLuint b) { return builder.centroids[a][axis] < builder.centroids[b][axis]; });
+    } else if (bestAxis >= 0) {
+        float axisMin = centroidBounds.min[bestAxis];
+        float scale = BVH_BINS / (centroidBounds.max[bestAxis] - axisMin);
+        std::vector<GLuint>::iterator middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](GLuint prim) {
+            int b = std::min(BVH_BINS - 1, int((builder.centroids[prim][bestAxis] - axisMin) * scale));
+            return b <= bestSplit;
+        });
+        leftCount = GLuint(middle - (indices.begin() + first));
+    } else {
+        // All centroids coincide, so any split is as good as another
+        leftCount = count / 2;
+    }
+
+    buildNode(builder, first, leftCount, depth + 1);
+    GLuint right = buildNode(builder, first + leftCount, count - leftCount, depth + 1);
+    builder.bvh.nodes[nodeIndex].rightOrFirst = right;
+    builder.bvh.nodes[nodeIndex].count = 0;
+
+    return nodeIndex;
+}
+
+// Function to compute the bounding boxes of spheres, reusing the storage of bounds
+void computeSphereBounds(const std::vector<Sphere>& spheres, std::vector<AABB>& bounds) {
+    bounds.resize(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        bounds[i].min = spheres[i].center - glm::vec3(spheres[i].radius);
+        bounds[i].max = spheres[i].center + glm::vec3(spheres[i].radius);
+    }
+}
+
+// Function to recompute the bounding boxes of the given spheres only
+void updateSphereBounds(const std::vector<Sphere>& spheres, const std::vector<GLuint>& moved, std::vector<AABB>& bounds) {
+    for (GLuint i : moved) {
+        bounds[i].min = spheres[i].center - glm::vec3(spheres[i].radius);
+        bounds[i].max = spheres[i].center + glm::vec3(spheres[i].radius);
+    }
+}
+
+// Function to build a BVH with a binned SAH split search
+BVH buildBVH(const std::vector<AABB>& primBounds) {
+    BVH bvh;
+    bvh.buildCost = 0.0f;
+    bvh.areaCost = 0.0;
+    if (primBounds.empty()) return bvh;
+
+    GLuint count = GLuint(primBounds.size());
+    bvh.primIndices.resize(count);
+    for (GLuint i = 0; i < count; i++) bvh.primIndices[i] = i;
+    bvh.nodes.reserve(2 * count - 1);
+
+    BVHBuilder builder(primBounds, bvh);
+    builder.centroids.resize(count);
+    for (GLuint i = 0; i < count; i++) {
+        builder.centroids[i] = 0.5f * (primBounds[i].min + primBounds[i].max);
+    }
+    buildNode(builder, 0, count, 0);
+
+    bvh.buildCost = computeBVHCost(bvh);
+    return bvh;
+}
+
+// Function to get the level of the deepest leaf under the node first of a node array, whose subtree ends before end
+int computeBVHDepth(const std::vector<BVHNode>& nodes, size_t first, size_t end) {
+    // Children come after their parent, so one pass in index order sees every parent before its children
+    std::vector<int> levels(end - first, 0);
+    int deepest = 0;
+    for (size_t i = first; i < end; i++) {
+        const BVHNode& node = nodes[i];
+        int level = levels[i - first];
+        deepest = std::max(deepest, level);
+        if (node.count > 0) continue;
+        levels[i + 1 - first] = level + 1;
+        levels[node.rightOrFirst - first] = level + 1;
+    }
+    return deepest;
+}
+
+// Function to compute the bounds of a node from its primitives or its children
+static AABB nodeBounds(const BVH& bvh, size_t i, const std::vector<AABB>& primBounds) {
+    const BVHNode& node = bvh.nodes[i];
+    AABB bounds = emptyAABB();
+    if (node.count > 0) {
+        for (GLuint p = node.rightOrFirst; p < node.rightOrFirst + node.count; p++) {
+            growAABB(bounds, primBounds[bvh.primIndices[p]]);
+        }
+    } else {
+        const BVHNode& left = bvh.nodes[i + 1];
+        const BVHNode& right = bvh.nodes[node.rightOrFirst];
+        bounds.min = glm::min(left.boundsMin, right.boundsMin);
+        bounds.max = glm::max(left.boundsMax, right.boundsMax);
+    }
+    return bounds;
+}
+
+// Function to recompute all node bounds bottom-up without changing the tree topology
+void refitBVH(BVH& bvh, const std::vector<AABB>& primBounds) {
+    // Children are always stored after their parent, so a reverse sweep visits them first
+    for (size_t i = bvh.nodes.size(); i-- > 0;) {
+        AABB bounds = nodeBounds(bvh, i, primBounds);
+        bvh.nodes[i].boundsMin = bounds.min;
+        bvh.nodes[i].boundsMax = bounds.max;
+    }
+    // The area cost no longer matches the nodes
+    bvh.parents.clear();
+    bvh.primLeaves.clear();
+}
+
+// Function to compute the SAH cost of a node, not yet relative to the root
+static float nodeCost(const BVHNode& node) {
+    AABB bounds = {node.boundsMin, node.boundsMax};
+    return areaAABB(bounds) * (node.count > 0 ? float(node.count) : BVH_TRAVERSAL_COST);
+}
+
+// Function to link the nodes of a BVH to their parents and the primitives to their leaves, and sum the node costs
+static void linkBVH(BVH& bvh) {
+    bvh.parents.assign(bvh.nodes.size(), 0);
+    bvh.primLeaves.assign(bvh.primIndices.size(), 0);
+    bvh.areaCost = 0.0;
+    for (GLuint i = 0; i < GLuint(bvh.nodes.size()); i++) {
+        const BVHNode& node = bvh.nodes[i];
+        bvh.areaCost += nodeCost(node);
+        if (node.count > 0) {
+            for (GLuint p = node.rightOrFirst; p < node.rightOrFirst + node.count; p++) bvh.primLeaves[bvh.primIndices[p]] = i;
+        } else {
+            bvh.parents[i + 1] = i;
+            bvh.parents[node.rightOrFirst] = i;
+        }
+    }
+}
+
+// Function to estimate the SAH traversal cost of a BVH relative to its root
+float computeBVHCost(const BVH& bvh) {
+    if (bvh.nodes.empty()) return 0.0f;
+
+    float cost = 0.0f;
+    for (size_t i = 0; i < bvh.nodes.size(); i++) cost += nodeCost(bvh.nodes[i]);
+    AABB root = {bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax};
+    float rootArea = areaAABB(root);
+
+    return rootArea > 0.0f ? cost / rootArea : cost;
+}
+
+// Function to refit the BVH to moved primitives, or rebuild it when the primitive count
+// changed or refitting has degraded the tree too much. Returns true after a rebuild.
+bool updateBVH(BVH& bvh, const std::vector<AABB>& primBounds) {
+    if (bvh.primIndices.size() != primBounds.size()) {
+        bvh = buildBVH(primBounds);
+        return true;
+    }
+
+    refitBVH(bvh, primBounds);
+    if (computeBVHCost(bvh) > BVH_REBUILD_THRESHOLD * bvh.buildCost) {
+        bvh = buildBVH(primBounds);
+        return true;
+    }
+    return false;
+}
+
+// Function to refit only the nodes above the moved primitives, stopping where the bounds do not change, or
+// rebuild the BVH like updateBVH. Returns true after a rebuild.
+bool updateBVH(BVH& bvh, const std::vector<AABB>& primBounds, const std::vector<GLuint>& movedPrims) {
+    if (bvh.primIndices.size() != primBounds.size()) {
+        bvh = buildBVH(primBounds);
+        return true;
+    }
+    if (movedPrims.empty()) return false;
+    if (bvh.parents.size() != bvh.nodes.size()) linkBVH(bvh);
+
+    // Parents are stored before their children, so taking the highest index first refits both children of a
+    // node before it. A node reached from both children comes out twice in a row.
+    std::priority_queue<GLuint> dirty;
+    for (GLuint prim : movedPrims) dirty.push(bvh.primLeaves[prim]);
+    GLuint last = GLuint(bvh.nodes.size());
+    while (!dirty.empty()) {
+        GLuint i = dirty.top();
+        dirty.pop();
+        if (i == last) continue;
+        last = i;
+
+        BVHNode& node = bvh.nodes[i];
+        AABB bounds = nodeBounds(bvh, i, primBounds);
+        if (bounds.min == node.boundsMin && bounds.max == node.boundsMax) continue;
+        bvh.areaCost -= nodeCost(node);
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        bvh.areaCost += nodeCost(node);
+        if (i > 0) dirty.push(bvh.parents[i]);
+    }
+
+    AABB root = {bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax};
+    float rootArea = areaAABB(root);
+    float cost = float(rootArea > 0.0f ? bvh.areaCost / rootArea : bvh.areaCost);
+    if (cost > BVH_REBUILD_THRESHOLD * bvh.buildCost) {
+        bvh = buildBVH(primBounds);
+        return true;
+    }
+    return false;
+}
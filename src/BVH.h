@@ -0,0 +1,66 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "Geometry.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Deepest level a leaf may have, the root being level 0. The build switches to median splits where the SAH
+// splits would go deeper, so clustered or exponentially spaced primitives can not grow long chains.
+const int BVH_MAX_DEPTH = 31;
+// Leaves are never made larger than this, even if the SAH prefers it. The packet tracer stages the primitives of a
+// leaf in arrays of this size, which the compute shaders get as a define from loadComputeShader.
+const GLuint BVH_MAX_LEAF_SIZE = 8;
+// Entries of the traversal stacks of all backends, enough for any BVH within BVH_MAX_DEPTH: the closest-hit walk
+// keeps at most one node per level, the any-hit walk pushes both children of a node one level above the leaves.
+// The compute shaders get it as a define from loadComputeShader.
+const int BVH_STACK_SIZE = BVH_MAX_DEPTH + 1;
+
+// Axis-aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Structure for a bounding volume hierarchy over a set of primitive bounds
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<GLuint> primIndices;    // Primitive indices in leaf order
+    float buildCost;                    // SAH cost right after the last full build
+    // Links for refitting the nodes above single primitives, built by the first such refit after a build or
+    // full refit, which clear them again
+    std::vector<GLuint> parents;        // Parent of every node but the root
+    std::vector<GLuint> primLeaves;     // Leaf of every primitive
+    double areaCost;                    // Sum of the SAH costs of all nodes, kept up to date by those refits
+};
+
+// Function to compute the bounding boxes of spheres, reusing the storage of bounds
+void computeSphereBounds(const std::vector<Sphere>& spheres, std::vector<AABB>& bounds);
+
+// Function to recompute the bounding boxes of the given spheres only
+void updateSphereBounds(const std::vector<Sphere>& spheres, const std::vector<GLuint>& moved, std::vector<AABB>& bounds);
+
+// Function to build a BVH with a binned SAH split search
+BVH buildBVH(const std::vector<AABB>& primBounds);
+
+// Function to get the level of the deepest leaf under the node first of a node array, whose subtree ends before end.
+// The children of every node must come after it, as buildBVH lays them out.
+int computeBVHDepth(const std::vector<BVHNode>& nodes, size_t first, size_t end);
+
+// Function to recompute all node bounds bottom-up without changing the tree topology
+void refitBVH(BVH& bvh, const std::vector<AABB>& primBounds);
+
+// Function to estimate the SAH traversal cost of a BVH relative to its root
+float computeBVHCost(const BVH& bvh);
+
+// Function to refit the BVH to moved primitives, or rebuild it when the primitive count
+// changed or refitting has degraded the tree too much. Returns true after a rebuild.
+bool updateBVH(BVH& bvh, const std::vector<AABB>& primBounds);
+
+// Function to refit only the nodes above the moved primitives, stopping where the bounds do not change, or
+// rebuild the BVH like updateBVH. Returns true after a rebuild.
+bool updateBVH(BVH& bvh, const std::vector<AABB>& primBounds, const std::vector<GLuint>& movedPrims);
+
+#endif // BVH_H
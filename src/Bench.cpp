@@ -0,0 +1,495 @@
+// Benchmark of the canned scenes at a fixed resolution, camera and timestamps. Reports frame time
+// statistics and ray throughput, writes them as JSON and optionally compares them against a baseline.
+
+#include "Animation.h"
+#include "BVH.h"
+#include "GLUtils.h"
+#include "GpuRenderer.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "Scenes.h"
+#include "Workgroups.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Animation time step between the frames of animated scenes
+const double BENCH_FRAME_TIME = 1.0 / 30.0;
+
+// Structure for the settings of a benchmark run
+struct BenchOptions {
+    RendererBackend backend;
+    int threads;
+    int width;
+    int height;
+    int frames;             // Timed frames per scene
+    int warmupFrames;       // Untimed frames per scene before the timed ones
+    std::vector<std::string> scenes;
+    std::string output;     // JSON results, empty to skip
+    std::string baseline;   // JSON results of an earlier run to compare against, empty to skip
+    double tolerance;       // Allowed slowdown against the baseline as a fraction
+    bool tune;              // Time the workgroup layouts of the gpu backend instead and store the fastest
+    bool quantizeScene;     // Store the spheres of the gpu backends as 16-bit coordinates in their BVH leaf
+    bool packetTracing;     // Trace the primary and shadow rays of a gpu workgroup as packets in shared memory
+    bool denoise;           // Add the denoiser passes of the gpu backends to every frame
+};
+
+// Structure for a canned benchmark scene
+struct BenchScene {
+    const char* name;
+    Scene (*create)();      // Scenes with tracks are animated at fixed timestamps
+};
+
+// Structure for the measurements of one scene
+struct BenchResult {
+    std::string name;
+    size_t spheres;
+    int frames;
+    RayCounts rays;         // Rays of all timed frames
+    ProfilerSummary summary;
+    double meanMs;
+    double primaryMrays;    // Millions of rays per second
+    double shadowMrays;
+    double totalMrays;
+};
+
+static Scene createSpheres1k() { return createRandomSpheresScene(1000, 1, 0.0f); }
+static Scene createSpheres100k() { return createRandomSpheresScene(100000, 2, 0.0f); }
+static Scene createSpheres1M() { return createRandomSpheresScene(1000000, 3, 0.0f); }
+static Scene createReflectiveSpheres10k() {
+    Scene scene = createRandomSpheresScene(10000, 4, 1.0f);
+    for (size_t i = 0; i < scene.planes.size(); i++) scene.planes[i].reflectivity = 0.6f;
+    return scene;
+}
+
+static Scene createTorusInstances() { return createMeshScene(256, 4); }
+// The same spheres under 64 and 4096 lights, which should cost about the same with the light BVH
+static Scene createLights64() { return createManyLightsScene(1000, 64, 5); }
+static Scene createLights4k() { return createManyLightsScene(1000, 4096, 5); }
+
+static const BenchScene BENCH_SCENES[] = {
+    {"demo", createDemoScene},
+    {"spheres-1k", createSpheres1k},
+    {"spheres-100k", createSpheres100k},
+    {"spheres-1m", createSpheres1M},
+    {"mirror-box", createMirrorScene},
+    {"reflective-spheres-10k", createReflectiveSpheres10k},
+    {"torus-instances", createTorusInstances},
+    {"lights-64", createLights64},
+    {"lights-4k", createLights4k},
+};
+const int BENCH_SCENE_COUNT = sizeof(BENCH_SCENES) / sizeof(BENCH_SCENES[0]);
+
+// Scenes a tuning run times unless --scenes is given: few objects, a deep BVH, and many reflections
+static const char* const TUNE_SCENES[] = {"demo", "spheres-100k", "reflective-spheres-10k"};
+
+// Function to print the supported command line arguments
+static void printBenchUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --backend <name>        auto, gpu, wavefront or cpu (default auto)\n"
+              << "  --threads <n>           Worker threads of the cpu backend (default 0: all cores)\n"
+              << "  --width <pixels>        Image width (default 640)\n"
+              << "  --height <pixels>       Image height (default 360)\n"
+              << "  --frames <n>            Timed frames per scene (default 10)\n"
+              << "  --warmup <n>            Untimed frames per scene before timing (default 2)\n"
+              << "  --scenes <a,b,...>      Scenes to run (default all):";
+    for (int i = 0; i < BENCH_SCENE_COUNT; i++) std::cout << " " << BENCH_SCENES[i].name;
+    std::cout << "\n"
+              << "  -o, --output <path>     Write the results as JSON\n"
+              << "  --baseline <path>       Compare against the JSON results of an earlier run, exit with 1\n"
+              << "                          if a scene got slower than the tolerance allows\n"
+              << "  --tolerance <fraction>  Allowed slowdown against the baseline (default 0.1)\n"
+              << "  --quantize-scene        Store the spheres of the gpu backends as 16-bit coordinates in their BVH leaf\n"
+              << "  --packet-tracing        Trace the primary and shadow rays of a gpu workgroup as packets in shared memory\n"
+              << "  --denoise               Add the denoiser passes of the gpu backends to every frame\n"
+              << "  --tune                  Time the workgroup layouts of the gpu backend on the scenes (default\n"
+              << "                          demo, spheres-100k, reflective-spheres-10k) and store the fastest\n"
+              << "                          for this device, later runs of every tool use it\n";
+}
+
+// Function to split a comma separated list
+static std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Function to parse the command line, returns false on invalid arguments
+static bool parseBenchOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--tune") {
+            options.tune = true;
+            continue;
+        } else if (arg == "--quantize-scene") {
+            options.quantizeScene = true;
+            continue;
+        } else if (arg == "--packet-tracing") {
+            options.packetTracing = true;
+            continue;
+        } else if (arg == "--denoise") {
+            options.denoise = true;
+            continue;
+        } else if (!value) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--backend") {
+            ok = parseRendererBackend(value, options.backend);
+        } else if (arg == "--threads") {
+            options.threads = std::atoi(value);
+            ok = options.threads >= 0;
+        } else if (arg == "--width") {
+            options.width = std::atoi(value);
+            ok = options.width > 0;
+        } else if (arg == "--height") {
+            options.height = std::atoi(value);
+            ok = options.height > 0;
+        } else if (arg == "--frames") {
+            options.frames = std::atoi(value);
+            ok = options.frames > 0;
+        } else if (arg == "--warmup") {
+            options.warmupFrames = std::atoi(value);
+            ok = options.warmupFrames >= 0;
+        } else if (arg == "--scenes") {
+            options.scenes = splitList(value);
+            for (size_t s = 0; s < options.scenes.size(); s++) {
+                bool known = false;
+                for (int k = 0; k < BENCH_SCENE_COUNT; k++) known = known || options.scenes[s] == BENCH_SCENES[k].name;
+                ok = ok && known;
+            }
+        } else if (arg == "--output" || arg == "-o") {
+            options.output = value;
+        } else if (arg == "--baseline") {
+            options.baseline = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::atof(value);
+            ok = options.tolerance >= 0.0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+// Function to set the scene to the state of a frame, animated scenes move at fixed timestamps. The objects that
+// moved are put in changes.
+static void prepareFrame(Scene& scene, std::vector<AABB>& sphereBounds, BVH& sphereBVH, int frame, SceneChanges& changes) {
+    changes = SceneChanges();
+    animateScene(scene, frame * BENCH_FRAME_TIME, changes);
+    updateSphereBounds(scene.spheres, changes.spheres, sphereBounds);
+    updateBVH(sphereBVH, sphereBounds, changes.spheres);
+}
+
+// Function to render one complete frame and wait until it is finished
+static void renderFrame(Renderer& renderer, const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes,
+                        bool glContext) {
+    // Restart the image every frame, so every frame traces the same rays
+    renderer.resetAccumulation();
+    renderer.render(scene, sphereBVH, camera, changes);
+    if (glContext) glFinish();
+}
+
+// Function to benchmark one scene
+static BenchResult runBenchScene(const BenchScene& benchScene, Renderer& renderer, const BenchOptions& options, bool glContext) {
+    Scene scene = benchScene.create();
+    std::vector<AABB> sphereBounds;
+    computeSphereBounds(scene.spheres, sphereBounds);
+    BVH sphereBVH = buildBVH(sphereBounds);
+    bool animated = !scene.tracks.empty();
+    Camera camera = {glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 1.0f};
+
+    BenchResult result;
+    result.name = benchScene.name;
+    result.spheres = scene.spheres.size();
+    result.frames = options.frames;
+    result.rays = {0, 0, 0};
+
+    // The renderer still holds the scene benchmarked before, so its first frame sets up all scene data
+    SceneChanges changes;
+    bool loaded = false;
+    for (int frame = 0; frame < options.warmupFrames; frame++) {
+        prepareFrame(scene, sphereBounds, sphereBVH, frame, changes);
+        renderFrame(renderer, scene, sphereBVH, camera, loaded ? &changes : nullptr, glContext);
+        loaded = true;
+    }
+
+    // Count the rays in untimed passes, static scenes trace the same rays every frame
+    renderer.setRayCounting(true);
+    for (int frame = 0; frame < options.frames; frame++) {
+        prepareFrame(scene, sphereBounds, sphereBVH, frame, changes);
+        renderFrame(renderer, scene, sphereBVH, camera, loaded ? &changes : nullptr, glContext);
+        loaded = true;
+        RayCounts counts = renderer.rayCounts();
+        int repeat = animated ? 1 : options.frames;
+        result.rays.primary += counts.primary * repeat;
+        result.rays.reflection += counts.reflection * repeat;
+        result.rays.shadow += counts.shadow * repeat;
+        if (!animated) break;
+    }
+    renderer.setRayCounting(false);
+
+    Profiler profiler = createProfiler(glContext, true);
+    renderer.setProfiler(&profiler);
+    for (int frame = 0; frame < options.frames; frame++) {
+        prepareFrame(scene, sphereBounds, sphereBVH, frame, changes);
+        beginProfilerFrame(profiler);
+        renderFrame(renderer, scene, sphereBVH, camera, &changes, glContext);
+        endProfilerFrame(profiler);
+    }
+    finishProfiler(profiler);
+    renderer.setProfiler(nullptr);
+
+    // Summarize all frames, not only the rolling window
+    result.summary = summarizeProfilerRecords(profiler);
+    deleteProfiler(profiler);
+
+    result.meanMs = result.summary.fps > 0.0 ? 1000.0 / result.summary.fps : 0.0;
+    double seconds = result.meanMs * options.frames / 1000.0;
+    result.primaryMrays = result.rays.primary / seconds / 1e6;
+    result.shadowMrays = result.rays.shadow / seconds / 1e6;
+    result.totalMrays = (result.rays.primary + result.rays.reflection + result.rays.shadow) / seconds / 1e6;
+    return result;
+}
+
+// Function to escape a string for JSON
+static std::string jsonString(const std::string& text) {
+    std::string escaped = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') escaped += '\\';
+        if (static_cast<unsigned char>(text[i]) >= 0x20) escaped += text[i];
+    }
+    return escaped + "\"";
+}
+
+// Function to write the results as JSON, one scene per line so the baseline reader can go line by line
+static bool writeBenchResults(const std::string& path, const std::string& device, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open results file: " << path << std::endl;
+        return false;
+    }
+
+    file << "{\n  \"device\": " << jsonString(device) << ",\n  \"width\": " << options.width << ",\n  \"height\": " << options.height
+         << ",\n  \"frames\": " << options.frames << ",\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char line[1024];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": %s, \"spheres\": %zu, \"frames\": %d, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, "
+                      "\"primary_rays\": %llu, \"reflection_rays\": %llu, \"shadow_rays\": %llu, "
+                      "\"primary_mrays_per_s\": %.4f, \"shadow_mrays_per_s\": %.4f, \"total_mrays_per_s\": %.4f}%s\n",
+                      jsonString(r.name).c_str(), r.spheres, r.frames, r.meanMs, r.summary.p50Ms, r.summary.p95Ms, r.summary.p99Ms,
+                      (unsigned long long)r.rays.primary, (unsigned long long)r.rays.reflection, (unsigned long long)r.rays.shadow,
+                      r.primaryMrays, r.shadowMrays, r.totalMrays, i + 1 < results.size() ? "," : "");
+        file << line;
+    }
+    file << "  ]\n}\n";
+    return bool(file);
+}
+
+// Function to find "key": value on a line of a results file and read the number
+static bool findJsonNumber(const std::string& line, const std::string& key, double& value) {
+    size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos) return false;
+    value = std::atof(line.c_str() + pos + key.size() + 3);
+    return true;
+}
+
+// Function to find "key": "value" on a line of a results file and read the string
+static bool findJsonString(const std::string& line, const std::string& key, std::string& value) {
+    size_t pos = line.find("\"" + key + "\": \"");
+    if (pos == std::string::npos) return false;
+    size_t begin = pos + key.size() + 5;
+    size_t end = line.find('"', begin);
+    if (end == std::string::npos) return false;
+    value = line.substr(begin, end - begin);
+    return true;
+}
+
+// Function to compare the results against a results file written by an earlier run.
+// Returns false if the file can not be read or any scene is slower than the tolerance allows.
+static bool compareWithBaseline(const std::string& path, const std::string& device, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open baseline: " << path << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name;
+        double width;
+        if (findJsonString(line, "device", name) && name != device) {
+            std::cout << "Warning: the baseline was recorded on " << name << std::endl;
+        } else if (findJsonNumber(line, "width", width) && int(width) != options.width) {
+            std::cout << "Warning: the baseline was recorded at a different resolution" << std::endl;
+        }
+        double baselineMs;
+        if (!findJsonString(line, "name", name) || !findJsonNumber(line, "mean_ms", baselineMs)) continue;
+
+        for (size_t i = 0; i < results.size(); i++) {
+            if (results[i].name != name) continue;
+            double change = baselineMs > 0.0 ? results[i].meanMs / baselineMs - 1.0 : 0.0;
+            bool regressed = change > options.tolerance;
+            char text[256];
+            std::snprintf(text, sizeof(text), "%-24s %10.3f ms vs %10.3f ms baseline (%+.1f%%) %s",
+                          name.c_str(), results[i].meanMs, baselineMs, 100.0 * change, regressed ? "REGRESSION" : "ok");
+            std::cout << text << std::endl;
+            ok = ok && !regressed;
+        }
+    }
+    return ok;
+}
+
+// Function to time every supported workgroup layout of the gpu backend and store the fastest for the device.
+// Layouts are ranked by the geometric mean of their scene times, so no single scene dominates.
+static bool tuneWorkgroups(const BenchOptions& options) {
+    GpuRenderer renderer(options.width, options.height);
+    if (!renderer.valid()) return false;
+    std::cout << "Tuning the workgroup layout for " << glDeviceString() << ", " << options.width << "x" << options.height
+              << ", " << options.frames << " frames" << std::endl;
+
+    char text[256];
+    std::string header;
+    std::snprintf(text, sizeof(text), "%-12s", "layout");
+    header = text;
+    for (size_t s = 0; s < options.scenes.size(); s++) {
+        std::snprintf(text, sizeof(text), " %24s", (options.scenes[s] + " ms").c_str());
+        header += text;
+    }
+    std::snprintf(text, sizeof(text), " %12s", "geomean ms");
+    std::cout << header << text << std::endl;
+
+    WorkgroupLayout best = DEFAULT_WORKGROUP_LAYOUT;
+    double bestMs = 0.0;
+    std::vector<WorkgroupLayout> candidates = workgroupCandidates();
+    for (size_t c = 0; c < candidates.size(); c++) {
+        if (!renderer.setWorkgroupLayout(candidates[c])) continue;
+        std::snprintf(text, sizeof(text), "%-12s", formatWorkgroupLayout(candidates[c]).c_str());
+        std::string row = text;
+        double logSum = 0.0;
+        for (size_t s = 0; s < options.scenes.size(); s++) {
+            for (int k = 0; k < BENCH_SCENE_COUNT; k++) {
+                if (options.scenes[s] != BENCH_SCENES[k].name) continue;
+                BenchResult result = runBenchScene(BENCH_SCENES[k], renderer, options, true);
+                logSum += std::log(std::max(result.meanMs, 1e-6));
+                std::snprintf(text, sizeof(text), " %24.3f", result.meanMs);
+                row += text;
+            }
+        }
+        double meanMs = std::exp(logSum / options.scenes.size());
+        std::snprintf(text, sizeof(text), " %12.3f", meanMs);
+        std::cout << row << text << std::endl;
+        if (bestMs == 0.0 || meanMs < bestMs) {
+            best = candidates[c];
+            bestMs = meanMs;
+        }
+    }
+
+    if (!saveWorkgroupLayout(best)) return false;
+    std::cout << "Stored " << formatWorkgroupLayout(best) << " for this device" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    options.backend = BACKEND_AUTO;
+    options.threads = 0;
+    options.width = 640;
+    options.height = 360;
+    options.frames = 10;
+    options.warmupFrames = 2;
+    options.tolerance = 0.1;
+    options.tune = false;
+    options.quantizeScene = false;
+    options.packetTracing = false;
+    options.denoise = false;
+    if (!parseBenchOptions(argc, argv, options)) {
+        printBenchUsage(argv[0]);
+        return 1;
+    }
+    if (options.scenes.empty() && options.tune) {
+        options.scenes.assign(TUNE_SCENES, TUNE_SCENES + sizeof(TUNE_SCENES) / sizeof(TUNE_SCENES[0]));
+    } else if (options.scenes.empty()) {
+        for (int i = 0; i < BENCH_SCENE_COUNT; i++) options.scenes.push_back(BENCH_SCENES[i].name);
+    }
+
+    // Without a display, so it also runs on GPU-less hosts through Mesa llvmpipe
+    HeadlessContext headless = {nullptr, nullptr, nullptr};
+    if (options.tune) {
+        headless = initializeHeadlessOpenGL();
+        if (!headless.context) return 1;
+        bool tuned = tuneWorkgroups(options);
+        destroyHeadlessOpenGL(headless);
+        return tuned ? 0 : 1;
+    }
+    RendererBackend backend = options.backend;
+    if (backend != BACKEND_CPU) {
+        headless = initializeHeadlessOpenGL();
+        if (!headless.context) {
+            if (backend != BACKEND_AUTO) return 1;
+            backend = BACKEND_CPU;
+        }
+    }
+    std::unique_ptr<Renderer> renderer = createRenderer(backend, options.width, options.height, options.threads);
+    if (!renderer) {
+        if (headless.context) destroyHeadlessOpenGL(headless);
+        return 1;
+    }
+    renderer->setSceneQuantization(options.quantizeScene);
+    renderer->setPacketTracing(options.packetTracing);
+    renderer->setDenoising(options.denoise);
+    bool glContext = headless.context != nullptr;
+    std::string device = std::string(renderer->name()) + ": "
+                         + (glContext ? reinterpret_cast<const char*>(glGetString(GL_RENDERER)) : "host");
+    std::cout << "Device: " << device << ", " << options.width << "x" << options.height << ", " << options.frames << " frames" << std::endl;
+
+    char text[256];
+    std::snprintf(text, sizeof(text), "%-24s %9s %10s %10s %10s %10s %14s %14s", "scene", "spheres", "mean ms", "p50 ms", "p95 ms", "p99 ms", "primary Mray/s", "shadow Mray/s");
+    std::cout << text << std::endl;
+    std::vector<BenchResult> results;
+    for (size_t s = 0; s < options.scenes.size(); s++) {
+        for (int k = 0; k < BENCH_SCENE_COUNT; k++) {
+            if (options.scenes[s] != BENCH_SCENES[k].name) continue;
+            BenchResult result = runBenchScene(BENCH_SCENES[k], *renderer, options, glContext);
+            std::snprintf(text, sizeof(text), "%-24s %9zu %10.3f %10.3f %10.3f %10.3f %14.2f %14.2f",
+                          result.name.c_str(), result.spheres, result.meanMs, result.summary.p50Ms, result.summary.p95Ms,
+                          result.summary.p99Ms, result.primaryMrays, result.shadowMrays);
+            std::cout << text << std::endl;
+            results.push_back(result);
+        }
+    }
+
+    bool ok = true;
+    if (!options.output.empty()) ok = writeBenchResults(options.output, device, options, results);
+    if (!options.baseline.empty()) ok = compareWithBaseline(options.baseline, device, options, results) && ok;
+
+    renderer.reset();
+    if (headless.context) destroyHeadlessOpenGL(headless);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,746 @@
+#include "CpuRenderer.h"
+#include "LightTree.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_RENDERER_X86 1
+#include <immintrin.h>
+#endif
+
+// Size of the square tiles handed to the worker threads, the same as the compute workgroup
+const int CPU_TILE_SIZE = 16;
+// Lanes tested per leaf kernel call
+const int SPHERE_LANES = 8;
+
+// Structure for the closest intersection along a ray, mirrors Point in common.glsl
+struct HitPoint {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 color;
+    float reflectivity;
+};
+
+// Kernel testing up to 8 consecutive spheres of sphereSoA against one ray. Returns the lane of the
+// closest hit in (tMin, tClosest) and lowers tClosest to it, or -1 if no lane was hit.
+typedef int (*SphereKernel)(const SphereSoA& soa, size_t first, int count, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest);
+
+// Function to intersect a ray with a sphere, the same formula as intersectSphere in raytracing.comp
+static bool intersectSphere(const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& center, float radius2, float& t) {
+    glm::vec3 oc = origin - center;
+    float a = glm::dot(dir, dir);
+    float b = 2.0f * glm::dot(oc, dir);
+    float c = glm::dot(oc, oc) - radius2;
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant > 0.0f) {
+        t = (-b - std::sqrt(discriminant)) / (2.0f * a);
+        return t > 0.0f;
+    }
+    return false;
+}
+
+// Function to intersect a ray with a plane, the same formula as intersectPlane in common.glsl, which gets
+// the distance of the plane from the origin from the scene buffer
+static bool intersectPlane(const glm::vec3& origin, const glm::vec3& dir, const Plane& plane, float& t) {
+    float denom = glm::dot(plane.normal, dir);
+    if (denom > 1e-6f) {
+        t = (glm::dot(plane.normal, plane.point) - glm::dot(origin, plane.normal)) / denom;
+        return t > 0.0f;
+    }
+    return false;
+}
+
+// Scalar leaf kernel for targets without SIMD support
+static int intersectSpheresScalar(const SphereSoA& soa, size_t first, int count, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    int hitLane = -1;
+    for (int lane = 0; lane < count; lane++) {
+        glm::vec3 center(soa.centerX[first + lane], soa.centerY[first + lane], soa.centerZ[first + lane]);
+        float t;
+        if (intersectSphere(origin, dir, center, soa.radius2[first + lane], t) && t > tMin && t < tClosest) {
+            tClosest = t;
+            hitLane = lane;
+        }
+    }
+    return hitLane;
+}
+
+#ifdef CPU_RENDERER_X86
+// Function to pick the closest valid lane from a mask of hits and their distances
+static int closestLane(int mask, const float* t, float& tClosest) {
+    int hitLane = -1;
+    for (int lane = 0; mask; lane++, mask >>= 1) {
+        if ((mask & 1) && t[lane] < tClosest) {
+            tClosest = t[lane];
+            hitLane = lane;
+        }
+    }
+    return hitLane;
+}
+
+// AVX2 leaf kernel: 8 spheres per instruction
+__attribute__((target("avx2")))
+static int intersectSpheresAVX2(const SphereSoA& soa, size_t first, int count, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    float a = glm::dot(dir, dir);
+    __m256 ocX = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_loadu_ps(&soa.centerX[first]));
+    __m256 ocY = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_loadu_ps(&soa.centerY[first]));
+    __m256 ocZ = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_loadu_ps(&soa.centerZ[first]));
+
+    __m256 ocDotDir = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, _mm256_set1_ps(dir.x)), _mm256_mul_ps(ocY, _mm256_set1_ps(dir.y))), _mm256_mul_ps(ocZ, _mm256_set1_ps(dir.z)));
+    __m256 b = _mm256_mul_ps(_mm256_set1_ps(2.0f), ocDotDir);
+    __m256 ocDotOc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ));
+    __m256 c = _mm256_sub_ps(ocDotOc, _mm256_loadu_ps(&soa.radius2[first]));
+    __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_set1_ps(4.0f * a), c));
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(b, _mm256_sqrt_ps(discriminant))), _mm256_set1_ps(2.0f * a));
+
+    __m256 lanes = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 valid = _mm256_and_ps(lanes, _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(tMin), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(tClosest), _CMP_LT_OQ));
+
+    int mask = _mm256_movemask_ps(valid);
+    if (!mask) return -1;
+    alignas(32) float distances[8];
+    _mm256_store_ps(distances, t);
+    return closestLane(mask, distances, tClosest);
+}
+
+// SSE leaf kernel: two groups of 4 spheres, available on every x86-64 CPU
+static int intersectSpheresSSE(const SphereSoA& soa, size_t first, int count, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    float a = glm::dot(dir, dir);
+    int hitLane = -1;
+    for (int half = 0; half < 2 && half * 4 < count; half++) {
+        size_t base = first + half * 4;
+        __m128 ocX = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(&soa.centerX[base]));
+        __m128 ocY = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(&soa.centerY[base]));
+        __m128 ocZ = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(&soa.centerZ[base]));
+
+        __m128 ocDotDir = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, _mm_set1_ps(dir.x)), _mm_mul_ps(ocY, _mm_set1_ps(dir.y))), _mm_mul_ps(ocZ, _mm_set1_ps(dir.z)));
+        __m128 b = _mm_mul_ps(_mm_set1_ps(2.0f), ocDotDir);
+        __m128 ocDotOc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ));
+        __m128 c = _mm_sub_ps(ocDotOc, _mm_loadu_ps(&soa.radius2[base]));
+        __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_set1_ps(4.0f * a), c));
+        __m128 t = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(b, _mm_sqrt_ps(discriminant))), _mm_set1_ps(2.0f * a));
+
+        __m128 lanes = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(count - half * 4), _mm_setr_epi32(0, 1, 2, 3)));
+        __m128 valid = _mm_and_ps(lanes, _mm_cmpgt_ps(discriminant, _mm_setzero_ps()));
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_setzero_ps()));
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(tMin)));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(tClosest)));
+
+        int mask = _mm_movemask_ps(valid);
+        if (!mask) continue;
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, t);
+        int lane = closestLane(mask, distances, tClosest);
+        if (lane >= 0) hitLane = half * 4 + lane;
+    }
+    return hitLane;
+}
+#endif
+
+// Function to pick the widest leaf kernel the running CPU supports. RAYTRACER_SIMD=scalar|sse
+// limits the choice, which is useful to compare the kernels against each other.
+static SphereKernel selectSphereKernel() {
+    const char* limit = std::getenv("RAYTRACER_SIMD");
+    std::string simd = limit ? limit : "";
+    if (simd == "scalar") return intersectSpheresScalar;
+#ifdef CPU_RENDERER_X86
+    __builtin_cpu_init();
+    if (simd != "sse" && __builtin_cpu_supports("avx2")) return intersectSpheresAVX2;
+    return intersectSpheresSSE;
+#else
+    return intersectSpheresScalar;
+#endif
+}
+
+static const SphereKernel sphereKernel = selectSphereKernel();
+
+// Structure bundling the read-only inputs of a frame for the tracing functions
+struct TraceContext {
+    const Scene& scene;
+    const BVH& bvh;
+    const SphereSoA& soa;
+    const BVH& instanceBVH;
+    const LightTree& lightTree;
+    int shadowRays;         // Shadow rays per pixel and sample
+    int sampleIndex;        // Sample of the progressive image being traced, seeds the light selection
+    RayCounts* counts;      // Rays traced by the worker, nullptr unless counting
+};
+
+// Function to test a ray against the box [boundsMin, boundsMax], tNear is the entry distance clamped to 0
+static bool intersectAABB(const glm::vec3& origin, const glm::vec3& invDir, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float tMax, float& tNear) {
+    glm::vec3 t0 = (boundsMin - origin) * invDir;
+    glm::vec3 t1 = (boundsMax - origin) * invDir;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    tNear = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+    float tFar = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+    return tNear <= tFar;
+}
+
+// Function to compute the reciprocal ray direction without infinities
+static glm::vec3 inverseDirection(const glm::vec3& dir) {
+    glm::vec3 inv;
+    for (int i = 0; i < 3; i++) inv[i] = 1.0f / (std::fabs(dir[i]) < 1e-20f ? 1e-20f : dir[i]);
+    return inv;
+}
+
+// Function to test all spheres of a leaf in groups of SPHERE_LANES, returns the hit position in leaf order or -1
+static int intersectLeaf(const TraceContext& context, const BVHNode& leaf, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    int hit = -1;
+    for (GLuint offset = 0; offset < leaf.count; offset += SPHERE_LANES) {
+        int count = int(std::min<GLuint>(leaf.count - offset, SPHERE_LANES));
+        int lane = sphereKernel(context.soa, leaf.rightOrFirst + offset, count, origin, dir, tMin, tClosest);
+        if (lane >= 0) hit = int(leaf.rightOrFirst + offset) + lane;
+    }
+    return hit;
+}
+
+// Function to find the closest sphere in (tMin, tClosest) by walking the BVH front to back, returns the sphere index or -1
+static int traceSpheres(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    const std::vector<BVHNode>& nodes = context.bvh.nodes;
+    if (nodes.empty()) return -1;
+
+    glm::vec3 invDir = inverseDirection(dir);
+    float tNear;
+    if (!intersectAABB(origin, invDir, nodes[0].boundsMin, nodes[0].boundsMax, tClosest, tNear)) return -1;
+
+    int hitSlot = -1;
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    GLuint nodeIndex = 0;
+    while (true) {
+        const BVHNode& node = nodes[nodeIndex];
+        if (node.count > 0) {
+            int slot = intersectLeaf(context, node, origin, dir, tMin, tClosest);
+            if (slot >= 0) hitSlot = slot;
+        } else {
+            GLuint left = nodeIndex + 1;
+            GLuint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(origin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(origin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if (stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while (stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(origin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if (!found) break;
+    }
+    return hitSlot >= 0 ? int(context.bvh.primIndices[hitSlot]) : -1;
+}
+
+// Function to check whether any sphere lies on the ray in (tMin, tMax)
+static bool occludedBySpheres(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir, float tMin, float tMax) {
+    const std::vector<BVHNode>& nodes = context.bvh.nodes;
+    if (nodes.empty()) return false;
+
+    glm::vec3 invDir = inverseDirection(dir);
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        GLuint nodeIndex = stack[--stackSize];
+        const BVHNode& node = nodes[nodeIndex];
+        float tNear;
+        if (!intersectAABB(origin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if (node.count > 0) {
+            float tClosest = tMax;
+            if (intersectLeaf(context, node, origin, dir, tMin, tClosest) >= 0) return true;
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Structure for the per-ray terms of the watertight triangle test, mirrors TriangleRay in common.glsl
+struct TriangleRay {
+    int kx, ky, kz;         // The axis of the largest direction component last, the other two keep the winding
+    glm::vec3 shear;        // Shear that turns the ray into the +z axis of the permuted space, and 1 / dir.z
+};
+
+// Function to choose the permutation and shear of the watertight test for a ray direction
+static TriangleRay triangleRay(const glm::vec3& dir) {
+    glm::vec3 size = glm::abs(dir);
+    TriangleRay ray;
+    ray.kz = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    ray.kx = (ray.kz + 1) % 3;
+    ray.ky = (ray.kx + 1) % 3;
+    if (dir[ray.kz] < 0.0f) std::swap(ray.kx, ray.ky);
+    ray.shear = glm::vec3(dir[ray.kx] / dir[ray.kz], dir[ray.ky] / dir[ray.kz], 1.0f / dir[ray.kz]);
+    return ray;
+}
+
+// Function to intersect a ray with a triangle without gaps between neighbours, the same as intersectTriangle in common.glsl
+static bool intersectTriangle(const glm::vec3& origin, const TriangleRay& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+                              float tMin, float tMax, float& t) {
+    glm::vec3 a = v0 - origin;
+    glm::vec3 b = v1 - origin;
+    glm::vec3 c = v2 - origin;
+    float ax = a[ray.kx] - ray.shear.x * a[ray.kz];
+    float ay = a[ray.ky] - ray.shear.y * a[ray.kz];
+    float bx = b[ray.kx] - ray.shear.x * b[ray.kz];
+    float by = b[ray.ky] - ray.shear.y * b[ray.kz];
+    float cx = c[ray.kx] - ray.shear.x * c[ray.kz];
+    float cy = c[ray.ky] - ray.shear.y * c[ray.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) return false;
+    float det = u + v + w;
+    if (det == 0.0f) return false;
+
+    t = (u * a[ray.kz] + v * b[ray.kz] + w * c[ray.kz]) * ray.shear.z / det;
+    return t > tMin && t < tMax;
+}
+
+// Function to test one triangle of a mesh, given in the leaf order of its BVH
+static bool intersectMeshTriangle(const Scene& scene, const MeshInfo& mesh, GLuint triangle, const glm::vec3& origin, const TriangleRay& ray,
+                                  float tMin, float tMax, float& t) {
+    glm::vec3 v0 = meshVertex(scene, mesh, meshIndex(scene, mesh, 3 * triangle));
+    glm::vec3 v1 = meshVertex(scene, mesh, meshIndex(scene, mesh, 3 * triangle + 1));
+    glm::vec3 v2 = meshVertex(scene, mesh, meshIndex(scene, mesh, 3 * triangle + 2));
+    return intersectTriangle(origin, ray, v0, v1, v2, tMin, tMax, t);
+}
+
+// Function to find the closest triangle of a mesh in (tMin, tClosest) with a ray in its object space, returns the triangle or -1
+static int traceMesh(const Scene& scene, const MeshInfo& mesh, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest) {
+    const std::vector<BVHNode>& nodes = scene.meshNodes;
+    TriangleRay ray = triangleRay(dir);
+    glm::vec3 invDir = inverseDirection(dir);
+    GLuint nodeIndex = mesh.nodeOffset;
+    float tNear;
+    if (!intersectAABB(origin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear)) return -1;
+
+    int hitTriangle = -1;
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    while (true) {
+        const BVHNode& node = nodes[nodeIndex];
+        if (node.count > 0) {
+            for (GLuint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if (intersectMeshTriangle(scene, mesh, i, origin, ray, tMin, tClosest, t)) {
+                    tClosest = t;
+                    hitTriangle = int(i);
+                }
+            }
+        } else {
+            GLuint left = nodeIndex + 1;
+            GLuint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(origin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(origin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if (stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while (stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(origin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if (!found) break;
+    }
+    return hitTriangle;
+}
+
+// Function to check whether any triangle of a mesh lies in (tMin, tMax) on a ray in its object space
+static bool occludedByMesh(const Scene& scene, const MeshInfo& mesh, const glm::vec3& origin, const glm::vec3& dir, float tMin, float tMax) {
+    const std::vector<BVHNode>& nodes = scene.meshNodes;
+    TriangleRay ray = triangleRay(dir);
+    glm::vec3 invDir = inverseDirection(dir);
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = mesh.nodeOffset;
+    while (stackSize > 0) {
+        GLuint nodeIndex = stack[--stackSize];
+        const BVHNode& node = nodes[nodeIndex];
+        float tNear;
+        if (!intersectAABB(origin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if (node.count > 0) {
+            for (GLuint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if (intersectMeshTriangle(scene, mesh, i, origin, ray, tMin, tMax, t)) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Function to transform a world space point (w = 1) or direction (w = 0) into the object space of an instance
+static glm::vec3 toObjectSpace(const MeshInstance& instance, const glm::vec4& v) {
+    return glm::vec3(glm::dot(instance.worldToObject[0], v), glm::dot(instance.worldToObject[1], v), glm::dot(instance.worldToObject[2], v));
+}
+
+// Function to find the closest mesh instance in (tMin, tClosest) and its triangle by walking the instance BVH
+// and the BVHs of the meshes it reaches, returns the instance index or -1
+static int traceMeshes(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir, float tMin, float& tClosest, GLuint& hitTriangle) {
+    const std::vector<BVHNode>& nodes = context.instanceBVH.nodes;
+    if (nodes.empty()) return -1;
+
+    glm::vec3 invDir = inverseDirection(dir);
+    float tNear;
+    if (!intersectAABB(origin, invDir, nodes[0].boundsMin, nodes[0].boundsMax, tClosest, tNear)) return -1;
+
+    int hitInstance = -1;
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    GLuint nodeIndex = 0;
+    while (true) {
+        const BVHNode& node = nodes[nodeIndex];
+        if (node.count > 0) {
+            for (GLuint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                GLuint instanceIndex = context.instanceBVH.primIndices[i];
+                const MeshInstance& instance = context.scene.instances[instanceIndex];
+                int triangle = traceMesh(context.scene, context.scene.meshes[instance.mesh], toObjectSpace(instance, glm::vec4(origin, 1.0f)),
+                                         toObjectSpace(instance, glm::vec4(dir, 0.0f)), tMin, tClosest);
+                if (triangle >= 0) {
+                    hitInstance = int(instanceIndex);
+                    hitTriangle = GLuint(triangle);
+                }
+            }
+        } else {
+            GLuint left = nodeIndex + 1;
+            GLuint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(origin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(origin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if (stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while (stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(origin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if (!found) break;
+    }
+    return hitInstance;
+}
+
+// Function to check whether any mesh instance lies on the ray in (tMin, tMax)
+static bool occludedByMeshes(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir, float tMin, float tMax) {
+    const std::vector<BVHNode>& nodes = context.instanceBVH.nodes;
+    if (nodes.empty()) return false;
+
+    glm::vec3 invDir = inverseDirection(dir);
+    GLuint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        GLuint nodeIndex = stack[--stackSize];
+        const BVHNode& node = nodes[nodeIndex];
+        float tNear;
+        if (!intersectAABB(origin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if (node.count > 0) {
+            for (GLuint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                const MeshInstance& instance = context.scene.instances[context.instanceBVH.primIndices[i]];
+                if (occludedByMesh(context.scene, context.scene.meshes[instance.mesh], toObjectSpace(instance, glm::vec4(origin, 1.0f)),
+                                   toObjectSpace(instance, glm::vec4(dir, 0.0f)), tMin, tMax)) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Function to find the closest surface along a ray, the same as getClosestPoint in raytracing.comp
+static HitPoint getClosestPoint(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir) {
+    HitPoint closestPoint = {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+    float smallestT = FLT_MAX;
+
+    int sphereIndex = traceSpheres(context, origin, dir, 0.0f, smallestT);
+    if (sphereIndex >= 0) {
+        const Sphere& sphere = context.scene.spheres[sphereIndex];
+        closestPoint.position = origin + smallestT * dir;
+        closestPoint.normal = glm::normalize(closestPoint.position - sphere.center);
+        closestPoint.color = sphere.color;
+        closestPoint.reflectivity = sphere.reflectivity;
+    }
+
+    for (size_t i = 0; i < context.scene.planes.size(); i++) {
+        const Plane& plane = context.scene.planes[i];
+        float t;
+        if (intersectPlane(origin, dir, plane, t) && t < smallestT) {
+            smallestT = t;
+            closestPoint.position = origin + t * dir;
+            closestPoint.normal = plane.normal;
+            closestPoint.color = plane.color;
+            closestPoint.reflectivity = plane.reflectivity;
+        }
+    }
+
+    GLuint triangle = 0;
+    int instanceIndex = traceMeshes(context, origin, dir, MESH_EPSILON, smallestT, triangle);
+    if (instanceIndex >= 0) {
+        const MeshInstance& instance = context.scene.instances[instanceIndex];
+        const MeshInfo& mesh = context.scene.meshes[instance.mesh];
+        glm::vec3 v0 = meshVertex(context.scene, mesh, meshIndex(context.scene, mesh, 3 * triangle));
+        glm::vec3 v1 = meshVertex(context.scene, mesh, meshIndex(context.scene, mesh, 3 * triangle + 1));
+        glm::vec3 v2 = meshVertex(context.scene, mesh, meshIndex(context.scene, mesh, 3 * triangle + 2));
+        glm::vec3 n = glm::cross(v1 - v0, v2 - v0);
+        glm::vec3 normal = glm::normalize(n.x * glm::vec3(instance.worldToObject[0]) + n.y * glm::vec3(instance.worldToObject[1])
+                                          + n.z * glm::vec3(instance.worldToObject[2]));
+        closestPoint.position = origin + smallestT * dir;
+        closestPoint.normal = glm::dot(normal, dir) > 0.0f ? -normal : normal;
+        closestPoint.color = instance.color;
+        closestPoint.reflectivity = instance.reflectivity;
+    }
+    return closestPoint;
+}
+
+// Function to check whether any sphere, plane or mesh lies on a ray in (tMin, tMax)
+static bool occluded(const TraceContext& context, const glm::vec3& origin, const glm::vec3& dir, float tMin, float tMax) {
+    if (occludedBySpheres(context, origin, dir, tMin, tMax)) return true;
+    for (size_t i = 0; i < context.scene.planes.size(); i++) {
+        float t;
+        if (intersectPlane(origin, dir, context.scene.planes[i], t) && t > tMin && t < tMax) return true;
+    }
+    return occludedByMeshes(context, origin, dir, std::max(tMin, MESH_EPSILON), tMax);
+}
+
+// Function to get the light reaching a surface point from the light samples of its pixel, the same as
+// directLight in raytracing.comp: every light while the scene has no more than the shadow ray budget,
+// else that many lights picked from the light BVH
+static glm::vec3 directLight(const TraceContext& context, uint32_t pixelIndex, const glm::vec3& position, const glm::vec3& normal) {
+    const std::vector<Light>& lights = context.lightTree.lights;
+    int lightCount = int(lights.size());
+    bool sampled = lightCount > context.shadowRays;
+    glm::vec3 light(0.0f);
+    for (int i = 0; i < std::min(lightCount, context.shadowRays); i++) {
+        int lightIndex = i;
+        float weight = 1.0f;
+        if (sampled) {
+            float pdf;
+            lightIndex = sampleLightTree(context.lightTree, position, normal, lightSampleRandom(pixelIndex, context.sampleIndex, i), pdf);
+            if (lightIndex < 0) continue;
+            weight = 1.0f / (pdf * float(context.shadowRays));
+        }
+        // The shadow ray ends at the light, so objects behind it cast no shadow
+        glm::vec3 toLight = lights[lightIndex].position - position;
+        float lightDistance = glm::length(toLight);
+        if (context.counts) context.counts->shadow++;
+        if (occluded(context, position, toLight / lightDistance, 0.001f, lightDistance)) continue;
+        light += weight * lights[lightIndex].color * lightFactor(lights[lightIndex].position, position, normal);
+    }
+    return light;
+}
+
+// Function to shade a point on the image plane given in pixels of the traced region, the same as tracePixel
+// in raytracing.comp
+static glm::vec3 shadePixel(const TraceContext& context, const Camera& camera, const glm::vec2& pixel, const ImageRegion& region) {
+    glm::vec2 imagePixel = pixel + glm::vec2(float(region.x), float(region.y));
+    float u = (imagePixel.x / float(region.imageWidth)) * 2.0f - 1.0f;
+    float v = (imagePixel.y / float(region.imageHeight)) * 2.0f - 1.0f;
+
+    glm::vec3 cameraRight = glm::normalize(glm::cross(camera.direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+    glm::vec3 cameraUp = glm::cross(cameraRight, camera.direction);
+    float aspectRatio = float(region.imageWidth) / float(region.imageHeight);
+
+    glm::vec3 rayDir = glm::normalize(camera.direction * camera.focalLength + cameraRight * u * aspectRatio + cameraUp * v);
+    glm::vec3 rayOrigin = camera.position;
+    if (context.counts) context.counts->primary++;
+
+    HitPoint closestPoint = getClosestPoint(context, rayOrigin, rayDir);
+    glm::vec3 color = closestPoint.color;
+
+    // Reflection
+    if (closestPoint.reflectivity > 0.0f) {
+        glm::vec3 reflectDir = glm::reflect(rayDir, closestPoint.normal);
+        if (context.counts) context.counts->reflection++;
+        HitPoint reflectedPoint = getClosestPoint(context, closestPoint.position, reflectDir);
+        color = closestPoint.color * (1.0f - closestPoint.reflectivity) + reflectedPoint.color * closestPoint.reflectivity;
+    }
+
+    if (context.scene.lights.empty()) return glm::vec3(0.25f) * color;
+
+    // Ambient and diffuse shading without the specular term, like the shader
+    uint32_t pixelIndex = uint32_t(int(imagePixel.y) * region.imageWidth + int(imagePixel.x));
+    return (SHADOW_AMBIENT + directLight(context, pixelIndex, closestPoint.position, closestPoint.normal)) * color;
+}
+
+// Function to allocate the image and start the worker threads, 0 threads uses all cores
+CpuRenderer::CpuRenderer(int width, int height, int threadCount)
+    : width(width), height(height), pixels(size_t(width) * height * 4, 0.0f), sceneLoaded(false), scheduler(threadCount),
+      texture(0), textureWidth(0), textureHeight(0), textureDirty(false) {}
+
+CpuRenderer::~CpuRenderer() {
+    if (texture) glDeleteTextures(1, &texture);
+}
+
+// Function to reallocate the image for a new size
+void CpuRenderer::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    pixels.assign(size_t(width) * height * 4, 0.0f);
+    resetAccumulation();
+}
+
+// Function to store the sphere at a position of the leaf order in the SIMD arrays
+static void storeSphere(SphereSoA& soa, size_t slot, const Sphere& sphere) {
+    soa.centerX[slot] = sphere.center.x;
+    soa.centerY[slot] = sphere.center.y;
+    soa.centerZ[slot] = sphere.center.z;
+    soa.radius2[slot] = sphere.radius * sphere.radius;
+}
+
+// Function to shade one sample of all pixels of one tile and fold it into the running mean
+void CpuRenderer::renderTile(int tile, int worker, const Scene& scene, const BVH& sphereBVH, const Camera& camera, int sampleIndex) {
+    TraceContext context = {scene, sphereBVH, sphereSoA, instanceBVH, lightTree, shadowRays, sampleIndex,
+                            countRays ? &workerRayCounts[worker] : nullptr};
+    int tilesX = (width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    int x0 = (tile % tilesX) * CPU_TILE_SIZE;
+    int y0 = (tile / tilesX) * CPU_TILE_SIZE;
+    int x1 = std::min(x0 + CPU_TILE_SIZE, width);
+    int y1 = std::min(y0 + CPU_TILE_SIZE, height);
+    glm::vec2 jitter = sampleJitter(sampleIndex);
+    ImageRegion traced = imageRegion(width, height);
+
+    for (int y = y0; y < y1; y++) {
+        float* row = &pixels[(size_t(y) * width) * 4];
+        for (int x = x0; x < x1; x++) {
+            glm::vec3 color = shadePixel(context, camera, glm::vec2(float(x), float(y)) + jitter, traced);
+            if (sampleIndex > 0) {
+                glm::vec3 mean(row[4 * x + 0], row[4 * x + 1], row[4 * x + 2]);
+                color = mean + (color - mean) / float(sampleIndex + 1);
+            }
+            row[4 * x + 0] = color.x;
+            row[4 * x + 1] = color.y;
+            row[4 * x + 2] = color.z;
+            row[4 * x + 3] = 1.0f;
+        }
+    }
+}
+
+// Function to trace the next sample of the scene into the host image using all worker threads
+void CpuRenderer::render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) {
+    setProfilerMemory(profiler, double(imageBytes()));
+    // Moved objects keep their place as long as no object was added or removed, and the spheres keep theirs in the
+    // leaf order as long as their BVH was only refit, which leaves the links to their leaves in place
+    size_t count = sphereBVH.primIndices.size();
+    bool patch = changes && sceneLoaded && sphereSoA.centerX.size() == count + SPHERE_LANES && lightTree.lights.size() == scene.lights.size()
+                 && instanceBounds.size() == scene.instances.size()
+                 && (changes->spheres.empty() || sphereBVH.parents.size() == sphereBVH.nodes.size());
+    bool sceneChanged = !patch || !changes->empty();
+    if (!patch) {
+        // Gather the spheres in leaf order, so each leaf is one contiguous run for the SIMD kernels
+        sphereSoA.centerX.resize(count + SPHERE_LANES);
+        sphereSoA.centerY.resize(count + SPHERE_LANES);
+        sphereSoA.centerZ.resize(count + SPHERE_LANES);
+        sphereSoA.radius2.resize(count + SPHERE_LANES);
+        for (size_t i = 0; i < count; i++) storeSphere(sphereSoA, i, scene.spheres[sphereBVH.primIndices[i]]);
+        computeInstanceBounds(scene, instanceBounds);
+        if (scene.instances.empty()) instanceBVH = BVH();
+        else updateBVH(instanceBVH, instanceBounds);
+        updateLightTree(lightTree, scene.lights);
+        sceneLoaded = true;
+    } else {
+        // A moved sphere is found in the leaf it belongs to, which is a short run
+        for (GLuint sphere : changes->spheres) {
+            const BVHNode& leaf = sphereBVH.nodes[sphereBVH.primLeaves[sphere]];
+            for (GLuint i = leaf.rightOrFirst; i < leaf.rightOrFirst + leaf.count; i++) {
+                if (sphereBVH.primIndices[i] == sphere) storeSphere(sphereSoA, i, scene.spheres[sphere]);
+            }
+        }
+        if (!changes->instances.empty()) {
+            computeInstanceBounds(scene, instanceBounds);
+            updateBVH(instanceBVH, instanceBounds);
+        }
+        if (!changes->lights.empty()) updateLightTree(lightTree, scene.lights);
+    }
+    int sampleIndex = beginSample(camera, sceneChanged);
+    lastRayCounts = {0, 0, 0};
+    if (sampleIndex < 0) return;
+
+    ScopedTimer timer(profiler, "trace");
+    int tilesX = (width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    int tilesY = (height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    // Every worker counts into its own slot, summed once all tiles are done
+    if (countRays) workerRayCounts.assign(scheduler.threadCount(), lastRayCounts);
+    scheduler.run(tilesX * tilesY, [&](int tile, int worker) { renderTile(tile, worker, scene, sphereBVH, camera, sampleIndex); });
+    for (size_t i = 0; countRays && i < workerRayCounts.size(); i++) {
+        lastRayCounts.primary += workerRayCounts[i].primary;
+        lastRayCounts.reflection += workerRayCounts[i].reflection;
+        lastRayCounts.shadow += workerRayCounts[i].shadow;
+    }
+
+    textureDirty = true;
+}
+
+// Function to upload the host image into a texture for display
+GLuint CpuRenderer::outputTexture() {
+    if (!texture || textureWidth != width || textureHeight != height) {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = createTexture(width, height);
+        textureWidth = width;
+        textureHeight = height;
+        textureDirty = true;
+    }
+    if (textureDirty) {
+        ScopedTimer timer(profiler, "upload", true);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        countProfilerBytes(profiler, "upload", double(pixels.size() * sizeof(float)));
+        textureDirty = false;
+    }
+    return texture;
+}
+
+// Function to get the bytes of the host image and of the display texture once it exists
+size_t CpuRenderer::imageBytes() const {
+    size_t bytes = pixels.size() * sizeof(float);
+    if (texture) bytes += size_t(textureWidth) * textureHeight * 16;
+    return bytes;
+}
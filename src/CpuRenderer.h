@@ -0,0 +1,53 @@
+#ifndef CPURENDERER_H
+#define CPURENDERER_H
+
+#include "LightTree.h"
+#include "Renderer.h"
+#include "TileScheduler.h"
+
+#include <vector>
+
+// Sphere data in BVH leaf order, split into arrays so that all spheres of a leaf can be
+// tested against a ray with one SIMD operation. Padded so 8-wide loads never run past the end.
+struct SphereSoA {
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius2;
+};
+
+// Renderer that runs the shading model of raytracing.comp on all CPU cores
+class CpuRenderer : public Renderer {
+public:
+    // Function to allocate the image and start the worker threads, 0 threads uses all cores
+    CpuRenderer(int width, int height, int threadCount = 0);
+    ~CpuRenderer();
+
+    const char* name() const override { return "cpu"; }
+    void resize(int width, int height) override;
+    void render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) override;
+    GLuint outputTexture() override;
+    const float* hostPixels() const override { return pixels.data(); }
+    size_t imageBytes() const override;
+
+private:
+    void renderTile(int tile, int worker, const Scene& scene, const BVH& sphereBVH, const Camera& camera, int sampleIndex);
+
+    int width;
+    int height;
+    std::vector<float> pixels;  // RGBA, bottom row first like the GPU texture, the running mean of the samples
+    bool sceneLoaded;           // Whether the scene data below was set up for a whole scene, so moved objects can be patched in
+    SphereSoA sphereSoA;
+    BVH instanceBVH;            // BVH over the mesh instances
+    std::vector<AABB> instanceBounds;
+    LightTree lightTree;        // BVH over the lights
+    TileScheduler scheduler;
+    std::vector<RayCounts> workerRayCounts;
+
+    GLuint texture;             // Created on first use, only needed to display the image
+    int textureWidth;
+    int textureHeight;
+    bool textureDirty;
+};
+
+#endif // CPURENDERER_H
@@ -0,0 +1,88 @@
+#include "Denoiser.h"
+
+#include <string>
+
+// Size of the workgroups of denoise.comp
+static const int DENOISE_GROUP_SIZE = 16;
+
+// Function to delete the images of the denoiser
+static void deleteDenoiserImages(Denoiser& denoiser) {
+    if (denoiser.width == 0) return;
+    glDeleteTextures(1, &denoiser.normalDepthTexture);
+    glDeleteTextures(1, &denoiser.albedoTexture);
+    glDeleteTextures(2, denoiser.filterTextures);
+    denoiser.width = 0;
+    denoiser.height = 0;
+}
+
+// Function to create a denoiser without images, they are created for the size of the first frame
+Denoiser createDenoiser() {
+    Denoiser denoiser;
+    denoiser.variants.path = std::string(SHADER_DIR) + "/denoise.comp";
+    denoiser.width = 0;
+    denoiser.height = 0;
+    denoiser.normalDepthTexture = 0;
+    denoiser.albedoTexture = 0;
+    denoiser.filterTextures[0] = 0;
+    denoiser.filterTextures[1] = 0;
+    return denoiser;
+}
+
+// Function to bind the feature images to the image units the trace pass stores them to, (re)creating them if the size changed
+void bindDenoiserFeatures(Denoiser& denoiser, int width, int height) {
+    if (width != denoiser.width || height != denoiser.height) {
+        deleteDenoiserImages(denoiser);
+        denoiser.width = width;
+        denoiser.height = height;
+        // Half floats hold unit normals and albedos exactly enough, and distances to 0.1%
+        denoiser.normalDepthTexture = createTexture(width, height, GL_RGBA16F);
+        denoiser.albedoTexture = createTexture(width, height, GL_RGBA16F);
+        denoiser.filterTextures[0] = createTexture(width, height);
+        denoiser.filterTextures[1] = createTexture(width, height);
+    }
+    glBindImageTexture(2, denoiser.normalDepthTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindImageTexture(3, denoiser.albedoTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+}
+
+// Function to filter the accumulated colors into the output texture with DENOISE_PASSES passes of denoise.comp
+bool runDenoiser(Denoiser& denoiser, GLuint accumulationTexture, GLuint outputTexture, OutputFormat format) {
+    // Only the output format varies, the filter does not depend on the scene
+    ShaderVariant variant = {-1, -1, -1, {0, 0, false}, false, format, false, false, false};
+    GLuint program = getShaderVariant(denoiser.variants, shaderVariantDefines(variant));
+    if (!program || denoiser.width == 0) return false;
+
+    glUseProgram(program);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, outputInternalFormat(format));
+    glBindImageTexture(1, accumulationTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glUniform1i(glGetUniformLocation(program, "denoiseSteps"), DENOISE_PASSES);
+    GLint stepLocation = glGetUniformLocation(program, "denoiseStep");
+    int groupsX = (denoiser.width + DENOISE_GROUP_SIZE - 1) / DENOISE_GROUP_SIZE;
+    int groupsY = (denoiser.height + DENOISE_GROUP_SIZE - 1) / DENOISE_GROUP_SIZE;
+    for (int step = 0; step < DENOISE_PASSES; step++) {
+        // Pass i reads what pass i - 1 wrote, the first pass reads the accumulation texture instead
+        glBindImageTexture(4, denoiser.filterTextures[(step + 1) % 2], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(5, denoiser.filterTextures[step % 2], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glUniform1i(stepLocation, step);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    return true;
+}
+
+// Function to get the bytes of the images of the denoiser: two half-float feature images and two float filter images
+size_t denoiserImageBytes(const Denoiser& denoiser) {
+    return size_t(denoiser.width) * denoiser.height * (8 + 8 + 16 + 16);
+}
+
+// Function to estimate the bytes the filter passes move through the images
+double denoiserImageTraffic(int width, int height, OutputFormat format) {
+    // Every tap reads its irradiance and normal and depth, the centre also its albedo before the last pass writes
+    double passBytes = 25.0 * (16 + 8) + 8 + 16;
+    return double(width) * height * (DENOISE_PASSES * passBytes + outputFormatBytes(format));
+}
+
+// Function to delete the images and programs of the denoiser
+void deleteDenoiser(Denoiser& denoiser) {
+    deleteDenoiserImages(denoiser);
+    deleteShaderVariants(denoiser.variants);
+}
@@ -0,0 +1,45 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "Shader.h"
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Passes of the edge-avoiding à-trous filter in denoise.comp. The taps of pass i are 2^i pixels apart,
+// so five passes reach 62 pixels from the centre.
+const int DENOISE_PASSES = 5;
+
+// Structure for the image-space denoiser of the GPU backends. The trace pass writes the feature images next to
+// the accumulated colors, and the filter passes turn both into the output texture.
+struct Denoiser {
+    ShaderVariantCache variants;    // denoise.comp for every output format used so far
+    int width;                      // Size of the images, 0 before the first frame
+    int height;
+    GLuint normalDepthTexture;      // Running means of the normal and camera distance of the first surfaces
+    GLuint albedoTexture;           // Running mean of the colors of the first surfaces
+    GLuint filterTextures[2];       // Irradiance and its variance, ping-ponged between the passes
+};
+
+// Function to create a denoiser without images, they are created for the size of the first frame
+Denoiser createDenoiser();
+
+// Function to bind the feature images to the image units the trace pass stores them to, (re)creating them if
+// the size changed. Must be called before every dispatch of a shader variant with denoise set.
+void bindDenoiserFeatures(Denoiser& denoiser, int width, int height);
+
+// Function to filter the accumulated colors into the output texture, after the trace pass of a frame and with
+// its FrameData still bound. Returns false if denoise.comp does not compile, the output keeps the noisy image then.
+bool runDenoiser(Denoiser& denoiser, GLuint accumulationTexture, GLuint outputTexture, OutputFormat format);
+
+// Function to get the bytes of the images of the denoiser
+size_t denoiserImageBytes(const Denoiser& denoiser);
+
+// Function to estimate the bytes the filter passes move through the images: every pass reads the irradiance and
+// features of its 25 taps and writes one pixel
+double denoiserImageTraffic(int width, int height, OutputFormat format);
+
+// Function to delete the images and programs of the denoiser
+void deleteDenoiser(Denoiser& denoiser);
+
+#endif // DENOISER_H
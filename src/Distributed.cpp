@@ -0,0 +1,762 @@
+#include "Distributed.h"
+#include "Animation.h"
+#include "BVH.h"
+#include "GLUtils.h"
+#include "Headless.h"
+#include "Image.h"
+#include "Readback.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "Scenes.h"
+#include "Socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Messages between a coordinator and its workers. Every message is a MessageHeader followed by size bytes
+// of payload. The structs are sent as they are in memory, so all nodes must share the byte order, as
+// x86-64 and AArch64 Linux hosts do.
+enum MessageType : uint32_t {
+    MESSAGE_HELLO = 1,      // Worker: WorkerHello, sent once after connecting
+    MESSAGE_SETUP,          // Coordinator: JobSettings, followed by a binary scene file with its tracks unless it is the demo scene
+    MESSAGE_REQUEST,        // Worker: ready for the next task, no payload
+    MESSAGE_TASK,           // Coordinator: TaskMessage
+    MESSAGE_RESULT,         // Worker: ResultHeader followed by the RGBA32F pixels of one frame of the task's region
+    MESSAGE_CANCEL,         // Coordinator: uint32_t task, another worker finished it first
+    MESSAGE_DONE            // Coordinator: the job is finished, no payload
+};
+
+// First word of a hello, so connections from anything else are dropped
+const uint32_t PROTOCOL_MAGIC = 0x44575452;     // "RTWD"
+// Bumped whenever a message changes
+const uint32_t PROTOCOL_VERSION = 5;
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t pad;
+    uint64_t size;
+};
+
+struct WorkerHello {
+    uint32_t magic;
+    uint32_t version;
+    char name[64];          // Host and backend of the worker, for the coordinator's log
+};
+
+// Structure for the settings every worker renders the job with
+struct JobSettings {
+    int32_t width;          // Size of the full image
+    int32_t height;
+    int32_t samples;
+    int32_t shadowRays;
+    int32_t bounces;
+    int32_t variableRate;
+    int32_t outputFormat;
+    int32_t demoScene;      // Non-zero for the demo scene, which every node creates itself instead of receiving it
+    glm::vec3 cameraPos;
+    glm::vec3 cameraDir;
+    float focalLength;
+    int32_t quantizeScene;
+    int32_t packetTracing;
+    int32_t denoise;
+    double startTime;
+    double frameTime;
+};
+
+struct TaskMessage {
+    uint32_t task;
+    int32_t firstFrame;
+    int32_t frameCount;
+    int32_t x;              // Region of the full image, in pixels from the bottom left
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t pad;
+};
+
+struct ResultHeader {
+    uint32_t task;
+    int32_t frame;
+};
+
+static_assert(sizeof(MessageHeader) == 16, "MessageHeader must not contain implicit padding");
+static_assert(sizeof(JobSettings) == 88, "JobSettings must not contain implicit padding");
+static_assert(sizeof(TaskMessage) == 32, "TaskMessage must not contain implicit padding");
+
+// Function to send a message with a payload in up to two parts, returns false if the connection failed
+static bool sendMessage(int socket, MessageType type, const void* payload = nullptr, size_t size = 0,
+                        const void* extra = nullptr, size_t extraSize = 0) {
+    MessageHeader header = {uint32_t(type), 0, uint64_t(size + extraSize)};
+    return sendAll(socket, &header, sizeof(header)) && sendAll(socket, payload, size) && sendAll(socket, extra, extraSize);
+}
+
+// Function to receive the next message, blocking until it arrived. Returns false if the connection failed.
+static bool receiveMessage(int socket, MessageHeader& header, std::vector<char>& payload) {
+    if (!receiveAll(socket, &header, sizeof(header))) return false;
+    payload.resize(size_t(header.size));
+    return receiveAll(socket, payload.data(), payload.size());
+}
+
+// Function to create an empty file in the temporary directory, returns its path or an empty string
+static std::string createTemporaryFile() {
+    const char* directory = std::getenv("TMPDIR");
+    std::string pattern = std::string(directory && *directory ? directory : "/tmp") + "/raytracer-XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        std::cerr << "Failed to create a temporary file in " << pattern << std::endl;
+        return std::string();
+    }
+    close(fd);
+    return path.data();
+}
+
+// Function to get the seconds since a point in time
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// States of a task of the coordinator
+enum TaskState {
+    TASK_PENDING,           // In a block or the retry queue
+    TASK_RUNNING,           // Handed to one worker, or two if it was duplicated
+    TASK_DONE
+};
+
+// Structure for a part of the job: a range of frames of one region of the image
+struct Task {
+    int firstFrame;
+    int frameCount;
+    int x;
+    int y;
+    int width;
+    int height;
+    TaskState state;
+    int attempts;           // Times the task was handed out for the first time or after a failure
+    int copies;             // Workers rendering the task, two while a straggler's task is duplicated
+    int framesReceived;     // Frames accepted so far, every worker sends the frames of a task in order
+};
+
+// Structure for a contiguous run of pending tasks [front, back)
+struct TaskBlock {
+    int front;
+    int back;
+};
+
+// Structure for the connection of the coordinator to a worker
+struct WorkerConnection {
+    int socket;             // -1 once the worker disconnected or was dropped
+    std::string name;
+    std::vector<char> buffer;   // Received bytes that do not form a whole message yet
+    bool ready;             // Got the job settings
+    bool idle;              // Asked for a task while none was left to give
+    TaskBlock block;        // Tasks the worker takes from the front, idle workers steal from the back
+    int task;               // Task being rendered, -1 if none
+    std::chrono::steady_clock::time_point started;  // When the task was handed out
+    int tasksDone;          // Tasks the worker finished first
+    int steals;             // Times the worker took half of another block
+    int duplicates;         // Tasks it rendered a second copy of
+};
+
+// Structure for a frame whose regions are still being assembled
+struct FrameAssembly {
+    std::vector<float> pixels;
+    int regionsLeft;
+};
+
+// Structure for the state of a coordinator
+struct Coordinator {
+    const RenderOptions* options;
+    std::vector<Task> tasks;
+    int regionsPerFrame;
+    TaskBlock unassigned;           // Tasks no worker has taken yet, split between workers like any other block
+    std::deque<int> retries;        // Tasks of failed workers, handed out before any block
+    std::vector<WorkerConnection> workers;
+    std::map<int, FrameAssembly> frames;
+    int tasksDone;
+    bool failed;                    // A task failed too often or a frame could not be written
+};
+
+// Function to split a job into tasks: tiles of a single frame, or ranges of frames of a sequence
+static void splitJob(Coordinator& coordinator, const RenderOptions& options) {
+    Task task = {0, 1, 0, 0, options.width, options.height, TASK_PENDING, 0, 0, 0};
+    if (options.frames > 1) {
+        for (int frame = 0; frame < options.frames; frame += options.taskFrames) {
+            task.firstFrame = frame;
+            task.frameCount = std::min(options.taskFrames, options.frames - frame);
+            coordinator.tasks.push_back(task);
+        }
+        coordinator.regionsPerFrame = 1;
+        return;
+    }
+    for (int y = 0; y < options.height; y += options.tileSize) {
+        for (int x = 0; x < options.width; x += options.tileSize) {
+            task.x = x;
+            task.y = y;
+            task.width = std::min(options.tileSize, options.width - x);
+            task.height = std::min(options.tileSize, options.height - y);
+            coordinator.tasks.push_back(task);
+        }
+    }
+    coordinator.regionsPerFrame = int(coordinator.tasks.size());
+}
+
+// Function to pick the next task for a worker: a retry, the front of its own block, the back half of the
+// largest other block, or, once nothing is pending, a second copy of the task that has been running longest
+// on another worker. Returns -1 if there is nothing to do.
+static int takeTask(Coordinator& coordinator, int workerIndex) {
+    WorkerConnection& worker = coordinator.workers[workerIndex];
+    while (!coordinator.retries.empty()) {
+        int task = coordinator.retries.front();
+        coordinator.retries.pop_front();
+        if (coordinator.tasks[task].state == TASK_PENDING) return task;
+    }
+
+    for (;;) {
+        while (worker.block.front < worker.block.back) {
+            int task = worker.block.front++;
+            if (coordinator.tasks[task].state == TASK_PENDING) return task;
+        }
+        // Blocks of dropped workers are stolen like any other
+        TaskBlock* victim = &coordinator.unassigned;
+        for (size_t i = 0; i < coordinator.workers.size(); i++) {
+            TaskBlock& block = coordinator.workers[i].block;
+            if (int(i) != workerIndex && block.back - block.front > victim->back - victim->front) victim = &block;
+        }
+        int size = victim->back - victim->front;
+        if (size <= 0) break;
+        int taken = (size + 1) / 2;
+        worker.block = {victim->back - taken, victim->back};
+        victim->back -= taken;
+        if (victim != &coordinator.unassigned) worker.steals++;
+    }
+
+    int straggler = -1;
+    for (size_t i = 0; i < coordinator.workers.size(); i++) {
+        const WorkerConnection& other = coordinator.workers[i];
+        if (other.socket < 0 || other.task < 0 || coordinator.tasks[other.task].copies != 1) continue;
+        if (straggler < 0 || other.started < coordinator.workers[straggler].started) straggler = int(i);
+    }
+    if (straggler < 0) return -1;
+    worker.duplicates++;
+    return coordinator.workers[straggler].task;
+}
+
+// Function to hand the next task to a worker, or mark it idle until a task becomes available
+static void assignTask(Coordinator& coordinator, int workerIndex);
+
+// Function to close the connection to a worker and put its task back, so it is rendered by another one
+static void dropWorker(Coordinator& coordinator, int workerIndex, const char* reason) {
+    WorkerConnection& worker = coordinator.workers[workerIndex];
+    if (worker.socket < 0) return;
+    std::cerr << "Dropping worker " << (worker.name.empty() ? std::to_string(workerIndex) : worker.name) << ": " << reason << std::endl;
+    closeSocket(worker.socket);
+    worker.socket = -1;
+    worker.ready = false;
+    worker.idle = false;
+
+    int taskIndex = worker.task;
+    worker.task = -1;
+    if (taskIndex < 0) return;
+    Task& task = coordinator.tasks[taskIndex];
+    task.copies--;
+    if (task.state == TASK_DONE || task.copies > 0) return;
+    if (task.attempts >= MAX_TASK_ATTEMPTS) {
+        std::cerr << "Task " << taskIndex << " failed " << task.attempts << " times, giving up" << std::endl;
+        coordinator.failed = true;
+        return;
+    }
+    // A retried frame range resumes at its first missing frame
+    task.firstFrame += task.framesReceived;
+    task.frameCount -= task.framesReceived;
+    task.framesReceived = 0;
+    task.state = TASK_PENDING;
+    coordinator.retries.push_back(taskIndex);
+    for (size_t i = 0; i < coordinator.workers.size(); i++) {
+        if (coordinator.workers[i].idle) assignTask(coordinator, int(i));
+    }
+}
+
+// Function to hand the next task to a worker, or mark it idle until a task becomes available
+static void assignTask(Coordinator& coordinator, int workerIndex) {
+    int taskIndex = takeTask(coordinator, workerIndex);
+    WorkerConnection& worker = coordinator.workers[workerIndex];
+    worker.idle = taskIndex < 0;
+    if (taskIndex < 0) return;
+
+    Task& task = coordinator.tasks[taskIndex];
+    if (task.state == TASK_PENDING) task.attempts++;
+    task.state = TASK_RUNNING;
+    task.copies++;
+    worker.task = taskIndex;
+    worker.started = std::chrono::steady_clock::now();
+    TaskMessage message = {uint32_t(taskIndex), task.firstFrame, task.frameCount, task.x, task.y, task.width, task.height, 0};
+    if (!sendMessage(worker.socket, MESSAGE_TASK, &message, sizeof(message))) dropWorker(coordinator, workerIndex, "connection lost");
+}
+
+// Function to write a finished frame to disk
+static void writeFrame(Coordinator& coordinator, int frame, const float* pixels) {
+    const RenderOptions& options = *coordinator.options;
+    std::string path = formatOutputPath(options.output, frame, options.frames);
+    if (writeImage(path, options.width, options.height, pixels)) {
+        std::cout << "Wrote " << path << std::endl;
+    } else {
+        coordinator.failed = true;
+    }
+}
+
+// Function to take one frame of a task's region from a worker. Frames a duplicate already delivered are dropped.
+// Returns true if the frame finished the task.
+static bool acceptResult(Coordinator& coordinator, int taskIndex, int frame, const float* pixels) {
+    Task& task = coordinator.tasks[taskIndex];
+    if (task.state == TASK_DONE || frame != task.firstFrame + task.framesReceived) return false;
+    task.framesReceived++;
+    bool finished = task.framesReceived == task.frameCount;
+    if (finished) {
+        task.state = TASK_DONE;
+        coordinator.tasksDone++;
+    }
+
+    const RenderOptions& options = *coordinator.options;
+    if (coordinator.regionsPerFrame == 1) {
+        writeFrame(coordinator, frame, pixels);
+        return finished;
+    }
+    FrameAssembly& assembly = coordinator.frames[frame];
+    if (assembly.pixels.empty()) {
+        assembly.pixels.assign(size_t(options.width) * options.height * 4, 0.0f);
+        assembly.regionsLeft = coordinator.regionsPerFrame;
+    }
+    // Both the region and the image are stored bottom row first
+    for (int row = 0; row < task.height; row++) {
+        const float* source = pixels + size_t(row) * task.width * 4;
+        float* target = &assembly.pixels[(size_t(task.y + row) * options.width + task.x) * 4];
+        std::memcpy(target, source, size_t(task.width) * 4 * sizeof(float));
+    }
+    if (--assembly.regionsLeft == 0) {
+        writeFrame(coordinator, frame, assembly.pixels.data());
+        coordinator.frames.erase(frame);
+    }
+    return finished;
+}
+
+// Function to handle one message of a worker, returns false if the worker broke the protocol
+static bool handleMessage(Coordinator& coordinator, int workerIndex, const MessageHeader& header, const char* payload,
+                          const std::vector<char>& setup) {
+    WorkerConnection& worker = coordinator.workers[workerIndex];
+    if (!worker.ready) {
+        if (header.type != MESSAGE_HELLO || header.size != sizeof(WorkerHello)) return false;
+        WorkerHello hello;
+        std::memcpy(&hello, payload, sizeof(hello));
+        if (hello.magic != PROTOCOL_MAGIC || hello.version != PROTOCOL_VERSION) return false;
+        hello.name[sizeof(hello.name) - 1] = '\0';
+        worker.name = std::string(hello.name) + " #" + std::to_string(workerIndex);
+        std::cout << "Worker " << worker.name << " connected" << std::endl;
+        worker.ready = true;
+        // The scene can be large, the other workers wait while it is sent
+        MessageHeader setupHeader = {MESSAGE_SETUP, 0, uint64_t(setup.size())};
+        return sendAll(worker.socket, &setupHeader, sizeof(setupHeader)) && sendAll(worker.socket, setup.data(), setup.size());
+    }
+
+    if (header.type == MESSAGE_REQUEST && header.size == 0) {
+        if (worker.task >= 0) {
+            coordinator.tasks[worker.task].copies--;
+            worker.task = -1;
+        }
+        assignTask(coordinator, workerIndex);
+        return true;
+    }
+    if (header.type == MESSAGE_RESULT && header.size >= sizeof(ResultHeader) && worker.task >= 0) {
+        ResultHeader result;
+        std::memcpy(&result, payload, sizeof(result));
+        const Task& task = coordinator.tasks[worker.task];
+        if (result.task != uint32_t(worker.task) || header.size != sizeof(ResultHeader) + size_t(task.width) * task.height * 4 * sizeof(float)) return false;
+        if (!acceptResult(coordinator, worker.task, result.frame, reinterpret_cast<const float*>(payload + sizeof(ResultHeader)))) return true;
+        worker.tasksDone++;
+        // The other copy of a duplicated task is no longer needed
+        for (size_t i = 0; i < coordinator.workers.size(); i++) {
+            WorkerConnection& other = coordinator.workers[i];
+            if (int(i) == workerIndex || other.socket < 0 || other.task != int(result.task)) continue;
+            if (!sendMessage(other.socket, MESSAGE_CANCEL, &result.task, sizeof(result.task))) dropWorker(coordinator, int(i), "connection lost");
+        }
+        return true;
+    }
+    return false;
+}
+
+// Function to receive and handle the messages a worker sent, dropping it if the connection failed
+static void serviceWorker(Coordinator& coordinator, int workerIndex, const std::vector<char>& setup) {
+    bool connected = receiveAvailable(coordinator.workers[workerIndex].socket, coordinator.workers[workerIndex].buffer);
+    size_t offset = 0;
+    for (;;) {
+        std::vector<char>& buffer = coordinator.workers[workerIndex].buffer;
+        if (buffer.size() - offset < sizeof(MessageHeader)) break;
+        MessageHeader header;
+        std::memcpy(&header, buffer.data() + offset, sizeof(header));
+        if (buffer.size() - offset - sizeof(header) < header.size) break;
+        // Copied, so the pixels are aligned for floats
+        std::vector<char> payload(buffer.begin() + offset + sizeof(header), buffer.begin() + offset + sizeof(header) + header.size);
+        offset += sizeof(header) + size_t(header.size);
+        if (!handleMessage(coordinator, workerIndex, header, payload.data(), setup)) {
+            dropWorker(coordinator, workerIndex, "protocol error");
+            return;
+        }
+        if (coordinator.workers[workerIndex].socket < 0) return;
+    }
+    std::vector<char>& buffer = coordinator.workers[workerIndex].buffer;
+    buffer.erase(buffer.begin(), buffer.begin() + offset);
+    if (!connected) dropWorker(coordinator, workerIndex, "connection lost");
+}
+
+// Function to build the setup message: the job settings followed by the scene as a binary scene file
+static bool buildSetup(const RenderOptions& options, std::vector<char>& setup) {
+    JobSettings settings = {};
+    settings.width = options.width;
+    settings.height = options.height;
+    settings.samples = options.samples > 0 ? options.samples : 1;
+    settings.shadowRays = options.shadowRays;
+    settings.bounces = options.bounces;
+    settings.variableRate = options.variableRate ? 1 : 0;
+    settings.quantizeScene = options.quantizeScene ? 1 : 0;
+    settings.packetTracing = options.packetTracing ? 1 : 0;
+    settings.denoise = options.denoise ? 1 : 0;
+    settings.outputFormat = int32_t(options.outputFormat);
+    settings.demoScene = options.scene.empty() ? 1 : 0;
+    settings.cameraPos = options.cameraPos;
+    settings.cameraDir = options.cameraDir;
+    settings.focalLength = options.focalLength;
+    settings.startTime = options.startTime;
+    settings.frameTime = options.frameTime;
+    const char* bytes = reinterpret_cast<const char*>(&settings);
+    setup.assign(bytes, bytes + sizeof(settings));
+    if (settings.demoScene) return true;
+
+    // The binary format carries the meshes and the BVH, which a text scene only refers to
+    Scene scene;
+    BVH sphereBVH;
+    if (!loadScene(options.scene, scene, sphereBVH)) return false;
+    if (sphereBVH.nodes.empty()) {
+        std::vector<AABB> sphereBounds;
+        computeSphereBounds(scene.spheres, sphereBounds);
+        sphereBVH = buildBVH(sphereBounds);
+    }
+    std::string path = createTemporaryFile();
+    if (path.empty()) return false;
+    bool ok = writeSceneBinary(path, scene, &sphereBVH);
+    std::ifstream file(path, std::ios::binary);
+    setup.insert(setup.end(), std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+    return ok;
+}
+
+// Function to split a headless job into tasks, tiles of a single frame or ranges of a sequence, hand them to
+// the workers connecting to options.coordinator and write the frames assembled from their results.
+// Returns the process exit code.
+int runCoordinator(const RenderOptions& options) {
+    std::vector<char> setup;
+    if (!buildSetup(options, setup)) return 1;
+
+    Coordinator coordinator;
+    coordinator.options = &options;
+    splitJob(coordinator, options);
+    coordinator.unassigned = {0, int(coordinator.tasks.size())};
+    coordinator.tasksDone = 0;
+    coordinator.failed = false;
+
+    int listener = listenSocket(options.coordinator);
+    if (listener < 0) return 1;
+    std::cout << "Waiting for workers on " << options.coordinator << ", " << coordinator.tasks.size()
+              << (options.frames > 1 ? " frame ranges" : " tiles") << " to render" << std::endl;
+    if (options.denoise && options.frames <= 1 && coordinator.tasks.size() > 1) {
+        // The filter of a worker only sees its own tile
+        std::cerr << "Warning: tiles are denoised separately, so their edges may show seams" << std::endl;
+    }
+    if (!options.stream.empty()) {
+        // Frame ranges finish in any order, a stream would have to hold back every frame after a slow one
+        std::cerr << "Warning: the coordinator writes image files, --stream is ignored" << std::endl;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<pollfd> polled;
+    std::vector<int> polledWorkers;
+    while (coordinator.tasksDone < int(coordinator.tasks.size()) && !coordinator.failed) {
+        polled.assign(1, pollfd{listener, POLLIN, 0});
+        polledWorkers.assign(1, -1);
+        for (size_t i = 0; i < coordinator.workers.size(); i++) {
+            if (coordinator.workers[i].socket < 0) continue;
+            polled.push_back(pollfd{coordinator.workers[i].socket, POLLIN, 0});
+            polledWorkers.push_back(int(i));
+        }
+        // Wakes up regularly to check the task timeout
+        if (poll(polled.data(), nfds_t(polled.size()), 100) < 0 && errno != EINTR) {
+            std::cerr << "Failed to wait for the workers" << std::endl;
+            coordinator.failed = true;
+            break;
+        }
+
+        for (size_t i = 1; i < polled.size(); i++) {
+            if (polled[i].revents != 0) serviceWorker(coordinator, polledWorkers[i], setup);
+        }
+        if (polled[0].revents & POLLIN) {
+            int socket = acceptSocket(listener);
+            if (socket >= 0) {
+                WorkerConnection worker = {};
+                worker.socket = socket;
+                worker.task = -1;
+                coordinator.workers.push_back(worker);
+            }
+        }
+
+        if (options.taskTimeout > 0.0) {
+            for (size_t i = 0; i < coordinator.workers.size(); i++) {
+                const WorkerConnection& worker = coordinator.workers[i];
+                if (worker.socket >= 0 && worker.task >= 0 && secondsSince(worker.started) > options.taskTimeout) {
+                    dropWorker(coordinator, int(i), "task timed out");
+                }
+            }
+        }
+    }
+
+    // Every worker is told the job is over, also the ones still rendering a duplicate. The connections are
+    // drained for a moment, so workers in the middle of sending a result read the message before they see
+    // the connection close.
+    for (size_t i = 0; i < coordinator.workers.size(); i++) {
+        WorkerConnection& worker = coordinator.workers[i];
+        if (worker.socket >= 0) sendMessage(worker.socket, MESSAGE_DONE);
+    }
+    auto drainStart = std::chrono::steady_clock::now();
+    for (;;) {
+        polled.clear();
+        polledWorkers.clear();
+        for (size_t i = 0; i < coordinator.workers.size(); i++) {
+            if (coordinator.workers[i].socket < 0) continue;
+            polled.push_back(pollfd{coordinator.workers[i].socket, POLLIN, 0});
+            polledWorkers.push_back(int(i));
+        }
+        if (polled.empty() || secondsSince(drainStart) > 1.0 || poll(polled.data(), nfds_t(polled.size()), 100) < 0) break;
+        for (size_t i = 0; i < polled.size(); i++) {
+            WorkerConnection& worker = coordinator.workers[polledWorkers[i]];
+            if (polled[i].revents == 0) continue;
+            worker.buffer.clear();
+            if (receiveAvailable(worker.socket, worker.buffer)) continue;
+            closeSocket(worker.socket);
+            worker.socket = -1;
+        }
+    }
+    for (size_t i = 0; i < coordinator.workers.size(); i++) closeSocket(coordinator.workers[i].socket);
+    closeSocket(listener, options.coordinator);
+
+    for (size_t i = 0; i < coordinator.workers.size(); i++) {
+        const WorkerConnection& worker = coordinator.workers[i];
+        if (worker.name.empty()) continue;
+        std::cout << worker.name << ": " << worker.tasksDone << " tasks, " << worker.steals << " steals, "
+                  << worker.duplicates << " duplicates" << std::endl;
+    }
+    std::cout << (coordinator.failed ? "Failed after " : "Finished in ") << secondsSince(start) << " s" << std::endl;
+    return coordinator.failed ? 1 : 0;
+}
+
+// Function to connect to the coordinator, retrying while it is not listening yet. Returns the socket or -1.
+static int connectToCoordinator(const std::string& address) {
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        int socket = connectSocket(address);
+        if (socket >= 0) return socket;
+        if (secondsSince(start) > WORKER_CONNECT_SECONDS) {
+            std::cerr << "Failed to connect to the coordinator at " << address << std::endl;
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+// Function to load the scene of the setup message, the binary scene file after the settings
+static bool loadSetupScene(const std::vector<char>& payload, Scene& scene, BVH& sphereBVH) {
+    std::string path = createTemporaryFile();
+    if (path.empty()) return false;
+    std::ofstream file(path, std::ios::binary);
+    file.write(payload.data() + sizeof(JobSettings), std::streamsize(payload.size() - sizeof(JobSettings)));
+    file.close();
+    bool ok = file && loadSceneBinary(path, scene, sphereBVH);
+    std::remove(path.c_str());
+    return ok;
+}
+
+// Function to check without blocking whether the coordinator cancelled the task being rendered or finished
+// the job. Returns false if the connection failed or the coordinator broke the protocol.
+static bool checkCoordinator(int socket, uint32_t task, bool& cancelled, bool& finished) {
+    pollfd polled = {socket, POLLIN, 0};
+    while (!cancelled && poll(&polled, 1, 0) > 0) {
+        MessageHeader header;
+        std::vector<char> payload;
+        if (!receiveMessage(socket, header, payload)) return false;
+        if (header.type == MESSAGE_DONE) {
+            finished = true;
+            cancelled = true;
+        } else if (header.type == MESSAGE_CANCEL && payload.size() == sizeof(uint32_t)) {
+            uint32_t cancelledTask;
+            std::memcpy(&cancelledTask, payload.data(), sizeof(cancelledTask));
+            cancelled = cancelledTask == task;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to get the options of a worker with the tracing settings of a job in place of its own
+static RenderOptions jobOptions(const RenderOptions& options, const JobSettings& settings) {
+    RenderOptions job = options;
+    job.variableRate = settings.variableRate != 0;
+    job.quantizeScene = settings.quantizeScene != 0;
+    job.packetTracing = settings.packetTracing != 0;
+    job.denoise = settings.denoise != 0;
+    job.shadowRays = settings.shadowRays;
+    job.outputFormat = OutputFormat(settings.outputFormat);
+    job.bounces = settings.bounces;
+    return job;
+}
+
+// Function to render tasks for the coordinator at options.worker until the job is finished, returns the
+// process exit code
+int runWorker(const RenderOptions& options) {
+    // The renderer is created before the job is known, its name goes into the hello
+    HeadlessContext headless;
+    std::unique_ptr<Renderer> renderer = createHeadlessRenderer(options, 1, 1, headless);
+    if (!renderer) return 1;
+
+    int socket = connectToCoordinator(options.worker);
+    bool ok = socket >= 0;
+    WorkerHello hello = {PROTOCOL_MAGIC, PROTOCOL_VERSION, {0}};
+    char host[32] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    std::snprintf(hello.name, sizeof(hello.name), "%s/%d/%s", host, int(getpid()), renderer->name());
+    MessageHeader header;
+    std::vector<char> payload;
+    ok = ok && sendMessage(socket, MESSAGE_HELLO, &hello, sizeof(hello));
+    ok = ok && receiveMessage(socket, header, payload) && header.type == MESSAGE_SETUP && payload.size() >= sizeof(JobSettings);
+
+    JobSettings settings = {};
+    Scene scene;
+    BVH sphereBVH;
+    std::vector<AABB> sphereBounds;
+    if (ok) {
+        std::memcpy(&settings, payload.data(), sizeof(settings));
+        if (settings.demoScene) scene = createDemoScene();
+        else ok = loadSetupScene(payload, scene, sphereBVH);
+        ok = ok && settings.bounces >= 0;
+        computeSphereBounds(scene.spheres, sphereBounds);
+        if (ok && sphereBVH.nodes.empty()) sphereBVH = buildBVH(sphereBounds);
+        std::cout << "Connected to " << options.worker << " as " << hello.name << std::endl;
+    }
+    // The bounces are fixed when a renderer is created, so one of the same backend is made for the job's
+    RenderOptions job = jobOptions(options, settings);
+    RendererBackend backend;
+    if (ok && job.bounces != options.bounces && parseRendererBackend(renderer->name(), backend)) {
+        renderer = createRenderer(backend, 1, 1, job.threads, job.bounces);
+        if (!renderer) {
+            closeSocket(socket);
+            if (headless.context) destroyHeadlessOpenGL(headless);
+            return 1;
+        }
+    }
+    applyRenderOptions(*renderer, job, settings.samples);
+    Camera camera = {settings.cameraPos, settings.cameraDir, settings.focalLength};
+
+    bool gpuFrames = headless.context && !renderer->hostPixels();
+    TextureReadback readback = {};
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+    SceneChanges changes;       // Objects moved since the last render, the tasks of a job share the scene
+    bool finished = false;
+    while (ok && !finished) {
+        // A cancel can still arrive for the task just finished, it is of no concern any more
+        ok = sendMessage(socket, MESSAGE_REQUEST);
+        do {
+            ok = ok && receiveMessage(socket, header, payload);
+        } while (ok && header.type == MESSAGE_CANCEL);
+        if (!ok) break;
+        if (header.type == MESSAGE_DONE) {
+            finished = true;
+            break;
+        }
+        if (header.type != MESSAGE_TASK || payload.size() != sizeof(TaskMessage)) {
+            ok = false;
+            break;
+        }
+        TaskMessage task;
+        std::memcpy(&task, payload.data(), sizeof(task));
+        auto start = std::chrono::steady_clock::now();
+
+        if (task.width != width || task.height != height) {
+            width = task.width;
+            height = task.height;
+            renderer->resize(width, height);
+            if (gpuFrames) {
+                if (readback.width) deleteTextureReadback(readback);
+                readback = createTextureReadback(width, height);
+            }
+        }
+        renderer->setImageRegion({task.x, task.y, settings.width, settings.height});
+        bool cancelled = false;
+        for (int frame = task.firstFrame; ok && !cancelled && frame < task.firstFrame + task.frameCount; frame++) {
+            // Animated from the frame number like headless rendering, so every worker gets the same frame
+            if (!scene.tracks.empty()) {
+                animateScene(scene, settings.startTime + frame * settings.frameTime, changes);
+                updateSphereBounds(scene.spheres, changes.spheres, sphereBounds);
+                updateBVH(sphereBVH, sphereBounds, changes.spheres);
+            }
+            for (int sample = 0; ok && !cancelled && sample < settings.samples; sample++) {
+                renderer->render(scene, sphereBVH, camera, &changes);
+                changes = SceneChanges();
+                ok = checkCoordinator(socket, task.task, cancelled, finished);
+            }
+            if (!ok || cancelled) break;
+
+            const float* framePixels = renderer->hostPixels();
+            if (gpuFrames) {
+                int readFrame;
+                requestReadback(readback, renderer->outputTexture(), frame);
+                collectReadback(readback, pixels, readFrame, true);
+                framePixels = pixels.data();
+            }
+            ResultHeader result = {task.task, frame};
+            ok = sendMessage(socket, MESSAGE_RESULT, &result, sizeof(result), framePixels, size_t(width) * height * 4 * sizeof(float));
+        }
+        if (finished) break;
+        if (cancelled) {
+            std::cout << "Task " << task.task << " was finished by another worker" << std::endl;
+            continue;
+        }
+        if (!ok) break;
+        std::cout << "Rendered task " << task.task << " (frames " << task.firstFrame << "-" << task.firstFrame + task.frameCount - 1
+                  << ", " << task.width << "x" << task.height << " at " << task.x << "," << task.y << ") in "
+                  << secondsSince(start) * 1000.0 << " ms" << std::endl;
+    }
+    // A send can fail because the coordinator closed the connection right after the job was done
+    while (!finished && socket >= 0 && receiveMessage(socket, header, payload)) finished = header.type == MESSAGE_DONE;
+    if (!finished && socket >= 0) std::cerr << "Lost the connection to the coordinator" << std::endl;
+
+    if (gpuFrames && readback.width) deleteTextureReadback(readback);
+    closeSocket(socket);
+    renderer.reset();
+    if (headless.context) destroyHeadlessOpenGL(headless);
+    return finished ? 0 : 1;
+}
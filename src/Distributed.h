@@ -0,0 +1,21 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "Options.h"
+
+// Times a task is handed out before the coordinator gives up on the job, so a task that takes down every
+// worker that renders it does not take down all of them
+const int MAX_TASK_ATTEMPTS = 3;
+// Seconds a worker keeps trying to reach its coordinator, so the workers may be started first
+const double WORKER_CONNECT_SECONDS = 10.0;
+
+// Function to split a headless job into tasks, tiles of a single frame or ranges of a sequence, hand them to
+// the workers connecting to options.coordinator and write the frames assembled from their results.
+// Returns the process exit code.
+int runCoordinator(const RenderOptions& options);
+
+// Function to render tasks for the coordinator at options.worker until the job is finished, returns the
+// process exit code
+int runWorker(const RenderOptions& options);
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,85 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+
+// Function to copy the objects listed in the changes of an update out of the scene
+void gatherSceneUpdate(const Scene& scene, SceneUpdate& update) {
+    update.spheres.clear();
+    update.lights.clear();
+    update.instances.clear();
+    for (GLuint sphere : update.changes.spheres) update.spheres.push_back(scene.spheres[sphere]);
+    for (GLuint light : update.changes.lights) update.lights.push_back(scene.lights[light]);
+    for (GLuint instance : update.changes.instances) update.instances.push_back(scene.instances[instance]);
+}
+
+// Function to write the objects of an update into a copy of the scene
+void applySceneUpdate(Scene& scene, const SceneUpdate& update) {
+    for (size_t i = 0; i < update.spheres.size(); i++) scene.spheres[update.changes.spheres[i]] = update.spheres[i];
+    for (size_t i = 0; i < update.lights.size(); i++) scene.lights[update.changes.lights[i]] = update.lights[i];
+    for (size_t i = 0; i < update.instances.size(); i++) scene.instances[update.changes.instances[i]] = update.instances[i];
+}
+
+FrameQueue::FrameQueue(int capacity) : capacity(size_t(std::max(capacity, 1))), closed(false) {}
+
+// Function to add a snapshot, blocks while the queue is full
+bool FrameQueue::push(const FrameSnapshot& snapshot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return closed || frames.size() < capacity; });
+    if (closed) return false;
+    frames.push_back(snapshot);
+    changed.notify_all();
+    return true;
+}
+
+// Function to take the oldest snapshot, blocks while the queue is empty
+bool FrameQueue::pop(FrameSnapshot& snapshot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return closed || !frames.empty(); });
+    if (closed) return false;
+    snapshot = frames.front();
+    frames.pop_front();
+    changed.notify_all();
+    return true;
+}
+
+// Function to make every waiting and later push and pop return false
+void FrameQueue::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    // Release the scenes of the frames that will not be drawn
+    frames.clear();
+    changed.notify_all();
+}
+
+// Function to wait for the GPU to finish the frame of a fence and delete the fence
+static void waitForFence(GLsync& fence) {
+    if (!fence) return;
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+// Function to create the fences for a number of frames in flight, clamped to the depth of the ring buffers
+FrameFences createFrameFences(int depth) {
+    FrameFences fences;
+    fences.depth = std::min(std::max(depth, 1), FRAMES_IN_FLIGHT);
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) fences.fences[i] = 0;
+    return fences;
+}
+
+// Function to wait until a frame can start
+void waitForFrameSlot(FrameFences& fences, long frame) {
+    waitForFence(fences.fences[frame % fences.depth]);
+}
+
+// Function to fence a frame after all its commands have been issued
+void fenceFrame(FrameFences& fences, long frame) {
+    GLsync& fence = fences.fences[frame % fences.depth];
+    if (fence) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Function to wait for all frames in flight and delete their fences
+void deleteFrameFences(FrameFences& fences) {
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) waitForFence(fences.fences[i]);
+}
@@ -0,0 +1,85 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include "Animation.h"
+#include "Geometry.h"
+#include "Renderer.h"
+#include "Shader.h"
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Structure for the objects the animation moved in one frame with their new state. The render thread writes them
+// into its own copy of the scene, so the snapshots carry only what moved instead of a copy of the whole scene.
+struct SceneUpdate {
+    SceneChanges changes;
+    std::vector<Sphere> spheres;            // State of every sphere in changes.spheres, in the same order
+    std::vector<Light> lights;
+    std::vector<MeshInstance> instances;
+};
+
+// Function to copy the objects listed in the changes of an update out of the scene
+void gatherSceneUpdate(const Scene& scene, SceneUpdate& update);
+
+// Function to write the objects of an update into a copy of the scene
+void applySceneUpdate(Scene& scene, const SceneUpdate& update);
+
+// Structure for everything the render thread needs to draw one frame, prepared by the simulation thread
+struct FrameSnapshot {
+    long frame;
+    std::shared_ptr<const SceneUpdate> update;  // Objects moved since the previous snapshot, null if none moved
+    Camera camera;
+    int windowWidth;                        // Framebuffer size when the frame was prepared
+    int windowHeight;
+    bool variableRate;
+    double simulateMs;                      // Time the simulation thread spent preparing the frame
+};
+
+// Bounded queue handing snapshots from the simulation thread to the render thread. The capacity is how many
+// frames the simulation may run ahead of the render thread.
+class FrameQueue {
+public:
+    explicit FrameQueue(int capacity);
+
+    // Function to add a snapshot, blocks while the queue is full. Returns false once the queue is closed.
+    bool push(const FrameSnapshot& snapshot);
+
+    // Function to take the oldest snapshot, blocks while the queue is empty. Returns false once the queue is closed.
+    bool pop(FrameSnapshot& snapshot);
+
+    // Function to make every waiting and later push and pop return false
+    void close();
+
+private:
+    FrameQueue(const FrameQueue&);
+    FrameQueue& operator=(const FrameQueue&);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<FrameSnapshot> frames;
+    size_t capacity;
+    bool closed;
+};
+
+// Structure for the fences of the frames the GPU has not finished yet
+struct FrameFences {
+    GLsync fences[FRAMES_IN_FLIGHT];
+    int depth;                              // Frames allowed in flight, 1 to FRAMES_IN_FLIGHT
+};
+
+// Function to create the fences for a number of frames in flight, clamped to the depth of the ring buffers
+FrameFences createFrameFences(int depth);
+
+// Function to wait until a frame can start, which is when the frame depth frames before it has finished on the GPU
+void waitForFrameSlot(FrameFences& fences, long frame);
+
+// Function to fence a frame after all its commands have been issued
+void fenceFrame(FrameFences& fences, long frame);
+
+// Function to wait for all frames in flight and delete their fences
+void deleteFrameFences(FrameFences& fences);
+
+#endif // FRAMEPIPELINE_H
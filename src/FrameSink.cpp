@@ -0,0 +1,159 @@
+#include "FrameSink.h"
+#include "Image.h"
+#include "Options.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+// Function to parse a stream format name (rgb24, yuv420p), returns false for unknown names
+bool parseStreamFormat(const std::string& name, StreamFormat& format) {
+    if (name == "rgb24") format = STREAM_RGB24;
+    else if (name == "yuv420p") format = STREAM_YUV420P;
+    else return false;
+    return true;
+}
+
+// Function to open the target and start the workers
+FrameSink::FrameSink(const FrameSinkTarget& target, int width, int height, int threads)
+    : target(target), width(width), height(height), stream(nullptr), pushed(0), stopping(false), writeFailed(false),
+      nextOrder(0), streamBroken(false), streamBytes(0.0) {
+    if (!target.stream.empty()) {
+        // An encoder that exits early must fail the write instead of raising SIGPIPE
+        std::signal(SIGPIPE, SIG_IGN);
+        if (target.stream == "-") {
+            stream = stdout;
+        } else {
+            struct stat status;
+            if (stat(target.stream.c_str(), &status) == 0 && S_ISFIFO(status.st_mode)) {
+                std::cout << "Waiting for a reader on " << target.stream << std::endl;
+            }
+            stream = std::fopen(target.stream.c_str(), "wb");
+            if (!stream) {
+                std::cerr << "Failed to open " << target.stream << ": " << std::strerror(errno) << std::endl;
+                writeFailed = true;
+                return;
+            }
+        }
+    }
+
+    // Converting a frame takes a fraction of tracing it, a few threads keep up without taking cores from the renderer
+    if (threads <= 0) threads = std::min(std::max(int(std::thread::hardware_concurrency()), 1), 4);
+    for (int i = 0; i < threads; i++) workers.push_back(std::thread(&FrameSink::workerLoop, this));
+}
+
+FrameSink::~FrameSink() {
+    finish();
+}
+
+// Function to hand a frame to the workers, blocks while the queue is full
+bool FrameSink::push(int frame, std::vector<float>& pixels) {
+    // A broken stream ends the sequence, a failed image file only loses that frame
+    std::unique_lock<std::mutex> lock(mutex);
+    queueChanged.wait(lock, [this] { return queue.size() < size_t(FRAME_SINK_QUEUE_FRAMES) || (writeFailed && stream); });
+    if ((writeFailed && stream) || workers.empty()) return false;
+
+    Job job;
+    job.frame = frame;
+    job.order = pushed++;
+    if (!spareBuffers.empty()) {
+        job.pixels.swap(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+    job.pixels.swap(pixels);
+    queue.push_back(std::move(job));
+    queueChanged.notify_all();
+    return true;
+}
+
+// Function to write the remaining frames and close the target
+bool FrameSink::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    if (stream) {
+        bool closed = stream == stdout ? std::fflush(stream) == 0 : std::fclose(stream) == 0;
+        stream = nullptr;
+        if (!closed) {
+            std::cerr << "Failed to close " << target.stream << std::endl;
+            writeFailed = true;
+        } else if (!writeFailed) {
+            std::cout << "Streamed " << pushed << " frames (" << streamBytes / (1024.0 * 1024.0) << " MB) to "
+                      << (target.stream == "-" ? "stdout" : target.stream) << std::endl;
+        }
+    }
+    return !writeFailed;
+}
+
+// Function to check whether opening the target or writing a frame failed
+bool FrameSink::failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writeFailed;
+}
+
+// Function run by every worker: takes frames off the queue until the sink finishes and the queue is empty
+void FrameSink::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this] { return !queue.empty() || stopping; });
+            if (queue.empty()) return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        // Room in the queue for the render thread
+        queueChanged.notify_all();
+
+        bool written = writeJob(job);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        spareBuffers.push_back(std::move(job.pixels));
+        if (!written) {
+            writeFailed = true;
+            queueChanged.notify_all();
+        }
+    }
+}
+
+// Function to convert a frame and write it to its image file, or append it to the stream once the frames before it are
+bool FrameSink::writeJob(const Job& job) {
+    if (!stream) {
+        std::string path = formatOutputPath(target.pattern, job.frame, target.frameCount);
+        if (!writeImage(path, width, height, job.pixels.data())) return false;
+        // One insertion per line, so the lines of different workers do not interleave
+        std::ostringstream line;
+        line << "Wrote " << path << "\n";
+        std::cout << line.str() << std::flush;
+        return true;
+    }
+
+    // The workers convert in parallel and only take turns for the write
+    std::vector<uint8_t> bytes = target.format == STREAM_YUV420P ? convertToYUV420(width, height, job.pixels.data())
+                                                                 : convertToRGB8(width, height, job.pixels.data());
+    std::unique_lock<std::mutex> lock(streamMutex);
+    streamAdvanced.wait(lock, [this, &job] { return nextOrder == job.order; });
+    bool written = false;
+    if (!streamBroken) {
+        written = std::fwrite(bytes.data(), 1, bytes.size(), stream) == bytes.size() && std::fflush(stream) == 0;
+        if (written) {
+            streamBytes += double(bytes.size());
+        } else {
+            std::cerr << "Failed to write frame " << job.frame << " to " << target.stream << ": " << std::strerror(errno) << std::endl;
+            streamBroken = true;
+        }
+    }
+    // A frame that failed still hands the stream on, so no worker waits for it forever
+    nextOrder++;
+    streamAdvanced.notify_all();
+    return written;
+}
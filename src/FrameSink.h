@@ -0,0 +1,88 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames the render thread may hand to the sink before it blocks, on top of the frames the workers hold
+const int FRAME_SINK_QUEUE_FRAMES = 4;
+
+// Enumeration for the pixel formats of raw video streams
+enum StreamFormat {
+    STREAM_RGB24,       // Packed 8-bit RGB, 3 bytes per pixel
+    STREAM_YUV420P      // Planar 8-bit YUV 4:2:0, 1.5 bytes per pixel, what most encoders take directly
+};
+
+// Function to parse a stream format name (rgb24, yuv420p), returns false for unknown names
+bool parseStreamFormat(const std::string& name, StreamFormat& format);
+
+// Structure for where a FrameSink puts the frames
+struct FrameSinkTarget {
+    std::string pattern;    // Image files named by formatOutputPath, used when stream is empty
+    int frameCount;         // Frames of the sequence, for the file names
+    std::string stream;     // "-" for stdout, or a file or named pipe raw frames are written to one after another
+    StreamFormat format;    // Pixel format of the stream
+};
+
+// Writes rendered frames out on worker threads, so the render thread only waits when disk or encoder fall behind.
+// Frames go through a bounded queue to the workers, which convert them from RGBA32F and either write each to its
+// own image file, in any order, or append them to a raw video stream in the order they were pushed.
+class FrameSink {
+public:
+    // Function to open the target and start the workers, 0 threads picks up to 4 by the hardware threads.
+    // Check failed() afterwards.
+    FrameSink(const FrameSinkTarget& target, int width, int height, int threads);
+    ~FrameSink();
+
+    // Function to hand a frame (RGBA32F, bottom row first) to the workers, blocks while the queue is full. The pixels
+    // are swapped with a buffer of an earlier frame, so the caller can reuse them without allocating. Returns false
+    // if the target could not be opened or the stream broke.
+    bool push(int frame, std::vector<float>& pixels);
+
+    // Function to write the remaining frames and close the target. Returns false if any frame could not be written.
+    bool finish();
+
+    // Function to check whether opening the target or writing a frame failed
+    bool failed();
+
+private:
+    FrameSink(const FrameSink&);
+    FrameSink& operator=(const FrameSink&);
+
+    // Structure for a frame waiting for a worker
+    struct Job {
+        int frame;
+        long order;                 // Position in the stream, frames are appended in push order
+        std::vector<float> pixels;
+    };
+
+    void workerLoop();
+    bool writeJob(const Job& job);
+
+    FrameSinkTarget target;
+    int width;
+    int height;
+    std::FILE* stream;              // Open raw video stream, null when writing image files
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;               // Guards the queue, the spare buffers and the flags
+    std::condition_variable queueChanged;
+    std::deque<Job> queue;
+    std::vector<std::vector<float>> spareBuffers;   // Pixels of written frames, handed back to push
+    long pushed;
+    bool stopping;
+    bool writeFailed;
+
+    std::mutex streamMutex;         // Guards the stream and nextOrder
+    std::condition_variable streamAdvanced;
+    long nextOrder;                 // Frame the stream is waiting for
+    bool streamBroken;              // Set once a write failed, later frames are dropped
+    double streamBytes;
+};
+
+#endif // FRAMESINK_H
@@ -1,5 +1,17 @@
 #include "GLUtils.h"
 
+// Keep the X11 headers out, the headless path does not use a window system
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+// Older GLEW releases do not name this status yet
+#ifndef GLEW_ERROR_NO_GLX_DISPLAY
+#define GLEW_ERROR_NO_GLX_DISPLAY 4
+#endif
+
 GLFWwindow* initializeOpenGL(int width, int height, const char* title) {
     // Initialize GLFW
     if (!glfwInit()) {
@@ -39,6 +51,109 @@ GLFWwindow* initializeOpenGL(int width, int height, const char* title) {
     return window;
 }
 
+// Function to create a hidden window whose context shares its objects with the context of a window
+GLFWwindow* createSharedContext(GLFWwindow* window) {
+    // The context hints of initializeOpenGL are still set, so both contexts get the same version
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* shared = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!shared) std::cerr << "Failed to create a shared OpenGL context" << std::endl;
+    return shared;
+}
+
+HeadlessContext initializeHeadlessOpenGL() {
+    HeadlessContext headless = {nullptr, nullptr, nullptr};
+
+    // Prefer the surfaceless platform, which works without a window system or a GPU (e.g. Mesa llvmpipe)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cerr << "Failed to initialize EGL" << std::endl;
+        return headless;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+        eglTerminate(display);
+        return headless;
+    }
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    bool noConfig = extensions && std::strstr(extensions, "EGL_KHR_no_config_context");
+    bool surfaceless = extensions && std::strstr(extensions, "EGL_KHR_surfaceless_context");
+
+    // A config is only needed when the context has to be bound to a pbuffer
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!noConfig || !surfaceless) {
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            std::cerr << "Failed to find an EGL config" << std::endl;
+            eglTerminate(display);
+            return headless;
+        }
+    }
+
+    // Compute shaders need OpenGL 4.3
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an OpenGL 4.3 EGL context" << std::endl;
+        eglTerminate(display);
+        return headless;
+    }
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        const EGLint surfaceAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        std::cerr << "Failed to make the EGL context current" << std::endl;
+        if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return headless;
+    }
+
+    // GLEW looks for a GLX display as well, which does not exist here and is not needed
+    glewExperimental = GL_TRUE;
+    GLenum glewStatus = glewInit();
+    if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return headless;
+    }
+
+    headless.display = display;
+    headless.context = context;
+    headless.surface = surface;
+    return headless;
+}
+
+void destroyHeadlessOpenGL(HeadlessContext headless) {
+    if (!headless.display) return;
+    eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (headless.surface) eglDestroySurface(headless.display, headless.surface);
+    if (headless.context) eglDestroyContext(headless.display, headless.context);
+    eglTerminate(headless.display);
+}
+
 VertexObjects createVertexObjectsForQuad(const GLfloat* vertices, size_t size) {
     VertexObjects vo;
 
@@ -68,23 +183,3 @@ void deleteVertexObjects(VertexObjects vo) {
     glDeleteVertexArrays(1, &vo.VAO);
     glDeleteBuffers(1, &vo.VBO);
 }
-
-double calculateFPS() {
-    static double previousTime = 0.0;
-    static int frameCount = 0;
-    double currentTime = glfwGetTime();  // Get current time in seconds
-    frameCount++;
-
-    // Calculate FPS every second
-    if (currentTime - previousTime >= 1.0) {
-        double fps = double(frameCount) / (currentTime - previousTime);
-
-        // Reset for the next calculation
-        previousTime = currentTime;
-        frameCount = 0;
-
-        return fps;  // Return the calculated FPS
-    }
-
-    return -1.0;  // Return -1 if it's not time to update FPS yet
-}
\ No newline at end of file
@@ -14,16 +14,30 @@
 // #include <glm/gtc/matrix_transform.hpp>
 // #include <glm/gtc/type_ptr.hpp>
 
+// Structure for an offscreen OpenGL context without a window (EGL handles, kept opaque here)
+struct HeadlessContext {
+    void* display;
+    void* context;
+    void* surface;
+};
+
 // Function to initialize GLFW, create a window, and initialize GLEW
 GLFWwindow* initializeOpenGL(int width, int height, const char* title);
 
+// Function to create a hidden window whose context shares its objects with the context of a window, so a
+// background thread can compile programs for it. Call on the main thread, returns nullptr on failure.
+GLFWwindow* createSharedContext(GLFWwindow* window);
+
+// Function to create a surfaceless EGL context, make it current and initialize GLEW
+HeadlessContext initializeHeadlessOpenGL();
+
+// Function to release a headless context
+void destroyHeadlessOpenGL(HeadlessContext headless);
+
 // Function to create a Vertex Array Object and a Vertex Buffer Object for the screen-filling quad
 VertexObjects createVertexObjectsForQuad(const GLfloat* vertices, size_t size);
 
 // Function to delete a Vertex Array Object and a Vertex Buffer Object
 void deleteVertexObjects(VertexObjects vo);
 
-// Function to calculate the frames per second
-double calculateFPS();
-
 #endif // GLUTILS_H
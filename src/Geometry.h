@@ -2,7 +2,9 @@
 #define GEOMETRY_H
 
 #include <GL/glew.h>
+#include <cstddef>
 #include <glm/glm.hpp>
+#include <vector>
 
 // Structure to store vertex array object and vertex buffer object
 struct VertexObjects {
@@ -42,6 +44,134 @@ struct Light {
     Light(const glm::vec3& p, const glm::vec3& c) : position(p), color(c) {}
 };
 
+// The structs above are stored byte for byte in binary scene files, and the lights are copied into a std430
+// shader storage block, so their layout must not change. The scene buffer splits spheres and planes into the
+// hot arrays the shaders read and a material table.
+static_assert(sizeof(glm::vec3) == 12, "glm::vec3 must be tightly packed");
+
+static_assert(sizeof(Plane) == 48, "Plane does not match the std430 layout");
+static_assert(offsetof(Plane, point) == 0, "Plane::point does not match the std430 layout");
+static_assert(offsetof(Plane, normal) == 16, "Plane::normal does not match the std430 layout");
+static_assert(offsetof(Plane, color) == 32, "Plane::color does not match the std430 layout");
+static_assert(offsetof(Plane, reflectivity) == 44, "Plane::reflectivity does not match the std430 layout");
+
+static_assert(sizeof(Sphere) == 32, "Sphere does not match the std430 layout");
+static_assert(offsetof(Sphere, center) == 0, "Sphere::center does not match the std430 layout");
+static_assert(offsetof(Sphere, radius) == 12, "Sphere::radius does not match the std430 layout");
+static_assert(offsetof(Sphere, color) == 16, "Sphere::color does not match the std430 layout");
+static_assert(offsetof(Sphere, reflectivity) == 28, "Sphere::reflectivity does not match the std430 layout");
+
+static_assert(sizeof(Light) == 32, "Light does not match the std430 layout");
+static_assert(offsetof(Light, position) == 0, "Light::position does not match the std430 layout");
+static_assert(offsetof(Light, color) == 16, "Light::color does not match the std430 layout");
+
+// Node of the flattened BVH. Nodes are stored depth-first, so the left child of an
+// inner node always directly follows it and only the right child index is stored.
+struct BVHNode {
+    glm::vec3 boundsMin;
+    GLuint rightOrFirst;    // Right child for inner nodes, first entry in primIndices for leaves
+    glm::vec3 boundsMax;
+    GLuint count;           // Number of primitives in a leaf, 0 for inner nodes
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode does not match the std430 layout");
+static_assert(offsetof(BVHNode, rightOrFirst) == 12, "BVHNode::rightOrFirst does not match the std430 layout");
+static_assert(offsetof(BVHNode, boundsMax) == 16, "BVHNode::boundsMax does not match the std430 layout");
+static_assert(offsetof(BVHNode, count) == 28, "BVHNode::count does not match the std430 layout");
+
+// Structure for a compressed triangle mesh inside the mesh arrays of a scene, shared by all of its instances.
+// Vertices are stored as 16-bit coordinates on a grid over the mesh bounds, two words per vertex, and the
+// triangles are reordered so that every leaf of the mesh BVH covers a contiguous run of them.
+struct MeshInfo {
+    glm::vec3 quantizationOrigin;   // Corner of the vertex grid
+    GLuint nodeOffset;              // Root of the mesh BVH in Scene::meshNodes
+    glm::vec3 quantizationStep;     // Size of one grid step along each axis
+    GLuint vertexOffset;            // First word of the vertices in Scene::meshWords
+    GLuint indexOffset;             // First word of the vertex indices in Scene::meshWords
+    GLuint triangleCount;
+    GLuint vertexCount;
+    GLuint shortIndices;            // 1 if two 16-bit indices are packed into every word
+};
+
+// Structure for a placed copy of a mesh. Only the transform and material are stored per instance.
+struct MeshInstance {
+    glm::vec4 objectToWorld[3];     // Rows of the affine transform from mesh to world space
+    glm::vec4 worldToObject[3];     // Rows of its inverse
+    glm::vec3 color;
+    float reflectivity;
+    GLuint mesh;
+    GLuint pad1 = 0;
+    GLuint pad2 = 0;
+    GLuint pad3 = 0;
+
+    MeshInstance(GLuint m, const glm::mat4& transform, const glm::vec3& c, const float r) : color(c), reflectivity(r), mesh(m) {
+        glm::mat4 inverse = glm::inverse(transform);
+        for (int row = 0; row < 3; row++) {
+            objectToWorld[row] = glm::vec4(transform[0][row], transform[1][row], transform[2][row], transform[3][row]);
+            worldToObject[row] = glm::vec4(inverse[0][row], inverse[1][row], inverse[2][row], inverse[3][row]);
+        }
+    }
+};
+
+static_assert(sizeof(MeshInfo) == 48, "MeshInfo does not match the std430 layout");
+static_assert(offsetof(MeshInfo, quantizationStep) == 16, "MeshInfo::quantizationStep does not match the std430 layout");
+static_assert(offsetof(MeshInfo, indexOffset) == 32, "MeshInfo::indexOffset does not match the std430 layout");
+
+static_assert(sizeof(MeshInstance) == 128, "MeshInstance does not match the std430 layout");
+static_assert(offsetof(MeshInstance, worldToObject) == 48, "MeshInstance::worldToObject does not match the std430 layout");
+static_assert(offsetof(MeshInstance, color) == 96, "MeshInstance::color does not match the std430 layout");
+static_assert(offsetof(MeshInstance, mesh) == 112, "MeshInstance::mesh does not match the std430 layout");
+
+// Kinds of objects an animation track moves
+const GLuint TRACK_SPHERE = 0;      // Moves the center of a sphere
+const GLuint TRACK_LIGHT = 1;       // Moves the position of a light
+const GLuint TRACK_INSTANCE = 2;    // Moves the translation of a mesh instance, keeping its rotation and scale
+
+// Keyframe of an animation track: the position of its object at a time in seconds
+struct TrackKey {
+    float time;
+    glm::vec3 position;
+
+    TrackKey(const float t, const glm::vec3& p) : time(t), position(p) {}
+};
+
+// Structure for the track of one animated object. Its position at a time is interpolated linearly between
+// the keys of the track, held before the first and after the last key, plus a procedural sine wave
+// amplitude * sin(frequency * time + phase) per axis. See Animation.h.
+struct AnimationTrack {
+    GLuint target;          // TRACK_SPHERE, TRACK_LIGHT or TRACK_INSTANCE
+    GLuint object;          // Index of the object in its array of the scene
+    GLuint firstKey;        // First key of the track in Scene::trackKeys, the keys are sorted by time
+    GLuint keyCount;
+    glm::vec3 amplitude;
+    float pad1 = 0.0f;
+    glm::vec3 frequency;    // Angular frequency in radians per second
+    float pad2 = 0.0f;
+    glm::vec3 phase;
+    float pad3 = 0.0f;
+
+    AnimationTrack(GLuint t, GLuint o) : target(t), object(o), firstKey(0), keyCount(0), amplitude(0.0f), frequency(0.0f), phase(0.0f) {}
+};
+
+// Tracks and keys are stored byte for byte in binary scene files too
+static_assert(sizeof(TrackKey) == 16, "TrackKey must not change its layout");
+static_assert(sizeof(AnimationTrack) == 64, "AnimationTrack must not change its layout");
+static_assert(offsetof(AnimationTrack, amplitude) == 16, "AnimationTrack::amplitude must not change its offset");
+static_assert(offsetof(AnimationTrack, phase) == 48, "AnimationTrack::phase must not change its offset");
+
+// Structure to hold all objects of a scene
+struct Scene {
+    std::vector<Sphere> spheres;
+    std::vector<Plane> planes;
+    std::vector<Light> lights;
+    std::vector<MeshInfo> meshes;       // Added with addMesh in Mesh.h
+    std::vector<BVHNode> meshNodes;     // BVHs of all meshes, leaves index the triangles of their own mesh
+    std::vector<GLuint> meshWords;      // Quantized vertices and packed indices of all meshes
+    std::vector<MeshInstance> instances;
+    std::vector<AnimationTrack> tracks; // Added with addTrack in Animation.h, a scene without tracks is static
+    std::vector<TrackKey> trackKeys;    // Keys of all tracks
+};
+
 //Structure for FreeType character
 struct Character {
     GLuint textureID;   // ID handle of the glyph texture
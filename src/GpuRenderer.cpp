@@ -0,0 +1,195 @@
+#include "GpuRenderer.h"
+#include "Shader.h"
+#include "Workgroups.h"
+
+#include <string>
+
+// Function to load the general variant of the compute shader with the workgroup layout of the device and create
+// the output and accumulation textures, check valid() afterwards. The general variant handles any scene, so it
+// is kept as the fallback.
+GpuRenderer::GpuRenderer(int width, int height)
+    : width(width), height(height), computeProgram(0), texture(0), accumulationTexture(0), rayCounterBuffer(0) {
+    variants.path = std::string(SHADER_DIR) + "/raytracing.comp";
+    denoiser = createDenoiser();
+    sceneVariant = {-1, -1, -1, {0, 0, false}, false, OUTPUT_RGBA32F, false, false, false};
+    workgroup = loadWorkgroupLayout();
+    bool tuned = workgroup.sizeX != DEFAULT_WORKGROUP_LAYOUT.sizeX || workgroup.sizeY != DEFAULT_WORKGROUP_LAYOUT.sizeY
+                 || workgroup.morton != DEFAULT_WORKGROUP_LAYOUT.morton;
+    if (!selectVariant(sceneVariant) && tuned) {
+        // A stored layout that fails to compile falls back to the shape the shader was written for
+        workgroup = DEFAULT_WORKGROUP_LAYOUT;
+        selectVariant(sceneVariant);
+    }
+    if (!computeProgram) return;
+
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    accumulationTexture = createTexture(width, height);
+    frameUniforms = createFrameUniformRing();
+    // Start small, the scene buffer grows to fit the first scene it is given
+    sceneBuffer = createSceneBuffer(1, 1, 1);
+}
+
+GpuRenderer::~GpuRenderer() {
+    if (!computeProgram) return;
+
+    deleteSceneBuffer(sceneBuffer);
+    deleteShaderVariants(variants);
+    deleteFrameUniformRing(frameUniforms);
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &accumulationTexture);
+    if (rayCounterBuffer) glDeleteBuffers(1, &rayCounterBuffer);
+    deleteDenoiser(denoiser);
+}
+
+// Function to reallocate the output and accumulation textures for a new size
+void GpuRenderer::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &accumulationTexture);
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    accumulationTexture = createTexture(width, height);
+    resetAccumulation();
+}
+
+// Function to switch the format of the output texture, the compute shader writes it in that format
+void GpuRenderer::setOutputFormat(OutputFormat format) {
+    if (format == textureFormat) return;
+    OutputFormat previous = textureFormat;
+    textureFormat = format;
+    if (!selectVariant(sceneVariant)) {
+        textureFormat = previous;
+        return;
+    }
+    glDeleteTextures(1, &texture);
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    // The new texture is empty, so even a converged image has to be traced again
+    resetAccumulation();
+}
+
+// Function to get the bytes of the output and accumulation textures and the images of the denoiser
+size_t GpuRenderer::imageBytes() const {
+    return size_t(width) * height * (outputFormatBytes(textureFormat) + 16) + denoiserImageBytes(denoiser);
+}
+
+// Function to switch to the program of a variant with the current workgroup layout, compiling it on first use.
+// Keeps the current program and returns false if the variant does not compile.
+bool GpuRenderer::selectVariant(const ShaderVariant& variant) {
+    ShaderVariant laidOut = variant;
+    laidOut.workgroup = workgroup;
+    laidOut.variableRate = variableRate;
+    laidOut.output = textureFormat;
+    laidOut.quantized = quantizedScene;
+    // A variable rate invocation traces the periphery and the centre on different paths, so it cannot join packets
+    laidOut.packets = packetTracing && !variableRate;
+    laidOut.denoise = denoising;
+    std::string defines = shaderVariantDefines(laidOut);
+    if (computeProgram && defines == variantDefines) return true;
+    GLuint program = getShaderVariant(variants, defines);
+    if (!program) return false;
+
+    computeProgram = program;
+    variantDefines = defines;
+    return true;
+}
+
+// Function to list the variants of raytracing.comp and of the denoiser compiled so far
+void GpuRenderer::listShaderVariants(std::vector<ShaderVariantProgram>& list) const {
+    ::listShaderVariants(variants, list);
+    ::listShaderVariants(denoiser.variants, list);
+}
+
+// Function to switch to programs rebuilt for the listed variants, deleting the ones they replace
+void GpuRenderer::replaceShaderVariants(const std::vector<ShaderVariantProgram>& rebuilt) {
+    for (const ShaderVariantProgram& variant : rebuilt) {
+        // The denoiser looks its program up in the cache every frame
+        GLuint denoiseProgram = 0;
+        if (!replaceShaderVariant(variants, variant, computeProgram)
+            && !replaceShaderVariant(denoiser.variants, variant, denoiseProgram)) glDeleteProgram(variant.program);
+    }
+    resetAccumulation();
+}
+
+// Function to switch the workgroup shape and pixel order of the compute shader, compiling it if needed
+bool GpuRenderer::setWorkgroupLayout(const WorkgroupLayout& layout) {
+    WorkgroupLayout previous = workgroup;
+    workgroup = layout;
+    if (selectVariant(sceneVariant)) return true;
+    workgroup = previous;
+    return false;
+}
+
+// Function to upload the changed parts of the scene and trace the next sample into the output texture
+void GpuRenderer::render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) {
+    {
+        ScopedTimer timer(profiler, "upload", true);
+        setSceneBufferQuantization(sceneBuffer, quantizedScene);
+        updateSceneBuffer(sceneBuffer, scene, sphereBVH, changes);
+        countProfilerBytes(profiler, "upload", double(sceneBuffer.bytesUploaded));
+    }
+    setProfilerMemory(profiler, double(imageBytes()));
+    // The compute shader follows at most one reflection
+    if (sceneBuffer.changed) sceneVariant = sceneShaderVariant(scene, 1);
+    // Also picks up a change of the variable rate, quantization, packet tracing or denoising since the last frame
+    selectVariant(sceneVariant);
+
+    // A converged image stays in the output texture, so a static view costs no GPU time
+    int sampleIndex = beginSample(camera, sceneBuffer.changed);
+    if (sampleIndex >= 0) {
+        FrameUniforms uniforms = {};
+        setComputeShaderUniforms(uniforms, width, height, camera.position, camera.direction, camera.focalLength);
+        setSceneBufferUniforms(uniforms, sceneBuffer);
+        setSampleUniforms(uniforms, sampleIndex, sampleJitter(sampleIndex));
+        setRayCountingUniform(uniforms, countRays);
+        setShadowRayUniform(uniforms, shadowRays);
+        ImageRegion traced = imageRegion(width, height);
+        setImageRegionUniforms(uniforms, traced.x, traced.y, traced.imageWidth, traced.imageHeight);
+        uploadFrameUniforms(frameUniforms, uniforms);
+        if (countRays) beginGpuRayCount(rayCounterBuffer);
+        {
+            ScopedTimer timer(profiler, "trace", true);
+            // The variable rate shader traces a 2x2 pixel block per invocation
+            int groupWidth = variableRate ? (width + 1) / 2 : width;
+            int groupHeight = variableRate ? (height + 1) / 2 : height;
+            if (denoising) bindDenoiserFeatures(denoiser, width, height);
+            dispatchComputeShader(computeProgram, texture, accumulationTexture, groupWidth, groupHeight, workgroup, textureFormat);
+            countProfilerBytes(profiler, "trace", sampleImageTraffic(width, height, textureFormat, sampleIndex));
+        }
+        if (denoising) {
+            ScopedTimer timer(profiler, "denoise", true);
+            runDenoiser(denoiser, accumulationTexture, texture, textureFormat);
+            countProfilerBytes(profiler, "denoise", denoiserImageTraffic(width, height, textureFormat));
+        }
+        fenceFrameUniforms(frameUniforms);
+        if (countRays) lastRayCounts = endGpuRayCount(rayCounterBuffer);
+    } else {
+        lastRayCounts = {0, 0, 0};
+    }
+    fenceSceneBuffer(sceneBuffer);
+}
+
+// Function to clear the ray counters of the compute shaders and bind them, creating the buffer on first use
+void beginGpuRayCount(GLuint& rayCounterBuffer) {
+    GLuint zeros[3] = {0, 0, 0};
+    if (!rayCounterBuffer) {
+        glGenBuffers(1, &rayCounterBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCounterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_READ);
+    } else {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCounterBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, rayCounterBuffer);
+}
+
+// Function to read the ray counters back, waits for the dispatches to finish
+RayCounts endGpuRayCount(GLuint rayCounterBuffer) {
+    GLuint counts[3];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayCounterBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    RayCounts rayCounts = {counts[0], counts[1], counts[2]};
+    return rayCounts;
+}
@@ -0,0 +1,64 @@
+#ifndef GPURENDERER_H
+#define GPURENDERER_H
+
+#include "Denoiser.h"
+#include "Renderer.h"
+#include "SceneBuffer.h"
+#include "Shader.h"
+
+#include <string>
+#include <vector>
+
+// Renderer that traces the scene with the raytracing.comp compute shader
+class GpuRenderer : public Renderer {
+public:
+    // Function to load the general variant of the compute shader with the workgroup layout of the device
+    // and create the output texture, check valid() afterwards
+    GpuRenderer(int width, int height);
+    ~GpuRenderer();
+
+    // Function to check whether the compute shader could be loaded
+    bool valid() const { return computeProgram != 0; }
+
+    const char* name() const override { return "gpu"; }
+    void resize(int width, int height) override;
+    void render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) override;
+    GLuint outputTexture() override { return texture; }
+    void setOutputFormat(OutputFormat format) override;
+    size_t imageBytes() const override;
+    size_t sceneBytesUploaded() const override { return sceneBuffer.bytesUploaded; }
+    void listShaderVariants(std::vector<ShaderVariantProgram>& variants) const override;
+    void replaceShaderVariants(const std::vector<ShaderVariantProgram>& rebuilt) override;
+
+    // Function to switch the workgroup shape and pixel order of the compute shader, compiling it if needed.
+    // Keeps the current layout and returns false if the variant does not compile.
+    bool setWorkgroupLayout(const WorkgroupLayout& layout);
+
+    // Function to get the workgroup layout the compute shader runs with
+    const WorkgroupLayout& workgroupLayout() const { return workgroup; }
+
+private:
+    bool selectVariant(const ShaderVariant& variant);
+
+    int width;
+    int height;
+    ShaderVariantCache variants;    // Variants of raytracing.comp compiled for the scenes so far
+    ShaderVariant sceneVariant;     // Variant the current scene needs, without the workgroup layout and output format
+    WorkgroupLayout workgroup;      // Drives both the variant's local size and the dispatch size
+    std::string variantDefines;     // Defines of the current variant
+    GLuint computeProgram;          // Program of the current variant
+    GLuint texture;
+    GLuint accumulationTexture;     // Running mean of the samples since the last reset
+    FrameUniformRing frameUniforms; // FrameData blocks of the compute shader, one per frame in flight
+    SceneBuffer sceneBuffer;
+    GLuint rayCounterBuffer;        // Created when ray counting is first enabled
+    Denoiser denoiser;              // Images created when denoising is first enabled
+};
+
+// Function to clear the ray counters of the compute shaders and bind them, creating the buffer on first use
+void beginGpuRayCount(GLuint& rayCounterBuffer);
+
+// Function to read the ray counters back, waits for the dispatches to finish
+RayCounts endGpuRayCount(GLuint rayCounterBuffer);
+
+#endif // GPURENDERER_H
@@ -0,0 +1,141 @@
+#include "Headless.h"
+#include "Animation.h"
+#include "FrameSink.h"
+#include "BVH.h"
+#include "GLUtils.h"
+#include "Profiler.h"
+#include "Readback.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "Scenes.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Function to create a renderer without a window, in an offscreen GL context unless the backend is the CPU
+std::unique_ptr<Renderer> createHeadlessRenderer(const RenderOptions& options, int width, int height, HeadlessContext& headless) {
+    // The CPU backend needs no GL context at all, so only give up without one if a GPU backend was requested
+    headless = {nullptr, nullptr, nullptr};
+    RendererBackend backend = options.backend;
+    if (backend != BACKEND_CPU) {
+        headless = initializeHeadlessOpenGL();
+        if (!headless.context) {
+            if (backend != BACKEND_AUTO) return nullptr;
+            std::cerr << "Falling back to the CPU backend" << std::endl;
+            backend = BACKEND_CPU;
+        }
+    }
+
+    std::unique_ptr<Renderer> renderer = createRenderer(backend, width, height, options.threads, options.bounces);
+    if (!renderer && headless.context) {
+        destroyHeadlessOpenGL(headless);
+        headless = {nullptr, nullptr, nullptr};
+    }
+    return renderer;
+}
+
+// Function to apply the tracing options of the command line or of a distributed job to a renderer
+void applyRenderOptions(Renderer& renderer, const RenderOptions& options, int maxSamples) {
+    renderer.setMaxSamples(maxSamples);
+    renderer.setVariableRate(options.variableRate);
+    renderer.setSceneQuantization(options.quantizeScene);
+    renderer.setPacketTracing(options.packetTracing);
+    renderer.setDenoising(options.denoise);
+    renderer.setShadowRays(options.shadowRays);
+    renderer.setOutputFormat(options.outputFormat);
+}
+
+// Function to hand the oldest pending frame to the sink. Returns false if no frame was ready.
+static bool writeNextFrame(TextureReadback& readback, std::vector<float>& pixels, FrameSink& sink, bool wait, bool& ok) {
+    int frame;
+    if (!collectReadback(readback, pixels, frame, wait)) return false;
+
+    if (!sink.push(frame, pixels)) ok = false;
+    return true;
+}
+
+// Function to render a sequence of frames offscreen and write them to disk, returns the process exit code
+int runHeadless(const RenderOptions& options) {
+    // Raw frames on stdout leave the console messages to stderr
+    if (options.stream == "-") std::cout.rdbuf(std::cerr.rdbuf());
+
+    // The demo scene and scene files with tracks are animated
+    Scene scene;
+    BVH sphereBVH;
+    if (options.scene.empty()) scene = createDemoScene();
+    else if (!loadScene(options.scene, scene, sphereBVH)) return -1;
+    bool animated = !scene.tracks.empty();
+    std::vector<AABB> sphereBounds;
+    computeSphereBounds(scene.spheres, sphereBounds);
+    if (sphereBVH.nodes.empty()) sphereBVH = buildBVH(sphereBounds);
+
+    HeadlessContext headless;
+    std::unique_ptr<Renderer> renderer = createHeadlessRenderer(options, options.width, options.height, headless);
+    if (!renderer) return -1;
+    std::cout << "Rendering with the " << renderer->name() << " backend" << std::endl;
+    int samples = options.samples > 0 ? options.samples : 1;
+    applyRenderOptions(*renderer, options, samples);
+    Profiler profiler = createProfiler(headless.context != nullptr, !options.profile.empty() || !options.trace.empty());
+    renderer->setProfiler(&profiler);
+
+    Camera camera = {options.cameraPos, options.cameraDir, options.focalLength};
+
+    // Frames rendered on the host are copied to the sink directly, GPU frames go through the readback ring first.
+    // The sink converts and writes them on its own threads, so the loop only waits when those fall behind.
+    TextureReadback readback = {};
+    bool gpuFrames = headless.context && !renderer->hostPixels();
+    if (gpuFrames) readback = createTextureReadback(options.width, options.height);
+    std::vector<float> pixels;
+    FrameSinkTarget target = {options.output, options.frames, options.stream, options.streamFormat};
+    FrameSink sink(target, options.width, options.height, options.outputThreads);
+
+    bool ok = !sink.failed();
+    SceneChanges changes;
+    for (int frame = 0; ok && frame < options.frames; frame++) {
+        beginProfilerFrame(profiler);
+        // Animate from the frame number instead of the wall clock, so every run gives the same images
+        double time = options.startTime + frame * options.frameTime;
+        if (animated) {
+            ScopedTimer timer(&profiler, "animate");
+            // Only the spheres that moved get new bounds and refit their BVH nodes
+            animateScene(scene, time, changes);
+            updateSphereBounds(scene.spheres, changes.spheres, sphereBounds);
+            updateBVH(sphereBVH, sphereBounds, changes.spheres);
+        }
+        // The first render updates the moved objects and starts a new image, the others add jittered samples to it
+        for (int sample = 0; sample < samples; sample++) {
+            renderer->render(scene, sphereBVH, camera, &changes);
+            changes = SceneChanges();
+        }
+
+        ScopedTimer timer(&profiler, "output", true);
+        if (!gpuFrames) {
+            const float* hostPixels = renderer->hostPixels();
+            pixels.assign(hostPixels, hostPixels + size_t(options.width) * options.height * 4);
+            if (!sink.push(frame, pixels)) ok = false;
+        } else {
+            // Only block on the oldest frame when every readback buffer is in use
+            if (readback.pending == READBACK_BUFFERS) writeNextFrame(readback, pixels, sink, true, ok);
+            requestReadback(readback, renderer->outputTexture(), frame);
+            // The texture is read and converted to RGBA32F in the pixel pack buffer
+            countProfilerBytes(&profiler, "output", double(options.width) * options.height * (outputFormatBytes(renderer->outputFormat()) + 16));
+            while (writeNextFrame(readback, pixels, sink, false, ok)) {}
+        }
+    }
+
+    // Cleanup
+    if (gpuFrames) {
+        while (readback.pending > 0) writeNextFrame(readback, pixels, sink, true, ok);
+        deleteTextureReadback(readback);
+    }
+    ok = sink.finish() && ok;
+    finishProfiler(profiler);
+    std::cout << formatProfilerSummary(profiler) << std::endl;
+    if (!options.profile.empty()) ok = writeProfile(profiler, options.profile) && ok;
+    if (!options.trace.empty()) ok = writeChromeTrace(profiler, options.trace) && ok;
+    deleteProfiler(profiler);
+    renderer.reset();
+    if (headless.context) destroyHeadlessOpenGL(headless);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "GLUtils.h"
+#include "Options.h"
+#include "Renderer.h"
+
+#include <memory>
+
+// Function to create a renderer of options.backend without a window, in an offscreen GL context it opens in headless
+// unless the backend is the CPU. BACKEND_AUTO falls back to the CPU backend without a context. Returns null on
+// failure, with no context left open.
+std::unique_ptr<Renderer> createHeadlessRenderer(const RenderOptions& options, int width, int height, HeadlessContext& headless);
+
+// Function to apply the tracing options of the command line or of a distributed job to a renderer
+void applyRenderOptions(Renderer& renderer, const RenderOptions& options, int maxSamples);
+
+// Function to render a sequence of frames offscreen and write them to disk, returns the process exit code
+int runHeadless(const RenderOptions& options);
+
+#endif // HEADLESS_H
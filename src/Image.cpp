@@ -0,0 +1,264 @@
+#include "Image.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Function to convert a linear float channel to 8 bits, the same mapping the window output uses
+static uint8_t toByte(float value) {
+    return uint8_t(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Function to convert an RGBA float image (bottom row first) to 8-bit RGB rows, top row first
+std::vector<uint8_t> convertToRGB8(int width, int height, const float* pixels) {
+    std::vector<uint8_t> rgb(size_t(width) * height * 3);
+    for (int y = 0; y < height; y++) {
+        const float* row = pixels + size_t(height - 1 - y) * width * 4;
+        uint8_t* out = &rgb[size_t(y) * width * 3];
+        for (int x = 0; x < width; x++) {
+            out[3 * x + 0] = toByte(row[4 * x + 0]);
+            out[3 * x + 1] = toByte(row[4 * x + 1]);
+            out[3 * x + 2] = toByte(row[4 * x + 2]);
+        }
+    }
+    return rgb;
+}
+
+// Function to convert an RGBA float image (bottom row first) to planar 8-bit YUV 4:2:0, top row first
+std::vector<uint8_t> convertToYUV420(int width, int height, const float* pixels) {
+    std::vector<uint8_t> rgb = convertToRGB8(width, height, pixels);
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    std::vector<uint8_t> yuv(size_t(width) * height + 2 * size_t(chromaWidth) * chromaHeight);
+    uint8_t* lumaPlane = yuv.data();
+    uint8_t* uPlane = lumaPlane + size_t(width) * height;
+    uint8_t* vPlane = uPlane + size_t(chromaWidth) * chromaHeight;
+
+    // BT.601 in limited range, which is what ffmpeg assumes for untagged raw video and uses to convert rgb24 itself
+    for (size_t i = 0; i < size_t(width) * height; i++) {
+        float r = rgb[3 * i + 0], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        lumaPlane[i] = uint8_t(16.0f + (65.481f * r + 128.553f * g + 24.966f * b) / 255.0f + 0.5f);
+    }
+    // Every chroma sample averages a 2x2 block, the last column and row repeat on odd sizes
+    for (int y = 0; y < chromaHeight; y++) {
+        for (int x = 0; x < chromaWidth; x++) {
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const uint8_t* pixel = &rgb[3 * (size_t(std::min(2 * y + dy, height - 1)) * width + std::min(2 * x + dx, width - 1))];
+                    r += pixel[0];
+                    g += pixel[1];
+                    b += pixel[2];
+                }
+            }
+            r /= 4.0f * 255.0f;
+            g /= 4.0f * 255.0f;
+            b /= 4.0f * 255.0f;
+            size_t index = size_t(y) * chromaWidth + x;
+            uPlane[index] = uint8_t(128.0f - 37.797f * r - 74.203f * g + 112.0f * b + 0.5f);
+            vPlane[index] = uint8_t(128.0f + 112.0f * r - 93.786f * g - 18.214f * b + 0.5f);
+        }
+    }
+    return yuv;
+}
+
+// Function to append little-endian integers to a byte buffer
+static void putLE32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+static void putLE64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+// Function to append a big-endian integer to a byte buffer
+static void putBE32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 3; i >= 0; i--) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+// Function to compute the CRC-32 used by PNG chunks
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    // Local statics are initialized once even if several frame sink threads get here at the same time
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+// Function to append a PNG chunk with its length and CRC
+static void putPNGChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    putBE32(out, uint32_t(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBE32(out, crc32(&out[start], out.size() - start));
+}
+
+// Function to write a finished byte buffer to disk
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open image file: " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return file.good();
+}
+
+// Function to write an RGBA float image (bottom row first, as read back from GL) to a PPM file
+bool writePPM(const std::string& path, int width, int height, const float* pixels) {
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    std::vector<uint8_t> bytes(header.begin(), header.end());
+    std::vector<uint8_t> rgb = convertToRGB8(width, height, pixels);
+    bytes.insert(bytes.end(), rgb.begin(), rgb.end());
+    return writeFile(path, bytes);
+}
+
+// Function to write an RGBA float image (bottom row first) to an 8-bit RGB PNG file
+bool writePNG(const std::string& path, int width, int height, const float* pixels) {
+    std::vector<uint8_t> rgb = convertToRGB8(width, height, pixels);
+
+    // Raw scanlines, each prefixed with filter type 0 (none)
+    size_t rowSize = size_t(width) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * rowSize, rgb.begin() + (y + 1) * rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks, so no compression library is needed
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    size_t offset = 0;
+    do {
+        size_t blockSize = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(uint8_t(blockSize));
+        zlib.push_back(uint8_t(blockSize >> 8));
+        zlib.push_back(uint8_t(~blockSize));
+        zlib.push_back(uint8_t(~blockSize >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBE32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    putBE32(header, uint32_t(width));
+    putBE32(header, uint32_t(height));
+    header.push_back(8);    // Bit depth
+    header.push_back(2);    // Colour type RGB
+    header.push_back(0);    // Compression method
+    header.push_back(0);    // Filter method
+    header.push_back(0);    // No interlacing
+
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> bytes(signature, signature + 8);
+    putPNGChunk(bytes, "IHDR", header);
+    putPNGChunk(bytes, "IDAT", zlib);
+    putPNGChunk(bytes, "IEND", std::vector<uint8_t>());
+    return writeFile(path, bytes);
+}
+
+// Function to append an OpenEXR header attribute
+static void putEXRAttribute(std::vector<uint8_t>& out, const std::string& name, const std::string& type, const std::vector<uint8_t>& value) {
+    out.insert(out.end(), name.begin(), name.end());
+    out.push_back(0);
+    out.insert(out.end(), type.begin(), type.end());
+    out.push_back(0);
+    putLE32(out, uint32_t(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+// Function to write an RGBA float image (bottom row first) to an uncompressed 32-bit float OpenEXR file
+bool writeEXR(const std::string& path, int width, int height, const float* pixels) {
+    // Channels must be listed in alphabetical order
+    const char* channelNames[3] = {"B", "G", "R"};
+    const int channelOffsets[3] = {2, 1, 0};
+
+    std::vector<uint8_t> channels;
+    for (int c = 0; c < 3; c++) {
+        channels.push_back(uint8_t(channelNames[c][0]));
+        channels.push_back(0);
+        putLE32(channels, 2);   // Pixel type FLOAT
+        putLE32(channels, 0);   // pLinear and reserved bytes
+        putLE32(channels, 1);   // x sampling
+        putLE32(channels, 1);   // y sampling
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    putLE32(window, 0);
+    putLE32(window, 0);
+    putLE32(window, uint32_t(width - 1));
+    putLE32(window, uint32_t(height - 1));
+
+    const float one = 1.0f;
+    const float zero[2] = {0.0f, 0.0f};
+    const uint8_t* oneBytes = reinterpret_cast<const uint8_t*>(&one);
+    const uint8_t* zeroBytes = reinterpret_cast<const uint8_t*>(zero);
+
+    std::vector<uint8_t> bytes;
+    putLE32(bytes, 20000630);   // Magic number
+    putLE32(bytes, 2);          // Version 2, single-part scanline file
+    putEXRAttribute(bytes, "channels", "chlist", channels);
+    putEXRAttribute(bytes, "compression", "compression", std::vector<uint8_t>(1, 0));
+    putEXRAttribute(bytes, "dataWindow", "box2i", window);
+    putEXRAttribute(bytes, "displayWindow", "box2i", window);
+    putEXRAttribute(bytes, "lineOrder", "lineOrder", std::vector<uint8_t>(1, 0));
+    putEXRAttribute(bytes, "pixelAspectRatio", "float", std::vector<uint8_t>(oneBytes, oneBytes + 4));
+    putEXRAttribute(bytes, "screenWindowCenter", "v2f", std::vector<uint8_t>(zeroBytes, zeroBytes + 8));
+    putEXRAttribute(bytes, "screenWindowWidth", "float", std::vector<uint8_t>(oneBytes, oneBytes + 4));
+    bytes.push_back(0);
+
+    // Offset table with one entry per scanline, followed by the scanlines themselves
+    uint32_t lineDataSize = uint32_t(width) * 3 * sizeof(float);
+    uint64_t lineOffset = bytes.size() + uint64_t(height) * 8;
+    for (int y = 0; y < height; y++) {
+        putLE64(bytes, lineOffset);
+        lineOffset += 8 + lineDataSize;
+    }
+    for (int y = 0; y < height; y++) {
+        putLE32(bytes, uint32_t(y));
+        putLE32(bytes, lineDataSize);
+        const float* row = pixels + size_t(height - 1 - y) * width * 4;
+        for (int c = 0; c < 3; c++) {
+            for (int x = 0; x < width; x++) {
+                const uint8_t* value = reinterpret_cast<const uint8_t*>(&row[4 * x + channelOffsets[c]]);
+                bytes.insert(bytes.end(), value, value + 4);
+            }
+        }
+    }
+    return writeFile(path, bytes);
+}
+
+// Function to write an image in the format given by the file extension
+bool writeImage(const std::string& path, int width, int height, const float* pixels) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == "png") return writePNG(path, width, height, pixels);
+    if (extension == "ppm") return writePPM(path, width, height, pixels);
+    if (extension == "exr") return writeEXR(path, width, height, pixels);
+
+    std::cerr << "Unsupported image format: " << path << " (use .png, .ppm or .exr)" << std::endl;
+    return false;
+}
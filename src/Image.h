@@ -0,0 +1,27 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Function to write an RGBA float image (bottom row first, as read back from GL) to a PPM file
+bool writePPM(const std::string& path, int width, int height, const float* pixels);
+
+// Function to write an RGBA float image (bottom row first) to an 8-bit RGB PNG file
+bool writePNG(const std::string& path, int width, int height, const float* pixels);
+
+// Function to write an RGBA float image (bottom row first) to an uncompressed 32-bit float OpenEXR file
+bool writeEXR(const std::string& path, int width, int height, const float* pixels);
+
+// Function to write an image in the format given by the file extension
+bool writeImage(const std::string& path, int width, int height, const float* pixels);
+
+// Function to convert an RGBA float image (bottom row first) to 8-bit RGB rows, top row first, as written to PPM and PNG
+std::vector<uint8_t> convertToRGB8(int width, int height, const float* pixels);
+
+// Function to convert an RGBA float image (bottom row first) to planar 8-bit YUV 4:2:0 (BT.601, limited range), top row
+// first: the full-size Y plane, then the U and V planes of (width + 1) / 2 by (height + 1) / 2 samples
+std::vector<uint8_t> convertToYUV420(int width, int height, const float* pixels);
+
+#endif // IMAGE_H
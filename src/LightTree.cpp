@@ -0,0 +1,133 @@
+#include "LightTree.h"
+#include <algorithm>
+#include <cmath>
+
+// Function to get the brightness of a light that its selection probability is proportional to
+float lightPower(const Light& light) {
+    return (light.color.x + light.color.y + light.color.z) / 3.0f;
+}
+
+// Function to refit the light BVH to the lights of a scene, or rebuild it if they no longer fit it well,
+// and sum the power of every node
+void updateLightTree(LightTree& tree, const std::vector<Light>& lights) {
+    tree.bounds.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        tree.bounds[i].min = lights[i].position;
+        tree.bounds[i].max = lights[i].position;
+    }
+    if (lights.empty()) tree.bvh = BVH();
+    else updateBVH(tree.bvh, tree.bounds);
+
+    tree.lights.clear();
+    for (size_t i = 0; i < tree.bvh.primIndices.size(); i++) tree.lights.push_back(lights[tree.bvh.primIndices[i]]);
+
+    // Children are stored after their parent, so a reverse sweep sums them first
+    tree.nodes.resize(tree.bvh.nodes.size());
+    for (size_t i = tree.nodes.size(); i-- > 0;) {
+        const BVHNode& node = tree.bvh.nodes[i];
+        LightNode& lightNode = tree.nodes[i];
+        lightNode.boundsMin = node.boundsMin;
+        lightNode.rightOrFirst = node.rightOrFirst;
+        lightNode.boundsMax = node.boundsMax;
+        lightNode.count = node.count;
+        lightNode.power = 0.0f;
+        if (node.count > 0) {
+            for (GLuint l = node.rightOrFirst; l < node.rightOrFirst + node.count; l++) lightNode.power += lightPower(tree.lights[l]);
+        } else {
+            lightNode.power = tree.nodes[i + 1].power + tree.nodes[node.rightOrFirst].power;
+        }
+    }
+}
+
+// Function to get the light a surface point receives from a light if nothing blocks it, without its color
+float lightFactor(const glm::vec3& lightPosition, const glm::vec3& position, const glm::vec3& normal) {
+    glm::vec3 lightDir = glm::normalize(lightPosition - position);
+    return LIGHT_FILL + std::max(0.0f, glm::dot(lightDir, normal));
+}
+
+// Function to bound the light a surface point can receive from the lights inside a node, the same as
+// nodeImportance in common.glsl: the power of the node times the largest lightFactor any point of its
+// bounding sphere can have
+static float nodeImportance(const LightNode& node, const glm::vec3& position, const glm::vec3& normal) {
+    glm::vec3 center = 0.5f * (node.boundsMin + node.boundsMax);
+    float radius = 0.5f * glm::length(node.boundsMax - node.boundsMin);
+    glm::vec3 toCenter = center - position;
+    float distance = glm::length(toCenter);
+    if (distance <= radius) return node.power * (LIGHT_FILL + 1.0f);
+
+    // The sphere covers a cone of half-angle asin(radius / distance) around toCenter, the cosine is largest
+    // at the direction of the cone closest to the normal
+    float sinCone = radius / distance;
+    float cosCone = std::sqrt(std::max(0.0f, 1.0f - sinCone * sinCone));
+    float cosTheta = glm::dot(toCenter / distance, normal);
+    float cosBound = 1.0f;
+    if (cosTheta < cosCone) {
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        cosBound = std::max(0.0f, cosTheta * cosCone + sinTheta * sinCone);
+    }
+    return node.power * (LIGHT_FILL + cosBound);
+}
+
+// Function to pick a light of the tree for a surface point, the same as sampleLightTree in common.glsl.
+// Every step down the tree picks a child by its importance and rescales u to the chosen part of [0, 1).
+int sampleLightTree(const LightTree& tree, const glm::vec3& position, const glm::vec3& normal, float u, float& pdf) {
+    pdf = 1.0f;
+    if (tree.nodes.empty()) return -1;
+
+    GLuint nodeIndex = 0;
+    while (tree.nodes[nodeIndex].count == 0) {
+        GLuint left = nodeIndex + 1;
+        GLuint right = tree.nodes[nodeIndex].rightOrFirst;
+        float leftImportance = nodeImportance(tree.nodes[left], position, normal);
+        float rightImportance = nodeImportance(tree.nodes[right], position, normal);
+        float total = leftImportance + rightImportance;
+        if (total <= 0.0f) return -1;
+
+        float leftProbability = leftImportance / total;
+        if (u < leftProbability) {
+            u /= leftProbability;
+            pdf *= leftProbability;
+            nodeIndex = left;
+        } else {
+            u = (u - leftProbability) / (1.0f - leftProbability);
+            pdf *= 1.0f - leftProbability;
+            nodeIndex = right;
+        }
+        u = std::min(u, 0.99999994f);
+    }
+
+    // The few lights of a leaf are weighted exactly
+    const LightNode& leaf = tree.nodes[nodeIndex];
+    float total = 0.0f;
+    for (GLuint l = leaf.rightOrFirst; l < leaf.rightOrFirst + leaf.count; l++) {
+        total += lightPower(tree.lights[l]) * lightFactor(tree.lights[l].position, position, normal);
+    }
+    if (total <= 0.0f) return -1;
+    // Rounding may leave target just above the sum, then the last light that can be chosen is taken
+    float target = u * total;
+    int chosen = -1;
+    float chosenImportance = 0.0f;
+    for (GLuint l = leaf.rightOrFirst; l < leaf.rightOrFirst + leaf.count; l++) {
+        float importance = lightPower(tree.lights[l]) * lightFactor(tree.lights[l].position, position, normal);
+        if (importance <= 0.0f) continue;
+        chosen = int(l);
+        chosenImportance = importance;
+        if (target < importance) break;
+        target -= importance;
+    }
+    pdf *= chosenImportance / total;
+    return chosen;
+}
+
+// Function to mix the bits of a number into a well distributed hash (the PCG output permutation)
+static uint32_t hashBits(uint32_t value) {
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Function to get the random number in [0, 1) that picks a light sample of a pixel
+float lightSampleRandom(uint32_t pixelIndex, int sampleIndex, int lightSampleIndex) {
+    uint32_t hash = hashBits(pixelIndex ^ hashBits(uint32_t(sampleIndex * MAX_SHADOW_RAYS + lightSampleIndex)));
+    return float(hash >> 8) / 16777216.0f;
+}
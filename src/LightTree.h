@@ -0,0 +1,68 @@
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include "BVH.h"
+#include "Geometry.h"
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Shadow rays per pixel and sample unless --shadow-rays is given. Scenes with no more lights than the budget
+// test every light, larger ones pick this many lights at random.
+const int DEFAULT_SHADOW_RAYS = 4;
+// Most shadow rays per pixel and sample, the wavefront paths keep one visibility bit per ray
+const int MAX_SHADOW_RAYS = 16;
+// Light a surface gets even when no light reaches it
+const float SHADOW_AMBIENT = 0.1f;
+// Light every visible light adds besides its diffuse term. With one white light a lit surface gets
+// SHADOW_AMBIENT + LIGHT_FILL = 0.25 ambient, the same as the single-light shading before.
+const float LIGHT_FILL = 0.15f;
+
+// Node of the light BVH as the shaders read it: the layout of BVHNode followed by the summed power of the
+// lights below it. Leaves index the lights of a LightTree, which are stored in leaf order.
+struct LightNode {
+    glm::vec3 boundsMin;
+    GLuint rightOrFirst;    // Right child for inner nodes, first light for leaves
+    glm::vec3 boundsMax;
+    GLuint count;           // Number of lights in a leaf, 0 for inner nodes
+    float power;            // Sum of lightPower() of all lights below the node
+    float pad1 = 0.0f;
+    float pad2 = 0.0f;
+    float pad3 = 0.0f;
+};
+
+static_assert(sizeof(LightNode) == 48, "LightNode does not match the std430 layout");
+static_assert(offsetof(LightNode, boundsMax) == 16, "LightNode::boundsMax does not match the std430 layout");
+static_assert(offsetof(LightNode, power) == 32, "LightNode::power does not match the std430 layout");
+
+// Structure for a BVH over the lights of a scene that a shading point walks down to pick a light with
+// a probability close to the light it receives from it, so the cost per pick only grows with the depth
+struct LightTree {
+    BVH bvh;
+    std::vector<AABB> bounds;
+    std::vector<LightNode> nodes;
+    std::vector<Light> lights;      // Lights in the leaf order of the BVH
+};
+
+// Function to get the brightness of a light that its selection probability is proportional to
+float lightPower(const Light& light);
+
+// Function to refit the light BVH to the lights of a scene, or rebuild it if they no longer fit it well,
+// and sum the power of every node
+void updateLightTree(LightTree& tree, const std::vector<Light>& lights);
+
+// Function to get the light a surface point receives from a light if nothing blocks it, without its color
+float lightFactor(const glm::vec3& lightPosition, const glm::vec3& position, const glm::vec3& normal);
+
+// Function to pick a light of the tree for a surface point. u in [0, 1) chooses the light, pdf is the probability
+// it was chosen with. Returns the index into tree.lights, or -1 if no light reaches the point.
+int sampleLightTree(const LightTree& tree, const glm::vec3& position, const glm::vec3& normal, float u, float& pdf);
+
+// Function to get the random number in [0, 1) that picks a light sample of a pixel, the same as lightSampleRandom
+// in common.glsl
+float lightSampleRandom(uint32_t pixelIndex, int sampleIndex, int lightSampleIndex);
+
+#endif // LIGHTTREE_H
@@ -0,0 +1,337 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Function to get the lower case extension of a path without the dot
+static std::string fileExtension(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+// Function to append a polygon as a fan of triangles around its first vertex
+static void addPolygon(const std::vector<GLuint>& polygon, std::vector<GLuint>& indices) {
+    for (size_t i = 2; i < polygon.size(); i++) {
+        indices.push_back(polygon[0]);
+        indices.push_back(polygon[i - 1]);
+        indices.push_back(polygon[i]);
+    }
+}
+
+// Function to load the vertex positions and faces of a Wavefront OBJ file, everything else is skipped
+static bool loadObj(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open mesh file: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    std::vector<GLuint> polygon;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type)) continue;
+
+        bool ok = true;
+        if (type == "v") {
+            glm::vec3 vertex;
+            ok = bool(fields >> vertex.x >> vertex.y >> vertex.z);
+            vertices.push_back(vertex);
+        } else if (type == "f") {
+            // Every corner is v, v/vt, v//vn or v/vt/vn, negative indices count back from the last vertex
+            polygon.clear();
+            std::string corner;
+            while (ok && fields >> corner) {
+                long index = std::strtol(corner.c_str(), nullptr, 10);
+                if (index < 0) index += long(vertices.size()) + 1;
+                ok = index > 0;
+                polygon.push_back(GLuint(index - 1));
+            }
+            ok = ok && polygon.size() >= 3;
+            addPolygon(polygon, indices);
+        }
+        if (!ok) {
+            std::cerr << path << ":" << lineNumber << ": invalid " << type << ": " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Structure for a property of a PLY element, lists store a count of the given type before their values
+struct PlyProperty {
+    std::string name;
+    std::string type;
+    std::string countType;  // Empty for scalar properties
+};
+
+// Structure for an element of a PLY file and its properties, in file order
+struct PlyElement {
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+// Function to get the size in bytes of a PLY scalar type, 0 for unknown types
+static size_t plyTypeSize(const std::string& type) {
+    if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") return 1;
+    if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") return 2;
+    if (type == "int" || type == "uint" || type == "int32" || type == "uint32" || type == "float" || type == "float32") return 4;
+    if (type == "double" || type == "float64") return 8;
+    return 0;
+}
+
+// Function to read a binary value of type T in native (little-endian) byte order
+template <typename T>
+static double readBinary(std::istream& in) {
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return double(value);
+}
+
+// Function to read one PLY value of the given type as text or as binary
+static bool readPlyValue(std::istream& in, bool binary, const std::string& type, double& value) {
+    if (!binary) return bool(in >> value);
+
+    if (type == "char" || type == "int8") value = readBinary<int8_t>(in);
+    else if (type == "uchar" || type == "uint8") value = readBinary<uint8_t>(in);
+    else if (type == "short" || type == "int16") value = readBinary<int16_t>(in);
+    else if (type == "ushort" || type == "uint16") value = readBinary<uint16_t>(in);
+    else if (type == "int" || type == "int32") value = readBinary<int32_t>(in);
+    else if (type == "uint" || type == "uint32") value = readBinary<uint32_t>(in);
+    else if (type == "float" || type == "float32") value = readBinary<float>(in);
+    else value = readBinary<double>(in);
+    return bool(in);
+}
+
+// Function to load the vertex positions and faces of a PLY file, other elements and properties are skipped
+static bool loadPly(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open mesh file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<PlyElement> elements;
+    std::string line, format;
+    bool header = std::getline(file, line) && line.compare(0, 3, "ply") == 0;
+    while (header && std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream fields(line);
+        std::string keyword;
+        fields >> keyword;
+        if (keyword == "end_header") break;
+
+        if (keyword == "format") {
+            fields >> format;
+        } else if (keyword == "element") {
+            PlyElement element;
+            header = bool(fields >> element.name >> element.count);
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            PlyProperty property;
+            fields >> property.type;
+            if (property.type == "list") fields >> property.countType >> property.type;
+            header = bool(fields >> property.name) && plyTypeSize(property.type) > 0
+                     && (property.countType.empty() || plyTypeSize(property.countType) > 0);
+            elements.back().properties.push_back(property);
+        }
+    }
+    if (!header || (format != "ascii" && format != "binary_little_endian")) {
+        std::cerr << "Unsupported PLY file, only ASCII and binary little-endian are read: " << path << std::endl;
+        return false;
+    }
+
+    bool binary = format != "ascii";
+    std::vector<GLuint> polygon;
+    for (const PlyElement& element : elements) {
+        bool isVertex = element.name == "vertex";
+        bool isFace = element.name == "face";
+        for (size_t item = 0; item < element.count; item++) {
+            glm::vec3 vertex(0.0f);
+            for (const PlyProperty& property : element.properties) {
+                double value;
+                if (property.countType.empty()) {
+                    if (!readPlyValue(file, binary, property.type, value)) break;
+                    if (isVertex && (property.name == "x" || property.name == "y" || property.name == "z")) {
+                        vertex[property.name[0] - 'x'] = float(value);
+                    }
+                    continue;
+                }
+
+                double count;
+                if (!readPlyValue(file, binary, property.countType, count)) break;
+                bool isIndices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                polygon.clear();
+                for (long i = 0; i < long(count) && readPlyValue(file, binary, property.type, value); i++) {
+                    polygon.push_back(GLuint(value));
+                }
+                if (isIndices) addPolygon(polygon, indices);
+            }
+            if (!file) {
+                std::cerr << "Truncated PLY file: " << path << std::endl;
+                return false;
+            }
+            if (isVertex) vertices.push_back(vertex);
+        }
+    }
+    return true;
+}
+
+// Function to load the triangles of a Wavefront OBJ or PLY (ASCII or binary little-endian) file, chosen by
+// file extension. Polygons are split into triangle fans. Prints the reason and returns false if the file
+// can not be loaded or has no triangles.
+bool loadMesh(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices) {
+    vertices.clear();
+    indices.clear();
+    std::string extension = fileExtension(path);
+    bool ok;
+    if (extension == "obj") {
+        ok = loadObj(path, vertices, indices);
+    } else if (extension == "ply") {
+        ok = loadPly(path, vertices, indices);
+    } else {
+        std::cerr << "Unknown mesh format, expected .obj or .ply: " << path << std::endl;
+        return false;
+    }
+    if (!ok) return false;
+
+    if (indices.empty()) {
+        std::cerr << "Mesh file has no triangles: " << path << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= vertices.size()) {
+            std::cerr << "Mesh file refers to missing vertex " << indices[i] + 1 << ": " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to quantize a triangle mesh, build its BVH and append it to the mesh arrays of a scene.
+// Returns the index of the mesh for MeshInstance::mesh. The mesh must have at least one triangle.
+GLuint addMesh(Scene& scene, const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices) {
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (const glm::vec3& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex);
+        boundsMax = glm::max(boundsMax, vertex);
+    }
+
+    MeshInfo mesh = MeshInfo();
+    mesh.quantizationOrigin = boundsMin;
+    mesh.quantizationStep = (boundsMax - boundsMin) / float(MESH_GRID_MAX);
+    mesh.vertexCount = GLuint(vertices.size());
+    mesh.triangleCount = GLuint(indices.size() / 3);
+    mesh.shortIndices = mesh.vertexCount <= MESH_SHORT_INDEX_LIMIT ? 1 : 0;
+
+    // Snap every vertex to the grid, 16 bits per axis. A flat axis has a step of 0 and stays at the origin.
+    mesh.vertexOffset = GLuint(scene.meshWords.size());
+    for (const glm::vec3& vertex : vertices) {
+        GLuint grid[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float step = mesh.quantizationStep[axis];
+            float cell = step > 0.0f ? std::round((vertex[axis] - boundsMin[axis]) / step) : 0.0f;
+            grid[axis] = GLuint(std::min(std::max(cell, 0.0f), float(MESH_GRID_MAX)));
+        }
+        scene.meshWords.push_back(grid[0] | (grid[1] << 16));
+        scene.meshWords.push_back(grid[2]);
+    }
+
+    // Bound the decoded triangles rather than the input, so the BVH contains exactly what is intersected
+    std::vector<AABB> triangleBounds(mesh.triangleCount);
+    for (GLuint t = 0; t < mesh.triangleCount; t++) {
+        glm::vec3 v0 = meshVertex(scene, mesh, indices[3 * t]);
+        glm::vec3 v1 = meshVertex(scene, mesh, indices[3 * t + 1]);
+        glm::vec3 v2 = meshVertex(scene, mesh, indices[3 * t + 2]);
+        triangleBounds[t].min = glm::min(v0, glm::min(v1, v2));
+        triangleBounds[t].max = glm::max(v0, glm::max(v1, v2));
+    }
+    BVH bvh = buildBVH(triangleBounds);
+
+    // Inner nodes point at their right child in the shared node array, leaves at triangles of this mesh
+    mesh.nodeOffset = GLuint(scene.meshNodes.size());
+    for (BVHNode node : bvh.nodes) {
+        if (node.count == 0) node.rightOrFirst += mesh.nodeOffset;
+        scene.meshNodes.push_back(node);
+    }
+
+    // Store the triangles in leaf order, so the leaves need no index indirection
+    mesh.indexOffset = GLuint(scene.meshWords.size());
+    for (GLuint i = 0; i < 3 * mesh.triangleCount; i++) {
+        GLuint index = indices[3 * bvh.primIndices[i / 3] + i % 3];
+        if (!mesh.shortIndices) scene.meshWords.push_back(index);
+        else if (i % 2 == 0) scene.meshWords.push_back(index);
+        else scene.meshWords.back() |= index << 16;
+    }
+
+    scene.meshes.push_back(mesh);
+    return GLuint(scene.meshes.size() - 1);
+}
+
+// Function to compute the world space bounding boxes of the mesh instances, reusing the storage of bounds
+void computeInstanceBounds(const Scene& scene, std::vector<AABB>& bounds) {
+    bounds.resize(scene.instances.size());
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const MeshInstance& instance = scene.instances[i];
+        const BVHNode& root = scene.meshNodes[scene.meshes[instance.mesh].nodeOffset];
+        glm::vec3 center = 0.5f * (root.boundsMin + root.boundsMax);
+        glm::vec3 halfExtent = 0.5f * (root.boundsMax - root.boundsMin);
+
+        // Transform the center and grow the box by the extent projected onto every world axis
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec4 row = instance.objectToWorld[axis];
+            float worldCenter = glm::dot(glm::vec3(row), center) + row.w;
+            float worldExtent = glm::dot(glm::abs(glm::vec3(row)), halfExtent);
+            bounds[i].min[axis] = worldCenter - worldExtent;
+            bounds[i].max[axis] = worldCenter + worldExtent;
+        }
+    }
+}
+
+// Function to check that the offsets, BVH nodes and indices of all meshes and the meshes of all
+// instances stay inside their arrays and the BVHs within BVH_MAX_DEPTH, so corrupt data can not send
+// the traversal out of bounds
+bool validMeshes(const Scene& scene) {
+    uint64_t wordCount = scene.meshWords.size();
+    for (size_t m = 0; m < scene.meshes.size(); m++) {
+        const MeshInfo& mesh = scene.meshes[m];
+        // The nodes of a mesh run up to the root of the next one
+        uint64_t nodesEnd = m + 1 < scene.meshes.size() ? scene.meshes[m + 1].nodeOffset : scene.meshNodes.size();
+        uint64_t indexWords = mesh.shortIndices ? (3 * uint64_t(mesh.triangleCount) + 1) / 2 : 3 * uint64_t(mesh.triangleCount);
+        if (mesh.triangleCount == 0 || mesh.nodeOffset >= nodesEnd || nodesEnd > scene.meshNodes.size()
+            || mesh.vertexOffset + 2 * uint64_t(mesh.vertexCount) > wordCount || mesh.indexOffset + indexWords > wordCount
+            || (mesh.shortIndices && mesh.vertexCount > MESH_SHORT_INDEX_LIMIT)) {
+            return false;
+        }
+
+        for (uint64_t i = mesh.nodeOffset; i < nodesEnd; i++) {
+            const BVHNode& node = scene.meshNodes[i];
+            bool valid = node.count > 0 ? node.count <= BVH_MAX_LEAF_SIZE && uint64_t(node.rightOrFirst) + node.count <= mesh.triangleCount
+                                        : node.rightOrFirst > i + 1 && node.rightOrFirst < nodesEnd;
+            if (!valid) return false;
+        }
+        if (computeBVHDepth(scene.meshNodes, mesh.nodeOffset, nodesEnd) > BVH_MAX_DEPTH) return false;
+        for (GLuint i = 0; i < 3 * mesh.triangleCount; i++) {
+            if (meshIndex(scene, mesh, i) >= mesh.vertexCount) return false;
+        }
+    }
+    for (const MeshInstance& instance : scene.instances) {
+        if (instance.mesh >= scene.meshes.size()) return false;
+    }
+    return true;
+}
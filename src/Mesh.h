@@ -0,0 +1,52 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "BVH.h"
+#include "Geometry.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Meshes with at most this many vertices store their indices as 16 bits
+const GLuint MESH_SHORT_INDEX_LIMIT = 65536;
+
+// Largest vertex coordinate on the quantization grid of a mesh
+const GLuint MESH_GRID_MAX = 65535;
+
+// Mesh hits closer than this are ignored, so rays leaving a triangle do not hit it again. Matches common.glsl.
+const float MESH_EPSILON = 1e-4f;
+
+// Function to load the triangles of a Wavefront OBJ or PLY (ASCII or binary little-endian) file, chosen by
+// file extension. Polygons are split into triangle fans. Prints the reason and returns false if the file
+// can not be loaded or has no triangles.
+bool loadMesh(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices);
+
+// Function to quantize a triangle mesh, build its BVH and append it to the mesh arrays of a scene.
+// Returns the index of the mesh for MeshInstance::mesh. The mesh must have at least one triangle.
+GLuint addMesh(Scene& scene, const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices);
+
+// Function to decode a vertex of a mesh the same way the shaders do
+inline glm::vec3 meshVertex(const Scene& scene, const MeshInfo& mesh, GLuint vertex) {
+    GLuint xy = scene.meshWords[mesh.vertexOffset + 2 * vertex];
+    GLuint z = scene.meshWords[mesh.vertexOffset + 2 * vertex + 1];
+    return mesh.quantizationOrigin + glm::vec3(float(xy & 0xffff), float(xy >> 16), float(z)) * mesh.quantizationStep;
+}
+
+// Function to read the i-th vertex index of a mesh, three per triangle
+inline GLuint meshIndex(const Scene& scene, const MeshInfo& mesh, GLuint i) {
+    if (!mesh.shortIndices) return scene.meshWords[mesh.indexOffset + i];
+    GLuint word = scene.meshWords[mesh.indexOffset + i / 2];
+    return (i & 1) == 0 ? word & 0xffff : word >> 16;
+}
+
+// Function to compute the world space bounding boxes of the mesh instances, reusing the storage of bounds
+void computeInstanceBounds(const Scene& scene, std::vector<AABB>& bounds);
+
+// Function to check that the offsets, BVH nodes and indices of all meshes and the meshes of all
+// instances stay inside their arrays and the BVHs within BVH_MAX_DEPTH and BVH_MAX_LEAF_SIZE, so corrupt
+// data can not send the traversal out of bounds
+bool validMeshes(const Scene& scene);
+
+#endif // MESH_H
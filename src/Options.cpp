@@ -0,0 +1,248 @@
+#include "Options.h"
+#include "LightTree.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Function to parse "x,y,z" into a vector
+static bool parseVec3(const char* text, glm::vec3& value) {
+    return std::sscanf(text, "%f,%f,%f", &value.x, &value.y, &value.z) == 3;
+}
+
+// Function to fill in the default settings of the interactive renderer
+RenderOptions defaultRenderOptions() {
+    RenderOptions options;
+    options.headless = false;
+    options.backend = BACKEND_AUTO;
+    options.threads = 0;
+    options.bounces = 1;
+    options.shadowRays = DEFAULT_SHADOW_RAYS;
+    options.targetFrameMs = 0.0;
+    options.variableRate = false;
+    options.quantizeScene = false;
+    options.packetTracing = false;
+    options.denoise = false;
+    options.watchShaders = false;
+    options.outputFormat = OUTPUT_RGBA32F;
+    options.blitPresent = false;
+    options.framesInFlight = 2;
+    options.width = 800;
+    options.height = 600;
+    options.cameraPos = glm::vec3(0.0f, 0.0f, 0.0f);
+    options.cameraDir = glm::vec3(0.0f, 0.0f, -1.0f);
+    options.focalLength = 1.0f;
+    options.samples = 0;
+    options.frames = 1;
+    options.startTime = 0.0;
+    options.frameTime = 1.0 / 30.0;
+    options.fixedTimestep = false;
+    options.output = "frame_%04d.png";
+    options.streamFormat = STREAM_RGB24;
+    options.outputThreads = 0;
+    options.tileSize = 128;
+    options.taskFrames = 4;
+    options.taskTimeout = 0.0;
+    return options;
+}
+
+// Function to parse the command line into options, returns false on invalid arguments
+bool parseRenderOptions(int argc, char** argv, RenderOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if (arg == "--headless") {
+            options.headless = true;
+            continue;
+        } else if (arg == "--variable-rate") {
+            options.variableRate = true;
+            continue;
+        } else if (arg == "--quantize-scene") {
+            options.quantizeScene = true;
+            continue;
+        } else if (arg == "--packet-tracing") {
+            options.packetTracing = true;
+            continue;
+        } else if (arg == "--denoise") {
+            options.denoise = true;
+            continue;
+        } else if (arg == "--watch-shaders") {
+            options.watchShaders = true;
+            continue;
+        } else if (arg == "--fixed-timestep") {
+            options.fixedTimestep = true;
+            continue;
+        } else if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (!value) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--backend") {
+            ok = parseRendererBackend(value, options.backend);
+        } else if (arg == "--threads") {
+            options.threads = std::atoi(value);
+            ok = options.threads >= 0;
+        } else if (arg == "--bounces") {
+            options.bounces = std::atoi(value);
+            ok = options.bounces >= 0;
+        } else if (arg == "--shadow-rays") {
+            options.shadowRays = std::atoi(value);
+            ok = options.shadowRays >= 1 && options.shadowRays <= MAX_SHADOW_RAYS;
+        } else if (arg == "--target-ms") {
+            options.targetFrameMs = std::atof(value);
+            ok = options.targetFrameMs >= 0.0;
+        } else if (arg == "--output-format") {
+            ok = parseOutputFormat(value, options.outputFormat);
+        } else if (arg == "--present") {
+            std::string present = value;
+            ok = present == "quad" || present == "blit";
+            options.blitPresent = present == "blit";
+        } else if (arg == "--frames-in-flight") {
+            options.framesInFlight = std::atoi(value);
+            ok = options.framesInFlight >= 1 && options.framesInFlight <= FRAMES_IN_FLIGHT;
+        } else if (arg == "--width") {
+            options.width = std::atoi(value);
+            ok = options.width > 0;
+        } else if (arg == "--height") {
+            options.height = std::atoi(value);
+            ok = options.height > 0;
+        } else if (arg == "--scene") {
+            options.scene = value;
+        } else if (arg == "--camera-pos") {
+            ok = parseVec3(value, options.cameraPos);
+        } else if (arg == "--camera-dir") {
+            ok = parseVec3(value, options.cameraDir) && glm::length(options.cameraDir) > 0.0f;
+            if (ok) options.cameraDir = glm::normalize(options.cameraDir);
+        } else if (arg == "--focal-length") {
+            options.focalLength = float(std::atof(value));
+        } else if (arg == "--samples") {
+            options.samples = std::atoi(value);
+            ok = options.samples > 0;
+        } else if (arg == "--frames") {
+            options.frames = std::atoi(value);
+            ok = options.frames > 0;
+        } else if (arg == "--start-time") {
+            options.startTime = std::atof(value);
+        } else if (arg == "--fps") {
+            double fps = std::atof(value);
+            ok = fps > 0.0;
+            if (ok) options.frameTime = 1.0 / fps;
+        } else if (arg == "--output" || arg == "-o") {
+            options.output = value;
+        } else if (arg == "--stream") {
+            options.stream = value;
+        } else if (arg == "--stream-format") {
+            ok = parseStreamFormat(value, options.streamFormat);
+        } else if (arg == "--output-threads") {
+            options.outputThreads = std::atoi(value);
+            ok = options.outputThreads >= 0;
+        } else if (arg == "--profile") {
+            options.profile = value;
+        } else if (arg == "--trace") {
+            options.trace = value;
+        } else if (arg == "--coordinator") {
+            options.coordinator = value;
+        } else if (arg == "--worker") {
+            options.worker = value;
+        } else if (arg == "--tile-size") {
+            options.tileSize = std::atoi(value);
+            ok = options.tileSize > 0;
+        } else if (arg == "--task-frames") {
+            options.taskFrames = std::atoi(value);
+            ok = options.taskFrames > 0;
+        } else if (arg == "--task-timeout") {
+            options.taskTimeout = std::atof(value);
+            ok = options.taskTimeout >= 0.0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+        i++;
+    }
+    if (!options.coordinator.empty() && !options.worker.empty()) {
+        std::cerr << "A process is either a coordinator or a worker" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to print the supported command line arguments
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --headless              Render without a window and write the frames to disk\n"
+              << "  --backend <name>        auto, gpu, wavefront or cpu (default auto: gpu if OpenGL 4.3 is available)\n"
+              << "  --threads <n>           Worker threads of the cpu backend (default 0: all cores)\n"
+              << "  --bounces <n>           Reflections followed per path by the wavefront backend (default 1)\n"
+              << "  --shadow-rays <n>       Shadow rays per pixel and sample, 1 to 16 (default 4). Scenes with more\n"
+              << "                          lights pick that many from a light BVH each sample\n"
+              << "  --target-ms <ms>        Frame time budget in the window, the trace resolution is lowered to\n"
+              << "                          meet it and upscaled to the window (default 0: full resolution)\n"
+              << "  --variable-rate         Trace the periphery at a quarter of the rate of the screen centre\n"
+              << "                          (gpu backend, toggle with V in the window)\n"
+              << "  --quantize-scene        Store the spheres of the gpu and wavefront backends as 16-bit coordinates\n"
+              << "                          in their BVH leaf, half the bytes per sphere test for a tiny loss of size\n"
+              << "  --packet-tracing        Trace the primary and shadow rays of a gpu workgroup as packets that read\n"
+              << "                          the BVH through shared memory (not together with --variable-rate)\n"
+              << "  --denoise               Filter the image of the gpu and wavefront backends with an edge-avoiding\n"
+              << "                          a-trous denoiser guided by normals, depths and albedos, for low --samples\n"
+              << "  --watch-shaders         Rebuild the compute shaders in the background when their files change and\n"
+              << "                          swap them in if they build (window only), printing the stage times\n"
+              << "                          before and after\n"
+              << "  --output-format <name>  Output texture of the gpu and wavefront backends: rgba32f (default),\n"
+              << "                          rgba16f, r11g11b10f, or rgba8 tonemapped by the compute pass\n"
+              << "  --present <path>        quad (default, upscales edge-aware) or blit (glBlitFramebuffer, no quad pass)\n"
+              << "  --frames-in-flight <n>  Frames the window renders ahead of the presented one, 1 to 3 (default 2)\n"
+              << "  --width <pixels>        Image width (default 800)\n"
+              << "  --height <pixels>       Image height (default 600)\n"
+              << "  --scene <path>          Scene file, .scene (text) or .rtscene (binary), instead of the\n"
+              << "                          animated demo scene\n"
+              << "  --camera-pos <x,y,z>    Camera position (default 0,0,0)\n"
+              << "  --camera-dir <x,y,z>    Camera view direction (default 0,0,-1)\n"
+              << "  --focal-length <f>      Focal length (default 1)\n"
+              << "  --samples <n>           Anti-aliasing samples per pixel, accumulated while the view is static\n"
+              << "                          (default 256 in the window, 1 per frame in headless mode)\n"
+              << "  --frames <n>            Number of frames to render in headless mode (default 1)\n"
+              << "  --start-time <seconds>  Animation time of the first frame (default 0)\n"
+              << "  --fps <rate>            Animation frame rate in headless mode and with --fixed-timestep (default 30)\n"
+              << "  --fixed-timestep        Advance the animation in the window by 1/fps per frame instead of by the\n"
+              << "                          wall clock, so every run shows the same sequence of frames\n"
+              << "  -o, --output <path>     Output image, .png, .ppm or .exr, may contain a frame\n"
+              << "                          number pattern such as frame_%04d.png (default)\n"
+              << "  --stream <path>         Write the headless frames as raw video to a named pipe or file, or to\n"
+              << "                          stdout with -, e.g. for ffmpeg -f rawvideo, instead of image files\n"
+              << "  --stream-format <name>  Pixel format of --stream: rgb24 (default) or yuv420p\n"
+              << "  --output-threads <n>    Threads converting and writing headless frames (default 0: up to 4)\n"
+              << "  --profile <path>        Write the CPU and GPU timings of every frame to a .csv or .json file\n"
+              << "  --trace <path>          Write the timings of every frame as a Chrome trace (chrome://tracing)\n"
+              << "  --coordinator <address> Split the headless job into tasks for workers and assemble their results.\n"
+              << "                          The address is unix:<path> or [host]:<port>\n"
+              << "  --worker <address>      Render tasks for the coordinator at an address with --backend\n"
+              << "  --tile-size <pixels>    Tile edge a coordinator splits a single frame into (default 128)\n"
+              << "  --task-frames <n>       Frames per task a coordinator splits a sequence into (default 4)\n"
+              << "  --task-timeout <s>      Seconds after which a coordinator retries a task elsewhere (default 0: never)\n";
+}
+
+// Function to build the output file name of a frame from the output pattern
+std::string formatOutputPath(const std::string& pattern, int frame, int frameCount) {
+    if (pattern.find('%') != std::string::npos) {
+        char path[4096];
+        std::snprintf(path, sizeof(path), pattern.c_str(), frame);
+        return path;
+    }
+    if (frameCount == 1) return pattern;
+
+    // Without a pattern, number the frames in front of the extension
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = pattern.find_last_of('.');
+    size_t slash = pattern.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return pattern + number;
+    return pattern.substr(0, dot) + number + pattern.substr(dot);
+}
@@ -0,0 +1,62 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "FrameSink.h"
+#include "Renderer.h"
+
+#include <glm/glm.hpp>
+#include <string>
+
+// Structure for the settings that can be given on the command line
+struct RenderOptions {
+    bool headless;          // Render offscreen without a window and write images to disk
+    RendererBackend backend;
+    int threads;            // Worker threads of the CPU backend, 0 for all cores
+    int bounces;            // Reflections followed per path by the wavefront backend
+    int shadowRays;         // Shadow rays per pixel and sample, more lights are sampled from the light BVH
+    double targetFrameMs;   // Frame time budget of the dynamic resolution in the window, 0 to trace at full resolution
+    bool variableRate;      // Trace the periphery at a quarter of the rate of the screen centre
+    bool quantizeScene;     // Store the spheres on the GPU as 16-bit coordinates in their BVH leaf
+    bool packetTracing;     // Trace the primary and shadow rays of a GPU workgroup as packets in shared memory
+    bool denoise;           // Filter the accumulated image of the GPU backends with the feature-guided denoiser
+    bool watchShaders;      // Rebuild the compute shaders in the window when their files change
+    OutputFormat outputFormat;  // Format of the output texture of the GPU backends
+    bool blitPresent;       // Present the window with glBlitFramebuffer instead of the quad pass
+    int framesInFlight;     // Frames the window's simulation and GPU work may run ahead of the presented one
+    int width;
+    int height;
+    std::string scene;      // Text or binary scene file, empty for the animated demo scene
+    glm::vec3 cameraPos;
+    glm::vec3 cameraDir;
+    float focalLength;
+    int samples;            // Samples per pixel to accumulate while the view is static, 0 for the mode's default
+    int frames;             // Number of frames to render in headless mode
+    double startTime;       // Animation time of the first frame in seconds
+    double frameTime;       // Animation time step between frames in seconds
+    bool fixedTimestep;     // Advance the window's animation by frameTime per frame instead of by the wall clock
+    std::string output;     // Output path, may contain a printf pattern such as frame_%04d.png
+    std::string stream;     // Raw video target of headless frames instead of image files: "-" for stdout or a path
+    StreamFormat streamFormat;  // Pixel format of the raw video stream
+    int outputThreads;      // Threads converting and writing headless frames, 0 for up to 4
+    std::string profile;    // Per-frame timings as .csv or .json, empty to skip
+    std::string trace;      // Per-frame timings in the Chrome trace format, empty to skip
+    std::string coordinator;    // Address to hand out the tiles or frames of a headless job on, empty to render locally
+    std::string worker;     // Address of a coordinator to render tiles or frames for, empty to render locally
+    int tileSize;           // Edge of the tiles a coordinator splits a single frame into
+    int taskFrames;         // Frames per task when a coordinator splits a sequence
+    double taskTimeout;     // Seconds after which a coordinator gives up on a worker's task, 0 waits forever
+};
+
+// Function to fill in the default settings of the interactive renderer
+RenderOptions defaultRenderOptions();
+
+// Function to parse the command line into options, returns false on invalid arguments
+bool parseRenderOptions(int argc, char** argv, RenderOptions& options);
+
+// Function to print the supported command line arguments
+void printUsage(const char* program);
+
+// Function to build the output file name of a frame from the output pattern
+std::string formatOutputPath(const std::string& pattern, int frame, int frameCount);
+
+#endif // OPTIONS_H
@@ -0,0 +1,444 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Function to get the milliseconds between the creation of the profiler and a point in time
+static double millisecondsSince(const Profiler& profiler, std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double, std::milli>(time - profiler.origin).count();
+}
+
+// Function to get the index of a section, adding it on first use
+static int findSection(Profiler& profiler, const char* name, bool gpu) {
+    for (size_t i = 0; i < profiler.sections.size(); i++) {
+        if (profiler.sections[i].name == name) {
+            profiler.sections[i].gpu = profiler.sections[i].gpu || gpu;
+            return int(i);
+        }
+    }
+    ProfilerSection section = {name, gpu, false};
+    profiler.sections.push_back(section);
+    return int(profiler.sections.size() - 1);
+}
+
+// Function to make room for every known section in a record
+static void growRecord(ProfilerRecord& record, size_t sectionCount) {
+    if (record.cpuMs.size() >= sectionCount) return;
+    record.sectionStartMs.resize(sectionCount, -1.0);
+    record.cpuMs.resize(sectionCount, 0.0);
+    record.gpuMs.resize(sectionCount, -1.0);
+    record.bytes.resize(sectionCount, 0.0);
+}
+
+// Function to read the timer queries of a frame and move its record into the window
+static void resolveSlot(Profiler& profiler, ProfilerFrameSlot& slot) {
+    ProfilerRecord& record = slot.record;
+    growRecord(record, profiler.sections.size());
+    for (int i = 0; i < slot.usedQueries; i++) {
+        // Issued PROFILER_LATENCY frames ago, so this rarely has to wait
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &nanoseconds);
+        double& gpuMs = record.gpuMs[slot.querySections[i]];
+        gpuMs = std::max(gpuMs, 0.0) + double(nanoseconds) / 1e6;
+    }
+
+    profiler.window.push_back(record);
+    if (profiler.window.size() > size_t(PROFILER_WINDOW)) profiler.window.pop_front();
+    if (profiler.keepRecords) profiler.records.push_back(record);
+    slot.pending = false;
+}
+
+// Function to create a profiler. gpuTimers needs a current GL context with timer queries.
+Profiler createProfiler(bool gpuTimers, bool keepRecords) {
+    Profiler profiler;
+    profiler.gpuTimers = gpuTimers && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    profiler.keepRecords = keepRecords;
+    profiler.origin = std::chrono::steady_clock::now();
+    profiler.frame = -1;
+    profiler.inFrame = false;
+    profiler.gpuQueryActive = false;
+    profiler.comparisonFrame = 0;
+    for (int i = 0; i < PROFILER_LATENCY; i++) {
+        profiler.slots[i].usedQueries = 0;
+        profiler.slots[i].pending = false;
+    }
+    return profiler;
+}
+
+// Function to start a new frame, reading the GPU times of the frame PROFILER_LATENCY frames ago
+void beginProfilerFrame(Profiler& profiler) {
+    double now = millisecondsSince(profiler, std::chrono::steady_clock::now());
+    if (profiler.inFrame) endProfilerFrame(profiler);
+
+    // The frame time runs from one frame start to the next, so it includes presenting and waiting
+    if (profiler.frame >= 0) {
+        ProfilerFrameSlot& previous = profiler.slots[profiler.frame % PROFILER_LATENCY];
+        if (previous.pending) previous.record.frameMs = now - previous.record.startMs;
+    }
+
+    profiler.frame++;
+    ProfilerFrameSlot& slot = profiler.slots[profiler.frame % PROFILER_LATENCY];
+    if (slot.pending) resolveSlot(profiler, slot);
+
+    slot.usedQueries = 0;
+    slot.querySections.clear();
+    slot.pending = true;
+    slot.record.frame = profiler.frame;
+    slot.record.startMs = now;
+    slot.record.frameMs = 0.0;
+    slot.record.sectionStartMs.assign(profiler.sections.size(), -1.0);
+    slot.record.cpuMs.assign(profiler.sections.size(), 0.0);
+    slot.record.gpuMs.assign(profiler.sections.size(), -1.0);
+    slot.record.bytes.assign(profiler.sections.size(), 0.0);
+    slot.record.memoryBytes = 0.0;
+    profiler.inFrame = true;
+}
+
+// Function to end the current frame
+void endProfilerFrame(Profiler& profiler) {
+    if (!profiler.inFrame) return;
+
+    // Until the next frame starts, the frame time is the time spent inside the frame
+    ProfilerRecord& record = profiler.slots[profiler.frame % PROFILER_LATENCY].record;
+    record.frameMs = millisecondsSince(profiler, std::chrono::steady_clock::now()) - record.startMs;
+    profiler.inFrame = false;
+}
+
+// Function to wait for the GPU times of all frames still in flight
+void finishProfiler(Profiler& profiler) {
+    endProfilerFrame(profiler);
+    for (long frame = profiler.frame - PROFILER_LATENCY + 1; frame <= profiler.frame; frame++) {
+        if (frame < 0) continue;
+        ProfilerFrameSlot& slot = profiler.slots[frame % PROFILER_LATENCY];
+        if (slot.pending) resolveSlot(profiler, slot);
+    }
+}
+
+// Function to delete the timer queries
+void deleteProfiler(Profiler& profiler) {
+    for (int i = 0; i < PROFILER_LATENCY; i++) {
+        std::vector<GLuint>& queries = profiler.slots[i].queries;
+        if (!queries.empty()) glDeleteQueries(GLsizei(queries.size()), queries.data());
+        queries.clear();
+    }
+}
+
+// Function to add the estimated memory traffic of a section to the current frame
+void countProfilerBytes(Profiler* profiler, const char* name, double bytes) {
+    if (!profiler || !profiler->inFrame) return;
+    int section = findSection(*profiler, name, false);
+    profiler->sections[section].bytes = true;
+    ProfilerRecord& record = profiler->slots[profiler->frame % PROFILER_LATENCY].record;
+    growRecord(record, profiler->sections.size());
+    record.bytes[section] += bytes;
+}
+
+// Function to add CPU time measured on another thread to a section of the current frame
+void addProfilerTime(Profiler* profiler, const char* name, double cpuMs) {
+    if (!profiler || !profiler->inFrame) return;
+    int section = findSection(*profiler, name, false);
+    ProfilerRecord& record = profiler->slots[profiler->frame % PROFILER_LATENCY].record;
+    growRecord(record, profiler->sections.size());
+    record.cpuMs[section] += cpuMs;
+    // The time was spent before the frame started, the trace shows it at the start of the frame
+    if (record.sectionStartMs[section] < 0.0) record.sectionStartMs[section] = record.startMs;
+}
+
+// Function to report the memory held by the renderer's images in the current frame
+void setProfilerMemory(Profiler* profiler, double bytes) {
+    if (!profiler || !profiler->inFrame) return;
+    profiler->slots[profiler->frame % PROFILER_LATENCY].record.memoryBytes = bytes;
+}
+
+// Function to get the value below which the given fraction of the sorted values lie (nearest rank)
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = size_t(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// Function to compute frame time percentiles and per frame section averages of a list of records
+template <typename Records>
+static ProfilerSummary summarizeRecords(const Profiler& profiler, const Records& records) {
+    ProfilerSummary summary;
+    size_t sectionCount = profiler.sections.size();
+    summary.frames = int(records.size());
+    summary.cpuMs.assign(sectionCount, 0.0);
+    summary.gpuMs.assign(sectionCount, -1.0);
+    summary.bytes.assign(sectionCount, 0.0);
+    summary.memoryBytes = records.empty() ? 0.0 : records.back().memoryBytes;
+
+    std::vector<double> frameTimes;
+    double totalMs = 0.0;
+    for (typename Records::const_iterator record = records.begin(); record != records.end(); ++record) {
+        frameTimes.push_back(record->frameMs);
+        totalMs += record->frameMs;
+        for (size_t i = 0; i < sectionCount && i < record->cpuMs.size(); i++) {
+            summary.cpuMs[i] += record->cpuMs[i];
+            if (record->gpuMs[i] >= 0.0) summary.gpuMs[i] = std::max(summary.gpuMs[i], 0.0) + record->gpuMs[i];
+            summary.bytes[i] += record->bytes[i];
+        }
+    }
+    std::sort(frameTimes.begin(), frameTimes.end());
+
+    summary.fps = totalMs > 0.0 ? 1000.0 * records.size() / totalMs : 0.0;
+    summary.p50Ms = percentile(frameTimes, 0.50);
+    summary.p95Ms = percentile(frameTimes, 0.95);
+    summary.p99Ms = percentile(frameTimes, 0.99);
+    for (size_t i = 0; i < sectionCount && !records.empty(); i++) {
+        summary.cpuMs[i] /= records.size();
+        if (summary.gpuMs[i] >= 0.0) summary.gpuMs[i] /= records.size();
+        summary.bytes[i] /= records.size();
+    }
+    return summary;
+}
+
+// Function to compute the percentiles of the frame time and the section averages over the recent frames
+ProfilerSummary summarizeProfiler(const Profiler& profiler) {
+    return summarizeRecords(profiler, profiler.window);
+}
+
+// Function to compute the same statistics over all kept records
+ProfilerSummary summarizeProfilerRecords(const Profiler& profiler) {
+    return summarizeRecords(profiler, profiler.records);
+}
+
+// Function to get the average time of every GPU section over the recent frames from a frame on, -1 for the
+// CPU-only sections. Drivers without timer results report zero GPU time, their CPU time is used instead.
+static std::vector<double> sectionTimesSince(const Profiler& profiler, long firstFrame, int& frames) {
+    std::deque<ProfilerRecord> since;
+    for (const ProfilerRecord& record : profiler.window) {
+        if (record.frame >= firstFrame) since.push_back(record);
+    }
+    ProfilerSummary summary = summarizeRecords(profiler, since);
+    frames = summary.frames;
+    std::vector<double> times(summary.cpuMs.size(), -1.0);
+    for (size_t i = 0; i < times.size(); i++) {
+        if (summary.gpuMs[i] > 0.0) times[i] = summary.gpuMs[i];
+        else if (profiler.sections[i].gpu) times[i] = summary.cpuMs[i];
+    }
+    return times;
+}
+
+// Function to mark a change made between this frame and the next, such as rebuilt shaders
+void markProfilerComparison(Profiler& profiler, const std::string& label) {
+    // The last PROFILER_LATENCY frames are not resolved yet, so the times before are those of the frames before them
+    int frames;
+    profiler.comparisonMs = sectionTimesSince(profiler, profiler.comparisonFrame, frames);
+    profiler.comparisonLabel = label;
+    profiler.comparisonFrame = profiler.frame + 1;
+}
+
+// Function to format the rolling statistics as one line for the console
+std::string formatProfilerSummary(const Profiler& profiler) {
+    ProfilerSummary summary = summarizeProfiler(profiler);
+    char text[256];
+    std::snprintf(text, sizeof(text), "FPS: %.1f | Frame p50/p95/p99: %.2f/%.2f/%.2f ms",
+                  summary.fps, summary.p50Ms, summary.p95Ms, summary.p99Ms);
+    std::string line = text;
+
+    double trafficBytes = 0.0;
+    for (size_t i = 0; i < profiler.sections.size(); i++) {
+        if (summary.gpuMs[i] >= 0.0) {
+            std::snprintf(text, sizeof(text), " | %s: %.2f ms cpu %.2f ms gpu", profiler.sections[i].name.c_str(), summary.cpuMs[i], summary.gpuMs[i]);
+        } else {
+            std::snprintf(text, sizeof(text), " | %s: %.2f ms cpu", profiler.sections[i].name.c_str(), summary.cpuMs[i]);
+        }
+        line += text;
+        if (profiler.sections[i].bytes) {
+            std::snprintf(text, sizeof(text), " %.1f MB", summary.bytes[i] / 1e6);
+            line += text;
+            trafficBytes += summary.bytes[i];
+        }
+    }
+    if (summary.memoryBytes > 0.0 || trafficBytes > 0.0) {
+        std::snprintf(text, sizeof(text), " | Images: %.1f MB | Traffic: %.1f MB/frame", summary.memoryBytes / 1e6, trafficBytes / 1e6);
+        line += text;
+    }
+
+    // The GPU sections that ran both before and after the last change, as before -> after
+    int frames = 0;
+    std::vector<double> afterMs;
+    if (!profiler.comparisonLabel.empty()) afterMs = sectionTimesSince(profiler, profiler.comparisonFrame, frames);
+    if (frames > 0) {
+        line += " | " + profiler.comparisonLabel + ":";
+        for (size_t i = 0; i < afterMs.size() && i < profiler.comparisonMs.size(); i++) {
+            double beforeMs = profiler.comparisonMs[i];
+            if (beforeMs <= 0.0 || afterMs[i] <= 0.0) continue;
+            std::snprintf(text, sizeof(text), " %s %.2f -> %.2f ms (%+.1f%%)", profiler.sections[i].name.c_str(),
+                          beforeMs, afterMs[i], 100.0 * (afterMs[i] / beforeMs - 1.0));
+            line += text;
+        }
+    }
+    return line;
+}
+
+// Function to format a number for CSV and JSON files
+static std::string formatNumber(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.4f", value);
+    return text;
+}
+
+// Function to format a byte count, estimates may be fractional per frame
+static std::string formatBytes(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.0f", value);
+    return text;
+}
+
+// Function to write the kept records as CSV, one row per frame and a cpu/gpu/bytes column group per section
+static void writeProfileCSV(const Profiler& profiler, std::ofstream& file) {
+    file << "frame,start_ms,frame_ms";
+    for (size_t i = 0; i < profiler.sections.size(); i++) {
+        file << "," << profiler.sections[i].name << "_cpu_ms";
+        if (profiler.sections[i].gpu) file << "," << profiler.sections[i].name << "_gpu_ms";
+        if (profiler.sections[i].bytes) file << "," << profiler.sections[i].name << "_bytes";
+    }
+    file << ",memory_bytes\n";
+
+    for (size_t r = 0; r < profiler.records.size(); r++) {
+        const ProfilerRecord& record = profiler.records[r];
+        file << record.frame << "," << formatNumber(record.startMs) << "," << formatNumber(record.frameMs);
+        for (size_t i = 0; i < profiler.sections.size(); i++) {
+            // Sections that did not run in a frame are left empty
+            bool ran = i < record.cpuMs.size() && record.sectionStartMs[i] >= 0.0;
+            file << "," << (ran ? formatNumber(record.cpuMs[i]) : "");
+            if (profiler.sections[i].gpu) file << "," << (ran && record.gpuMs[i] >= 0.0 ? formatNumber(record.gpuMs[i]) : "");
+            if (profiler.sections[i].bytes) file << "," << (i < record.bytes.size() ? formatBytes(record.bytes[i]) : "");
+        }
+        file << "," << formatBytes(record.memoryBytes) << "\n";
+    }
+}
+
+// Function to write the kept records and their summary as JSON
+static void writeProfileJSON(const Profiler& profiler, std::ofstream& file) {
+    ProfilerSummary summary = summarizeProfilerRecords(profiler);
+    file << "{\n  \"sections\": [";
+    for (size_t i = 0; i < profiler.sections.size(); i++) {
+        file << (i ? ", " : "") << "{\"name\": \"" << profiler.sections[i].name << "\", \"gpu\": " << (profiler.sections[i].gpu ? "true" : "false")
+             << ", \"bytes\": " << (profiler.sections[i].bytes ? "true" : "false") << "}";
+    }
+    file << "],\n  \"summary\": {\"frames\": " << summary.frames << ", \"fps\": " << formatNumber(summary.fps)
+         << ", \"p50_ms\": " << formatNumber(summary.p50Ms) << ", \"p95_ms\": " << formatNumber(summary.p95Ms)
+         << ", \"p99_ms\": " << formatNumber(summary.p99Ms) << "},\n  \"frames\": [";
+
+    for (size_t r = 0; r < profiler.records.size(); r++) {
+        const ProfilerRecord& record = profiler.records[r];
+        file << (r ? ",\n" : "\n") << "    {\"frame\": " << record.frame << ", \"start_ms\": " << formatNumber(record.startMs)
+             << ", \"frame_ms\": " << formatNumber(record.frameMs) << ", \"memory_bytes\": " << formatBytes(record.memoryBytes)
+             << ", \"sections\": {";
+        bool first = true;
+        for (size_t i = 0; i < record.cpuMs.size(); i++) {
+            if (record.sectionStartMs[i] < 0.0) continue;
+            file << (first ? "" : ", ") << "\"" << profiler.sections[i].name << "\": {\"cpu_ms\": " << formatNumber(record.cpuMs[i]);
+            if (record.gpuMs[i] >= 0.0) file << ", \"gpu_ms\": " << formatNumber(record.gpuMs[i]);
+            if (profiler.sections[i].bytes) file << ", \"bytes\": " << formatBytes(record.bytes[i]);
+            file << "}";
+            first = false;
+        }
+        file << "}}";
+    }
+    file << "\n  ]\n}\n";
+}
+
+// Function to write the kept records as CSV (.csv) or JSON (any other extension)
+bool writeProfile(const Profiler& profiler, const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open profile file: " << path << std::endl;
+        return false;
+    }
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    if (csv) writeProfileCSV(profiler, file);
+    else writeProfileJSON(profiler, file);
+    return bool(file);
+}
+
+// Function to write one complete event of the Chrome trace format
+static void writeTraceEvent(std::ofstream& file, bool& first, const std::string& name, int thread, double startMs, double durationMs) {
+    file << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread
+         << ", \"ts\": " << formatNumber(startMs * 1000.0) << ", \"dur\": " << formatNumber(durationMs * 1000.0) << "}";
+    first = false;
+}
+
+// Function to write the kept records in the Chrome trace event format (chrome://tracing, Perfetto).
+// CPU sections are placed at their first start in the frame. GPU times only come as durations, so
+// they are laid out in submission order on their own track, each starting no earlier than its CPU side.
+bool writeChromeTrace(const Profiler& profiler, const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open trace file: " << path << std::endl;
+        return false;
+    }
+
+    file << "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n"
+         << "    {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n"
+         << "    {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}},";
+    bool first = true;
+    double gpuCursorMs = 0.0;
+    for (size_t r = 0; r < profiler.records.size(); r++) {
+        const ProfilerRecord& record = profiler.records[r];
+        writeTraceEvent(file, first, "frame " + std::to_string(record.frame), 1, record.startMs, record.frameMs);
+
+        // Order the sections of the frame by their start time
+        std::vector<size_t> order;
+        for (size_t i = 0; i < record.cpuMs.size(); i++) {
+            if (record.sectionStartMs[i] >= 0.0) order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return record.sectionStartMs[a] < record.sectionStartMs[b]; });
+
+        for (size_t k = 0; k < order.size(); k++) {
+            size_t i = order[k];
+            writeTraceEvent(file, first, profiler.sections[i].name, 1, record.sectionStartMs[i], record.cpuMs[i]);
+            if (record.gpuMs[i] >= 0.0) {
+                gpuCursorMs = std::max(gpuCursorMs, record.sectionStartMs[i]);
+                writeTraceEvent(file, first, profiler.sections[i].name, 2, gpuCursorMs, record.gpuMs[i]);
+                gpuCursorMs += record.gpuMs[i];
+            }
+        }
+    }
+    file << "\n  ]\n}\n";
+    return bool(file);
+}
+
+ScopedTimer::ScopedTimer(Profiler* profiler, const char* name, bool gpu) : profiler(profiler), section(-1), gpuQuery(false) {
+    if (!profiler || !profiler->inFrame) {
+        this->profiler = nullptr;
+        return;
+    }
+    section = findSection(*profiler, name, gpu && profiler->gpuTimers);
+
+    ProfilerFrameSlot& slot = profiler->slots[profiler->frame % PROFILER_LATENCY];
+    growRecord(slot.record, profiler->sections.size());
+    if (gpu && profiler->gpuTimers && !profiler->gpuQueryActive) {
+        if (slot.usedQueries == int(slot.queries.size())) {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.usedQueries++]);
+        slot.querySections.push_back(section);
+        profiler->gpuQueryActive = true;
+        gpuQuery = true;
+    }
+    start = std::chrono::steady_clock::now();
+}
+
+ScopedTimer::~ScopedTimer() {
+    if (!profiler) return;
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    if (gpuQuery) {
+        glEndQuery(GL_TIME_ELAPSED);
+        profiler->gpuQueryActive = false;
+    }
+
+    ProfilerRecord& record = profiler->slots[profiler->frame % PROFILER_LATENCY].record;
+    record.cpuMs[section] += std::chrono::duration<double, std::milli>(end - start).count();
+    if (record.sectionStartMs[section] < 0.0) record.sectionStartMs[section] = millisecondsSince(*profiler, start);
+}
@@ -0,0 +1,135 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Number of frames whose GPU timer queries are in flight before their results are read
+const int PROFILER_LATENCY = 4;
+// Number of frames the rolling percentiles and averages are computed over
+const int PROFILER_WINDOW = 240;
+
+// Structure for a named part of the frame that is timed on the CPU and optionally on the GPU
+struct ProfilerSection {
+    std::string name;
+    bool gpu;                               // Whether GPU times are measured for this section
+    bool bytes;                             // Whether memory traffic is counted for this section
+};
+
+// Structure for the measurements of one frame, section times are summed over all scopes of a section
+struct ProfilerRecord {
+    long frame;
+    double startMs;                         // Start of the frame since the profiler was created
+    double frameMs;                         // Time from the start of this frame to the start of the next
+    std::vector<double> sectionStartMs;     // Start of the first scope of each section, -1 if it did not run
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;              // -1 if the section has no GPU time this frame
+    std::vector<double> bytes;              // Estimated bytes read and written in memory by the section
+    double memoryBytes;                     // Size of the renderer's images in this frame, 0 if not reported
+};
+
+// Structure for the timer queries of one frame in flight
+struct ProfilerFrameSlot {
+    std::vector<GLuint> queries;            // GL_TIME_ELAPSED queries, grown on demand and reused
+    std::vector<int> querySections;         // Section measured by each used query
+    int usedQueries;
+    bool pending;                           // Whether the slot holds a frame that was not resolved yet
+    ProfilerRecord record;
+};
+
+// Structure for a frame profiler with CPU scope timers and GPU timer query rings
+struct Profiler {
+    bool gpuTimers;                         // Whether GL_TIME_ELAPSED queries are issued
+    bool keepRecords;                       // Whether every record is kept for export
+    std::chrono::steady_clock::time_point origin;
+    std::vector<ProfilerSection> sections;
+    ProfilerFrameSlot slots[PROFILER_LATENCY];
+    long frame;                             // Index of the current frame, -1 before the first
+    bool inFrame;
+    bool gpuQueryActive;                    // GL_TIME_ELAPSED queries can not nest
+    std::deque<ProfilerRecord> window;      // The last PROFILER_WINDOW resolved records
+    std::vector<ProfilerRecord> records;    // All resolved records if keepRecords is set
+    std::string comparisonLabel;            // Change the section times are compared across, empty without one
+    long comparisonFrame;                   // First frame after the change
+    std::vector<double> comparisonMs;       // Average time per section before the change, GPU time where measured
+};
+
+// Structure for the rolling statistics of the recent frames
+struct ProfilerSummary {
+    int frames;
+    double fps;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    std::vector<double> cpuMs;              // Average per section
+    std::vector<double> gpuMs;              // Average per section, -1 without GPU times
+    std::vector<double> bytes;              // Average memory traffic per section
+    double memoryBytes;                     // Image memory of the last frame
+};
+
+// Function to create a profiler. gpuTimers needs a current GL context with timer queries.
+Profiler createProfiler(bool gpuTimers, bool keepRecords);
+
+// Function to start a new frame, reading the GPU times of the frame PROFILER_LATENCY frames ago
+void beginProfilerFrame(Profiler& profiler);
+
+// Function to end the current frame
+void endProfilerFrame(Profiler& profiler);
+
+// Function to wait for the GPU times of all frames still in flight
+void finishProfiler(Profiler& profiler);
+
+// Function to delete the timer queries
+void deleteProfiler(Profiler& profiler);
+
+// Function to add the estimated memory traffic of a section to the current frame.
+// Does nothing if profiler is nullptr or no frame is active.
+void countProfilerBytes(Profiler* profiler, const char* name, double bytes);
+
+// Function to add CPU time measured on another thread, such as the simulation of the frame, to a section of
+// the current frame. Does nothing if profiler is nullptr or no frame is active.
+void addProfilerTime(Profiler* profiler, const char* name, double cpuMs);
+
+// Function to report the memory held by the renderer's images in the current frame
+void setProfilerMemory(Profiler* profiler, double bytes);
+
+// Function to compute the percentiles of the frame time and the section averages over the recent frames
+ProfilerSummary summarizeProfiler(const Profiler& profiler);
+
+// Function to compute the same statistics over all kept records
+ProfilerSummary summarizeProfilerRecords(const Profiler& profiler);
+
+// Function to mark a change made between this frame and the next, such as rebuilt shaders. The section times
+// of the frames since the previous mark are kept, and the console line shows them next to the times after it.
+void markProfilerComparison(Profiler& profiler, const std::string& label);
+
+// Function to format the rolling statistics as one line for the console
+std::string formatProfilerSummary(const Profiler& profiler);
+
+// Function to write the kept records as CSV (.csv) or JSON (any other extension)
+bool writeProfile(const Profiler& profiler, const std::string& path);
+
+// Function to write the kept records in the Chrome trace event format (chrome://tracing, Perfetto)
+bool writeChromeTrace(const Profiler& profiler, const std::string& path);
+
+// Timer measuring the CPU time of a scope, and with gpu set the GPU time of the commands issued in it.
+// Does nothing if profiler is nullptr or no frame is active.
+class ScopedTimer {
+public:
+    ScopedTimer(Profiler* profiler, const char* name, bool gpu = false);
+    ~ScopedTimer();
+
+private:
+    ScopedTimer(const ScopedTimer&);
+    ScopedTimer& operator=(const ScopedTimer&);
+
+    Profiler* profiler;
+    int section;
+    bool gpuQuery;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PROFILER_H
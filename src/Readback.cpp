@@ -0,0 +1,93 @@
+#include "Readback.h"
+#include <cstring>
+
+// Function to create the pixel pack buffers for RGBA32F images of the given size
+TextureReadback createTextureReadback(int width, int height) {
+    TextureReadback readback;
+    readback.width = width;
+    readback.height = height;
+    readback.next = 0;
+    readback.pending = 0;
+
+    GLsizeiptr size = GLsizeiptr(width) * height * 4 * sizeof(float);
+    glGenBuffers(READBACK_BUFFERS, readback.pbos);
+    for (int i = 0; i < READBACK_BUFFERS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        readback.fences[i] = 0;
+        readback.frames[i] = -1;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return readback;
+}
+
+// Function to start copying a texture into the next free buffer. Returns false if all buffers are still pending.
+bool requestReadback(TextureReadback& readback, GLuint texture, int frame) {
+    if (readback.pending == READBACK_BUFFERS) return false;
+
+    int index = readback.next;
+    readback.next = (readback.next + 1) % READBACK_BUFFERS;
+    readback.pending++;
+    readback.frames[index] = frame;
+
+    // The texture was written with imageStore, make those writes visible to the copy
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbos[index]);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback.fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Make sure the copy is submitted even if nothing else flushes the command stream
+    glFlush();
+
+    return true;
+}
+
+// Function to copy the oldest pending frame into pixels. If wait is false, returns false
+// instead of blocking when that frame has not finished yet.
+bool collectReadback(TextureReadback& readback, std::vector<float>& pixels, int& frame, bool wait) {
+    if (readback.pending == 0) return false;
+
+    int index = (readback.next - readback.pending + READBACK_BUFFERS) % READBACK_BUFFERS;
+    GLsync& fence = readback.fences[index];
+    GLuint64 timeout = wait ? 1000000 : 0;
+    GLenum status;
+    do {
+        status = glClientWaitSync(fence, 0, timeout);
+    } while (wait && status == GL_TIMEOUT_EXPIRED);
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) return false;
+
+    glDeleteSync(fence);
+    fence = 0;
+
+    size_t size = size_t(readback.width) * readback.height * 4;
+    pixels.resize(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbos[index]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * sizeof(float), GL_MAP_READ_BIT);
+    if (mapped) {
+        std::memcpy(pixels.data(), mapped, size * sizeof(float));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frame = readback.frames[index];
+    readback.frames[index] = -1;
+    readback.pending--;
+
+    return mapped != nullptr;
+}
+
+// Function to delete the pixel pack buffers and their fences
+void deleteTextureReadback(TextureReadback& readback) {
+    for (int i = 0; i < READBACK_BUFFERS; i++) {
+        if (readback.fences[i]) glDeleteSync(readback.fences[i]);
+        readback.fences[i] = 0;
+    }
+    glDeleteBuffers(READBACK_BUFFERS, readback.pbos);
+    readback.pending = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <GL/glew.h>
+#include <vector>
+
+// Number of pixel pack buffers in flight, so reading frame N never waits for frame N to finish
+const int READBACK_BUFFERS = 3;
+
+// Structure for asynchronous texture readback through a ring of pixel pack buffers
+struct TextureReadback {
+    GLuint pbos[READBACK_BUFFERS];
+    GLsync fences[READBACK_BUFFERS];    // Signalled once the copy into a buffer has finished
+    int frames[READBACK_BUFFERS];       // Frame stored in each buffer, -1 if unused
+    int width;
+    int height;
+    int next;                           // Buffer the next request will use
+    int pending;                        // Number of requests not collected yet
+};
+
+// Function to create the pixel pack buffers for RGBA32F images of the given size
+TextureReadback createTextureReadback(int width, int height);
+
+// Function to start copying a texture into the next free buffer. Returns false if all buffers are still pending.
+bool requestReadback(TextureReadback& readback, GLuint texture, int frame);
+
+// Function to copy the oldest pending frame into pixels. If wait is false, returns false
+// instead of blocking when that frame has not finished yet.
+bool collectReadback(TextureReadback& readback, std::vector<float>& pixels, int& frame, bool wait);
+
+// Function to delete the pixel pack buffers and their fences
+void deleteTextureReadback(TextureReadback& readback);
+
+#endif // READBACK_H
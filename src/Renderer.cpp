@@ -0,0 +1,96 @@
+#include "Renderer.h"
+#include "CpuRenderer.h"
+#include "GpuRenderer.h"
+#include "LightTree.h"
+#include "WavefrontRenderer.h"
+
+#include <iostream>
+
+Renderer::Renderer()
+    : profiler(nullptr), countRays(false), variableRate(false), shadowRays(DEFAULT_SHADOW_RAYS), quantizedScene(false), packetTracing(false), denoising(false), textureFormat(OUTPUT_RGBA32F) {
+    lastRayCounts = {0, 0, 0};
+    accumulation.camera = {glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+    accumulation.samples = 0;
+    accumulation.maxSamples = 1;
+    region = {0, 0, 0, 0};
+}
+
+// Function to start the next sample, restarting the image if the camera or scene changed.
+// Returns the index of the sample, or -1 if the image already has maxSamples.
+int Renderer::beginSample(const Camera& camera, bool sceneChanged) {
+    bool cameraChanged = camera.position != accumulation.camera.position
+                         || camera.direction != accumulation.camera.direction
+                         || camera.focalLength != accumulation.camera.focalLength;
+    if (cameraChanged || sceneChanged) {
+        accumulation.camera = camera;
+        accumulation.samples = 0;
+    }
+    if (accumulation.samples > 0 && accumulation.samples >= accumulation.maxSamples) return -1;
+    return accumulation.samples++;
+}
+
+// Function to get the region traced by a renderer of the given size, the whole image unless one was set
+ImageRegion Renderer::imageRegion(int width, int height) const {
+    if (region.imageWidth <= 0 || region.imageHeight <= 0) return {0, 0, width, height};
+    return region;
+}
+
+// Function to get the element of the Halton sequence with the given base
+static float haltonSequence(int index, int base) {
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    for (; index > 0; index /= base, fraction /= base) result += fraction * (index % base);
+    return result;
+}
+
+// Function to get the offset inside the pixel of a sample, a Halton (2, 3) point in [0, 1).
+// Sample 0 is the pixel corner that single-sample rendering always used.
+glm::vec2 sampleJitter(int sampleIndex) {
+    return glm::vec2(haltonSequence(sampleIndex, 2), haltonSequence(sampleIndex, 3));
+}
+
+// Function to estimate the bytes a GPU sample moves through the output and accumulation images
+double sampleImageTraffic(int width, int height, OutputFormat format, int sampleIndex) {
+    int accumulationBytes = sampleIndex > 0 ? 32 : 16;
+    return double(width) * height * (accumulationBytes + outputFormatBytes(format));
+}
+
+// Function to create a renderer, falling back from GPU to CPU for BACKEND_AUTO.
+// Unless the backend is BACKEND_CPU, a GL context must be current. Returns nullptr on failure.
+// cpuThreads sets the worker count of a CPU renderer, 0 uses all cores. maxBounces is the number of
+// reflections a wavefront renderer follows, the other backends always trace one.
+std::unique_ptr<Renderer> createRenderer(RendererBackend backend, int width, int height, int cpuThreads, int maxBounces) {
+    if (backend != BACKEND_WAVEFRONT && maxBounces != 1) {
+        std::cerr << "Only the wavefront backend traces more than one bounce" << std::endl;
+    }
+    if (backend == BACKEND_WAVEFRONT) {
+        if (GLEW_VERSION_4_3) {
+            std::unique_ptr<WavefrontRenderer> wavefront(new WavefrontRenderer(width, height, maxBounces));
+            if (wavefront->valid()) return std::unique_ptr<Renderer>(wavefront.release());
+        }
+        std::cerr << "The wavefront backend needs OpenGL 4.3 compute shaders" << std::endl;
+        return nullptr;
+    }
+    if (backend != BACKEND_CPU) {
+        if (GLEW_VERSION_4_3) {
+            std::unique_ptr<GpuRenderer> gpu(new GpuRenderer(width, height));
+            if (gpu->valid()) return std::unique_ptr<Renderer>(gpu.release());
+        }
+        if (backend == BACKEND_GPU) {
+            std::cerr << "The GPU backend needs OpenGL 4.3 compute shaders" << std::endl;
+            return nullptr;
+        }
+        std::cerr << "Falling back to the CPU backend" << std::endl;
+    }
+    return std::unique_ptr<Renderer>(new CpuRenderer(width, height, cpuThreads));
+}
+
+// Function to parse a backend name (auto, gpu, wavefront, cpu), returns false for unknown names
+bool parseRendererBackend(const std::string& name, RendererBackend& backend) {
+    if (name == "auto") backend = BACKEND_AUTO;
+    else if (name == "gpu") backend = BACKEND_GPU;
+    else if (name == "wavefront") backend = BACKEND_WAVEFRONT;
+    else if (name == "cpu") backend = BACKEND_CPU;
+    else return false;
+    return true;
+}
@@ -0,0 +1,196 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "Animation.h"
+#include "BVH.h"
+#include "Geometry.h"
+#include "Profiler.h"
+#include "Shader.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Structure for the camera a frame is rendered from
+struct Camera {
+    glm::vec3 position;
+    glm::vec3 direction;
+    float focalLength;
+};
+
+// Structure for the part of a larger image a renderer traces, so the tiles of a distributed frame are traced
+// with the rays and random numbers the whole image would use. The size of the region is the renderer's size.
+struct ImageRegion {
+    int x;              // Offset of the region in the full image, in pixels from the bottom left
+    int y;
+    int imageWidth;     // Size of the full image, 0 if the renderer traces the whole image
+    int imageHeight;
+};
+
+// Structure tracking the samples averaged into the current image of a renderer
+struct Accumulation {
+    Camera camera;      // Camera the accumulated samples were traced from
+    int samples;        // Samples per pixel in the current image, 0 after a reset
+    int maxSamples;     // Samples after which a static image counts as converged
+};
+
+// Structure for the number of rays traced in a frame
+struct RayCounts {
+    uint64_t primary;
+    uint64_t reflection;
+    uint64_t shadow;
+};
+
+// Backends that can render a frame
+enum RendererBackend {
+    BACKEND_AUTO,   // GPU if OpenGL 4.3 compute shaders are available, CPU otherwise
+    BACKEND_GPU,
+    BACKEND_CPU,
+    BACKEND_WAVEFRONT   // GPU split into passes with ray queues, the only backend with more than one bounce
+};
+
+// Interface shared by the GPU, wavefront and CPU backends
+class Renderer {
+public:
+    Renderer();
+    virtual ~Renderer() {}
+
+    // Function to get the name of the backend for logging
+    virtual const char* name() const = 0;
+
+    // Function to change the size of the output image
+    virtual void resize(int width, int height) = 0;
+
+    // Function to add a sample to the image, or start a new image if the camera or scene changed.
+    // Does nothing once a static image has maxSamples. The BVH must be up to date with the scene spheres.
+    // changes lists the objects moved since the previous call, with the sphere BVH refit by one updateBVH, and only
+    // those are updated. Null when the scene may have been replaced as a whole, which sets up all scene data again.
+    virtual void render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) = 0;
+
+    // Function to get a texture in outputFormat() holding the last frame, requires a current GL context
+    virtual GLuint outputTexture() = 0;
+
+    // Function to choose the format of outputTexture(). Only the GPU backends support formats other than RGBA32F.
+    virtual void setOutputFormat(OutputFormat format) { (void)format; }
+
+    // Function to get the format of outputTexture()
+    OutputFormat outputFormat() const { return textureFormat; }
+
+    // Function to get the bytes of the images the renderer keeps for the current size
+    virtual size_t imageBytes() const { return 0; }
+
+    // Function to get the last frame as RGBA floats (bottom row first) if it was rendered
+    // on the host, nullptr if it only exists in outputTexture()
+    virtual const float* hostPixels() const { return nullptr; }
+
+    // Function to get the number of scene bytes sent to the GPU for the last frame
+    virtual size_t sceneBytesUploaded() const { return 0; }
+
+    // Function to list the compute shader variants the renderer compiled so far, so they can be rebuilt when
+    // their sources change. The CPU backend has none.
+    virtual void listShaderVariants(std::vector<ShaderVariantProgram>& variants) const { (void)variants; }
+
+    // Function to switch to programs rebuilt for the listed variants, deleting the ones they replace. The image
+    // restarts, since the new shaders may trace it differently.
+    virtual void replaceShaderVariants(const std::vector<ShaderVariantProgram>& rebuilt) { (void)rebuilt; }
+
+    // Function to set the samples per pixel after which a static image stops being refined
+    void setMaxSamples(int maxSamples) { accumulation.maxSamples = maxSamples; }
+
+    // Function to get the number of samples averaged in the current image
+    int sampleCount() const { return accumulation.samples; }
+
+    // Function to discard the accumulated samples, the next frame starts a new image
+    void resetAccumulation() { accumulation.samples = 0; }
+
+    // Function to time the upload and trace of every frame with a profiler, nullptr disables it
+    void setProfiler(Profiler* frameProfiler) { profiler = frameProfiler; }
+
+    // Function to count the rays of every frame, which slows the tracing down, so not for timed frames
+    void setRayCounting(bool enabled) { countRays = enabled; }
+
+    // Function to trace the periphery of the image once per 2x2 pixel block while the centre is traced
+    // per pixel. Only the GPU backend supports it, the others always trace every pixel.
+    void setVariableRate(bool enabled) {
+        if (enabled != variableRate) resetAccumulation();
+        variableRate = enabled;
+    }
+
+    // Function to set the shadow rays per pixel and sample. Scenes with more lights pick that many lights
+    // from their light BVH at random each sample, and the accumulation averages the picks.
+    void setShadowRays(int rays) {
+        if (rays != shadowRays) resetAccumulation();
+        shadowRays = rays;
+    }
+
+    // Function to store the spheres as 16-bit coordinates on a grid over their BVH leaf, which halves the bytes
+    // the sphere tests read but shrinks every sphere by up to a grid step. Only the GPU backends support it.
+    void setSceneQuantization(bool enabled) {
+        if (enabled != quantizedScene) resetAccumulation();
+        quantizedScene = enabled;
+    }
+
+    // Function to trace the primary and shadow rays of a workgroup as packets that share the BVH nodes and
+    // spheres they read through shared memory. Only the GPU backend supports it, the image stays the same.
+    void setPacketTracing(bool enabled) { packetTracing = enabled; }
+
+    // Function to filter the accumulated image with an edge-avoiding à-trous denoiser guided by the normals, depths
+    // and albedos of the first surfaces, so few samples per pixel look clean. Only the GPU backends support it.
+    void setDenoising(bool enabled) {
+        if (enabled != denoising) resetAccumulation();
+        denoising = enabled;
+    }
+
+    // Function to trace only a region of a larger image, the renderer's size is the size of the region.
+    // An imageWidth of 0 traces the whole image again.
+    void setImageRegion(const ImageRegion& newRegion) {
+        if (newRegion.x != region.x || newRegion.y != region.y || newRegion.imageWidth != region.imageWidth
+            || newRegion.imageHeight != region.imageHeight) resetAccumulation();
+        region = newRegion;
+    }
+
+    // Function to get the rays traced by the last frame while counting was enabled
+    RayCounts rayCounts() const { return lastRayCounts; }
+
+protected:
+    // Function to start the next sample, restarting the image if the camera or scene changed.
+    // Returns the index of the sample, or -1 if the image already has maxSamples.
+    int beginSample(const Camera& camera, bool sceneChanged);
+
+    // Function to get the region traced by a renderer of the given size, the whole image unless one was set
+    ImageRegion imageRegion(int width, int height) const;
+
+    Accumulation accumulation;
+    Profiler* profiler;
+    bool countRays;
+    bool variableRate;
+    int shadowRays;
+    bool quantizedScene;
+    bool packetTracing;
+    bool denoising;
+    ImageRegion region;
+    OutputFormat textureFormat;
+    RayCounts lastRayCounts;
+};
+
+// Function to get the offset inside the pixel of a sample, a Halton (2, 3) point in [0, 1).
+// Sample 0 is the pixel corner that single-sample rendering always used.
+glm::vec2 sampleJitter(int sampleIndex);
+
+// Function to estimate the bytes a GPU sample moves through the images: the accumulation texture is read
+// (except for the first sample) and written, and the output texture is written
+double sampleImageTraffic(int width, int height, OutputFormat format, int sampleIndex);
+
+// Function to create a renderer, falling back from GPU to CPU for BACKEND_AUTO.
+// Unless the backend is BACKEND_CPU, a GL context must be current. Returns nullptr on failure.
+// cpuThreads sets the worker count of a CPU renderer, 0 uses all cores. maxBounces is the number of
+// reflections a wavefront renderer follows, the other backends always trace one.
+std::unique_ptr<Renderer> createRenderer(RendererBackend backend, int width, int height, int cpuThreads = 0, int maxBounces = 1);
+
+// Function to parse a backend name (auto, gpu, wavefront, cpu), returns false for unknown names
+bool parseRendererBackend(const std::string& name, RendererBackend& backend);
+
+#endif // RENDERER_H
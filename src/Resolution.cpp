@@ -0,0 +1,66 @@
+#include "Resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Function to create a controller for a frame time budget in milliseconds, 0 disables scaling
+ResolutionController createResolutionController(double targetMs) {
+    ResolutionController controller;
+    controller.targetMs = targetMs;
+    controller.scale = 1.0f;
+    controller.motionScale = 1.0f;
+    controller.smoothedMs = 0.0;
+    controller.measuredFrames = 0;
+    controller.settleFrames = 0;
+    controller.staticFrames = 0;
+    return controller;
+}
+
+// Function to change the scale and restart the measurement
+static void setScale(ResolutionController& controller, float scale) {
+    controller.scale = scale;
+    controller.measuredFrames = 0;
+    controller.settleFrames = RESOLUTION_SETTLE_FRAMES;
+}
+
+// Function to add the time of the last frame and whether its view was static, returns true if the scale changed
+bool updateResolutionController(ResolutionController& controller, double frameMs, bool staticView) {
+    if (controller.targetMs <= 0.0) return false;
+
+    // A static image converges over many frames, so refine it at the full resolution instead of
+    // lowering the resolution to keep the time of each sample in budget
+    controller.staticFrames = staticView ? controller.staticFrames + 1 : 0;
+    if (controller.staticFrames >= RESOLUTION_STATIC_FRAMES) {
+        if (controller.scale == 1.0f) return false;
+        controller.motionScale = controller.scale;
+        setScale(controller, 1.0f);
+        return true;
+    }
+    if (!staticView && controller.motionScale < 1.0f) {
+        setScale(controller, controller.motionScale);
+        controller.motionScale = 1.0f;
+        return true;
+    }
+
+    if (controller.settleFrames > 0) {
+        controller.settleFrames--;
+        return false;
+    }
+    // Average out single slow frames, e.g. from other processes
+    controller.smoothedMs = controller.measuredFrames == 0 ? frameMs : 0.8 * controller.smoothedMs + 0.2 * frameMs;
+    controller.measuredFrames++;
+    if (controller.measuredFrames < RESOLUTION_MEASURE_FRAMES || controller.smoothedMs <= 0.0) return false;
+
+    // The trace time grows with the pixel count, the square of the scale
+    double ratio = RESOLUTION_HEADROOM * controller.targetMs / controller.smoothedMs;
+    float scale = float(std::min(1.0, std::max(double(RESOLUTION_MIN_SCALE), controller.scale * std::sqrt(ratio))));
+    if (std::fabs(scale - controller.scale) < RESOLUTION_MIN_STEP * controller.scale) return false;
+    setScale(controller, scale);
+    return true;
+}
+
+// Function to get the trace resolution for a window size at the current scale
+void resolutionFor(const ResolutionController& controller, int windowWidth, int windowHeight, int& width, int& height) {
+    width = std::max(1, int(std::lround(windowWidth * controller.scale)));
+    height = std::max(1, int(std::lround(windowHeight * controller.scale)));
+}
@@ -0,0 +1,39 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+// Smallest fraction of the window size per axis the controller traces at
+const float RESOLUTION_MIN_SCALE = 0.25f;
+// Frames measured at a scale before the controller changes it again
+const int RESOLUTION_MEASURE_FRAMES = 8;
+// Frames the view has to stay static before the image is refined at the full resolution
+const int RESOLUTION_STATIC_FRAMES = 8;
+// Frames skipped after a change, they include the reallocation of the textures
+const int RESOLUTION_SETTLE_FRAMES = 2;
+// Smallest relative change of the scale worth reallocating the textures for
+const float RESOLUTION_MIN_STEP = 0.05f;
+// Fraction of the budget the controller aims for, leaving room for frame time variance
+const double RESOLUTION_HEADROOM = 0.9;
+
+// Structure for a dynamic resolution controller that scales the trace resolution to hold a frame time budget
+struct ResolutionController {
+    double targetMs;        // Frame time budget, 0 keeps the full window resolution
+    float scale;            // Fraction of the window size per axis that is traced
+    float motionScale;      // Scale to return to when the view moves again after being refined at full resolution
+    double smoothedMs;      // Moving average of the frame times measured since the last change
+    int measuredFrames;     // Frames in smoothedMs
+    int settleFrames;       // Frames to skip before measuring again after a change
+    int staticFrames;       // Consecutive frames in which neither the camera nor the scene changed
+};
+
+// Function to create a controller for a frame time budget in milliseconds, 0 disables scaling
+ResolutionController createResolutionController(double targetMs);
+
+// Function to add the time of the last frame and whether its view was static. Moving views are traced at the
+// scale that meets the budget, static views are refined at the full resolution. Returns true if the scale
+// changed and the renderer has to be resized to resolutionFor() of the window size.
+bool updateResolutionController(ResolutionController& controller, double frameMs, bool staticView);
+
+// Function to get the trace resolution for a window size at the current scale
+void resolutionFor(const ResolutionController& controller, int windowWidth, int windowHeight, int& width, int& height);
+
+#endif // RESOLUTION_H
@@ -0,0 +1,539 @@
+#include "SceneBuffer.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+// Function to round a byte size up to the next multiple of alignment
+static size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Function to set up an empty section, its offset is assigned when the storage is allocated
+static void initSection(SceneBufferSection& section, size_t stride, size_t capacity) {
+    section.offset = 0;
+    section.stride = stride;
+    section.capacity = capacity;
+    section.count = 0;
+}
+
+// Function to record a dirty range for every region of the buffer
+static void markDirty(SceneBufferSection& section, size_t begin, size_t end) {
+    DirtyRange range = {begin, end};
+    for (int i = 0; i < SCENE_BUFFER_REGIONS; i++) {
+        section.pending[i].push_back(range);
+    }
+}
+
+// Function to compare new contents of the objects [first, first + count) of a section against the mirror and
+// record the changed ones. Objects beyond the current count always count as changed.
+static bool recordObjects(SceneBufferSection& section, const void* data, size_t first, size_t count) {
+    const char* source = static_cast<const char*>(data);
+    bool anyChanged = false;
+    bool inRun = false;
+    size_t runBegin = 0;
+    for (size_t i = first; i < first + count; i++) {
+        char* mirrored = &section.mirror[i * section.stride];
+        const char* object = source + (i - first) * section.stride;
+        bool changed = i >= section.count || std::memcmp(mirrored, object, section.stride) != 0;
+
+        if (changed) {
+            anyChanged = true;
+            std::memcpy(mirrored, object, section.stride);
+            if (!inRun) {
+                runBegin = i;
+                inRun = true;
+            }
+        } else if (inRun) {
+            markDirty(section, runBegin, i);
+            inRun = false;
+        }
+    }
+    if (inRun) markDirty(section, runBegin, first + count);
+    return anyChanged;
+}
+
+// Function to compare new section contents against the mirror and record the changed objects
+static bool recordSection(SceneBufferSection& section, const void* data, size_t count) {
+    bool changed = recordObjects(section, data, 0, count) || count != section.count;
+    section.count = count;
+    return changed;
+}
+
+// Function to write the pending ranges of a section into the current region
+static size_t flushSection(SceneBuffer& sceneBuffer, SceneBufferSection& section) {
+    std::vector<DirtyRange>& pending = section.pending[sceneBuffer.region];
+    if (pending.empty()) return 0;
+
+    // Ranges accumulate over the frames in which this region was not in use, so merge overlaps first
+    std::sort(pending.begin(), pending.end(), [](const DirtyRange& a, const DirtyRange& b) { return a.begin < b.begin; });
+
+    size_t regionOffset = sceneBuffer.region * sceneBuffer.regionSize;
+    size_t written = 0;
+    size_t i = 0;
+    while (i < pending.size()) {
+        size_t begin = pending[i].begin;
+        size_t end = pending[i].end;
+        for (i++; i < pending.size() && pending[i].begin <= end; i++) {
+            end = std::max(end, pending[i].end);
+        }
+        end = std::min(end, section.count);
+        if (begin >= end) continue;
+
+        size_t offset = regionOffset + section.offset + begin * section.stride;
+        size_t size = (end - begin) * section.stride;
+        const char* source = &section.mirror[begin * section.stride];
+        if (sceneBuffer.mapped) {
+            std::memcpy(sceneBuffer.mapped + offset, source, size);
+        } else {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, source);
+        }
+        written += size;
+    }
+    pending.clear();
+
+    return written;
+}
+
+// Function to lay out the sections by their capacity and allocate the GL storage for all regions
+static void allocateStorage(SceneBuffer& sceneBuffer) {
+    // Each array gets its own binding point, so every section must start at a bindable offset
+    GLint alignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+
+    size_t offset = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        SceneBufferSection& section = sceneBuffer.sections[i];
+        section.offset = offset;
+        section.mirror.resize(section.capacity * section.stride);
+        // Reserve at least one object so that empty arrays can still be bound
+        offset = alignUp(offset + std::max<size_t>(section.capacity, 1) * section.stride, alignment);
+    }
+    sceneBuffer.regionSize = offset;
+    GLsizeiptr totalSize = sceneBuffer.regionSize * SCENE_BUFFER_REGIONS;
+
+    sceneBuffer.mapped = nullptr;
+    glGenBuffers(1, &sceneBuffer.ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBuffer.ssbo);
+
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, totalSize, nullptr, flags);
+        sceneBuffer.mapped = static_cast<char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, totalSize, flags));
+    }
+    if (!sceneBuffer.mapped) {
+        // Immutable storage cannot be respecified, so start over with a mutable buffer
+        std::cerr << "Persistent mapping unavailable, falling back to glBufferSubData uploads" << std::endl;
+        glDeleteBuffers(1, &sceneBuffer.ssbo);
+        glGenBuffers(1, &sceneBuffer.ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBuffer.ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Function to wait for all regions and release the GL storage, keeping the CPU mirrors
+static void releaseStorage(SceneBuffer& sceneBuffer) {
+    for (int i = 0; i < SCENE_BUFFER_REGIONS; i++) {
+        GLsync& fence = sceneBuffer.fences[i];
+        if (!fence) continue;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    if (sceneBuffer.mapped) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBuffer.ssbo);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        sceneBuffer.mapped = nullptr;
+    }
+    glDeleteBuffers(1, &sceneBuffer.ssbo);
+    sceneBuffer.ssbo = 0;
+}
+
+// Function to re-send everything after the storage was reallocated
+static void markAllDirty(SceneBuffer& sceneBuffer) {
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        SceneBufferSection& section = sceneBuffer.sections[i];
+        for (int r = 0; r < SCENE_BUFFER_REGIONS; r++) section.pending[r].clear();
+        if (section.count > 0) markDirty(section, 0, section.count);
+    }
+}
+
+// Function to enlarge the buffer when the scene no longer fits, re-sending everything to the new storage
+static void reserveSceneBuffer(SceneBuffer& sceneBuffer, const size_t counts[SECTION_COUNT]) {
+    bool fits = true;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        if (counts[i] > sceneBuffer.sections[i].capacity) fits = false;
+    }
+    if (fits) return;
+
+    releaseStorage(sceneBuffer);
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        SceneBufferSection& section = sceneBuffer.sections[i];
+        // Grow geometrically so that a slowly growing scene does not reallocate every frame
+        if (counts[i] > section.capacity) section.capacity = std::max(counts[i], 2 * section.capacity);
+    }
+    markAllDirty(sceneBuffer);
+    allocateStorage(sceneBuffer);
+}
+
+// Function to create the persistent scene buffer with an initial object capacity
+SceneBuffer createSceneBuffer(size_t maxSpheres, size_t maxPlanes, size_t maxLights) {
+    SceneBuffer sceneBuffer;
+    sceneBuffer.region = SCENE_BUFFER_REGIONS - 1;
+    sceneBuffer.bytesUploaded = 0;
+    sceneBuffer.totalBytesUploaded = 0;
+    sceneBuffer.changed = false;
+    sceneBuffer.loaded = false;
+    for (int i = 0; i < SCENE_BUFFER_REGIONS; i++) sceneBuffer.fences[i] = 0;
+
+    initSection(sceneBuffer.sections[SECTION_SPHERES], sizeof(glm::vec4), maxSpheres);
+    initSection(sceneBuffer.sections[SECTION_PLANES], sizeof(glm::vec4), maxPlanes);
+    initSection(sceneBuffer.sections[SECTION_LIGHTS], sizeof(Light), maxLights);
+    initSection(sceneBuffer.sections[SECTION_MATERIALS], sizeof(Material), 1);
+    initSection(sceneBuffer.sections[SECTION_OBJECT_MATERIALS], sizeof(GLuint), maxSpheres + maxPlanes);
+    initSection(sceneBuffer.sections[SECTION_NODES], sizeof(BVHNode), 2 * maxSpheres);
+    // Meshes are optional, their sections start with room for one object
+    initSection(sceneBuffer.sections[SECTION_MESH_WORDS], sizeof(GLuint), 1);
+    initSection(sceneBuffer.sections[SECTION_INSTANCES], sizeof(InstanceRecord), 1);
+    initSection(sceneBuffer.sections[SECTION_LIGHT_NODES], sizeof(LightNode), 2 * maxLights);
+    sceneBuffer.instanceRoot = -1;
+    sceneBuffer.sphereRoot = -1;
+    sceneBuffer.quantized = false;
+    allocateStorage(sceneBuffer);
+
+    return sceneBuffer;
+}
+
+// Function to choose between float and quantized spheres, the next update re-sends the spheres in the new format
+void setSceneBufferQuantization(SceneBuffer& sceneBuffer, bool quantized) {
+    if (quantized == sceneBuffer.quantized) return;
+    sceneBuffer.quantized = quantized;
+
+    // The stride of the sphere section changes the layout of every region
+    releaseStorage(sceneBuffer);
+    SceneBufferSection& spheres = sceneBuffer.sections[SECTION_SPHERES];
+    spheres.stride = quantized ? sizeof(glm::uvec2) : sizeof(glm::vec4);
+    spheres.count = 0;
+    sceneBuffer.loaded = false;
+    markAllDirty(sceneBuffer);
+    allocateStorage(sceneBuffer);
+}
+
+// Function to copy the nodes of a BVH to where it starts in the node section, moving the child indices of its
+// inner nodes along. Leaves keep indexing the objects of their own section.
+static void placeNodes(const std::vector<BVHNode>& nodes, GLuint root, std::vector<BVHNode>& placed) {
+    placed = nodes;
+    for (BVHNode& node : placed) {
+        if (node.count == 0) node.rightOrFirst += root;
+    }
+}
+
+// Function to store a sphere as 16-bit coordinates on a grid over the bounds of its leaf, with the radius in steps
+// of the largest grid step. Rounding moves the center by up to half a step per axis, so the radius is rounded down
+// by that much more and the stored sphere never leaves the bounds the BVH was built for.
+static glm::uvec2 quantizeSphere(const Sphere& sphere, const glm::vec3& boundsMin, const glm::vec3& step, float radiusStep) {
+    GLuint cells[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float cell = step[axis] > 0.0f ? (sphere.center[axis] - boundsMin[axis]) / step[axis] : 0.0f;
+        cells[axis] = GLuint(std::min(std::max(cell + 0.5f, 0.0f), SPHERE_GRID_STEPS));
+    }
+    float radiusCells = radiusStep > 0.0f ? (sphere.radius - 0.5f * radiusStep) / radiusStep : 0.0f;
+    GLuint radius = GLuint(std::min(std::max(radiusCells, 0.0f), SPHERE_GRID_STEPS));
+    return glm::uvec2(cells[0] | (cells[1] << 16), cells[2] | (radius << 16));
+}
+
+// Function to gather the spheres of one leaf of their BVH into its run of the sphere array. The shaders decode a
+// quantized sphere with the bounds of the leaf they are testing, sphereAt in common.glsl.
+static void gatherLeafSpheres(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH, const BVHNode& leaf) {
+    GLuint end = leaf.rightOrFirst + leaf.count;
+    if (!sceneBuffer.quantized) {
+        for (GLuint i = leaf.rightOrFirst; i < end; i++) {
+            const Sphere& sphere = scene.spheres[sphereBVH.primIndices[i]];
+            sceneBuffer.sphereData[i] = glm::vec4(sphere.center, sphere.radius);
+        }
+        return;
+    }
+
+    glm::vec3 step = (leaf.boundsMax - leaf.boundsMin) / SPHERE_GRID_STEPS;
+    float radiusStep = std::max(step.x, std::max(step.y, step.z));
+    for (GLuint i = leaf.rightOrFirst; i < end; i++) {
+        sceneBuffer.packedSpheres[i] = quantizeSphere(scene.spheres[sphereBVH.primIndices[i]], leaf.boundsMin, step, radiusStep);
+    }
+}
+
+// Function to gather the spheres in the leaf order of their BVH, so each leaf is one contiguous run and the
+// shaders need no index indirection. Only the center and radius are stored, the colors are in the material table.
+static void gatherSpheres(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH) {
+    size_t count = sphereBVH.primIndices.size();
+    if (sceneBuffer.quantized) sceneBuffer.packedSpheres.resize(count);
+    else sceneBuffer.sphereData.resize(count);
+    for (const BVHNode& node : sphereBVH.nodes) {
+        if (node.count > 0) gatherLeafSpheres(sceneBuffer, scene, sphereBVH, node);
+    }
+}
+
+// Function to refit the BVH over the instances and gather the instances in its leaf order like the spheres. The
+// instances are few, so their BVH is simply refit to all of them. Its nodes go behind the mesh BVHs.
+static void gatherInstances(SceneBuffer& sceneBuffer, const Scene& scene) {
+    computeInstanceBounds(scene, sceneBuffer.instanceBounds);
+    if (scene.instances.empty()) sceneBuffer.instanceBVH = BVH();
+    else updateBVH(sceneBuffer.instanceBVH, sceneBuffer.instanceBounds);
+    GLuint instanceRoot = GLuint(scene.meshNodes.size());
+    sceneBuffer.instanceRoot = scene.instances.empty() ? -1 : GLint(instanceRoot);
+    placeNodes(sceneBuffer.instanceBVH.nodes, instanceRoot, sceneBuffer.instanceNodes);
+    sceneBuffer.instances.clear();
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const MeshInstance& instance = scene.instances[sceneBuffer.instanceBVH.primIndices[i]];
+        InstanceRecord record;
+        for (int row = 0; row < 3; row++) {
+            record.objectToWorld[row] = instance.objectToWorld[row];
+            record.worldToObject[row] = instance.worldToObject[row];
+        }
+        record.mesh = scene.meshes[instance.mesh];
+        sceneBuffer.instances.push_back(record);
+    }
+}
+
+// Function to store the material of the object at index, returns true if it differs from the stored one
+static bool storeMaterial(std::vector<Material>& materials, size_t index, const glm::vec3& color, float reflectivity) {
+    Material material = {color, reflectivity};
+    if (std::memcmp(&materials[index], &material, sizeof(Material)) == 0) return false;
+    materials[index] = material;
+    return true;
+}
+
+// Hash and equality of materials by their bytes, for the table lookup
+struct MaterialHash {
+    size_t operator()(const Material& material) const {
+        GLuint words[4];
+        std::memcpy(words, &material, sizeof(words));
+        size_t hash = 0;
+        for (GLuint word : words) hash = hash * 1000003u ^ word;
+        return hash;
+    }
+};
+
+struct MaterialEqual {
+    bool operator()(const Material& a, const Material& b) const { return std::memcmp(&a, &b, sizeof(Material)) == 0; }
+};
+
+// Function to collect the materials of all objects in scene order and rebuild the material table if any changed
+static void updateMaterials(SceneBuffer& sceneBuffer, const Scene& scene) {
+    size_t planeBase = scene.spheres.size();
+    size_t instanceBase = planeBase + scene.planes.size();
+    size_t count = instanceBase + scene.instances.size();
+    std::vector<Material>& sceneMaterials = sceneBuffer.sceneMaterials;
+    bool changed = sceneMaterials.size() != count;
+    sceneMaterials.resize(count);
+    for (size_t i = 0; i < scene.spheres.size(); i++) {
+        changed |= storeMaterial(sceneMaterials, i, scene.spheres[i].color, scene.spheres[i].reflectivity);
+    }
+    for (size_t i = 0; i < scene.planes.size(); i++) {
+        changed |= storeMaterial(sceneMaterials, planeBase + i, scene.planes[i].color, scene.planes[i].reflectivity);
+    }
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        changed |= storeMaterial(sceneMaterials, instanceBase + i, scene.instances[i].color, scene.instances[i].reflectivity);
+    }
+    if (!changed) return;
+
+    std::unordered_map<Material, GLuint, MaterialHash, MaterialEqual> lookup;
+    sceneBuffer.materials.clear();
+    sceneBuffer.sceneMaterialIndices.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        auto inserted = lookup.insert(std::make_pair(sceneMaterials[i], GLuint(sceneBuffer.materials.size())));
+        if (inserted.second) sceneBuffer.materials.push_back(sceneMaterials[i]);
+        sceneBuffer.sceneMaterialIndices[i] = inserted.first->second;
+    }
+}
+
+// Function to look up the material indices of the instances in their leaf order, behind those of the spheres and planes
+static void gatherInstanceMaterials(SceneBuffer& sceneBuffer, const Scene& scene) {
+    size_t instanceBase = scene.spheres.size() + scene.planes.size();
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        sceneBuffer.objectMaterials[instanceBase + i] = sceneBuffer.sceneMaterialIndices[instanceBase + sceneBuffer.instanceBVH.primIndices[i]];
+    }
+}
+
+// Function to gather the whole scene and record the objects that differ from the mirrors
+static void recordScene(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH) {
+    gatherInstances(sceneBuffer, scene);
+    GLuint instanceRoot = GLuint(scene.meshNodes.size());
+    // The sphere BVH goes last, so scenes without meshes use its nodes as they are
+    GLuint sphereRoot = instanceRoot + GLuint(sceneBuffer.instanceNodes.size());
+    sceneBuffer.sphereRoot = sphereBVH.nodes.empty() ? -1 : GLint(sphereRoot);
+    if (sphereRoot > 0) placeNodes(sphereBVH.nodes, sphereRoot, sceneBuffer.sphereNodes);
+    const std::vector<BVHNode>& sphereNodes = sphereRoot > 0 ? sceneBuffer.sphereNodes : sphereBVH.nodes;
+    size_t nodeCount = sphereRoot + sphereNodes.size();
+
+    gatherSpheres(sceneBuffer, scene, sphereBVH);
+    sceneBuffer.planeData.resize(scene.planes.size());
+    for (size_t i = 0; i < scene.planes.size(); i++) {
+        const Plane& plane = scene.planes[i];
+        sceneBuffer.planeData[i] = glm::vec4(plane.normal, glm::dot(plane.normal, plane.point));
+    }
+    // Material indices follow the objects into the order of their sections
+    updateMaterials(sceneBuffer, scene);
+    size_t planeBase = scene.spheres.size();
+    size_t instanceBase = planeBase + scene.planes.size();
+    std::vector<GLuint>& objectMaterials = sceneBuffer.objectMaterials;
+    objectMaterials.resize(sceneBuffer.sceneMaterialIndices.size());
+    for (size_t i = 0; i < sphereBVH.primIndices.size(); i++) {
+        objectMaterials[i] = sceneBuffer.sceneMaterialIndices[sphereBVH.primIndices[i]];
+    }
+    for (size_t i = planeBase; i < instanceBase; i++) objectMaterials[i] = sceneBuffer.sceneMaterialIndices[i];
+    gatherInstanceMaterials(sceneBuffer, scene);
+
+    // The lights go to the GPU in the leaf order of their BVH like the instances
+    updateLightTree(sceneBuffer.lightTree, scene.lights);
+    const LightTree& lightTree = sceneBuffer.lightTree;
+
+    const size_t counts[SECTION_COUNT] = {
+        sphereBVH.primIndices.size(), scene.planes.size(), lightTree.lights.size(), sceneBuffer.materials.size(), objectMaterials.size(),
+        nodeCount, scene.meshWords.size(), sceneBuffer.instances.size(), lightTree.nodes.size()
+    };
+    reserveSceneBuffer(sceneBuffer, counts);
+
+    bool changed = false;
+    const void* spheres = sceneBuffer.quantized ? static_cast<const void*>(sceneBuffer.packedSpheres.data())
+                                                : static_cast<const void*>(sceneBuffer.sphereData.data());
+    changed |= recordSection(sceneBuffer.sections[SECTION_SPHERES], spheres, sphereBVH.primIndices.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_PLANES], sceneBuffer.planeData.data(), sceneBuffer.planeData.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_LIGHTS], lightTree.lights.data(), lightTree.lights.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_MATERIALS], sceneBuffer.materials.data(), sceneBuffer.materials.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_OBJECT_MATERIALS], objectMaterials.data(), objectMaterials.size());
+
+    // A refit only touches the nodes above moved spheres, so only those are re-sent
+    SceneBufferSection& nodes = sceneBuffer.sections[SECTION_NODES];
+    changed |= recordObjects(nodes, scene.meshNodes.data(), 0, scene.meshNodes.size());
+    changed |= recordObjects(nodes, sceneBuffer.instanceNodes.data(), instanceRoot, sceneBuffer.instanceNodes.size());
+    changed |= recordObjects(nodes, sphereNodes.data(), sphereRoot, sphereNodes.size());
+    changed |= nodes.count != nodeCount;
+    nodes.count = nodeCount;
+    changed |= recordSection(sceneBuffer.sections[SECTION_MESH_WORDS], scene.meshWords.data(), scene.meshWords.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_INSTANCES], sceneBuffer.instances.data(), sceneBuffer.instances.size());
+    changed |= recordSection(sceneBuffer.sections[SECTION_LIGHT_NODES], lightTree.nodes.data(), lightTree.nodes.size());
+    sceneBuffer.changed = changed;
+    sceneBuffer.loaded = true;
+}
+
+// Function to record only the objects moved since the last update. Moved lights and instances are few, so their
+// arrays are gathered again as a whole. Of the spheres only the leaves holding moved ones are, with the nodes above
+// them. Returns false if a rebuild of the instance BVH moved the sphere nodes, which needs recordScene.
+static bool recordMovedObjects(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH, const SceneChanges& changes) {
+    SceneBufferSection& nodes = sceneBuffer.sections[SECTION_NODES];
+    bool changed = false;
+    if (!changes.instances.empty()) {
+        size_t instanceNodeCount = sceneBuffer.instanceNodes.size();
+        gatherInstances(sceneBuffer, scene);
+        if (sceneBuffer.instanceNodes.size() != instanceNodeCount) return false;
+        // A rebuild also reorders the instances, and their materials with them
+        gatherInstanceMaterials(sceneBuffer, scene);
+        size_t instanceBase = scene.spheres.size() + scene.planes.size();
+        changed |= recordObjects(nodes, sceneBuffer.instanceNodes.data(), sceneBuffer.instanceRoot, instanceNodeCount);
+        changed |= recordSection(sceneBuffer.sections[SECTION_INSTANCES], sceneBuffer.instances.data(), sceneBuffer.instances.size());
+        changed |= recordObjects(sceneBuffer.sections[SECTION_OBJECT_MATERIALS], &sceneBuffer.objectMaterials[instanceBase], instanceBase,
+                                 scene.instances.size());
+    }
+
+    if (!changes.lights.empty()) {
+        updateLightTree(sceneBuffer.lightTree, scene.lights);
+        const LightTree& lightTree = sceneBuffer.lightTree;
+        // A rebuild of the light BVH may need more nodes than its section holds
+        size_t counts[SECTION_COUNT];
+        for (int i = 0; i < SECTION_COUNT; i++) counts[i] = sceneBuffer.sections[i].count;
+        counts[SECTION_LIGHT_NODES] = lightTree.nodes.size();
+        reserveSceneBuffer(sceneBuffer, counts);
+        changed |= recordSection(sceneBuffer.sections[SECTION_LIGHTS], lightTree.lights.data(), lightTree.lights.size());
+        changed |= recordSection(sceneBuffer.sections[SECTION_LIGHT_NODES], lightTree.nodes.data(), lightTree.nodes.size());
+    }
+
+    // The refit changed the bounds of the leaves holding moved spheres, which the quantized spheres of the whole leaf
+    // depend on, and of the nodes above them. Parents are stored before their children, so taking the highest index
+    // first reaches a node after its children, both of which come out in a row.
+    SceneBufferSection& spheres = sceneBuffer.sections[SECTION_SPHERES];
+    GLuint sphereRoot = GLuint(sceneBuffer.sphereRoot);
+    std::priority_queue<GLuint> dirty;
+    for (GLuint sphere : changes.spheres) dirty.push(sphereBVH.primLeaves[sphere]);
+    GLuint last = GLuint(sphereBVH.nodes.size());
+    while (!dirty.empty()) {
+        GLuint i = dirty.top();
+        dirty.pop();
+        if (i == last) continue;
+        last = i;
+
+        BVHNode node = sphereBVH.nodes[i];
+        if (node.count > 0) {
+            gatherLeafSpheres(sceneBuffer, scene, sphereBVH, node);
+            const void* leafSpheres = sceneBuffer.quantized ? static_cast<const void*>(&sceneBuffer.packedSpheres[node.rightOrFirst])
+                                                            : static_cast<const void*>(&sceneBuffer.sphereData[node.rightOrFirst]);
+            changed |= recordObjects(spheres, leafSpheres, node.rightOrFirst, node.count);
+        } else {
+            node.rightOrFirst += sphereRoot;
+        }
+        changed |= recordObjects(nodes, &node, sphereRoot + i, 1);
+        if (i > 0) dirty.push(sphereBVH.parents[i]);
+    }
+    sceneBuffer.changed = changed;
+    return true;
+}
+
+// Function to write the dirty parts of the scene into the next region and bind its sections
+void updateSceneBuffer(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH, const SceneChanges* changes) {
+    // Move on to the next region and wait until the GPU has stopped reading it
+    sceneBuffer.region = (sceneBuffer.region + 1) % SCENE_BUFFER_REGIONS;
+    GLsync& fence = sceneBuffer.fences[sceneBuffer.region];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // Moved objects keep their place in the sections as long as no object was added or removed. A rebuild of the
+    // sphere BVH regroups all spheres and clears the links to their leaves, so only a refit one can be patched.
+    bool patch = changes && sceneBuffer.loaded && sphereBVH.primIndices.size() == sceneBuffer.sections[SECTION_SPHERES].count
+                 && scene.lights.size() == sceneBuffer.lightTree.lights.size() && scene.instances.size() == sceneBuffer.instances.size()
+                 && (changes->spheres.empty() || sphereBVH.parents.size() == sphereBVH.nodes.size());
+    if (!patch || !recordMovedObjects(sceneBuffer, scene, sphereBVH, *changes)) recordScene(sceneBuffer, scene, sphereBVH);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBuffer.ssbo);
+
+    sceneBuffer.bytesUploaded = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        sceneBuffer.bytesUploaded += flushSection(sceneBuffer, sceneBuffer.sections[i]);
+    }
+    sceneBuffer.totalBytesUploaded += sceneBuffer.bytesUploaded;
+
+    // Bind every section of the current region to its binding point
+    size_t regionOffset = sceneBuffer.region * sceneBuffer.regionSize;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        const SceneBufferSection& section = sceneBuffer.sections[i];
+        size_t size = std::max<size_t>(section.count, 1) * section.stride;
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SCENE_SECTION_BINDINGS[i], sceneBuffer.ssbo, regionOffset + section.offset, size);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Function to pass the object counts of the bound scene to the compute shaders
+void setSceneBufferUniforms(FrameUniforms& uniforms, const SceneBuffer& sceneBuffer) {
+    uniforms.numSpheres = GLint(sceneBuffer.sections[SECTION_SPHERES].count);
+    uniforms.numPlanes = GLint(sceneBuffer.sections[SECTION_PLANES].count);
+    uniforms.numLights = GLint(sceneBuffer.sections[SECTION_LIGHTS].count);
+    uniforms.sphereRoot = sceneBuffer.sphereRoot;
+    uniforms.instanceRoot = sceneBuffer.instanceRoot;
+}
+
+// Function to fence the current region after all commands reading it have been issued
+void fenceSceneBuffer(SceneBuffer& sceneBuffer) {
+    sceneBuffer.fences[sceneBuffer.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Function to delete the scene buffer and its fences
+void deleteSceneBuffer(SceneBuffer& sceneBuffer) {
+    releaseStorage(sceneBuffer);
+}
@@ -0,0 +1,126 @@
+#ifndef SCENEBUFFER_H
+#define SCENEBUFFER_H
+
+#include "Animation.h"
+#include "BVH.h"
+#include "Geometry.h"
+#include "LightTree.h"
+#include "Shader.h"
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+// Number of regions in the persistent scene buffer (one per frame in flight)
+const int SCENE_BUFFER_REGIONS = FRAMES_IN_FLIGHT;
+
+// Arrays stored in every region of the scene buffer, each bound to the SSBO binding point in SCENE_SECTION_BINDINGS.
+// The arrays the ray loops read hold only what the intersection tests need, the colors are in the material table.
+enum SceneSection {
+    SECTION_SPHERES,            // Center and radius of every sphere in the leaf order of the sphere BVH
+    SECTION_PLANES,             // Normal and distance from the origin of every plane
+    SECTION_LIGHTS,
+    SECTION_MATERIALS,          // Distinct colors and reflectivities of the scene
+    SECTION_OBJECT_MATERIALS,   // Material of every sphere, then of every plane, then of every instance
+    SECTION_NODES,              // The BVHs of all meshes, the BVH over the instances and the sphere BVH
+    SECTION_MESH_WORDS,
+    SECTION_INSTANCES,
+    SECTION_LIGHT_NODES,        // BVH over the lights, which the light section stores in its leaf order
+    SECTION_COUNT
+};
+
+// SSBO binding point of every section, the meshes and the light BVH come after the ray counters and wavefront queues
+const GLuint SCENE_SECTION_BINDINGS[SECTION_COUNT] = {0, 1, 2, 3, 4, 12, 13, 14, 15};
+
+// Highest SSBO binding point used by the scene
+const GLint SCENE_MAX_BINDING = 15;
+
+// Steps of the 16-bit grid that quantized spheres are stored on
+const float SPHERE_GRID_STEPS = 65535.0f;
+
+// Structure for an entry of the material table, shared by all objects with the same color and reflectivity
+struct Material {
+    glm::vec3 color;
+    float reflectivity;
+};
+
+static_assert(sizeof(Material) == 16, "Material does not match the std430 layout");
+
+// Structure for a mesh instance as the shaders read it, with a copy of the header of its mesh. Drivers
+// limit the storage blocks of a shader to as few as 16, so the headers get no block of their own.
+struct InstanceRecord {
+    glm::vec4 objectToWorld[3];     // Rows of the affine transform from mesh to world space
+    glm::vec4 worldToObject[3];     // Rows of its inverse
+    MeshInfo mesh;
+};
+
+static_assert(sizeof(InstanceRecord) == 144, "InstanceRecord does not match the std430 layout");
+static_assert(offsetof(InstanceRecord, mesh) == 96, "InstanceRecord::mesh does not match the std430 layout");
+
+// Half-open range [begin, end) of objects within a section
+struct DirtyRange {
+    size_t begin;
+    size_t end;
+};
+
+// Structure describing one object array inside a scene buffer region
+struct SceneBufferSection {
+    size_t offset;                                          // Byte offset of the array inside a region
+    size_t stride;                                          // Size of one object in bytes
+    size_t capacity;                                        // Maximum number of objects
+    size_t count;                                           // Number of objects currently stored
+    std::vector<char> mirror;                               // CPU copy of the latest contents
+    std::vector<DirtyRange> pending[SCENE_BUFFER_REGIONS];  // Ranges each region has not received yet
+};
+
+// Structure for a persistently mapped and triple-buffered scene SSBO, reallocated only when the scene outgrows it
+struct SceneBuffer {
+    GLuint ssbo;
+    char* mapped;                           // Persistent mapping of all regions, nullptr if unsupported
+    size_t regionSize;                      // Size of one region in bytes
+    int region;                             // Region used by the current frame
+    GLsync fences[SCENE_BUFFER_REGIONS];    // Signalled once the GPU is done reading a region
+    SceneBufferSection sections[SECTION_COUNT];
+    size_t bytesUploaded;                   // Bytes written to the buffer during the last update
+    bool changed;                           // Whether the last update found any difference to the previous scene
+    bool loaded;                            // Whether the whole scene was gathered, so updates may patch in moved objects
+    size_t totalBytesUploaded;              // Bytes written since creation
+    BVH instanceBVH;                        // BVH over the mesh instances, refit every update
+    std::vector<AABB> instanceBounds;
+    std::vector<BVHNode> instanceNodes;     // Nodes of instanceBVH with the indices they have in the node section
+    std::vector<InstanceRecord> instances;  // Instances in the leaf order of instanceBVH
+    int instanceRoot;                       // Index of the instance BVH root in the node section, -1 without instances
+    int sphereRoot;                         // Index of the sphere BVH root in the node section, -1 without spheres
+    LightTree lightTree;                    // BVH over the lights, refit every update
+    std::vector<BVHNode> sphereNodes;       // Nodes of the sphere BVH with the indices they have in the node section
+    bool quantized;                         // Whether spheres are stored as 16-bit coordinates in their BVH leaf
+    std::vector<glm::vec4> sphereData;      // Spheres in leaf order, unless quantized
+    std::vector<glm::uvec2> packedSpheres;  // Spheres in leaf order, if quantized
+    std::vector<glm::vec4> planeData;
+    std::vector<Material> sceneMaterials;   // Material of every sphere, plane and instance in scene order
+    std::vector<Material> materials;        // Material table, rebuilt when sceneMaterials changes
+    std::vector<GLuint> sceneMaterialIndices;   // Index in the table of every entry of sceneMaterials
+    std::vector<GLuint> objectMaterials;    // Material indices in the order of the object sections
+};
+
+// Function to create the persistent scene buffer with an initial object capacity
+SceneBuffer createSceneBuffer(size_t maxSpheres, size_t maxPlanes, size_t maxLights);
+
+// Function to choose between float spheres (16 bytes each) and spheres quantized to a 16-bit grid over their BVH
+// leaf (8 bytes each). The shaders must be compiled with the matching QUANTIZED_SCENE, see ShaderVariant.
+void setSceneBufferQuantization(SceneBuffer& sceneBuffer, bool quantized);
+
+// Function to write the dirty parts of the scene into the next region and bind its sections. Only the objects in
+// changes are gathered again, unless changes is null or the layout of the sections changed, see Renderer::render.
+void updateSceneBuffer(SceneBuffer& sceneBuffer, const Scene& scene, const BVH& sphereBVH, const SceneChanges* changes);
+
+// Function to pass the object counts of the bound scene to the compute shaders
+void setSceneBufferUniforms(FrameUniforms& uniforms, const SceneBuffer& sceneBuffer);
+
+// Function to fence the current region after all commands reading it have been issued
+void fenceSceneBuffer(SceneBuffer& sceneBuffer);
+
+// Function to delete the scene buffer and its fences
+void deleteSceneBuffer(SceneBuffer& sceneBuffer);
+
+#endif // SCENEBUFFER_H
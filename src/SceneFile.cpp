@@ -0,0 +1,367 @@
+#include "SceneFile.h"
+#include "Animation.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SCENE_FILE_MAGIC[8] = "RTSCENE";
+
+// Names of the track targets in text scenes, indexed by TRACK_SPHERE, TRACK_LIGHT and TRACK_INSTANCE
+static const char* const TRACK_TARGET_NAMES[] = {"sphere", "light", "instance"};
+
+// Function to check whether a path names a binary scene file
+bool isBinarySceneFile(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == "rtscene";
+}
+
+// Function to load a scene, a binary scene for the .rtscene extension and a text scene otherwise.
+// The BVH over the spheres is loaded too if the file stores one, otherwise bvh is left empty.
+bool loadScene(const std::string& path, Scene& scene, BVH& bvh) {
+    bvh.nodes.clear();
+    bvh.primIndices.clear();
+    bvh.parents.clear();
+    bvh.primLeaves.clear();
+    if (isBinarySceneFile(path)) return loadSceneBinary(path, scene, bvh);
+    return loadSceneText(path, scene);
+}
+
+// Function to load a mesh file named in a text scene, relative to the directory of the scene
+static bool loadSceneMesh(const std::string& scenePath, const std::string& file, Scene& scene) {
+    size_t slash = scenePath.find_last_of('/');
+    std::string path = file[0] == '/' || slash == std::string::npos ? file : scenePath.substr(0, slash + 1) + file;
+    std::vector<glm::vec3> vertices;
+    std::vector<GLuint> indices;
+    if (!loadMesh(path, vertices, indices)) return false;
+    addMesh(scene, vertices, indices);
+    return true;
+}
+
+// Function to parse the target and object of a track line, returns false if the object does not exist
+static bool parseTrackObject(std::istringstream& fields, const Scene& scene, GLuint& target, GLuint& object) {
+    std::string kind;
+    if (!(fields >> kind >> object)) return false;
+    const size_t counts[] = {scene.spheres.size(), scene.lights.size(), scene.instances.size()};
+    for (target = TRACK_SPHERE; target <= TRACK_INSTANCE; target++) {
+        if (kind == TRACK_TARGET_NAMES[target]) return object < counts[target];
+    }
+    return false;
+}
+
+// Function to load a text scene, one object per line
+bool loadSceneText(const std::string& path, Scene& scene) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file: " << path << std::endl;
+        return false;
+    }
+
+    scene = Scene();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type) || type[0] == '#') continue;
+
+        glm::vec3 a, b, color;
+        float value, reflectivity, yaw;
+        GLuint mesh, target, object;
+        std::string file;
+        bool ok;
+        if (type == "sphere") {
+            ok = bool(fields >> a.x >> a.y >> a.z >> value >> color.x >> color.y >> color.z >> reflectivity);
+            if (ok) scene.spheres.push_back(Sphere(a, value, color, reflectivity));
+        } else if (type == "plane") {
+            ok = bool(fields >> a.x >> a.y >> a.z >> b.x >> b.y >> b.z >> color.x >> color.y >> color.z >> reflectivity);
+            if (ok) scene.planes.push_back(Plane(a, b, color, reflectivity));
+        } else if (type == "light") {
+            ok = bool(fields >> a.x >> a.y >> a.z >> color.x >> color.y >> color.z);
+            if (ok) scene.lights.push_back(Light(a, color));
+        } else if (type == "mesh") {
+            ok = bool(fields >> file);
+            if (ok && !loadSceneMesh(path, file, scene)) return false;
+        } else if (type == "instance") {
+            ok = bool(fields >> mesh >> a.x >> a.y >> a.z >> value >> yaw >> color.x >> color.y >> color.z >> reflectivity)
+                 && mesh < scene.meshes.size();
+            if (ok) {
+                glm::mat4 transform = glm::translate(glm::mat4(1.0f), a);
+                transform = glm::rotate(transform, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+                transform = glm::scale(transform, glm::vec3(value));
+                scene.instances.push_back(MeshInstance(mesh, transform, color, reflectivity));
+            }
+        } else if (type == "key") {
+            ok = parseTrackObject(fields, scene, target, object) && bool(fields >> value >> a.x >> a.y >> a.z);
+            if (ok) addTrackKey(scene, addTrack(scene, target, object), TrackKey(value, a));
+        } else if (type == "wave") {
+            ok = parseTrackObject(fields, scene, target, object)
+                 && bool(fields >> a.x >> a.y >> a.z >> b.x >> b.y >> b.z >> color.x >> color.y >> color.z);
+            if (ok) setTrackWave(scene, addTrack(scene, target, object), a, b, color);
+        } else {
+            std::cerr << path << ":" << lineNumber << ": unknown object type " << type << std::endl;
+            return false;
+        }
+
+        std::string rest;
+        if (!ok || (fields >> rest && rest[0] != '#')) {
+            std::cerr << path << ":" << lineNumber << ": invalid " << type << ": " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to check that a section of count structs of the given size lies inside the file
+static bool sectionInFile(uint64_t offset, uint64_t count, size_t stride, size_t fileSize) {
+    if (count == 0) return true;
+    return offset % SCENE_FILE_ALIGNMENT == 0 && offset <= fileSize && count <= (fileSize - offset) / stride;
+}
+
+// Function to copy a section of a mapped file into a vector. The structs are trivially copyable,
+// so this is a single memcpy per section rather than a copy per object.
+template <typename T>
+static void copySection(const char* data, uint64_t offset, uint64_t count, std::vector<T>& out) {
+    const T* begin = reinterpret_cast<const T*>(data + offset);
+    out.assign(begin, begin + count);
+}
+
+// Function to check that the child and primitive indices of a loaded BVH stay inside its arrays and that no leaf
+// is larger than the packet tracer can stage, so a corrupt file can not send the traversal out of bounds
+static bool validBVH(const BVH& bvh, size_t sphereCount) {
+    for (size_t i = 0; i < bvh.nodes.size(); i++) {
+        const BVHNode& node = bvh.nodes[i];
+        bool valid = node.count > 0 ? node.count <= BVH_MAX_LEAF_SIZE && uint64_t(node.rightOrFirst) + node.count <= bvh.primIndices.size()
+                                    : node.rightOrFirst > i + 1 && node.rightOrFirst < bvh.nodes.size();
+        if (!valid) return false;
+    }
+    for (size_t i = 0; i < bvh.primIndices.size(); i++) {
+        if (bvh.primIndices[i] >= sphereCount) return false;
+    }
+    return true;
+}
+
+// Function to map a binary scene file and copy its sections into the scene and BVH as they are
+bool loadSceneBinary(const std::string& path, Scene& scene, BVH& bvh) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open scene file: " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < SCENE_FILE_V1_HEADER_SIZE) {
+        std::cerr << "Not a binary scene file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t fileSize = size_t(info.st_size);
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Failed to map scene file: " << path << std::endl;
+        return false;
+    }
+    // Every section is read front to back exactly once, so let the kernel read ahead
+    madvise(mapped, fileSize, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapped);
+
+    // Older headers stop before the mesh or animation sections, which are then left empty
+    SceneFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(&header, data, SCENE_FILE_V1_HEADER_SIZE);
+    size_t headerSize = header.version == 1 ? SCENE_FILE_V1_HEADER_SIZE
+                      : header.version == 2 ? SCENE_FILE_V2_HEADER_SIZE
+                      : header.version == SCENE_FILE_VERSION ? sizeof(SceneFileHeader) : 0;
+    bool supported = headerSize != 0 && header.headerSize == headerSize && fileSize >= headerSize;
+    if (supported) std::memcpy(&header, data, headerSize);
+
+    bool ok = std::memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) == 0;
+    if (!ok) {
+        std::cerr << "Not a binary scene file: " << path << std::endl;
+    } else if (!supported) {
+        std::cerr << "Unsupported scene file version " << header.version << ": " << path << std::endl;
+        ok = false;
+    } else if (!sectionInFile(header.sphereOffset, header.sphereCount, sizeof(Sphere), fileSize)
+               || !sectionInFile(header.planeOffset, header.planeCount, sizeof(Plane), fileSize)
+               || !sectionInFile(header.lightOffset, header.lightCount, sizeof(Light), fileSize)
+               || !sectionInFile(header.bvhNodeOffset, header.bvhNodeCount, sizeof(BVHNode), fileSize)
+               || !sectionInFile(header.bvhPrimOffset, header.bvhPrimCount, sizeof(GLuint), fileSize)
+               || !sectionInFile(header.meshOffset, header.meshCount, sizeof(MeshInfo), fileSize)
+               || !sectionInFile(header.meshNodeOffset, header.meshNodeCount, sizeof(BVHNode), fileSize)
+               || !sectionInFile(header.meshWordOffset, header.meshWordCount, sizeof(GLuint), fileSize)
+               || !sectionInFile(header.instanceOffset, header.instanceCount, sizeof(MeshInstance), fileSize)
+               || !sectionInFile(header.trackOffset, header.trackCount, sizeof(AnimationTrack), fileSize)
+               || !sectionInFile(header.trackKeyOffset, header.trackKeyCount, sizeof(TrackKey), fileSize)
+               || (header.bvhNodeCount > 0 && header.bvhPrimCount != header.sphereCount)) {
+        std::cerr << "Truncated or corrupt scene file: " << path << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        copySection(data, header.sphereOffset, header.sphereCount, scene.spheres);
+        copySection(data, header.planeOffset, header.planeCount, scene.planes);
+        copySection(data, header.lightOffset, header.lightCount, scene.lights);
+        copySection(data, header.meshOffset, header.meshCount, scene.meshes);
+        copySection(data, header.meshNodeOffset, header.meshNodeCount, scene.meshNodes);
+        copySection(data, header.meshWordOffset, header.meshWordCount, scene.meshWords);
+        copySection(data, header.instanceOffset, header.instanceCount, scene.instances);
+        copySection(data, header.trackOffset, header.trackCount, scene.tracks);
+        copySection(data, header.trackKeyOffset, header.trackKeyCount, scene.trackKeys);
+        ok = validMeshes(scene);
+        if (!ok) std::cerr << "Corrupt meshes in scene file: " << path << std::endl;
+        if (ok && !validTracks(scene)) {
+            std::cerr << "Corrupt animation tracks in scene file: " << path << std::endl;
+            ok = false;
+        }
+        if (ok && header.bvhNodeCount > 0) {
+            copySection(data, header.bvhNodeOffset, header.bvhNodeCount, bvh.nodes);
+            copySection(data, header.bvhPrimOffset, header.bvhPrimCount, bvh.primIndices);
+            bvh.buildCost = header.bvhBuildCost;
+            ok = validBVH(bvh, scene.spheres.size());
+            if (!ok) std::cerr << "Corrupt BVH in scene file: " << path << std::endl;
+            // Deeper trees would overflow the traversal stacks of the renderers
+            if (ok && computeBVHDepth(bvh.nodes, 0, bvh.nodes.size()) > BVH_MAX_DEPTH) {
+                std::cerr << "The BVH in scene file " << path << " is deeper than " << BVH_MAX_DEPTH
+                          << " levels, convert the scene again with raytracer_scene" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    munmap(mapped, fileSize);
+    return ok;
+}
+
+// Function to write a scene in the text format
+bool writeSceneText(const std::string& path, const Scene& scene) {
+    if (!scene.meshes.empty()) {
+        std::cerr << "Meshes can only be written to binary scene files: " << path << std::endl;
+        return false;
+    }
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to open scene file for writing: " << path << std::endl;
+        return false;
+    }
+
+    // 9 significant digits round-trip every float exactly
+    std::fprintf(file, "# Raytracer scene: %zu spheres, %zu planes, %zu lights\n",
+                 scene.spheres.size(), scene.planes.size(), scene.lights.size());
+    for (const Light& light : scene.lights) {
+        std::fprintf(file, "light %.9g %.9g %.9g %.9g %.9g %.9g\n", light.position.x, light.position.y, light.position.z,
+                     light.color.x, light.color.y, light.color.z);
+    }
+    for (const Plane& plane : scene.planes) {
+        std::fprintf(file, "plane %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", plane.point.x, plane.point.y, plane.point.z,
+                     plane.normal.x, plane.normal.y, plane.normal.z, plane.color.x, plane.color.y, plane.color.z, plane.reflectivity);
+    }
+    for (const Sphere& sphere : scene.spheres) {
+        std::fprintf(file, "sphere %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", sphere.center.x, sphere.center.y, sphere.center.z,
+                     sphere.radius, sphere.color.x, sphere.color.y, sphere.color.z, sphere.reflectivity);
+    }
+    // Tracks come after their objects, with the key at time 0 a track starts with written out too
+    for (const AnimationTrack& track : scene.tracks) {
+        const char* target = TRACK_TARGET_NAMES[track.target];
+        for (GLuint k = track.firstKey; k < track.firstKey + track.keyCount; k++) {
+            const TrackKey& key = scene.trackKeys[k];
+            std::fprintf(file, "key %s %u %.9g %.9g %.9g %.9g\n", target, track.object, key.time, key.position.x, key.position.y, key.position.z);
+        }
+        if (track.amplitude != glm::vec3(0.0f)) {
+            std::fprintf(file, "wave %s %u %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", target, track.object,
+                         track.amplitude.x, track.amplitude.y, track.amplitude.z, track.frequency.x, track.frequency.y,
+                         track.frequency.z, track.phase.x, track.phase.y, track.phase.z);
+        }
+    }
+
+    bool ok = std::ferror(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) std::cerr << "Failed to write scene file: " << path << std::endl;
+    return ok;
+}
+
+// Function to get the offset of the next section, aligned after the end of the previous one
+static uint64_t nextSectionOffset(uint64_t end) {
+    return (end + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+// Function to write a section at its offset, padding the file up to it with zeros
+static void writeSection(FILE* file, uint64_t& position, uint64_t offset, const void* data, size_t size) {
+    static const char zeros[SCENE_FILE_ALIGNMENT] = {};
+    std::fwrite(zeros, 1, size_t(offset - position), file);
+    if (size > 0) std::fwrite(data, 1, size, file);
+    position = offset + size;
+}
+
+// Function to write a scene in the binary format, with the sphere BVH unless bvh is nullptr
+bool writeSceneBinary(const std::string& path, const Scene& scene, const BVH* bvh) {
+    SceneFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_FILE_VERSION;
+    header.headerSize = sizeof(SceneFileHeader);
+    header.sphereCount = scene.spheres.size();
+    header.planeCount = scene.planes.size();
+    header.lightCount = scene.lights.size();
+    if (bvh) {
+        header.bvhNodeCount = bvh->nodes.size();
+        header.bvhPrimCount = bvh->primIndices.size();
+        header.bvhBuildCost = bvh->buildCost;
+    }
+    header.sphereOffset = nextSectionOffset(sizeof(header));
+    header.planeOffset = nextSectionOffset(header.sphereOffset + header.sphereCount * sizeof(Sphere));
+    header.lightOffset = nextSectionOffset(header.planeOffset + header.planeCount * sizeof(Plane));
+    header.bvhNodeOffset = nextSectionOffset(header.lightOffset + header.lightCount * sizeof(Light));
+    header.bvhPrimOffset = nextSectionOffset(header.bvhNodeOffset + header.bvhNodeCount * sizeof(BVHNode));
+    header.meshCount = scene.meshes.size();
+    header.meshNodeCount = scene.meshNodes.size();
+    header.meshWordCount = scene.meshWords.size();
+    header.instanceCount = scene.instances.size();
+    header.meshOffset = nextSectionOffset(header.bvhPrimOffset + header.bvhPrimCount * sizeof(GLuint));
+    header.meshNodeOffset = nextSectionOffset(header.meshOffset + header.meshCount * sizeof(MeshInfo));
+    header.meshWordOffset = nextSectionOffset(header.meshNodeOffset + header.meshNodeCount * sizeof(BVHNode));
+    header.instanceOffset = nextSectionOffset(header.meshWordOffset + header.meshWordCount * sizeof(GLuint));
+    header.trackCount = scene.tracks.size();
+    header.trackKeyCount = scene.trackKeys.size();
+    header.trackOffset = nextSectionOffset(header.instanceOffset + header.instanceCount * sizeof(MeshInstance));
+    header.trackKeyOffset = nextSectionOffset(header.trackOffset + header.trackCount * sizeof(AnimationTrack));
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open scene file for writing: " << path << std::endl;
+        return false;
+    }
+    std::fwrite(&header, sizeof(header), 1, file);
+    uint64_t position = sizeof(header);
+    writeSection(file, position, header.sphereOffset, scene.spheres.data(), scene.spheres.size() * sizeof(Sphere));
+    writeSection(file, position, header.planeOffset, scene.planes.data(), scene.planes.size() * sizeof(Plane));
+    writeSection(file, position, header.lightOffset, scene.lights.data(), scene.lights.size() * sizeof(Light));
+    if (bvh) {
+        writeSection(file, position, header.bvhNodeOffset, bvh->nodes.data(), bvh->nodes.size() * sizeof(BVHNode));
+        writeSection(file, position, header.bvhPrimOffset, bvh->primIndices.data(), bvh->primIndices.size() * sizeof(GLuint));
+    }
+    writeSection(file, position, header.meshOffset, scene.meshes.data(), scene.meshes.size() * sizeof(MeshInfo));
+    writeSection(file, position, header.meshNodeOffset, scene.meshNodes.data(), scene.meshNodes.size() * sizeof(BVHNode));
+    writeSection(file, position, header.meshWordOffset, scene.meshWords.data(), scene.meshWords.size() * sizeof(GLuint));
+    writeSection(file, position, header.instanceOffset, scene.instances.data(), scene.instances.size() * sizeof(MeshInstance));
+    writeSection(file, position, header.trackOffset, scene.tracks.data(), scene.tracks.size() * sizeof(AnimationTrack));
+    writeSection(file, position, header.trackKeyOffset, scene.trackKeys.data(), scene.trackKeys.size() * sizeof(TrackKey));
+
+    bool ok = std::ferror(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) std::cerr << "Failed to write scene file: " << path << std::endl;
+    return ok;
+}
@@ -0,0 +1,89 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include "BVH.h"
+#include "Geometry.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Version of the binary scene format, bumped whenever the header or a section layout changes
+const uint32_t SCENE_FILE_VERSION = 3;
+
+// Size of the header of version 1 files, which end before the mesh sections and are still read
+const uint32_t SCENE_FILE_V1_HEADER_SIZE = 104;
+// Size of the header of version 2 files, which end before the animation sections and are still read
+const uint32_t SCENE_FILE_V2_HEADER_SIZE = 168;
+
+// Alignment of the sections in a binary scene file. It is the largest SSBO offset alignment drivers
+// require, so a mapped file can be bound as shader storage section by section.
+const uint64_t SCENE_FILE_ALIGNMENT = 256;
+
+// Header at the start of a binary scene file (.rtscene). Every section is an array of the structs in
+// Geometry.h and BVH.h with their std430 layout, in native (little-endian) byte order.
+struct SceneFileHeader {
+    char magic[8];              // "RTSCENE" and a terminating zero
+    uint32_t version;
+    uint32_t headerSize;        // sizeof(SceneFileHeader) of the writer
+    uint64_t sphereOffset;
+    uint64_t sphereCount;
+    uint64_t planeOffset;
+    uint64_t planeCount;
+    uint64_t lightOffset;
+    uint64_t lightCount;
+    uint64_t bvhNodeOffset;     // The sphere BVH, both counts are 0 if the file has none
+    uint64_t bvhNodeCount;
+    uint64_t bvhPrimOffset;
+    uint64_t bvhPrimCount;
+    float bvhBuildCost;
+    uint32_t pad;
+    uint64_t meshOffset;        // The mesh arrays of Scene, added in version 2
+    uint64_t meshCount;
+    uint64_t meshNodeOffset;
+    uint64_t meshNodeCount;
+    uint64_t meshWordOffset;
+    uint64_t meshWordCount;
+    uint64_t instanceOffset;
+    uint64_t instanceCount;
+    uint64_t trackOffset;       // The animation tracks of Scene, added in version 3
+    uint64_t trackCount;
+    uint64_t trackKeyOffset;
+    uint64_t trackKeyCount;
+};
+
+static_assert(sizeof(SceneFileHeader) == 200, "SceneFileHeader must not contain implicit padding");
+static_assert(offsetof(SceneFileHeader, meshOffset) == SCENE_FILE_V1_HEADER_SIZE, "Version 1 headers must be a prefix of the header");
+static_assert(offsetof(SceneFileHeader, trackOffset) == SCENE_FILE_V2_HEADER_SIZE, "Version 2 headers must be a prefix of the header");
+
+// Function to load a scene, a binary scene for the .rtscene extension and a text scene otherwise.
+// The BVH over the spheres is loaded too if the file stores one, otherwise bvh is left empty.
+// Prints the reason and returns false if the file can not be loaded.
+bool loadScene(const std::string& path, Scene& scene, BVH& bvh);
+
+// Function to load a text scene, one object per line:
+//   sphere <x> <y> <z> <radius> <r> <g> <b> <reflectivity>
+//   plane <x> <y> <z> <normal x> <normal y> <normal z> <r> <g> <b> <reflectivity>
+//   light <x> <y> <z> <r> <g> <b>
+//   mesh <OBJ or PLY file, relative to the scene file>
+//   instance <mesh> <x> <y> <z> <scale> <yaw degrees> <r> <g> <b> <reflectivity>
+//   key <sphere|light|instance> <index> <time> <x> <y> <z>
+//   wave <sphere|light|instance> <index> <amplitude x y z> <frequency x y z> <phase x y z>
+// Meshes and the objects of each type are numbered from 0 in the order of their lines. A key or wave line adds
+// to the animation track of an earlier object, see Animation.h. Empty lines and lines starting with # are ignored.
+bool loadSceneText(const std::string& path, Scene& scene);
+
+// Function to map a binary scene file and copy its sections into the scene and BVH as they are
+bool loadSceneBinary(const std::string& path, Scene& scene, BVH& bvh);
+
+// Function to write a scene in the text format. Meshes are only stored in binary scenes, since the text
+// format refers to the files they were loaded from.
+bool writeSceneText(const std::string& path, const Scene& scene);
+
+// Function to write a scene in the binary format, with the sphere BVH unless bvh is nullptr
+bool writeSceneBinary(const std::string& path, const Scene& scene, const BVH* bvh);
+
+// Function to check whether a path names a binary scene file
+bool isBinarySceneFile(const std::string& path);
+
+#endif // SCENEFILE_H
@@ -0,0 +1,148 @@
+// Converter between the text and binary scene formats. Binary scenes store the sphere BVH as well,
+// so loading them costs little more than reading the file.
+
+#include "BVH.h"
+#include "SceneFile.h"
+#include "Scenes.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Structure for the settings of a conversion
+struct SceneToolOptions {
+    std::string input;      // Scene file, empty if a built-in scene is generated
+    std::string output;
+    std::string generate;   // Built-in scene: demo, mirror, meshes, spheres-<count> or lights-<count>
+    unsigned int seed;
+    float reflective;       // Fraction of reflective random spheres
+    bool bvh;               // Store the sphere BVH in binary output
+};
+
+// Function to print the supported command line arguments
+static void printSceneToolUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] <input> <output>\n"
+              << "       " << program << " [options] --generate <name> <output>\n"
+              << "Converts scenes between the text (.scene) and binary (.rtscene) formats, chosen by file extension.\n"
+              << "  --generate <name>       Write a built-in scene: demo, mirror, meshes, spheres-<count> or lights-<count>\n"
+              << "  --seed <n>              Seed of the random spheres (default 1)\n"
+              << "  --reflective <f>        Fraction of reflective random spheres (default 0)\n"
+              << "  --no-bvh                Do not store the sphere BVH in binary output\n";
+}
+
+// Function to parse the command line, returns false on invalid arguments
+static bool parseSceneToolOptions(int argc, char** argv, SceneToolOptions& options) {
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--no-bvh") {
+            options.bvh = false;
+            continue;
+        } else if (arg.compare(0, 2, "--") != 0) {
+            paths.push_back(arg);
+            continue;
+        } else if (!value) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--generate") {
+            options.generate = value;
+        } else if (arg == "--seed") {
+            options.seed = unsigned(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--reflective") {
+            options.reflective = float(std::atof(value));
+            ok = options.reflective >= 0.0f && options.reflective <= 1.0f;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+        i++;
+    }
+
+    size_t expected = options.generate.empty() ? 2 : 1;
+    if (paths.size() != expected) return false;
+    if (expected == 2) options.input = paths[0];
+    options.output = paths.back();
+    return true;
+}
+
+// Function to create a built-in scene by name, returns false for unknown names
+static bool generateScene(const SceneToolOptions& options, Scene& scene) {
+    if (options.generate == "demo") {
+        scene = createDemoScene();
+    } else if (options.generate == "mirror") {
+        scene = createMirrorScene();
+    } else if (options.generate == "meshes") {
+        scene = createMeshScene(64, 4);
+    } else if (options.generate.compare(0, 8, "spheres-") == 0) {
+        int count = std::atoi(options.generate.c_str() + 8);
+        if (count <= 0) return false;
+        scene = createRandomSpheresScene(count, options.seed, options.reflective);
+    } else if (options.generate.compare(0, 7, "lights-") == 0) {
+        int count = std::atoi(options.generate.c_str() + 7);
+        if (count <= 0) return false;
+        scene = createManyLightsScene(1000, count, options.seed);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to get the milliseconds since a point in time
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    SceneToolOptions options;
+    options.seed = 1;
+    options.reflective = 0.0f;
+    options.bvh = true;
+    if (!parseSceneToolOptions(argc, argv, options)) {
+        printSceneToolUsage(argv[0]);
+        return 1;
+    }
+
+    Scene scene;
+    BVH sphereBVH;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!options.generate.empty()) {
+        if (!generateScene(options, scene)) {
+            std::cerr << "Unknown scene: " << options.generate << std::endl;
+            return 1;
+        }
+    } else if (!loadScene(options.input, scene, sphereBVH)) {
+        return 1;
+    }
+    std::cout << "Loaded " << scene.spheres.size() << " spheres, " << scene.planes.size() << " planes, "
+              << scene.lights.size() << " lights, " << scene.meshes.size() << " meshes, " << scene.instances.size()
+              << " mesh instances and " << scene.tracks.size() << " animation tracks in " << millisecondsSince(start) << " ms" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    bool ok;
+    if (isBinarySceneFile(options.output)) {
+        // Build the BVH once here, so loading the binary scene does not have to
+        if (options.bvh && sphereBVH.nodes.empty() && !scene.spheres.empty()) {
+            std::vector<AABB> sphereBounds;
+            computeSphereBounds(scene.spheres, sphereBounds);
+            sphereBVH = buildBVH(sphereBounds);
+        }
+        ok = writeSceneBinary(options.output, scene, options.bvh && !sphereBVH.nodes.empty() ? &sphereBVH : nullptr);
+    } else {
+        ok = writeSceneText(options.output, scene);
+    }
+    if (!ok) return 1;
+    std::cout << "Wrote " << options.output << " in " << millisecondsSince(start) << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "Scenes.h"
+#include "Animation.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Function to create the box of the demo scene around the camera and its light, without spheres
+static Scene createDemoBox() {
+    Scene scene;
+
+    // Box around Camera
+    float boxSize = 1.0f;
+    scene.planes = {
+        {{0.0f, 0.0f, -boxSize}, {0.0f, 0.0f, -1.0f}, {1.0f, 1.0f, 0.0f}, 0.0f},  // Front plane
+        {{0.0f, 0.0f, boxSize}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 1.0f}, 0.0f},  // Back plane
+        {{-boxSize, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, 0.0f},  // Left Plane
+        {{boxSize, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.5f, 0.5f, 1.0f}, 0.0f},  // Right Plane
+        {{0.0f, -boxSize, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.5f, 0.5f}, 0.0f},  // Bottom Plane
+        {{0.0f, boxSize, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.0f, 0.5f}, 0.0f}   // Top Plane
+    };
+
+    scene.lights = {
+        {{-0.4f, 0.6f, -0.3f}, {1.0f, 1.0f, 1.0f}}
+    };
+
+    return scene;
+}
+
+// Function to create the demo scene: three spheres inside a box around the camera, two of them bobbing
+Scene createDemoScene() {
+    Scene scene = createDemoBox();
+
+    // Define geometry
+    scene.spheres = {
+        {{0.3f, 0.0f, -0.5f}, 0.2f, {1.0f, 1.0f, 1.0f}, 0.0f},
+        {{-0.3f, -0.15, 0.35f}, 0.15f, {0.0f, 1.0f, 0.0f}, 0.0f},
+        {{0.0f, -0.55, -0.2f}, 0.3f, {0.0f, 0.0f, 1.0f}, 0.0f}
+    };
+
+    // The white sphere moves up and down and the blue one sideways, three times as fast
+    setTrackWave(scene, addTrack(scene, TRACK_SPHERE, 0), glm::vec3(0.0f, 0.4f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f));
+    setTrackWave(scene, addTrack(scene, TRACK_SPHERE, 2), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(3.0f, 0.0f, 0.0f), glm::vec3(0.0f));
+
+    return scene;
+}
+
+// Function to get the next number of a xorshift generator in [0, 1), used instead of <random>
+// because its distributions are not required to give the same numbers on every standard library
+static float nextRandom(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return float(state >> 8) / 16777216.0f;
+}
+
+// Function to create the box of the demo scene filled with randomly placed spheres. The same seed always
+// gives the same scene on every platform. A fraction of the spheres is made reflective.
+Scene createRandomSpheresScene(int sphereCount, unsigned int seed, float reflectiveFraction) {
+    Scene scene = createDemoBox();
+    scene.spheres.reserve(sphereCount);
+
+    // Shrink the spheres with their number, so the box stays about equally full
+    float radius = 0.35f * std::cbrt(8.0f / float(std::max(sphereCount, 1)));
+    unsigned int state = seed ? seed : 1;
+    while (int(scene.spheres.size()) < sphereCount) {
+        glm::vec3 center(nextRandom(state) * 2.0f - 1.0f, nextRandom(state) * 2.0f - 1.0f, nextRandom(state) * 2.0f - 1.0f);
+        glm::vec3 color(nextRandom(state), nextRandom(state), nextRandom(state));
+        float reflectivity = nextRandom(state) < reflectiveFraction ? 0.8f : 0.0f;
+        // Keep the camera at the origin and the light outside of every sphere
+        if (glm::length(center) < 0.3f + radius || glm::length(center - scene.lights[0].position) < 0.1f + radius) continue;
+        scene.spheres.push_back(Sphere(center, radius, color, reflectivity));
+    }
+    return scene;
+}
+
+// Function to create the box of the demo scene with randomly placed spheres lit by many randomly placed
+// colored lights, whose total brightness stays about that of the demo light
+Scene createManyLightsScene(int sphereCount, int lightCount, unsigned int seed) {
+    Scene scene = createRandomSpheresScene(sphereCount, seed, 0.0f);
+    scene.lights.clear();
+    scene.lights.reserve(lightCount);
+    unsigned int state = seed ? seed + 1 : 2;
+    float brightness = 2.0f / float(std::max(lightCount, 1));
+    while (int(scene.lights.size()) < lightCount) {
+        glm::vec3 position(nextRandom(state) * 1.8f - 0.9f, nextRandom(state) * 1.8f - 0.9f, nextRandom(state) * 1.8f - 0.9f);
+        glm::vec3 color(nextRandom(state), nextRandom(state), nextRandom(state));
+        // Lights inside a sphere would never reach anything
+        bool inside = false;
+        for (const Sphere& sphere : scene.spheres) inside |= glm::length(position - sphere.center) < sphere.radius;
+        if (!inside) scene.lights.push_back(Light(position, brightness * color));
+    }
+    return scene;
+}
+
+// Function to create the demo box with mirror walls and a grid of reflective spheres
+Scene createMirrorScene() {
+    Scene scene = createDemoBox();
+    for (size_t i = 0; i < scene.planes.size(); i++) scene.planes[i].reflectivity = 0.6f;
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            glm::vec3 center(-0.6f + 0.4f * x, -0.6f + 0.4f * y, -0.6f);
+            glm::vec3 color(0.25f + 0.25f * x, 0.25f + 0.25f * y, 1.0f);
+            scene.spheres.push_back(Sphere(center, 0.15f, color, 0.9f));
+        }
+    }
+    return scene;
+}
+
+// Function to triangulate a torus around the y axis with the given number of segments around its ring
+static void createTorus(int segments, float majorRadius, float minorRadius, std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices) {
+    int ringSegments = std::max(segments, 3);
+    int tubeSegments = std::max(segments / 2, 3);
+    for (int i = 0; i < ringSegments; i++) {
+        float ring = 2.0f * glm::pi<float>() * float(i) / float(ringSegments);
+        for (int j = 0; j < tubeSegments; j++) {
+            float tube = 2.0f * glm::pi<float>() * float(j) / float(tubeSegments);
+            float radius = majorRadius + minorRadius * std::cos(tube);
+            vertices.push_back(glm::vec3(radius * std::cos(ring), minorRadius * std::sin(tube), radius * std::sin(ring)));
+        }
+    }
+    // Two triangles per quad, wrapping around in both directions so the surface is closed
+    for (int i = 0; i < ringSegments; i++) {
+        for (int j = 0; j < tubeSegments; j++) {
+            GLuint a = GLuint(i * tubeSegments + j);
+            GLuint b = GLuint(((i + 1) % ringSegments) * tubeSegments + j);
+            GLuint c = GLuint(((i + 1) % ringSegments) * tubeSegments + (j + 1) % tubeSegments);
+            GLuint d = GLuint(i * tubeSegments + (j + 1) % tubeSegments);
+            indices.insert(indices.end(), {a, b, c, a, c, d});
+        }
+    }
+}
+
+// Function to create the demo box with a grid of instances of one triangulated torus, every instance turned
+// differently. The torus has segments^2 triangles, which the gridSize^2 instances share.
+Scene createMeshScene(int segments, int gridSize) {
+    Scene scene = createDemoBox();
+
+    std::vector<glm::vec3> vertices;
+    std::vector<GLuint> indices;
+    createTorus(segments, 1.0f, 0.35f, vertices, indices);
+    GLuint torus = addMesh(scene, vertices, indices);
+
+    // Every instance only adds a transform, the triangles are stored once
+    float spacing = 1.6f / float(std::max(gridSize, 1));
+    for (int x = 0; x < gridSize; x++) {
+        for (int y = 0; y < gridSize; y++) {
+            glm::vec3 position(-0.8f + spacing * (x + 0.5f), -0.8f + spacing * (y + 0.5f), -0.6f);
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+            transform = glm::rotate(transform, 0.7f * float(x) + 0.3f, glm::vec3(1.0f, 0.0f, 0.0f));
+            transform = glm::rotate(transform, 0.5f * float(y), glm::vec3(0.0f, 0.0f, 1.0f));
+            transform = glm::scale(transform, glm::vec3(0.3f * spacing));
+            glm::vec3 color(0.3f + 0.7f * float(x) / float(gridSize), 0.3f + 0.7f * float(y) / float(gridSize), 0.8f);
+            float reflectivity = (x + y) % 3 == 0 ? 0.5f : 0.0f;
+            scene.instances.push_back(MeshInstance(torus, transform, color, reflectivity));
+        }
+    }
+    return scene;
+}
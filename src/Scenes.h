@@ -0,0 +1,25 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "Geometry.h"
+
+// Function to create the demo scene: three spheres inside a box around the camera, two of them moved by
+// procedural tracks, see Animation.h
+Scene createDemoScene();
+
+// Function to create the box of the demo scene filled with randomly placed spheres. The same seed always
+// gives the same scene on every platform. A fraction of the spheres is made reflective.
+Scene createRandomSpheresScene(int sphereCount, unsigned int seed, float reflectiveFraction);
+
+// Function to create the box of the demo scene with randomly placed spheres lit by many randomly placed
+// colored lights, whose total brightness stays about that of the demo light
+Scene createManyLightsScene(int sphereCount, int lightCount, unsigned int seed);
+
+// Function to create the demo box with mirror walls and a grid of reflective spheres
+Scene createMirrorScene();
+
+// Function to create the demo box with a grid of instances of one triangulated torus, every instance turned
+// differently. The torus has segments^2 triangles, which the gridSize^2 instances share.
+Scene createMeshScene(int segments, int gridSize);
+
+#endif // SCENES_H
@@ -1,20 +1,45 @@
 #include "Shader.h"
+#include "BVH.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <glm/glm.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// Function to load shader code from a file
+// Function to load shader code from a file, replacing every #include "file" line with the
+// contents of that file (relative to the including file) so shaders can share common code
 std::string loadShaderSource(const std::string& filepath) {
     std::ifstream shaderFile(filepath);  
     if (!shaderFile.is_open()) {
         std::cerr << "Failed to open shader file: " << filepath << std::endl;
         return "";
     }
-    
-    std::stringstream shaderStream;
 
-    shaderStream << shaderFile.rdbuf();
+    std::string directory;
+    size_t slash = filepath.find_last_of('/');
+    if (slash != std::string::npos) directory = filepath.substr(0, slash + 1);
+
+    std::stringstream shaderStream;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(shaderFile, line)) {
+        lineNumber++;
+        size_t begin = line.find("#include \"");
+        size_t end = begin == std::string::npos ? begin : line.find('"', begin + 10);
+        if (begin != std::string::npos && end != std::string::npos && line.find_first_not_of(" \t") == begin) {
+            std::string included = loadShaderSource(directory + line.substr(begin + 10, end - begin - 10));
+            if (included.empty()) return "";
+            // Keep the line numbers of compile errors matching the file they come from
+            shaderStream << "#line 1\n" << included << "#line " << lineNumber + 1 << "\n";
+        } else {
+            shaderStream << line << "\n";
+        }
+    }
     shaderFile.close();
 
     return shaderStream.str();
@@ -71,19 +96,140 @@ void deleteShaderProgram(GLuint shaderProgram) {
     glDeleteProgram(shaderProgram);
 }
 
-// Function to load and compile the compute shader
-GLuint loadComputeShader(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open compute shader file: " << path << std::endl;
+// Header of a program binary in the shader cache
+struct ProgramCacheHeader {
+    char magic[4];          // "RTPB"
+    uint32_t version;       // PROGRAM_CACHE_VERSION
+    uint64_t key;           // Hash of the source and the driver, also the file name
+    uint32_t format;        // Binary format reported by glGetProgramBinary
+    uint32_t length;        // Bytes of binary following the header
+};
+
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// Function to hash a string with 64-bit FNV-1a, continuing from a previous hash
+static uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Function to get a GL string, empty instead of null
+static std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+// Function to describe the driver of the current context by its vendor, renderer and version
+std::string glDeviceString() {
+    return glString(GL_VENDOR) + ", " + glString(GL_RENDERER) + ", " + glString(GL_VERSION);
+}
+
+// Function to get the directory of the shader cache, empty if caching is disabled
+std::string shaderCacheDirectory() {
+    const char* override = std::getenv("RAYTRACER_SHADER_CACHE");
+    if (override) return std::string(override) == "off" ? "" : override;
+    const char* xdgCache = std::getenv("XDG_CACHE_HOME");
+    if (xdgCache && *xdgCache) return std::string(xdgCache) + "/raytracer";
+    const char* home = std::getenv("HOME");
+    if (home && *home) return std::string(home) + "/.cache/raytracer";
+    return "";
+}
+
+// Function to create a directory and its missing parents, returns false if it does not exist afterwards
+bool createDirectories(const std::string& directory) {
+    for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+        // Fails harmlessly for the directories that already exist
+        mkdir(directory.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+    struct stat info;
+    return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Function to get the cache file of a program from its expanded source. The driver is part of the key,
+// so a driver update or another GPU misses the cache instead of loading an incompatible binary.
+static std::string programCachePath(const std::string& directory, const std::string& source, uint64_t& key) {
+    key = hashString(source);
+    key = hashString(glDeviceString(), key);
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+    return directory + name;
+}
+
+// Function to link a program from a cached binary, returns 0 if there is none or the driver rejects it
+static GLuint loadCachedProgram(const std::string& cachePath, uint64_t key) {
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file.is_open()) return 0;
+    ProgramCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, "RTPB", 4) != 0 ||
+        header.version != PROGRAM_CACHE_VERSION || header.key != key) {
         return 0;
     }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) return 0;
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
-    const char* src = source.c_str();
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Function to write the binary of a linked program to the cache. The file is renamed into place,
+// so other processes never read a partial binary.
+static void storeCachedProgram(GLuint program, const std::string& directory, const std::string& cachePath, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || !createDirectories(directory)) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramCacheHeader header = {{'R', 'T', 'P', 'B'}, PROGRAM_CACHE_VERSION, key, format, uint32_t(length)};
+    std::string temporaryPath = cachePath + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), length);
+    file.close();
+    if (!file || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) std::remove(temporaryPath.c_str());
+}
+
+// Function to insert #define lines after the #version line of a shader source
+static std::string insertDefines(const std::string& source, const std::string& defines) {
+    size_t versionEnd = source.find('\n');
+    if (defines.empty() || versionEnd == std::string::npos) return source;
+    // Keep the line numbers of compile errors matching the file
+    return source.substr(0, versionEnd + 1) + defines + "#line 2\n" + source.substr(versionEnd + 1);
+}
+
+// Function to load and compile the compute shader, or link it from the program binary cache
+GLuint loadComputeShader(const std::string& path, const std::string& defines) {
+    // Constants shared with the C++ side come first, the variant's own defines after them
+    std::string shared = "#define BVH_STACK_SIZE " + std::to_string(BVH_STACK_SIZE) + "\n"
+                         + "#define BVH_MAX_LEAF_SIZE " + std::to_string(BVH_MAX_LEAF_SIZE) + "u\n";
+    std::string source = insertDefines(loadShaderSource(path), shared + defines);
+    if (source.empty()) return 0;
+
+    // Drivers without program binary formats can not be cached
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    uint64_t key = 0;
+    std::string cacheDirectory = binaryFormats > 0 ? shaderCacheDirectory() : "";
+    std::string cachePath;
+    if (!cacheDirectory.empty()) {
+        cachePath = programCachePath(cacheDirectory, source, key);
+        GLuint program = loadCachedProgram(cachePath, key);
+        if (program) return program;
+    }
 
+    const char* src = source.c_str();
     GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
     glShaderSource(shader, 1, &src, nullptr);
     glCompileShader(shader);
@@ -94,11 +240,13 @@ GLuint loadComputeShader(const std::string& path) {
         char infoLog[512];
         glGetShaderInfoLog(shader, 512, nullptr, infoLog);
         std::cerr << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glDeleteShader(shader);
         return 0;
     }
 
     GLuint program = glCreateProgram();
     glAttachShader(program, shader);
+    if (!cachePath.empty()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -106,6 +254,10 @@ GLuint loadComputeShader(const std::string& path) {
         char infoLog[512];
         glGetProgramInfoLog(program, 512, nullptr, infoLog);
         std::cerr << "ERROR::SHADER::COMPUTE::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        program = 0;
+    } else if (!cachePath.empty()) {
+        storeCachedProgram(program, cacheDirectory, cachePath, key);
     }
 
     glDeleteShader(shader); // We can delete the shader after linking
@@ -113,36 +265,130 @@ GLuint loadComputeShader(const std::string& path) {
     return program;
 }
 
-// Function to create and bind SSBO for geometry data
-GLuint createSSBO(const std::vector<Sphere>& spheres, const std::vector<Plane>& planes, const std::vector<Light>& lights) {
-    GLuint ssbo;
-    glGenBuffers(1, &ssbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+// Function to check whether any surface of a scene reflects
+static bool sceneReflects(const Scene& scene) {
+    for (const Sphere& sphere : scene.spheres) {
+        if (sphere.reflectivity > 0.0f) return true;
+    }
+    for (const Plane& plane : scene.planes) {
+        if (plane.reflectivity > 0.0f) return true;
+    }
+    for (const MeshInstance& instance : scene.instances) {
+        if (instance.reflectivity > 0.0f) return true;
+    }
+    return false;
+}
 
-    size_t sphereSize = spheres.size() * sizeof(Sphere);
-    size_t planeSize = planes.size() * sizeof(Plane);
-    size_t lightSize = lights.size() * sizeof(Light);
+// Function to pick the variant a scene needs, keeping the default workgroup size
+ShaderVariant sceneShaderVariant(const Scene& scene, int maxBounces) {
+    ShaderVariant variant;
+    variant.maxBounces = sceneReflects(scene) ? maxBounces : 0;
+    variant.shadows = scene.lights.empty() ? 0 : 1;
+    variant.numLights = scene.lights.size() <= size_t(MAX_UNROLLED_LIGHTS) ? int(scene.lights.size()) : -1;
+    variant.workgroup.sizeX = 0;
+    variant.workgroup.sizeY = 0;
+    variant.workgroup.morton = false;
+    variant.variableRate = false;
+    variant.output = OUTPUT_RGBA32F;
+    variant.quantized = false;
+    variant.packets = false;
+    variant.denoise = false;
+    return variant;
+}
 
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sphereSize + planeSize + lightSize, nullptr, GL_DYNAMIC_DRAW);
+// Function to get the #define lines of a variant, the key of the variant in a ShaderVariantCache
+std::string shaderVariantDefines(const ShaderVariant& variant) {
+    std::string defines;
+    if (variant.maxBounces >= 0) defines += "#define MAX_BOUNCES " + std::to_string(variant.maxBounces) + "\n";
+    if (variant.shadows >= 0) defines += "#define SHADOWS_ON " + std::to_string(variant.shadows) + "\n";
+    if (variant.numLights >= 0) defines += "#define NUM_LIGHTS " + std::to_string(variant.numLights) + "\n";
+    if (variant.workgroup.sizeX > 0) defines += "#define WORKGROUP_SIZE_X " + std::to_string(variant.workgroup.sizeX) + "\n";
+    if (variant.workgroup.sizeY > 0) defines += "#define WORKGROUP_SIZE_Y " + std::to_string(variant.workgroup.sizeY) + "\n";
+    if (variant.workgroup.morton) defines += "#define MORTON_ORDER 1\n";
+    if (variant.variableRate) defines += "#define VARIABLE_RATE 1\n";
+    if (variant.output == OUTPUT_RGBA16F) defines += "#define OUTPUT_FORMAT rgba16f\n";
+    if (variant.output == OUTPUT_R11G11B10F) defines += "#define OUTPUT_FORMAT r11f_g11f_b10f\n";
+    if (variant.output == OUTPUT_RGBA8) defines += "#define OUTPUT_FORMAT rgba8\n#define TONEMAP_OUTPUT 1\n";
+    if (variant.quantized) defines += "#define QUANTIZED_SCENE 1\n";
+    if (variant.packets) defines += "#define PACKET_TRACING 1\n";
+    if (variant.denoise) defines += "#define DENOISE_FEATURES 1\n";
+    return defines;
+}
 
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sphereSize, spheres.data());
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sphereSize, planeSize, planes.data());
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sphereSize + planeSize, lightSize, lights.data());
+// Function to get the program of a variant, compiling it on first use. Returns 0 if it does not compile.
+GLuint getShaderVariant(ShaderVariantCache& cache, const std::string& defines) {
+    std::map<std::string, GLuint>::const_iterator found = cache.programs.find(defines);
+    if (found != cache.programs.end()) return found->second;
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+    GLuint program = loadComputeShader(cache.path, defines);
+    // Failures are not cached, a failing variant reports its errors on every attempt
+    if (program) cache.programs[defines] = program;
+    return program;
+}
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+// Function to append the compiled variants of a cache to a list
+void listShaderVariants(const ShaderVariantCache& cache, std::vector<ShaderVariantProgram>& variants) {
+    for (const auto& variant : cache.programs) {
+        ShaderVariantProgram listed = {cache.path, variant.first, variant.second};
+        variants.push_back(listed);
+    }
+}
 
-    return ssbo;
+// Function to put a program rebuilt for a variant of a cache in place of the old one, which is deleted
+bool replaceShaderVariant(ShaderVariantCache& cache, const ShaderVariantProgram& rebuilt, GLuint& current) {
+    if (rebuilt.path != cache.path) return false;
+    std::map<std::string, GLuint>::iterator found = cache.programs.find(rebuilt.defines);
+    if (found == cache.programs.end()) return false;
+    // Frames already queued keep the old program alive until the GPU is done with them
+    if (current == found->second) current = rebuilt.program;
+    glDeleteProgram(found->second);
+    found->second = rebuilt.program;
+    return true;
+}
+
+// Function to delete all compiled variants of a cache
+void deleteShaderVariants(ShaderVariantCache& cache) {
+    for (const auto& variant : cache.programs) glDeleteProgram(variant.second);
+    cache.programs.clear();
+}
+
+// Function to get the OpenGL internal format of an output format
+GLenum outputInternalFormat(OutputFormat format) {
+    switch (format) {
+        case OUTPUT_RGBA16F: return GL_RGBA16F;
+        case OUTPUT_R11G11B10F: return GL_R11F_G11F_B10F;
+        case OUTPUT_RGBA8: return GL_RGBA8;
+        default: return GL_RGBA32F;
+    }
+}
+
+// Function to get the bytes per pixel of an output format
+int outputFormatBytes(OutputFormat format) {
+    switch (format) {
+        case OUTPUT_RGBA16F: return 8;
+        case OUTPUT_R11G11B10F: return 4;
+        case OUTPUT_RGBA8: return 4;
+        default: return 16;
+    }
+}
+
+// Function to parse an output format name (rgba32f, rgba16f, r11g11b10f, rgba8), returns false for unknown names
+bool parseOutputFormat(const std::string& name, OutputFormat& format) {
+    if (name == "rgba32f") format = OUTPUT_RGBA32F;
+    else if (name == "rgba16f") format = OUTPUT_RGBA16F;
+    else if (name == "r11g11b10f") format = OUTPUT_R11G11B10F;
+    else if (name == "rgba8") format = OUTPUT_RGBA8;
+    else return false;
+    return true;
 }
 
 // Function to create a 2D texture to store the output of the compute shader
-GLuint createTexture(int width, int height) {
+GLuint createTexture(int width, int height, GLenum internalFormat) {
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -154,34 +400,145 @@ GLuint createTexture(int width, int height) {
     return texture;
 }
 
-// Function to set the uniforms for the compute shader
-void setComputeShaderUniforms(GLuint computeProgram, int width, int height, const glm::vec3& cameraPos, const glm::vec3& cameraDir, float focalLength) {
-    glUseProgram(computeProgram);
+// Function to set the image size and camera uniforms for the compute shaders
+void setComputeShaderUniforms(FrameUniforms& uniforms, int width, int height, const glm::vec3& cameraPos, const glm::vec3& cameraDir, float focalLength) {
+    uniforms.screenWidth = width;
+    uniforms.screenHeight = height;
+    uniforms.cameraPos = cameraPos;
+    uniforms.cameraDir = cameraDir;
+    uniforms.focalLength = focalLength;
+}
+
+// Function to set which sample of the progressive image the compute shaders trace
+void setSampleUniforms(FrameUniforms& uniforms, int sampleIndex, const glm::vec2& jitter) {
+    uniforms.sampleIndex = sampleIndex;
+    uniforms.sampleJitter = jitter;
+}
+
+// Function to switch the ray counters of the compute shaders on or off
+void setRayCountingUniform(FrameUniforms& uniforms, bool countRays) {
+    uniforms.countRays = countRays ? 1 : 0;
+}
+
+// Function to set the shadow rays the compute shaders trace per pixel and sample
+void setShadowRayUniform(FrameUniforms& uniforms, int shadowRays) {
+    uniforms.shadowRayBudget = shadowRays;
+}
+
+// Function to set the region of the full image the compute shaders trace, the image size is the traced size
+// unless a larger image is split into tiles
+void setImageRegionUniforms(FrameUniforms& uniforms, int x, int y, int imageWidth, int imageHeight) {
+    uniforms.imageOffset = glm::ivec2(x, y);
+    uniforms.imageSize = glm::ivec2(imageWidth, imageHeight);
+}
+
+// Function to wait for the GPU to finish reading a slot of the uniform ring and delete its fence
+static void waitForUniformSlot(FrameUniformRing& ring, int slot) {
+    GLsync& fence = ring.fences[slot];
+    if (!fence) return;
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fence);
+    fence = 0;
+}
 
-    // Set uniform values for screen width, height, camera position, and direction
-    glUniform1i(glGetUniformLocation(computeProgram, "screenWidth"), width);
-    glUniform1i(glGetUniformLocation(computeProgram, "screenHeight"), height);
-    glUniform3f(glGetUniformLocation(computeProgram, "cameraPos"), cameraPos.x, cameraPos.y, cameraPos.z);
-    glUniform3f(glGetUniformLocation(computeProgram, "cameraDir"), cameraDir.x, cameraDir.y, cameraDir.z);
-    glUniform1f(glGetUniformLocation(computeProgram, "focalLength"), focalLength);
+// Function to create the uniform ring buffer holding the FrameData blocks
+FrameUniformRing createFrameUniformRing() {
+    FrameUniformRing ring;
+    // Every slot is bound with glBindBufferRange, so it has to start at an aligned offset
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = alignment > 0 ? alignment : 1;
+    ring.stride = (GLsizeiptr(sizeof(FrameUniforms)) + alignment - 1) / alignment * alignment;
+    ring.slot = FRAMES_IN_FLIGHT - 1;
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) ring.fences[i] = 0;
+    GLsizeiptr size = ring.stride * FRAMES_IN_FLIGHT;
+
+    ring.mapped = nullptr;
+    glGenBuffers(1, &ring.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+        ring.mapped = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    }
+    if (!ring.mapped) {
+        // Immutable storage cannot be respecified, so start over with a mutable buffer
+        glDeleteBuffers(1, &ring.buffer);
+        glGenBuffers(1, &ring.buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return ring;
+}
+
+// Function to write the uniforms of a frame into the next slot and bind it to FRAME_UNIFORM_BINDING, one call
+// instead of a glUniform per value and program
+void uploadFrameUniforms(FrameUniformRing& ring, const FrameUniforms& uniforms) {
+    ring.slot = (ring.slot + 1) % FRAMES_IN_FLIGHT;
+    // Only waits if the GPU is FRAMES_IN_FLIGHT frames behind
+    waitForUniformSlot(ring, ring.slot);
+    GLintptr offset = ring.slot * ring.stride;
+    if (ring.mapped) {
+        std::memcpy(ring.mapped + offset, &uniforms, sizeof(uniforms));
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(uniforms), &uniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, ring.buffer, offset, sizeof(uniforms));
+}
+
+// Function to fence the slot of the last upload after all commands reading it have been issued
+void fenceFrameUniforms(FrameUniformRing& ring) {
+    if (ring.fences[ring.slot]) glDeleteSync(ring.fences[ring.slot]);
+    ring.fences[ring.slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Function to wait for the GPU and delete the uniform ring buffer
+void deleteFrameUniformRing(FrameUniformRing& ring) {
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) waitForUniformSlot(ring, i);
+    if (ring.mapped) {
+        glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        ring.mapped = nullptr;
+    }
+    glDeleteBuffers(1, &ring.buffer);
+    ring.buffer = 0;
+}
+
+// Function to get the pixels covered by one workgroup of a layout. A Morton tile of 2^k invocations
+// is 2^ceil(k/2) pixels wide and 2^floor(k/2) high, as invocationPixel in common.glsl walks it.
+void workgroupTileSize(const WorkgroupLayout& layout, int& tileWidth, int& tileHeight) {
+    if (!layout.morton) {
+        tileWidth = layout.sizeX;
+        tileHeight = layout.sizeY;
+        return;
+    }
+    int bits = 0;
+    while ((2 << bits) <= layout.sizeX) bits++;
+    tileWidth = 1 << ((bits + 1) / 2);
+    tileHeight = 1 << (bits / 2);
 }
 
 // Function to dispatch the compute shader for ray tracing
-void dispatchComputeShader(GLuint computeProgram, GLuint texture, int width, int height) {
+void dispatchComputeShader(GLuint computeProgram, GLuint texture, GLuint accumulationTexture, int width, int height, const WorkgroupLayout& layout,
+                           OutputFormat format) {
 
     // Use the compute shader program
     glUseProgram(computeProgram);
 
     // Bind the texture for writing
-    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-
-    // Define workgroup size
-    int workgroupSizeX = 16;
-    int workgroupSizeY = 16;
+    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, outputInternalFormat(format));
+    // Bind the running mean of the previous samples for reading and writing
+    glBindImageTexture(1, accumulationTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 
     // Calculate the number of workgroups needed
-    int numGroupsX = (width + workgroupSizeX - 1) / workgroupSizeX;
-    int numGroupsY = (height + workgroupSizeY - 1) / workgroupSizeY;
+    int tileWidth, tileHeight;
+    workgroupTileSize(layout, tileWidth, tileHeight);
+    int numGroupsX = (width + tileWidth - 1) / tileWidth;
+    int numGroupsY = (height + tileHeight - 1) / tileHeight;
 
     // Dispatch the compute shader
     glDispatchCompute(numGroupsX, numGroupsY, 1);
@@ -199,9 +556,6 @@ void renderQuadWithTexture(GLuint texture, GLuint shaderProgram, VertexObjects q
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
 
-    // Set the sampler uniform to use texture unit 0
-    glUniform1i(glGetUniformLocation(shaderProgram, "screenTexture"), 0);
-
     // Draw the quad
     glBindVertexArray(quadVO.VAO);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -209,4 +563,30 @@ void renderQuadWithTexture(GLuint texture, GLuint shaderProgram, VertexObjects q
 
     // Unbind the texture
     glBindTexture(GL_TEXTURE_2D, 0);
-}
\ No newline at end of file
+}
+
+// Function to create the read framebuffer of the blit present path
+BlitPresenter createBlitPresenter() {
+    BlitPresenter presenter;
+    glGenFramebuffers(1, &presenter.framebuffer);
+    return presenter;
+}
+
+// Function to copy a texture to the default framebuffer with glBlitFramebuffer. Unlike the quad pass this
+// needs no shader and no second texture read in a fragment shader, but can only scale bilinearly.
+void blitTextureToScreen(BlitPresenter& presenter, GLuint texture, int width, int height, int screenWidth, int screenHeight) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, presenter.framebuffer);
+    // Attach on every frame: renderers replace the texture on a resize, and a new texture often reuses the deleted
+    // one's name while the framebuffer still holds the deleted texture
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GLenum filter = width == screenWidth && height == screenHeight ? GL_NEAREST : GL_LINEAR;
+    glBlitFramebuffer(0, 0, width, height, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT, filter);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// Function to delete the framebuffer of the blit present path
+void deleteBlitPresenter(BlitPresenter& presenter) {
+    glDeleteFramebuffers(1, &presenter.framebuffer);
+    presenter.framebuffer = 0;
+}
@@ -5,10 +5,97 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <map>
 #include <string>
 #include <vector>
 
-// Function to load a shader source from a file
+// Binding point of the FrameData uniform block in common.glsl
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+// Most frames the CPU may run ahead of the GPU, the number of slots in every per-frame ring buffer
+const int FRAMES_IN_FLIGHT = 3;
+
+// Structure for the per-frame uniforms of the compute shaders. Layout must match the std140 FrameData block in common.glsl
+struct FrameUniforms {
+    glm::vec3 cameraPos;
+    float focalLength;
+    glm::vec3 cameraDir;
+    GLint screenWidth;
+    glm::vec2 sampleJitter;
+    GLint screenHeight;
+    GLint sampleIndex;
+    GLint numSpheres;
+    GLint numPlanes;
+    GLint numLights;
+    GLint sphereRoot;           // Root of the sphere BVH in the node array, -1 without spheres
+    GLint instanceRoot;
+    GLuint countRays;
+    GLint shadowRayBudget;
+    GLuint pad1;
+    glm::ivec2 imageOffset;     // Offset of the traced region in the full image
+    glm::ivec2 imageSize;       // Size of the full image the camera covers
+};
+
+static_assert(sizeof(FrameUniforms) == 96, "FrameUniforms must match the std140 layout of FrameData");
+
+// Lights up to which shader variants unroll the light loops, scenes with more loop over the light count at runtime
+const int MAX_UNROLLED_LIGHTS = 8;
+
+// Structure for the workgroup shape of a 2-D compute shader and the order its invocations cover the pixels.
+// Zero sizes keep the local size declared in the shader.
+struct WorkgroupLayout {
+    int sizeX;          // WORKGROUP_SIZE_X and WORKGROUP_SIZE_Y
+    int sizeY;
+    bool morton;        // MORTON_ORDER, 1-D workgroups of sizeX (a power of two) that cover a tile along a Z-order curve
+};
+
+// Layout raytracing.comp was written for, used until a tuned layout is stored for the device
+const WorkgroupLayout DEFAULT_WORKGROUP_LAYOUT = {16, 16, false};
+
+// Formats of the output texture the GPU backends present and read back. The accumulation texture
+// stays RGBA32F, so the format only limits what is displayed, not the precision of the running mean.
+enum OutputFormat {
+    OUTPUT_RGBA32F,     // 16 bytes per pixel
+    OUTPUT_RGBA16F,     // 8 bytes per pixel
+    OUTPUT_R11G11B10F,  // 4 bytes per pixel, without alpha and negative values
+    OUTPUT_RGBA8        // 4 bytes per pixel, tonemapped into [0, 1] by the compute pass
+};
+
+// Structure for the compile-time settings of a compute shader variant, injected as #defines so the compiler
+// removes the features a scene does not use. Negative values keep the shader's default.
+struct ShaderVariant {
+    int maxBounces;     // MAX_BOUNCES, reflections followed per path, 0 if no surface reflects
+    int shadows;        // SHADOWS_ON, 0 if no shadow rays are traced
+    int numLights;      // NUM_LIGHTS, the light count the loops are unrolled for
+    WorkgroupLayout workgroup;
+    bool variableRate;  // VARIABLE_RATE, one invocation per 2x2 pixel block that traces the periphery once, only
+                        // raytracing.comp supports it and is dispatched at half the size
+    OutputFormat output;    // OUTPUT_FORMAT and TONEMAP_OUTPUT, the image format of imgOutput
+    bool quantized;     // QUANTIZED_SCENE, spheres stored as 16-bit coordinates in their BVH leaf by the scene buffer
+    bool packets;       // PACKET_TRACING, primary and shadow rays traced per workgroup with shared memory, only
+                        // raytracing.comp supports it and not together with variableRate
+    bool denoise;       // DENOISE_FEATURES, the pass that stores the samples also writes the normal, depth and
+                        // albedo images that guide the denoiser (Denoiser.h)
+};
+
+// Structure for the variants of one compute shader that were compiled so far, by their #define lines
+struct ShaderVariantCache {
+    std::string path;
+    std::map<std::string, GLuint> programs;
+};
+
+// Function to describe the driver of the current context by its vendor, renderer and version,
+// the key of everything cached per device
+std::string glDeviceString();
+
+// Function to get the directory of the shader cache, empty if caching is disabled. RAYTRACER_SHADER_CACHE sets
+// the directory (default $XDG_CACHE_HOME/raytracer or ~/.cache/raytracer), RAYTRACER_SHADER_CACHE=off disables it.
+std::string shaderCacheDirectory();
+
+// Function to create a directory and its missing parents, returns false if it does not exist afterwards
+bool createDirectories(const std::string& directory);
+
+// Function to load a shader source from a file, expanding #include "file" lines
 std::string loadShaderSource(const std::string& filepath);
 
 // Function to compile a shader
@@ -20,22 +107,109 @@ GLuint createShaderProgram(const std::string& vertexSource, const std::string& f
 // Function to delete a shader program
 void deleteShaderProgram(GLuint shaderProgram);
 
-// Function to load and compile the compute shader
-GLuint loadComputeShader(const std::string& path);
+// Function to load and compile the compute shader. Linked programs are cached in shaderCacheDirectory() by the
+// hash of their source and the driver, so later runs skip the compile. defines are #define lines inserted after the #version line.
+GLuint loadComputeShader(const std::string& path, const std::string& defines = "");
+
+// Function to pick the variant a scene needs: reflections only if a surface reflects, shadows only if there
+// are lights, and light loops unrolled for small light counts. maxBounces is the most reflections to follow.
+ShaderVariant sceneShaderVariant(const Scene& scene, int maxBounces);
+
+// Function to get the #define lines of a variant, the key of the variant in a ShaderVariantCache
+std::string shaderVariantDefines(const ShaderVariant& variant);
+
+// Function to get the program of a variant, compiling it on first use. Returns 0 if it does not compile.
+GLuint getShaderVariant(ShaderVariantCache& cache, const std::string& defines);
+
+// Structure for a compiled variant of a compute shader, named by its file and #define lines
+struct ShaderVariantProgram {
+    std::string path;
+    std::string defines;
+    GLuint program;
+};
+
+// Function to append the compiled variants of a cache to a list
+void listShaderVariants(const ShaderVariantCache& cache, std::vector<ShaderVariantProgram>& variants);
 
-// Function to create and bind SSBO for geometry data
-GLuint createSSBO(const std::vector<Sphere>& spheres, const std::vector<Plane>& planes, const std::vector<Light>& lights);
+// Function to put a program rebuilt for a variant of a cache in place of the old one, which is deleted.
+// current is switched to the new program if it held the old one. Returns false if the cache has no such variant.
+bool replaceShaderVariant(ShaderVariantCache& cache, const ShaderVariantProgram& rebuilt, GLuint& current);
+
+// Function to delete all compiled variants of a cache
+void deleteShaderVariants(ShaderVariantCache& cache);
+
+// Function to get the OpenGL internal format of an output format
+GLenum outputInternalFormat(OutputFormat format);
+
+// Function to get the bytes per pixel of an output format
+int outputFormatBytes(OutputFormat format);
+
+// Function to parse an output format name (rgba32f, rgba16f, r11g11b10f, rgba8), returns false for unknown names
+bool parseOutputFormat(const std::string& name, OutputFormat& format);
 
 // Function to create a 2D texture to store the output of the compute shader
-GLuint createTexture(int width, int height);
+GLuint createTexture(int width, int height, GLenum internalFormat = GL_RGBA32F);
+
+// Function to get the pixels covered by one workgroup of a layout, the dispatch math of every 2-D pass
+void workgroupTileSize(const WorkgroupLayout& layout, int& tileWidth, int& tileHeight);
+
+// Function to dispatch the compute shader for ray tracing, compiled for the given workgroup layout and output format
+void dispatchComputeShader(GLuint computeProgram, GLuint texture, GLuint accumulationTexture, int width, int height, const WorkgroupLayout& layout,
+                           OutputFormat format = OUTPUT_RGBA32F);
+
+// Function to set the image size and camera uniforms for the compute shaders
+void setComputeShaderUniforms(FrameUniforms& uniforms, int width, int height, const glm::vec3& cameraPos, const glm::vec3& cameraDir, float focalLength);
+
+// Function to set which sample of the progressive image the compute shaders trace
+void setSampleUniforms(FrameUniforms& uniforms, int sampleIndex, const glm::vec2& jitter);
+
+// Function to switch the ray counters of the compute shaders on or off
+void setRayCountingUniform(FrameUniforms& uniforms, bool countRays);
 
-// Function to dispatch the compute shader for ray tracing
-void dispatchComputeShader(GLuint computeProgram, GLuint texture, int width, int height);
+// Function to set the shadow rays the compute shaders trace per pixel and sample
+void setShadowRayUniform(FrameUniforms& uniforms, int shadowRays);
 
-// Function to set uniforms for the compute shader
-void setComputeShaderUniforms(GLuint computeProgram, int width, int height, const glm::vec3& cameraPos, const glm::vec3& cameraDir, float focalLength);
+// Function to set the region of the full image the compute shaders trace, the image size is the traced size
+// unless a larger image is split into tiles
+void setImageRegionUniforms(FrameUniforms& uniforms, int x, int y, int imageWidth, int imageHeight);
 
-// Function to render a full-screen quad with a texture
+// Structure for a ring of FrameData blocks, one per frame in flight, so writing the uniforms of the next
+// frame never waits for the GPU to finish reading those of the previous ones
+struct FrameUniformRing {
+    GLuint buffer;
+    char* mapped;                           // Persistent mapping of all slots, nullptr if unsupported
+    GLsizeiptr stride;                      // Size of a slot, rounded up to the uniform buffer offset alignment
+    int slot;                               // Slot written by the last upload
+    GLsync fences[FRAMES_IN_FLIGHT];        // Signalled once the GPU is done reading a slot
+};
+
+// Function to create the uniform ring buffer holding the FrameData blocks
+FrameUniformRing createFrameUniformRing();
+
+// Function to write the uniforms of a frame into the next slot and bind it to FRAME_UNIFORM_BINDING for all compute shaders
+void uploadFrameUniforms(FrameUniformRing& ring, const FrameUniforms& uniforms);
+
+// Function to fence the slot of the last upload after all commands reading it have been issued
+void fenceFrameUniforms(FrameUniformRing& ring);
+
+// Function to wait for the GPU and delete the uniform ring buffer
+void deleteFrameUniformRing(FrameUniformRing& ring);
+
+// Function to render a full-screen quad with a texture. The screenTexture sampler of the program must use unit 0.
 void renderQuadWithTexture(GLuint texture, GLuint shaderProgram, VertexObjects vo);
 
+// Structure for presenting a texture with glBlitFramebuffer, which skips the quad pass
+struct BlitPresenter {
+    GLuint framebuffer;     // Read framebuffer the texture is attached to
+};
+
+// Function to create the read framebuffer of the blit present path
+BlitPresenter createBlitPresenter();
+
+// Function to copy a texture of width x height to the whole default framebuffer, scaling it bilinearly if the sizes differ
+void blitTextureToScreen(BlitPresenter& presenter, GLuint texture, int width, int height, int screenWidth, int screenHeight);
+
+// Function to delete the framebuffer of the blit present path
+void deleteBlitPresenter(BlitPresenter& presenter);
+
 #endif // SHADER_H
\ No newline at end of file
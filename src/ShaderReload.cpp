@@ -0,0 +1,150 @@
+#include "ShaderReload.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Function to check whether a file name ends with a suffix
+static bool endsWith(const std::string& name, const char* suffix) {
+    size_t length = std::strlen(suffix);
+    return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+// Function to start watching a directory and compiling on a context that shares objects with the render context
+ShaderReloader::ShaderReloader(const std::string& directory, GLFWwindow* context)
+    : directory(directory), context(context), inotifyFd(-1), stopping(false), sourcesChanged(false), requested(false),
+      finished(false) {
+    if (!context) return;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Editors either rewrite a file in place or write a copy and rename it over the original
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Failed to watch the shaders in " << directory << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    snapshotSources();
+    thread = std::thread(&ShaderReloader::run, this);
+    std::cout << "Watching the shaders in " << directory << std::endl;
+}
+
+ShaderReloader::~ShaderReloader() {
+    stopping = true;
+    if (thread.joinable()) thread.join();
+    if (inotifyFd >= 0) close(inotifyFd);
+    // Programs of a rebuild the render thread never picked up, the caller's context shares them
+    for (const ShaderVariantProgram& variant : result) glDeleteProgram(variant.program);
+}
+
+// Function to keep the expanded source of every compute shader in the directory, the state the programs were built from
+void ShaderReloader::snapshotSources() {
+    DIR* listing = opendir(directory.c_str());
+    if (!listing) return;
+    while (dirent* entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        if (endsWith(name, ".comp")) sources[directory + "/" + name] = loadShaderSource(directory + "/" + name);
+    }
+    closedir(listing);
+}
+
+// Function run by the background thread: waits for changes to settle, and rebuilds the variants the render thread
+// hands over on the shared context
+void ShaderReloader::run() {
+    glfwMakeContextCurrent(context);
+    bool changing = false;
+    std::chrono::steady_clock::time_point lastChange;
+    // Room for many events, aligned like the events it holds
+    alignas(inotify_event) char events[4096];
+    while (!stopping) {
+        pollfd watched = {inotifyFd, POLLIN, 0};
+        if (poll(&watched, 1, SHADER_RELOAD_SETTLE_MS / 2) > 0) {
+            ssize_t length;
+            while ((length = read(inotifyFd, events, sizeof(events))) > 0) {
+                for (char* at = events; at < events + length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+                    std::string name = event->len > 0 ? event->name : "";
+                    if (endsWith(name, ".comp") || endsWith(name, ".glsl")) {
+                        changing = true;
+                        lastChange = std::chrono::steady_clock::now();
+                    }
+                    at += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+        if (changing && std::chrono::steady_clock::now() - lastChange >= std::chrono::milliseconds(SHADER_RELOAD_SETTLE_MS)) {
+            changing = false;
+            sourcesChanged = true;
+        }
+
+        std::vector<ShaderVariantProgram> variants;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!requested) continue;
+            variants.swap(request);
+            requested = false;
+        }
+        std::vector<ShaderVariantProgram> rebuilt;
+        if (!rebuild(variants, rebuilt) || rebuilt.empty()) continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        // A rebuild the render thread did not pick up yet is outdated by this one
+        for (const ShaderVariantProgram& variant : result) glDeleteProgram(variant.program);
+        result.swap(rebuilt);
+        finished = true;
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+// Function to compile the variants whose expanded source changed. Returns false and deletes what it built if any of
+// them fails, so the render thread keeps the last working programs.
+bool ShaderReloader::rebuild(const std::vector<ShaderVariantProgram>& variants, std::vector<ShaderVariantProgram>& rebuilt) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // Includes are expanded, so an edit of common.glsl rebuilds every shader that includes it
+    std::map<std::string, std::string> current;
+    for (const ShaderVariantProgram& variant : variants) {
+        if (!current.count(variant.path)) current[variant.path] = loadShaderSource(variant.path);
+    }
+    for (const ShaderVariantProgram& variant : variants) {
+        if (current[variant.path] == sources[variant.path]) continue;
+        ShaderVariantProgram compiled = {variant.path, variant.defines, loadComputeShader(variant.path, variant.defines)};
+        if (!compiled.program) {
+            std::cerr << "Keeping the last working shaders, " << variant.path << " does not build" << std::endl;
+            for (const ShaderVariantProgram& built : rebuilt) glDeleteProgram(built.program);
+            rebuilt.clear();
+            return false;
+        }
+        rebuilt.push_back(compiled);
+    }
+    for (const auto& source : current) sources[source.first] = source.second;
+    if (rebuilt.empty()) return true;
+
+    // The render context may only use the programs once this context has finished building them
+    glFinish();
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rebuilt " << rebuilt.size() << " shader variant" << (rebuilt.size() == 1 ? "" : "s") << " in "
+              << milliseconds << " ms" << std::endl;
+    return true;
+}
+
+// Function for the render thread to call between frames
+bool ShaderReloader::update(Renderer& renderer) {
+    if (sourcesChanged.exchange(false)) {
+        std::vector<ShaderVariantProgram> variants;
+        renderer.listShaderVariants(variants);
+        std::lock_guard<std::mutex> lock(mutex);
+        request.swap(variants);
+        requested = true;
+    }
+
+    std::vector<ShaderVariantProgram> rebuilt;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!finished) return false;
+        rebuilt.swap(result);
+        finished = false;
+    }
+    renderer.replaceShaderVariants(rebuilt);
+    return true;
+}
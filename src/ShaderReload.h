@@ -0,0 +1,59 @@
+#ifndef SHADERRELOAD_H
+#define SHADERRELOAD_H
+
+#include "Renderer.h"
+#include "Shader.h"
+
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Time the shader files have to stay unchanged before they are rebuilt, editors often write a file in steps
+const int SHADER_RELOAD_SETTLE_MS = 100;
+
+// Rebuilds the compute shaders of a renderer while it keeps rendering. A background thread watches the shader
+// directory with inotify and compiles the variants whose source changed on its own GL context, which shares
+// its objects with the render context. The render thread swaps the new programs in between two frames, and
+// only once every variant compiled and linked, so a broken edit leaves the last working shaders in use.
+class ShaderReloader {
+public:
+    // Function to start watching a directory and compiling on a context that shares objects with the render
+    // context and is not current on any thread. Check watching() afterwards.
+    ShaderReloader(const std::string& directory, GLFWwindow* context);
+    ~ShaderReloader();
+
+    // Function to check whether the directory is watched
+    bool watching() const { return thread.joinable(); }
+
+    // Function for the render thread to call between frames: hands the variants of the renderer to the background
+    // thread after a shader changed, and swaps in the programs of a finished rebuild. Returns true if it swapped.
+    bool update(Renderer& renderer);
+
+private:
+    ShaderReloader(const ShaderReloader&);
+    ShaderReloader& operator=(const ShaderReloader&);
+
+    void run();
+    void snapshotSources();
+    bool rebuild(const std::vector<ShaderVariantProgram>& variants, std::vector<ShaderVariantProgram>& rebuilt);
+
+    std::string directory;
+    GLFWwindow* context;
+    int inotifyFd;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<bool> sourcesChanged;           // Set by the background thread once a change has settled
+    std::map<std::string, std::string> sources; // Expanded source of every compute shader the programs were built from
+
+    std::mutex mutex;                           // Guards the request and the result
+    bool requested;
+    std::vector<ShaderVariantProgram> request;  // Variants in use when the change was noticed
+    bool finished;
+    std::vector<ShaderVariantProgram> result;   // Programs rebuilt for the request
+};
+
+#endif // SHADERRELOAD_H
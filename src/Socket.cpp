@@ -0,0 +1,191 @@
+#include "Socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Prefix of the addresses of Unix domain sockets
+static const char* const UNIX_PREFIX = "unix:";
+
+// Function to check whether an address names a Unix domain socket, and get its path
+static bool unixSocketPath(const std::string& address, std::string& path) {
+    if (address.compare(0, 5, UNIX_PREFIX) != 0) return false;
+    path = address.substr(5);
+    return true;
+}
+
+// Function to fill in the address of a Unix domain socket, returns false if the path is too long
+static bool unixAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid Unix socket path: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Function to resolve <host>:<port>, the caller frees the result with freeaddrinfo
+static addrinfo* resolveTcpAddress(const std::string& address, bool listening) {
+    size_t colon = address.find_last_of(':');
+    if (colon == std::string::npos || colon + 1 == address.size()) {
+        std::cerr << "Invalid address " << address << ", expected unix:<path> or <host>:<port>" << std::endl;
+        return nullptr;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (listening) hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0) {
+        std::cerr << "Failed to resolve " << address << ": " << gai_strerror(error) << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+// Function to set the options of a connected TCP socket: small messages are sent at once, and the
+// keepalive probes notice a peer that went away without closing the connection
+static void configureTcpSocket(int socket) {
+    int enabled = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &enabled, sizeof(enabled));
+}
+
+// Function to open a listening socket on an address: unix:<path> for a Unix domain socket, or <host>:<port>
+// (host may be empty for all interfaces) for TCP. Returns the socket, or -1 after printing the reason.
+int listenSocket(const std::string& address) {
+    std::string path;
+    if (unixSocketPath(address, path)) {
+        sockaddr_un unixAddr;
+        if (!unixAddress(path, unixAddr)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        // A socket file left behind by a coordinator that did not exit cleanly would fail the bind
+        unlink(path.c_str());
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&unixAddr), sizeof(unixAddr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            std::cerr << "Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo* addresses = resolveTcpAddress(address, true);
+    if (!addresses) return -1;
+    int fd = -1;
+    for (addrinfo* info = addresses; info && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+        if (fd < 0) continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, info->ai_addr, info->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) std::cerr << "Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+    return fd;
+}
+
+// Function to accept a connection on a listening socket, returns -1 if none could be accepted
+int acceptSocket(int listener) {
+    int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) return -1;
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0 && address.ss_family != AF_UNIX) {
+        configureTcpSocket(fd);
+    }
+    return fd;
+}
+
+// Function to connect to an address in the format of listenSocket, returns the socket or -1
+int connectSocket(const std::string& address) {
+    std::string path;
+    if (unixSocketPath(address, path)) {
+        sockaddr_un unixAddr;
+        if (!unixAddress(path, unixAddr)) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&unixAddr), sizeof(unixAddr)) == 0) return fd;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    addrinfo* addresses = resolveTcpAddress(address, false);
+    if (!addresses) return -1;
+    int fd = -1;
+    for (addrinfo* info = addresses; info && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+        if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) configureTcpSocket(fd);
+    return fd;
+}
+
+// Function to close a socket, and remove the file of a listening Unix domain socket
+void closeSocket(int socket, const std::string& address) {
+    if (socket >= 0) close(socket);
+    std::string path;
+    if (unixSocketPath(address, path)) unlink(path.c_str());
+}
+
+// Function to send all bytes of a buffer, returns false if the connection failed
+bool sendAll(int socket, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        // A peer that went away must fail the send instead of raising SIGPIPE
+        ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= size_t(sent);
+    }
+    return true;
+}
+
+// Function to receive exactly size bytes, blocking until they arrived. Returns false if the connection
+// was closed or failed first.
+bool receiveAll(int socket, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        bytes += received;
+        size -= size_t(received);
+    }
+    return true;
+}
+
+// Function to receive the bytes that are available without blocking and append them to a buffer.
+// Returns false if the connection was closed or failed.
+bool receiveAvailable(int socket, std::vector<char>& buffer) {
+    char chunk[65536];
+    for (;;) {
+        ssize_t received = recv(socket, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + received);
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        return false;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Function to open a listening socket on an address: unix:<path> for a Unix domain socket, or <host>:<port>
+// (host may be empty for all interfaces) for TCP. Returns the socket, or -1 after printing the reason.
+int listenSocket(const std::string& address);
+
+// Function to accept a connection on a listening socket, returns -1 if none could be accepted
+int acceptSocket(int listener);
+
+// Function to connect to an address in the format of listenSocket, returns the socket or -1
+int connectSocket(const std::string& address);
+
+// Function to close a socket, and remove the file of a listening Unix domain socket
+void closeSocket(int socket, const std::string& address = std::string());
+
+// Function to send all bytes of a buffer, returns false if the connection failed
+bool sendAll(int socket, const void* data, size_t size);
+
+// Function to receive exactly size bytes, blocking until they arrived. Returns false if the connection
+// was closed or failed first.
+bool receiveAll(int socket, void* data, size_t size);
+
+// Function to receive the bytes that are available without blocking and append them to a buffer.
+// Returns false if the connection was closed or failed.
+bool receiveAvailable(int socket, std::vector<char>& buffer);
+
+#endif // SOCKET_H
@@ -0,0 +1,124 @@
+#include "TileScheduler.h"
+
+// Function to pack a tile range into one atomic word
+static uint64_t packRange(uint32_t front, uint32_t back) {
+    return (uint64_t(back) << 32) | front;
+}
+
+// Function to start the workers, 0 uses one thread per hardware thread
+TileScheduler::TileScheduler(int threadCount) : currentJob(nullptr), generation(0), busyWorkers(0), stopping(false) {
+    if (threadCount <= 0) threadCount = int(std::thread::hardware_concurrency());
+    workerCount = threadCount > 0 ? threadCount : 1;
+
+    queues.reset(new TileQueue[workerCount]);
+    for (int i = 0; i < workerCount; i++) queues[i].range.store(0);
+
+    // Worker 0 is the thread calling run()
+    for (int i = 1; i < workerCount; i++) {
+        threads.push_back(std::thread(&TileScheduler::workerLoop, this, i));
+    }
+}
+
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+// Function to take the next tile from the front of a worker's own block
+bool TileScheduler::popFront(int worker, int& tile) {
+    std::atomic<uint64_t>& range = queues[worker].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    while (true) {
+        uint32_t front = uint32_t(current);
+        uint32_t back = uint32_t(current >> 32);
+        if (front >= back) return false;
+        if (range.compare_exchange_weak(current, packRange(front + 1, back), std::memory_order_acq_rel)) {
+            tile = int(front);
+            return true;
+        }
+    }
+}
+
+// Function to take a tile from the back of another worker's block
+bool TileScheduler::stealBack(int victim, int& tile) {
+    std::atomic<uint64_t>& range = queues[victim].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    while (true) {
+        uint32_t front = uint32_t(current);
+        uint32_t back = uint32_t(current >> 32);
+        if (front >= back) return false;
+        if (range.compare_exchange_weak(current, packRange(front, back - 1), std::memory_order_acq_rel)) {
+            tile = int(back - 1);
+            return true;
+        }
+    }
+}
+
+// Function to work through the own block and then steal until all blocks are empty
+void TileScheduler::processTiles(int worker) {
+    const std::function<void(int, int)>& job = *currentJob;
+    int tile;
+    while (popFront(worker, tile)) job(tile, worker);
+
+    // Walk the other workers starting with the neighbour, so thieves spread over different victims
+    bool stolen = true;
+    while (stolen) {
+        stolen = false;
+        for (int i = 1; i < workerCount; i++) {
+            int victim = (worker + i) % workerCount;
+            while (stealBack(victim, tile)) {
+                job(tile, worker);
+                stolen = true;
+            }
+        }
+    }
+}
+
+// Function run by every pool thread: sleep until run() publishes work, then process it
+void TileScheduler::workerLoop(int worker) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        processTiles(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0) doneCondition.notify_one();
+    }
+}
+
+// Function to run job(tile, worker) for every tile in [0, tileCount), returns once all tiles are done.
+// The calling thread takes part as worker 0.
+void TileScheduler::run(int tileCount, const std::function<void(int tile, int worker)>& job) {
+    if (tileCount <= 0) return;
+
+    // Hand every worker an equal contiguous block of tiles
+    for (int i = 0; i < workerCount; i++) {
+        uint32_t front = uint32_t(int64_t(tileCount) * i / workerCount);
+        uint32_t back = uint32_t(int64_t(tileCount) * (i + 1) / workerCount);
+        queues[i].range.store(packRange(front, back), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = &job;
+        busyWorkers = workerCount - 1;
+        generation++;
+    }
+    startCondition.notify_all();
+
+    processTiles(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [&] { return busyWorkers == 0; });
+    currentJob = nullptr;
+}
@@ -0,0 +1,56 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent thread pool that runs a job over a set of tiles with work stealing. Every worker
+// starts with a contiguous block of tiles and takes from its front, idle workers steal from
+// the back of other blocks, so neighbouring tiles stay on one core while the load evens out.
+class TileScheduler {
+public:
+    // Function to start the workers, 0 uses one thread per hardware thread
+    explicit TileScheduler(int threadCount = 0);
+    ~TileScheduler();
+
+    // Function to run job(tile, worker) for every tile in [0, tileCount), returns once all tiles are done.
+    // The calling thread takes part as worker 0.
+    void run(int tileCount, const std::function<void(int tile, int worker)>& job);
+
+    // Function to get the number of workers including the calling thread
+    int threadCount() const { return workerCount; }
+
+private:
+    // Block of tiles owned by one worker, front in the low and back (exclusive) in the high 32 bits.
+    // Padded to a cache line so workers do not contend on each other's queues (C++11 new cannot
+    // over-align, so this is padding rather than alignas).
+    struct TileQueue {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    void workerLoop(int worker);
+    void processTiles(int worker);
+    bool popFront(int worker, int& tile);
+    bool stealBack(int victim, int& tile);
+
+    int workerCount;
+    std::unique_ptr<TileQueue[]> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(int, int)>* currentJob;
+    uint64_t generation;    // Incremented for every run() so sleeping workers notice new work
+    int busyWorkers;
+    bool stopping;
+};
+
+#endif // TILESCHEDULER_H
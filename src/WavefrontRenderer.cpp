@@ -0,0 +1,343 @@
+#include "WavefrontRenderer.h"
+#include "GpuRenderer.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Shader of every pass, in the order of WavefrontPass
+static const char* const WAVEFRONT_SHADERS[PASS_COUNT] = {
+    "wavefront_raygen.comp",
+    "wavefront_args.comp",
+    "wavefront_intersect.comp",
+    "wavefront_shade.comp",
+    "wavefront_shadow.comp",
+    "wavefront_finalize.comp"
+};
+
+// Sizes of the std430 structures in wavefront.glsl
+const size_t QUEUED_RAY_SIZE = 32;
+const size_t SURFACE_HIT_SIZE = 16;
+const size_t PATH_SIZE = 48;
+
+// Layout of the QueueState block in wavefront.glsl
+struct WavefrontQueueState {
+    GLuint intersectArgs[3];
+    GLuint shadeArgs[3];
+    GLuint shadowArgs[3];
+    GLuint inRayCount;
+    GLuint outRayCount;
+    GLuint shadowRayCount;
+};
+
+// Function to create a buffer that is only written and read by the GPU
+static GLuint createStorageBuffer(size_t size) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+// Function to get the part of a variant a pass depends on, so passes that ignore a setting are not
+// compiled again when it changes
+static ShaderVariant passVariant(int pass, const ShaderVariant& variant) {
+    if (pass == PASS_SHADE) return variant;
+    ShaderVariant general = {-1, -1, -1, {0, 0, false}, false, OUTPUT_RGBA32F, false, false, false};
+    if (pass == PASS_FINALIZE) {
+        general.shadows = variant.shadows;
+        general.numLights = variant.numLights;
+        general.output = variant.output;
+        general.denoise = variant.denoise;
+    }
+    // The passes that test rays against the spheres read them in the stored format
+    if (pass == PASS_INTERSECT || pass == PASS_SHADOW) general.quantized = variant.quantized;
+    return general;
+}
+
+// Function to load the general variant of the pass shaders and create the queues, check valid() afterwards
+WavefrontRenderer::WavefrontRenderer(int width, int height, int maxBounces)
+    : loaded(false), width(width), height(height), maxBounces(maxBounces), variantBounces(maxBounces),
+      variantShadows(true), texture(0), accumulationTexture(0),
+      shadowStageLocation(-1), bounceLocation(-1), stateBuffer(0), hitBuffer(0), shadowQueue(0),
+      shadowQueueCapacity(0), pathBuffer(0), rayCounterBuffer(0) {
+    std::fill(programs, programs + PASS_COUNT, 0);
+    denoiser = createDenoiser();
+    rayQueues[0] = rayQueues[1] = 0;
+
+    GLint maxBindings = 0;
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &maxBindings);
+    if (maxBindings <= SCENE_MAX_BINDING) {
+        std::cerr << "The wavefront backend needs " << SCENE_MAX_BINDING + 1 << " SSBO bindings, the driver has "
+                  << maxBindings << std::endl;
+        return;
+    }
+    for (int pass = 0; pass < PASS_COUNT; pass++) variants[pass].path = std::string(SHADER_DIR) + "/" + WAVEFRONT_SHADERS[pass];
+    // The general variant handles any scene, so it is kept as the fallback
+    sceneVariant = {maxBounces, -1, -1, {0, 0, false}, false, OUTPUT_RGBA32F, false, false, false};
+    if (!selectVariant(sceneVariant)) return;
+    loaded = true;
+
+    stateBuffer = createStorageBuffer(sizeof(WavefrontQueueState));
+    frameUniforms = createFrameUniformRing();
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    accumulationTexture = createTexture(width, height);
+    createQueues();
+    // Start small, the scene buffer grows to fit the first scene it is given
+    sceneBuffer = createSceneBuffer(1, 1, 1);
+}
+
+WavefrontRenderer::~WavefrontRenderer() {
+    for (int pass = 0; pass < PASS_COUNT; pass++) deleteShaderVariants(variants[pass]);
+    deleteDenoiser(denoiser);
+    if (!loaded) return;
+
+    deleteSceneBuffer(sceneBuffer);
+    deleteQueues();
+    glDeleteBuffers(1, &stateBuffer);
+    deleteFrameUniformRing(frameUniforms);
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &accumulationTexture);
+    if (rayCounterBuffer) glDeleteBuffers(1, &rayCounterBuffer);
+}
+
+// Function to allocate the per-pixel queues and path states
+void WavefrontRenderer::createQueues() {
+    size_t pixels = size_t(width) * height;
+    rayQueues[0] = createStorageBuffer(pixels * QUEUED_RAY_SIZE);
+    rayQueues[1] = createStorageBuffer(pixels * QUEUED_RAY_SIZE);
+    hitBuffer = createStorageBuffer(pixels * SURFACE_HIT_SIZE);
+    pathBuffer = createStorageBuffer(pixels * PATH_SIZE);
+    reserveShadowQueue(pixels);
+}
+
+// Function to delete the queues and path states
+void WavefrontRenderer::deleteQueues() {
+    glDeleteBuffers(2, rayQueues);
+    glDeleteBuffers(1, &hitBuffer);
+    glDeleteBuffers(1, &pathBuffer);
+    glDeleteBuffers(1, &shadowQueue);
+    shadowQueue = 0;
+    shadowQueueCapacity = 0;
+}
+
+// Function to grow the shadow ray queue to hold at least the given number of rays
+void WavefrontRenderer::reserveShadowQueue(size_t rays) {
+    rays = std::max<size_t>(rays, 1);
+    if (rays <= shadowQueueCapacity) return;
+    if (shadowQueue) glDeleteBuffers(1, &shadowQueue);
+    shadowQueue = createStorageBuffer(rays * QUEUED_RAY_SIZE);
+    shadowQueueCapacity = rays;
+}
+
+// Function to reallocate the textures and queues for a new size
+void WavefrontRenderer::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &accumulationTexture);
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    accumulationTexture = createTexture(width, height);
+    deleteQueues();
+    createQueues();
+    resetAccumulation();
+}
+
+// Function to switch the format of the output texture, the finalize pass writes it in that format
+void WavefrontRenderer::setOutputFormat(OutputFormat format) {
+    if (format == textureFormat) return;
+    OutputFormat previous = textureFormat;
+    textureFormat = format;
+    if (!selectVariant(sceneVariant)) {
+        textureFormat = previous;
+        return;
+    }
+    glDeleteTextures(1, &texture);
+    texture = createTexture(width, height, outputInternalFormat(textureFormat));
+    // The new texture is empty, so even a converged image has to be traced again
+    resetAccumulation();
+}
+
+// Function to get the bytes of the output and accumulation textures, the queues are not counted
+size_t WavefrontRenderer::imageBytes() const {
+    return size_t(width) * height * (outputFormatBytes(textureFormat) + 16) + denoiserImageBytes(denoiser);
+}
+
+// Function to run a queue pass over the live rays, with the group count the args pass wrote at argsOffset
+void WavefrontRenderer::dispatchPass(WavefrontPass pass, GLintptr argsOffset) {
+    glUseProgram(programs[pass]);
+    glDispatchComputeIndirect(argsOffset);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Function to compute the indirect dispatch arguments of the next bounce, or of the shadow rays
+void WavefrontRenderer::updateQueueArgs(bool shadowStage) {
+    glUseProgram(programs[PASS_ARGS]);
+    glUniform1i(shadowStageLocation, shadowStage ? 1 : 0);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Function to switch the passes to the programs of a variant, compiling the ones not used before.
+// Keeps the current programs and returns false if a pass does not compile.
+bool WavefrontRenderer::selectVariant(const ShaderVariant& variant) {
+    ShaderVariant formatted = variant;
+    formatted.output = textureFormat;
+    formatted.quantized = quantizedScene;
+    formatted.denoise = denoising;
+    std::string defines[PASS_COUNT];
+    GLuint selected[PASS_COUNT];
+    bool changed = false;
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        defines[pass] = shaderVariantDefines(passVariant(pass, formatted));
+        changed |= defines[pass] != variantDefines[pass] || !programs[pass];
+        selected[pass] = getShaderVariant(variants[pass], defines[pass]);
+        if (!selected[pass]) return false;
+    }
+    variantBounces = variant.maxBounces >= 0 ? std::min(variant.maxBounces, maxBounces) : maxBounces;
+    variantShadows = variant.shadows != 0;
+    if (!changed) return true;
+
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        variantDefines[pass] = defines[pass];
+        programs[pass] = selected[pass];
+    }
+    setupPassPrograms();
+    return true;
+}
+
+// Function to read the local sizes and uniform locations of the current pass programs after they changed
+void WavefrontRenderer::setupPassPrograms() {
+    for (int pass = 0; pass < PASS_COUNT; pass++) glGetProgramiv(programs[pass], GL_COMPUTE_WORK_GROUP_SIZE, groupSizes[pass]);
+
+    // The indirect dispatches are sized by the args pass, so it needs the local sizes of the queue passes
+    glUseProgram(programs[PASS_ARGS]);
+    glUniform1ui(glGetUniformLocation(programs[PASS_ARGS], "intersectGroupSize"), groupSizes[PASS_INTERSECT][0]);
+    glUniform1ui(glGetUniformLocation(programs[PASS_ARGS], "shadeGroupSize"), groupSizes[PASS_SHADE][0]);
+    glUniform1ui(glGetUniformLocation(programs[PASS_ARGS], "shadowGroupSize"), groupSizes[PASS_SHADOW][0]);
+    shadowStageLocation = glGetUniformLocation(programs[PASS_ARGS], "shadowStage");
+    bounceLocation = glGetUniformLocation(programs[PASS_SHADE], "bounce");
+}
+
+// Function to list the variants of the pass shaders and of the denoiser compiled so far
+void WavefrontRenderer::listShaderVariants(std::vector<ShaderVariantProgram>& list) const {
+    for (int pass = 0; pass < PASS_COUNT; pass++) ::listShaderVariants(variants[pass], list);
+    ::listShaderVariants(denoiser.variants, list);
+}
+
+// Function to switch to programs rebuilt for the listed variants, deleting the ones they replace
+void WavefrontRenderer::replaceShaderVariants(const std::vector<ShaderVariantProgram>& rebuilt) {
+    for (const ShaderVariantProgram& variant : rebuilt) {
+        bool replaced = false;
+        for (int pass = 0; pass < PASS_COUNT && !replaced; pass++) replaced = replaceShaderVariant(variants[pass], variant, programs[pass]);
+        GLuint denoiseProgram = 0;
+        if (!replaced && !replaceShaderVariant(denoiser.variants, variant, denoiseProgram)) glDeleteProgram(variant.program);
+    }
+    // A rebuilt pass may have a new local size
+    setupPassPrograms();
+    resetAccumulation();
+}
+
+// Function to upload the changed parts of the scene and trace the next sample through the wavefront passes
+void WavefrontRenderer::render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) {
+    {
+        ScopedTimer timer(profiler, "upload", true);
+        setSceneBufferQuantization(sceneBuffer, quantizedScene);
+        updateSceneBuffer(sceneBuffer, scene, sphereBVH, changes);
+        countProfilerBytes(profiler, "upload", double(sceneBuffer.bytesUploaded));
+    }
+    if (sceneBuffer.changed) sceneVariant = sceneShaderVariant(scene, maxBounces);
+    // Also picks up a change of denoising since the last frame, which adds the feature images to the finalize pass
+    selectVariant(sceneVariant);
+    setProfilerMemory(profiler, double(imageBytes()));
+
+    // A converged image stays in the output texture, so a static view costs no GPU time
+    int sampleIndex = beginSample(camera, sceneBuffer.changed);
+    if (sampleIndex >= 0) {
+        // Every camera ray that hits a surface casts one shadow ray per light, up to the shadow ray budget
+        reserveShadowQueue(size_t(width) * height * std::min<size_t>(scene.lights.size(), size_t(shadowRays)));
+
+        // All passes read the same FrameData block, so the frame uniforms are uploaded once
+        FrameUniforms uniforms = {};
+        setComputeShaderUniforms(uniforms, width, height, camera.position, camera.direction, camera.focalLength);
+        setSceneBufferUniforms(uniforms, sceneBuffer);
+        setSampleUniforms(uniforms, sampleIndex, sampleJitter(sampleIndex));
+        setRayCountingUniform(uniforms, countRays);
+        setShadowRayUniform(uniforms, shadowRays);
+        ImageRegion traced = imageRegion(width, height);
+        setImageRegionUniforms(uniforms, traced.x, traced.y, traced.imageWidth, traced.imageHeight);
+        uploadFrameUniforms(frameUniforms, uniforms);
+
+        // Ray generation fills the output queue with one camera ray per pixel
+        WavefrontQueueState state = {};
+        state.outRayCount = GLuint(width * height);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stateBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(state), &state);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stateBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, hitBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, shadowQueue);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, pathBuffer);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, stateBuffer);
+        if (countRays) beginGpuRayCount(rayCounterBuffer);
+
+        {
+            ScopedTimer timer(profiler, "raygen", true);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, rayQueues[0]);
+            glUseProgram(programs[PASS_RAYGEN]);
+            glDispatchCompute((width + groupSizes[PASS_RAYGEN][0] - 1) / groupSizes[PASS_RAYGEN][0],
+                              (height + groupSizes[PASS_RAYGEN][1] - 1) / groupSizes[PASS_RAYGEN][1], 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        // The reflected rays of every bounce go into the other queue, so only live rays are traced
+        for (int bounce = 0; bounce <= variantBounces; bounce++) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, rayQueues[bounce % 2]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, rayQueues[(bounce + 1) % 2]);
+            {
+                ScopedTimer timer(profiler, "intersect", true);
+                updateQueueArgs(false);
+                dispatchPass(PASS_INTERSECT, offsetof(WavefrontQueueState, intersectArgs));
+            }
+            {
+                ScopedTimer timer(profiler, "shade", true);
+                glUseProgram(programs[PASS_SHADE]);
+                glUniform1i(bounceLocation, bounce);
+                dispatchPass(PASS_SHADE, offsetof(WavefrontQueueState, shadeArgs));
+            }
+        }
+
+        if (variantShadows) {
+            ScopedTimer timer(profiler, "shadow", true);
+            updateQueueArgs(true);
+            dispatchPass(PASS_SHADOW, offsetof(WavefrontQueueState, shadowArgs));
+        }
+
+        {
+            ScopedTimer timer(profiler, "finalize", true);
+            glUseProgram(programs[PASS_FINALIZE]);
+            glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, outputInternalFormat(textureFormat));
+            glBindImageTexture(1, accumulationTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+            if (denoising) bindDenoiserFeatures(denoiser, width, height);
+            glDispatchCompute((width + groupSizes[PASS_FINALIZE][0] - 1) / groupSizes[PASS_FINALIZE][0],
+                              (height + groupSizes[PASS_FINALIZE][1] - 1) / groupSizes[PASS_FINALIZE][1], 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            countProfilerBytes(profiler, "finalize", sampleImageTraffic(width, height, textureFormat, sampleIndex));
+        }
+        if (denoising) {
+            ScopedTimer timer(profiler, "denoise", true);
+            runDenoiser(denoiser, accumulationTexture, texture, textureFormat);
+            countProfilerBytes(profiler, "denoise", denoiserImageTraffic(width, height, textureFormat));
+        }
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        fenceFrameUniforms(frameUniforms);
+
+        if (countRays) lastRayCounts = endGpuRayCount(rayCounterBuffer);
+    } else {
+        lastRayCounts = {0, 0, 0};
+    }
+    fenceSceneBuffer(sceneBuffer);
+}
@@ -0,0 +1,81 @@
+#ifndef WAVEFRONTRENDERER_H
+#define WAVEFRONTRENDERER_H
+
+#include "Denoiser.h"
+#include "Renderer.h"
+#include "SceneBuffer.h"
+#include "Shader.h"
+
+#include <string>
+#include <vector>
+
+// Compute passes of the wavefront pipeline, each with its own shader and workgroup size
+enum WavefrontPass {
+    PASS_RAYGEN,        // Start a path per pixel and queue its camera ray
+    PASS_ARGS,          // Turn the queue counters into indirect dispatch arguments
+    PASS_INTERSECT,     // Closest hit of every queued ray
+    PASS_SHADE,         // Gather surface colors, queue shadow and reflected rays
+    PASS_SHADOW,        // Any hit of every queued shadow ray
+    PASS_FINALIZE,      // Light the first surface and accumulate the sample
+    PASS_COUNT
+};
+
+// Renderer that splits tracing into wavefront passes connected by SSBO ray queues. Each bounce
+// only launches the rays that are still alive, so reflections can go several bounces deep.
+class WavefrontRenderer : public Renderer {
+public:
+    // Function to load the pass shaders and create the queues, check valid() afterwards.
+    // maxBounces is the number of reflections followed per path.
+    WavefrontRenderer(int width, int height, int maxBounces);
+    ~WavefrontRenderer();
+
+    // Function to check whether all pass shaders could be loaded
+    bool valid() const { return loaded; }
+
+    const char* name() const override { return "wavefront"; }
+    void resize(int width, int height) override;
+    void render(const Scene& scene, const BVH& sphereBVH, const Camera& camera, const SceneChanges* changes) override;
+    GLuint outputTexture() override { return texture; }
+    void setOutputFormat(OutputFormat format) override;
+    size_t imageBytes() const override;
+    size_t sceneBytesUploaded() const override { return sceneBuffer.bytesUploaded; }
+    void listShaderVariants(std::vector<ShaderVariantProgram>& variants) const override;
+    void replaceShaderVariants(const std::vector<ShaderVariantProgram>& rebuilt) override;
+
+private:
+    void createQueues();
+    void deleteQueues();
+    void reserveShadowQueue(size_t rays);
+    void dispatchPass(WavefrontPass pass, GLintptr argsOffset);
+    void updateQueueArgs(bool shadowStage);
+    bool selectVariant(const ShaderVariant& variant);
+    void setupPassPrograms();
+
+    bool loaded;
+    int width;
+    int height;
+    int maxBounces;
+    ShaderVariantCache variants[PASS_COUNT];    // Variants of every pass shader compiled for the scenes so far
+    ShaderVariant sceneVariant;                 // Variant the current scene needs, without the output format
+    std::string variantDefines[PASS_COUNT];     // Defines of the current variant of every pass
+    int variantBounces;                 // Bounces traced by the current variant, 0 if the scene does not reflect
+    bool variantShadows;                // Whether the current variant traces shadow rays
+    GLuint programs[PASS_COUNT];        // Programs of the current variant
+    GLint groupSizes[PASS_COUNT][3];    // Local size of each pass
+    GLuint texture;
+    GLuint accumulationTexture;         // Running mean of the samples since the last reset
+    GLint shadowStageLocation;          // Uniforms changed between the dispatches of a frame
+    GLint bounceLocation;
+    FrameUniformRing frameUniforms;     // FrameData blocks shared by all passes, one per frame in flight
+    SceneBuffer sceneBuffer;
+    GLuint stateBuffer;                 // Queue counters and indirect dispatch arguments
+    GLuint rayQueues[2];                // Swapped between the input and output of every bounce
+    GLuint hitBuffer;
+    GLuint shadowQueue;
+    size_t shadowQueueCapacity;         // Shadow rays that fit into shadowQueue
+    GLuint pathBuffer;
+    GLuint rayCounterBuffer;            // Created when ray counting is first enabled
+    Denoiser denoiser;                  // Images created when denoising is first enabled
+};
+
+#endif // WAVEFRONTRENDERER_H
@@ -0,0 +1,129 @@
+#include "Workgroups.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+// File in the shader cache directory with one "<layout>\t<device>" line per tuned device
+const char* const WORKGROUP_FILE = "workgroups.txt";
+
+// Layouts a tuning run tries: square and wide 2-D tiles, and Morton ordered 1-D tiles
+static const WorkgroupLayout WORKGROUP_CANDIDATES[] = {
+    {8, 8, false},
+    {16, 8, false},
+    {16, 16, false},
+    {32, 4, false},
+    {32, 8, false},
+    {64, 4, false},
+    {64, 1, true},
+    {256, 1, true},
+};
+
+// Function to check whether the current context can run a workgroup layout
+bool supportedWorkgroupLayout(const WorkgroupLayout& layout) {
+    if (layout.sizeX <= 0 || layout.sizeY <= 0) return false;
+    // Morton tiles are only defined for 1-D workgroups of a power of two
+    if (layout.morton && (layout.sizeY != 1 || (layout.sizeX & (layout.sizeX - 1)) != 0)) return false;
+
+    GLint maxInvocations = 0;
+    GLint maxSizeX = 0;
+    GLint maxSizeY = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxSizeX);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &maxSizeY);
+    return layout.sizeX <= maxSizeX && layout.sizeY <= maxSizeY && layout.sizeX * layout.sizeY <= maxInvocations;
+}
+
+// Function to list the workgroup layouts worth benchmarking that the current context supports
+std::vector<WorkgroupLayout> workgroupCandidates() {
+    std::vector<WorkgroupLayout> candidates;
+    for (const WorkgroupLayout& layout : WORKGROUP_CANDIDATES) {
+        if (supportedWorkgroupLayout(layout)) candidates.push_back(layout);
+    }
+    return candidates;
+}
+
+// Function to format a workgroup layout as 16x16 or morton-64
+std::string formatWorkgroupLayout(const WorkgroupLayout& layout) {
+    if (layout.morton) return "morton-" + std::to_string(layout.sizeX);
+    return std::to_string(layout.sizeX) + "x" + std::to_string(layout.sizeY);
+}
+
+// Function to parse a workgroup layout written by formatWorkgroupLayout, returns false for invalid text
+bool parseWorkgroupLayout(const std::string& text, WorkgroupLayout& layout) {
+    int sizeX = 0;
+    int sizeY = 0;
+    char end = 0;
+    if (std::sscanf(text.c_str(), "morton-%d%c", &sizeX, &end) == 1) {
+        layout = {sizeX, 1, true};
+    } else if (std::sscanf(text.c_str(), "%dx%d%c", &sizeX, &sizeY, &end) == 2) {
+        layout = {sizeX, sizeY, false};
+    } else {
+        return false;
+    }
+    return layout.sizeX > 0 && layout.sizeY > 0;
+}
+
+// Function to get the workgroup layout for the device of the current context
+WorkgroupLayout loadWorkgroupLayout() {
+    WorkgroupLayout layout;
+    const char* override = std::getenv("RAYTRACER_WORKGROUPS");
+    if (override && *override) {
+        if (parseWorkgroupLayout(override, layout) && supportedWorkgroupLayout(layout)) return layout;
+        std::cerr << "Ignoring RAYTRACER_WORKGROUPS=" << override << ", expected a supported layout such as 16x16 or morton-64" << std::endl;
+        return DEFAULT_WORKGROUP_LAYOUT;
+    }
+
+    std::string directory = shaderCacheDirectory();
+    if (directory.empty()) return DEFAULT_WORKGROUP_LAYOUT;
+    std::ifstream file(directory + "/" + WORKGROUP_FILE);
+    std::string device = glDeviceString();
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || line.compare(tab + 1, std::string::npos, device) != 0) continue;
+        // A layout the driver no longer supports counts as not tuned
+        if (parseWorkgroupLayout(line.substr(0, tab), layout) && supportedWorkgroupLayout(layout)) return layout;
+    }
+    return DEFAULT_WORKGROUP_LAYOUT;
+}
+
+// Function to store the tuned workgroup layout of the device of the current context
+bool saveWorkgroupLayout(const WorkgroupLayout& layout) {
+    std::string directory = shaderCacheDirectory();
+    if (directory.empty()) {
+        std::cerr << "The shader cache is disabled, so the workgroup layout can not be stored" << std::endl;
+        return false;
+    }
+    std::string path = directory + "/" + WORKGROUP_FILE;
+    std::string device = glDeviceString();
+
+    // Keep the layouts of the other devices
+    std::vector<std::string> lines;
+    std::ifstream existing(path);
+    std::string line;
+    while (std::getline(existing, line)) {
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos && line.compare(tab + 1, std::string::npos, device) != 0) lines.push_back(line);
+    }
+    existing.close();
+    lines.push_back(formatWorkgroupLayout(layout) + "\t" + device);
+
+    if (!createDirectories(directory)) {
+        std::cerr << "Failed to create " << directory << std::endl;
+        return false;
+    }
+    // Renamed into place, so a concurrent reader never sees a partial file
+    std::string temporaryPath = path + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporaryPath);
+    for (size_t i = 0; i < lines.size(); i++) file << lines[i] << "\n";
+    file.close();
+    if (!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
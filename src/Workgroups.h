@@ -0,0 +1,29 @@
+#ifndef WORKGROUPS_H
+#define WORKGROUPS_H
+
+#include "Shader.h"
+
+#include <string>
+#include <vector>
+
+// Function to list the workgroup layouts worth benchmarking that the current context supports
+std::vector<WorkgroupLayout> workgroupCandidates();
+
+// Function to check whether the current context can run a workgroup layout
+bool supportedWorkgroupLayout(const WorkgroupLayout& layout);
+
+// Function to format a workgroup layout as 16x16 or morton-64
+std::string formatWorkgroupLayout(const WorkgroupLayout& layout);
+
+// Function to parse a workgroup layout written by formatWorkgroupLayout, returns false for invalid text
+bool parseWorkgroupLayout(const std::string& text, WorkgroupLayout& layout);
+
+// Function to get the workgroup layout for the device of the current context: RAYTRACER_WORKGROUPS if set,
+// else the layout a tuning run stored for the device, else DEFAULT_WORKGROUP_LAYOUT
+WorkgroupLayout loadWorkgroupLayout();
+
+// Function to store the tuned workgroup layout of the device of the current context in the shader cache
+// directory, replacing an earlier one. Returns false if the cache is disabled or the file can not be written.
+bool saveWorkgroupLayout(const WorkgroupLayout& layout);
+
+#endif // WORKGROUPS_H
@@ -1,15 +1,34 @@
+#include "Animation.h"
+#include "BVH.h"
+#include "Distributed.h"
+#include "FramePipeline.h"
 #include "GLUtils.h"
+#include "Headless.h"
+#include "Options.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "Resolution.h"
+#include "SceneFile.h"
+#include "Scenes.h"
 #include "Shader.h"
+#include "ShaderReload.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 
 int screenWidth = 800;
 int screenHeight = 600;
-// Texture to store the result of the ray tracing
-GLuint texture;
+// Backend tracing the frames into its output texture, only used by the render thread while it runs
+std::unique_ptr<Renderer> renderer;
+// Dynamic resolution, the renderer traces at a fraction of the window size while it is over the frame budget.
+// Owned by the render thread.
+ResolutionController resolution = createResolutionController(0.0);
 // Set up camera
 glm::vec3 cameraPos(0.0f, 0.0f, 0.0f);
 glm::vec3 cameraDir(0.0f, 0.0f, -1.0f);
@@ -22,44 +41,20 @@ float mouseSensitivity = 0.1f;
 // Keep track of the last mouse position
 float lastX = screenWidth/2.0f, lastY = screenHeight/2.0f;
 bool firstMouse = true;
+// Samples per pixel a static view converges to unless --samples is given
+const int DEFAULT_WINDOW_SAMPLES = 256;
 
-GLuint defineAndBindGeometry(glm::vec3 cameraPos, glm::vec3 cameraDir) {
-    float time = glfwGetTime();
-    
-    // Define geometry
-    std::vector<Sphere> spheres = {
-        {{0.3f, 0.4f * sin(time), -0.5f}, 0.2f, {1.0f, 1.0f, 1.0f}, 0.0f},
-        {{-0.3f, -0.15, 0.35f}, 0.15f, {0.0f, 1.0f, 0.0f}, 0.0f},
-        {{0.2*sin(3*time), -0.55, -0.2f}, 0.3f, {0.0f, 0.0f, 1.0f}, 0.0f}
-    };
-    
-    // Box around Camera
-    float boxSize = 1.0f;
-    std::vector<Plane> planes = {
-        {{0.0f, 0.0f, -boxSize}, {0.0f, 0.0f, -1.0f}, {1.0f, 1.0f, 0.0f}, 0.0f},  // Front plane
-        {{0.0f, 0.0f, boxSize}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 1.0f}, 0.0f},  // Back plane
-        {{-boxSize, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, 0.0f},  // Left Plane
-        {{boxSize, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.5f, 0.5f, 1.0f}, 0.0f},  // Right Plane
-        {{0.0f, -boxSize, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.5f, 0.5f}, 0.0f},  // Bottom Plane
-        {{0.0f, boxSize, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.0f, 0.5f}, 0.0f}   // Top Plane
-    };
-
-    std::vector<Light> lights = {
-        {{-0.4f, 0.6f, -0.3f}, {1.0f, 1.0f, 1.0f}}
-    };
-
-    // Create and bind SSBO for geometry data
-    GLuint ssbo = createSSBO(spheres, planes, lights);
-    return ssbo;
+// Function to resize the renderer to a window size at the current resolution scale
+void resizeRenderer(int windowWidth, int windowHeight) {
+    int width, height;
+    resolutionFor(resolution, windowWidth, windowHeight, width, height);
+    renderer->resize(width, height);
 }
 
-// Window Resizing with GLFW and generating suitable texture
+// Window Resizing with GLFW, the render thread resizes the viewport and texture with the next frame
 void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
     screenWidth = width;
     screenHeight = height;
-    glDeleteTextures(1, &texture);
-    texture = createTexture(screenWidth, screenHeight);
 }
 
 void toggleFullScreenWithF11(GLFWwindow* window) {
@@ -71,8 +66,6 @@ void toggleFullScreenWithF11(GLFWwindow* window) {
             glfwSetWindowMonitor(window, glfwGetPrimaryMonitor(), 0, 0, mode->width, mode->height, mode->refreshRate);
             screenWidth = mode->width;
             screenHeight = mode->height;
-            glDeleteTextures(1, &texture);
-            texture = createTexture(screenWidth, screenHeight);
         } else {
             //TODO: Restore windowed mode
         }
@@ -112,18 +105,169 @@ void cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
     lastY = screenHeight/2.0;
 }
 
-int main() {
+// Function run by the render thread, which owns the GL context: draws the snapshots of the simulation thread
+// until the queue is closed. Up to options.framesInFlight frames are queued on the GPU while the simulation
+// thread prepares the next ones. With a shader reloader, rebuilt shaders are swapped in between frames.
+// The render thread owns the scene it draws and its sphere BVH, and moves the objects the snapshots update.
+void renderLoop(GLFWwindow* window, const RenderOptions& options, FrameQueue& queue, Profiler& profiler, GLuint quadShaderProgram,
+                VertexObjects quadVO, ShaderReloader* shaderReloader, Scene& scene, std::vector<AABB>& sphereBounds, BVH& sphereBVH) {
+    glfwMakeContextCurrent(window);
+    // Upscaling is switched on while the trace resolution is below the window size
+    GLint upscaleLocation = glGetUniformLocation(quadShaderProgram, "upscale");
+    // Framebuffer the output texture is blitted from with --present blit
+    BlitPresenter blitPresenter = createBlitPresenter();
+    FrameFences frameFences = createFrameFences(options.framesInFlight);
+
+    int windowWidth = options.width;
+    int windowHeight = options.height;
+    bool variableRate = options.variableRate;
+    double lastReportTime = glfwGetTime();
+    double lastFrameTime = glfwGetTime();
+    FrameSnapshot snapshot;
+    const SceneChanges unchanged;
+    // View of the last frame, a static view is refined at the full resolution
+    Camera lastCamera = {glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+    while (queue.pop(snapshot)) {
+        // Only waits if the GPU is options.framesInFlight frames behind
+        waitForFrameSlot(frameFences, snapshot.frame);
+        beginProfilerFrame(profiler);
+        addProfilerTime(&profiler, "animate", snapshot.simulateMs);
+
+        if (snapshot.windowWidth != windowWidth || snapshot.windowHeight != windowHeight) {
+            windowWidth = snapshot.windowWidth;
+            windowHeight = snapshot.windowHeight;
+            glViewport(0, 0, windowWidth, windowHeight);
+            resizeRenderer(windowWidth, windowHeight);
+        }
+        if (snapshot.variableRate != variableRate) {
+            variableRate = snapshot.variableRate;
+            renderer->setVariableRate(variableRate);
+        }
+        // The frames from here on use the rebuilt shaders, the console line compares their times with the old ones
+        if (shaderReloader && shaderReloader->update(*renderer)) markProfilerComparison(profiler, "Reload");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Report the frame times once per second
+        if(glfwGetTime() - lastReportTime >= 1.0) {
+            lastReportTime = glfwGetTime();
+            std::cout << formatProfilerSummary(profiler) << " | Samples: " << renderer->sampleCount();
+            if (options.targetFrameMs > 0.0) std::cout << " | Resolution: " << int(resolution.scale * 100.0f + 0.5f) << "%";
+            std::cout << std::endl;
+        }
+
+        // Only the moved spheres get new bounds and refit their BVH nodes, and only the moved objects are uploaded
+        if (snapshot.update) {
+            ScopedTimer timer(&profiler, "refit");
+            applySceneUpdate(scene, *snapshot.update);
+            updateSphereBounds(scene.spheres, snapshot.update->changes.spheres, sphereBounds);
+            updateBVH(sphereBVH, sphereBounds, snapshot.update->changes.spheres);
+        }
+        // Trace the next sample, the image restarts whenever the camera or the scene changed
+        renderer->render(scene, sphereBVH, snapshot.camera, snapshot.update ? &snapshot.update->changes : &unchanged);
+        // Render the full-screen quad with the texture (implement renderQuadWithTexture yourself)
+        GLuint outputTexture = renderer->outputTexture();
+        {
+            ScopedTimer timer(&profiler, "present", true);
+            int traceWidth, traceHeight;
+            resolutionFor(resolution, windowWidth, windowHeight, traceWidth, traceHeight);
+            if (options.blitPresent) blitTextureToScreen(blitPresenter, outputTexture, traceWidth, traceHeight, windowWidth, windowHeight);
+            else renderQuadWithTexture(outputTexture, quadShaderProgram, quadVO);
+            // Both paths read the output texture once and write every pixel of the RGBA8 back buffer
+            countProfilerBytes(&profiler, "present", double(traceWidth) * traceHeight * outputFormatBytes(renderer->outputFormat())
+                                                     + double(windowWidth) * windowHeight * 4);
+        }
+        endProfilerFrame(profiler);
+
+        glfwSwapBuffers(window);
+        fenceFrame(frameFences, snapshot.frame);
+
+        // Scale the trace resolution to the frame budget
+        double frameTime = glfwGetTime();
+        const Camera& camera = snapshot.camera;
+        bool staticView = !snapshot.update && camera.position == lastCamera.position &&
+                          camera.direction == lastCamera.direction && camera.focalLength == lastCamera.focalLength;
+        lastCamera = camera;
+        if (updateResolutionController(resolution, (frameTime - lastFrameTime) * 1000.0, staticView)) {
+            resizeRenderer(windowWidth, windowHeight);
+            glUseProgram(quadShaderProgram);
+            glUniform1i(upscaleLocation, resolution.scale < 1.0f);
+        }
+        lastFrameTime = frameTime;
+    }
+
+    // Write the timings of the session
+    finishProfiler(profiler);
+    if (!options.profile.empty()) writeProfile(profiler, options.profile);
+    if (!options.trace.empty()) writeChromeTrace(profiler, options.trace);
+
+    deleteFrameFences(frameFences);
+    deleteBlitPresenter(blitPresenter);
+    // Hand the context back to the main thread for the cleanup
+    glfwMakeContextCurrent(nullptr);
+}
+
+int main(int argc, char** argv) {
+    RenderOptions options = defaultRenderOptions();
+    if (!parseRenderOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!options.coordinator.empty()) return runCoordinator(options);
+    if (!options.worker.empty()) return runWorker(options);
+    if (options.headless) return runHeadless(options);
+
+    // Start from the resolution and camera given on the command line
+    screenWidth = options.width;
+    screenHeight = options.height;
+    lastX = screenWidth / 2.0f;
+    lastY = screenHeight / 2.0f;
+    cameraPos = options.cameraPos;
+    cameraDir = options.cameraDir;
+    focalLength = options.focalLength;
+    yaw = glm::degrees(atan2(cameraDir.z, cameraDir.x));
+    pitch = glm::degrees(asin(cameraDir.y));
+
+    // Define geometry, the demo scene and scene files with tracks are animated
+    Scene scene;
+    BVH sphereBVH;
+    if (options.scene.empty()) scene = createDemoScene();
+    else if (!loadScene(options.scene, scene, sphereBVH)) return -1;
+    bool animated = !scene.tracks.empty();
+    SceneChanges changes;
+    animateScene(scene, options.startTime, changes);
+    // Build the sphere BVH once unless the scene file has one, afterwards it is only refitted to the animated spheres
+    std::vector<AABB> sphereBounds;
+    computeSphereBounds(scene.spheres, sphereBounds);
+    if (sphereBVH.nodes.empty()) sphereBVH = buildBVH(sphereBounds);
+    // The BVH of a scene file fits the positions in the file, refit it to the spheres moved to the start time
+    else updateBVH(sphereBVH, sphereBounds, changes.spheres);
+
     // Initialize OpenGL, create window, and initialize GLEW
     GLFWwindow* window = initializeOpenGL(screenWidth, screenHeight, "Ray Tracing");
     if(!window) return -1;
 
-    // Define and Bind geometry
-    GLuint ssbo = defineAndBindGeometry(cameraPos, cameraDir);
+    // Pick the GPU, wavefront or CPU backend
+    renderer = createRenderer(options.backend, screenWidth, screenHeight, options.threads, options.bounces);
+    if (!renderer) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "Rendering with the " << renderer->name() << " backend" << std::endl;
+    applyRenderOptions(*renderer, options, options.samples > 0 ? options.samples : DEFAULT_WINDOW_SAMPLES);
+    resolution = createResolutionController(options.targetFrameMs);
+    // Time every frame, keeping the records only if they are exported at exit
+    Profiler profiler = createProfiler(true, !options.profile.empty() || !options.trace.empty());
+    renderer->setProfiler(&profiler);
 
     // Load, compile and link quad shader
     std::string quadVertexShaderSource = loadShaderSource(std::string(SHADER_DIR) + "/quad.vert");
     std::string quadFragmentShaderSource = loadShaderSource(std::string(SHADER_DIR) + "/quad.frag");
     GLuint quadShaderProgram = createShaderProgram(quadVertexShaderSource, quadFragmentShaderSource);
+    // The quad samples texture unit 0, set once instead of every frame
+    glUseProgram(quadShaderProgram);
+    glUniform1i(glGetUniformLocation(quadShaderProgram, "screenTexture"), 0);
+    glUniform1i(glGetUniformLocation(quadShaderProgram, "upscale"), GL_FALSE);
     // Screen-Filling quad vertices and texture coordinates
     float quadVertices[] = {
         // Positions    // Texture Coords
@@ -135,11 +279,6 @@ int main() {
     // Create and set up the Vertex Objects using the utility function
     VertexObjects quadVO = createVertexObjectsForQuad(quadVertices, sizeof(quadVertices));
 
-    // Load compute shader
-    GLuint computeProgram = loadComputeShader(std::string(SHADER_DIR) + "/raytracing.comp");
-    // Create texture to store the result
-    texture = createTexture(screenWidth, screenHeight);
-
     // Set up the framebuffer size callback
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
     // Update camera direction
@@ -147,23 +286,40 @@ int main() {
     // Hide the cursor
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 
-    double realFPS = 0.0;
-    double oldFPS = 0.0;
-    //Rendering loop
-    while (!glfwWindowShouldClose(window)) {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // The render thread gets its own copy of the scene, which the simulation thread animates from here on. A static
+    // scene is moved there once, the snapshots of an animated one only carry the objects that moved.
+    Scene renderScene = animated ? scene : std::move(scene);
+
+    // Shaders are rebuilt on a hidden context that shares its programs with the window
+    GLFWwindow* reloadContext = options.watchShaders ? createSharedContext(window) : nullptr;
+    std::unique_ptr<ShaderReloader> shaderReloader;
+    if (reloadContext) shaderReloader.reset(new ShaderReloader(SHADER_DIR, reloadContext));
+
+    // The main thread handles input and simulates the scene, the render thread owns the GL context from here on
+    glfwMakeContextCurrent(nullptr);
+    FrameQueue queue(options.framesInFlight);
+    std::thread renderThread(renderLoop, window, std::cref(options), std::ref(queue), std::ref(profiler), quadShaderProgram, quadVO,
+                             shaderReloader.get(), std::ref(renderScene), std::ref(sphereBounds), std::ref(sphereBVH));
+
+    // Animation clock, stops while paused so the image can converge. It follows the wall clock, or advances
+    // by the frame time of --fps every frame with --fixed-timestep.
+    double animationTime = options.startTime;
+    double snapshotTime = options.startTime;
+    double lastTime = glfwGetTime();
+    bool animationPaused = false;
+    bool pauseKeyDown = false;
+    bool variableRate = options.variableRate;
+    bool variableRateKeyDown = false;
+    //Simulation loop, blocks while the render thread is options.framesInFlight frames behind
+    for (long frame = 0; !glfwWindowShouldClose(window); frame++) {
+        glfwPollEvents();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
         // Close window on ESC press
         if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
         // Fullscreen on F11 press
         toggleFullScreenWithF11(window);
 
-        // Calculate FPS
-        double calculatedFPS = calculateFPS();
-        if(calculatedFPS != -1.0) realFPS = calculatedFPS;
-        if(oldFPS != realFPS) std::cout << "FPS: " << realFPS << std::endl;
-        oldFPS = realFPS;
-        
         // Update camera position
         if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) cameraPos += 0.01f * cameraDir ;
         if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) cameraPos -= 0.01f * cameraDir;
@@ -176,27 +332,50 @@ int main() {
         cameraPos.y = glm::clamp(cameraPos.y, -0.999f, 0.999f);
         cameraPos.z = glm::clamp(cameraPos.z, -0.999f, 0.999f);
 
-        // Update SSBO
-        glDeleteBuffers(1, &ssbo);
-        ssbo = defineAndBindGeometry(cameraPos, cameraDir);
+        // Pause or resume the animation on P press
+        bool pauseKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        if(pauseKey && !pauseKeyDown) animationPaused = !animationPaused;
+        pauseKeyDown = pauseKey;
+        double currentTime = glfwGetTime();
+        if(!animationPaused) animationTime += options.fixedTimestep ? options.frameTime : currentTime - lastTime;
+        lastTime = currentTime;
+        // Toggle the variable rate tracing of the periphery on V press
+        bool variableRateKey = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+        if(variableRateKey && !variableRateKeyDown) variableRate = !variableRate;
+        variableRateKeyDown = variableRateKey;
+
+        // Copy the objects that moved into the snapshot, the render thread applies them in the order of the frames
+        std::shared_ptr<SceneUpdate> update;
+        if (animated && animationTime != snapshotTime) {
+            update = std::make_shared<SceneUpdate>();
+            animateScene(scene, animationTime, update->changes);
+            snapshotTime = animationTime;
+            if (update->changes.empty()) update.reset();
+            else gatherSceneUpdate(scene, *update);
+        }
         // Update Focal Length
         if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) focalLength += 0.01f;
         if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) focalLength -= 0.01f;
 
-        // Set compute shader uniforms
-        setComputeShaderUniforms(computeProgram, screenWidth, screenHeight, cameraPos, cameraDir, focalLength);
-        // Dispatch the compute shader
-        dispatchComputeShader(computeProgram, texture, screenWidth, screenHeight);
-        // Render the full-screen quad with the texture (implement renderQuadWithTexture yourself)
-        renderQuadWithTexture(texture, quadShaderProgram, quadVO);
-        
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        FrameSnapshot snapshot;
+        snapshot.frame = frame;
+        snapshot.update = update;
+        snapshot.camera = {cameraPos, cameraDir, focalLength};
+        snapshot.windowWidth = screenWidth;
+        snapshot.windowHeight = screenHeight;
+        snapshot.variableRate = variableRate;
+        snapshot.simulateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!queue.push(snapshot)) break;
     }
+    queue.close();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+
     // Cleanup
-    glDeleteBuffers(1, &ssbo);
-    glDeleteProgram(computeProgram);
-    glDeleteTextures(1, &texture);
+    shaderReloader.reset();
+    if (reloadContext) glfwDestroyWindow(reloadContext);
+    deleteProfiler(profiler);
+    renderer.reset();
     deleteVertexObjects(quadVO);
     deleteShaderProgram(quadShaderProgram);
     glfwDestroyWindow(window);
@@ -0,0 +1,896 @@
+// Scene data, ray intersection and shading shared by the megakernel and the wavefront passes.
+// Included after the #version and local size of each compute shader.
+
+// Define the structure for an entry of the material table, shared by all surfaces with the same material
+struct Material {
+    vec3 color;
+    float reflectivity;
+};
+
+// Define the structure for a light
+struct Light {
+    vec3 position;
+    float pad1;
+    vec3 color;
+    float pad2;
+};
+
+// Define the structure for a node of a BVH (depth-first, left child follows its parent)
+struct BVHNode {
+    vec3 boundsMin;
+    uint rightOrFirst;
+    vec3 boundsMax;
+    uint count;
+};
+
+// Define the structure for a node of the light BVH, a BVHNode with the summed power of the lights below it
+struct LightNode {
+    vec3 boundsMin;
+    uint rightOrFirst;          // Right child for inner nodes, first light for leaves
+    vec3 boundsMax;
+    uint count;
+    float power;
+    float pad1;
+    float pad2;
+    float pad3;
+};
+
+// Define the structure for a compressed triangle mesh, shared by all of its instances
+struct MeshInfo {
+    vec3 quantizationOrigin;    // Corner of the 16-bit vertex grid
+    uint nodeOffset;            // Root of the mesh BVH in nodes
+    vec3 quantizationStep;      // Size of one grid step along each axis
+    uint vertexOffset;          // First word of the vertices in meshWords, two words per vertex
+    uint indexOffset;           // First word of the vertex indices in meshWords
+    uint triangleCount;
+    uint vertexCount;
+    uint shortIndices;          // Nonzero if two 16-bit indices are packed into every word
+};
+
+// Define the structure for a placed copy of a mesh together with the header of its mesh
+struct InstanceRecord {
+    vec4 objectToWorld[3];      // Rows of the affine transform from mesh to world space
+    vec4 worldToObject[3];      // Rows of its inverse
+    MeshInfo mesh;
+};
+
+// Define the structure for a 3D point in space
+struct Point {
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+    float reflectivity;
+};
+
+#ifndef QUANTIZED_SCENE
+#define QUANTIZED_SCENE 0           // 1 if the host stores spheres as 16-bit coordinates in their BVH leaf
+#endif
+
+// Shader Storage Buffers for Scene Data, sized at runtime. The arrays the ray loops walk hold only what
+// the intersection tests read, the colors are looked up in the material table for the hit surface.
+layout (std430, binding = 0) readonly buffer SphereData {
+#if QUANTIZED_SCENE
+    uvec2 spheres[];            // x | y << 16, z | radius << 16 on a grid over the leaf bounds, see sphereAt
+#else
+    vec4 spheres[];             // Center and radius, in the leaf order of the sphere BVH
+#endif
+};
+layout (std430, binding = 1) readonly buffer PlaneData {
+    vec4 planes[];              // Normal and the distance of the plane from the origin along it
+};
+layout (std430, binding = 2) readonly buffer LightData {
+    Light lights[];
+};
+layout (std430, binding = 3) readonly buffer MaterialData {
+    Material materials[];
+};
+layout (std430, binding = 4) readonly buffer ObjectMaterialData {
+    uint objectMaterials[];     // Material of every sphere, then of every plane at numSpheres, then of every instance
+};
+
+// BVHs and meshes, bound after the wavefront queues
+layout (std430, binding = 12) readonly buffer NodeData {
+    BVHNode nodes[];            // BVHs of all meshes, the BVH over the instances at instanceRoot and the sphere BVH at sphereRoot
+};
+layout (std430, binding = 13) readonly buffer MeshWordData {
+    uint meshWords[];           // Quantized vertices and packed indices of all meshes
+};
+layout (std430, binding = 14) readonly buffer InstanceData {
+    InstanceRecord instances[]; // In the leaf order of the instance BVH
+};
+// BVH over the lights, whose leaves index runs of the lights array
+layout (std430, binding = 15) readonly buffer LightNodeData {
+    LightNode lightNodes[];
+};
+
+// Ray counters for benchmarks, only bound and written while countRays is set
+layout (std430, binding = 5) buffer RayCounterData {
+    uint primaryRays;
+    uint reflectionRays;
+    uint shadowRays;
+};
+
+// Per-frame uniforms shared by every compute shader, uploaded once per frame. Layout must match FrameUniforms in Shader.h
+layout (std140, binding = 0) uniform FrameData {
+    vec3 cameraPos;
+    float focalLength;
+    vec3 cameraDir;
+    int screenWidth;
+    vec2 sampleJitter;  // Offset of this sample inside the pixel, in [0, 1)
+    int screenHeight;
+    int sampleIndex;    // Samples accumulated since the last reset, 0 starts a new image
+    int numSpheres;
+    int numPlanes;
+    int numLights;
+    int sphereRoot;     // Root of the sphere BVH in nodes, -1 if the scene has no spheres
+    int instanceRoot;   // Root of the instance BVH in nodes, -1 if the scene has no mesh instances
+    bool countRays;
+    int shadowRayBudget;    // Shadow rays per pixel and sample, scenes with more lights pick that many at random
+    ivec2 imageOffset;  // Offset of the traced region in the full image, non-zero for the tiles of a distributed frame
+    ivec2 imageSize;    // Size of the full image the camera covers, screenWidth x screenHeight is the traced region
+};
+
+// Compile-time settings of a shader variant, injected by the host (ShaderVariant in Shader.h).
+// The defaults handle any scene at runtime.
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 1               // Reflections followed per path, 0 removes the reflection code
+#endif
+#ifndef SHADOWS_ON
+#define SHADOWS_ON 1                // 0 removes the shadow rays
+#endif
+#ifdef NUM_LIGHTS
+#define LIGHT_COUNT NUM_LIGHTS      // Constant trip count, so the light loops can be unrolled
+#else
+#define LIGHT_COUNT numLights
+#endif
+#ifndef VARIABLE_RATE
+#define VARIABLE_RATE 0             // 1 traces the periphery once per 2x2 pixel block
+#endif
+#ifndef FOVEA_RADIUS
+#define FOVEA_RADIUS 0.3            // Radius around the screen centre traced per pixel, in screen heights
+#endif
+#ifndef OUTPUT_FORMAT
+#define OUTPUT_FORMAT rgba32f       // Image format of imgOutput, the format of the host's output texture
+#endif
+#ifndef TONEMAP_OUTPUT
+#define TONEMAP_OUTPUT 0            // 1 compresses highlights into [0, 1] for 8-bit output formats
+#endif
+#ifndef PACKET_TRACING
+#define PACKET_TRACING 0            // 1 traces the primary and shadow rays of a workgroup as packets (packets.glsl)
+#endif
+#ifndef DENOISE_FEATURES
+#define DENOISE_FEATURES 0          // 1 also stores the normal, depth and albedo images the denoiser (denoise.comp) reads
+#endif
+#ifndef MORTON_ORDER
+#define MORTON_ORDER 0              // 1 for 1-D workgroups that cover a tile of pixels along a Z-order curve
+#endif
+// Workgroup size of the including shader, the size it passes in unless the host overrides it
+#ifdef WORKGROUP_SIZE_X
+#define GROUP_SIZE_X(size) WORKGROUP_SIZE_X
+#else
+#define GROUP_SIZE_X(size) size
+#endif
+#ifdef WORKGROUP_SIZE_Y
+#define GROUP_SIZE_Y(size) WORKGROUP_SIZE_Y
+#else
+#define GROUP_SIZE_Y(size) size
+#endif
+
+// Output image
+layout (OUTPUT_FORMAT, binding = 0) uniform writeonly image2D imgOutput;
+// Running mean of the samples of every pixel
+layout (rgba32f, binding = 1) uniform image2D imgAccumulation;
+#if DENOISE_FEATURES
+// Running means of the normal and camera distance of the first surface of every pixel, and of its albedo and
+// the squared luminance of the irradiance, the sample divided by the albedo, for the variance of the samples
+layout (rgba16f, binding = 2) uniform image2D imgNormalDepth;
+layout (rgba16f, binding = 3) uniform image2D imgAlbedo;
+#endif
+
+const float MAX_FLOAT = 3.402823466e+38;
+// BVH_STACK_SIZE is defined by loadComputeShader from BVH.h, which also caps the depth of the BVHs to fit it
+// Mesh hits closer than this are ignored, so rays leaving a triangle do not hit it again
+const float MESH_EPSILON = 1e-4;
+
+// Kinds of surfaces in a SurfaceHit
+const int HIT_NONE = 0;
+const int HIT_SPHERE = 1;
+const int HIT_PLANE = 2;
+const int HIT_MESH = 3;
+
+// Define the structure for the closest surface along a ray
+struct SurfaceHit {
+    float t;
+    int kind;
+    uint object;        // Index of the sphere (in leaf order), plane or mesh instance
+    uint triangle;      // Triangle of a mesh hit in the leaf order of the mesh BVH, BVH leaf of a sphere hit
+};
+
+// Center and radius of the sphere in a slot of a leaf of the sphere BVH. Quantized spheres are decoded on a
+// grid of 65535 steps over the leaf bounds (quantizeSphere in SceneBuffer.cpp).
+vec4 sphereAt(uint slot, BVHNode leaf) {
+#if QUANTIZED_SCENE
+    uvec2 cells = spheres[slot];
+    vec3 step = (leaf.boundsMax - leaf.boundsMin) / 65535.0;
+    vec3 center = leaf.boundsMin + vec3(float(cells.x & 0xffffu), float(cells.x >> 16), float(cells.y & 0xffffu)) * step;
+    return vec4(center, float(cells.y >> 16) * max(step.x, max(step.y, step.z)));
+#else
+    return spheres[slot];
+#endif
+}
+
+// Material of a surface, the sphere, plane and instance materials follow each other in objectMaterials
+Material surfaceMaterial(int kind, uint object) {
+    uint base = kind == HIT_SPHERE ? 0u : kind == HIT_PLANE ? uint(numSpheres) : uint(numSpheres + numPlanes);
+    return materials[objectMaterials[base + object]];
+}
+
+bool intersectSphere(vec3 rayOrigin, vec3 rayDir, vec4 sphere, out float t) {
+    vec3 oc = rayOrigin - sphere.xyz;
+    float a = dot(rayDir, rayDir);
+    float b = 2.0 * dot(oc, rayDir);
+    float c = dot(oc, oc) - sphere.w * sphere.w;
+    float discriminant = b * b - 4.0 * a * c;
+    if (discriminant > 0) {
+        t = (-b - sqrt(discriminant)) / (2.0 * a);
+        return t > 0;
+    }
+    return false;
+}
+
+bool intersectPlane(vec3 rayOrigin, vec3 rayDir, vec4 plane, out float t) {
+    float denom = dot(plane.xyz, rayDir);
+    if (denom > 1e-6) {
+        t = (plane.w - dot(rayOrigin, plane.xyz)) / denom;
+        return t > 0;
+    }
+    return false;
+}
+
+// Slab test of a ray against a box, tNear is the entry distance clamped to 0
+bool intersectAABB(vec3 rayOrigin, vec3 invDir, vec3 boundsMin, vec3 boundsMax, float tMax, out float tNear) {
+    vec3 t0 = (boundsMin - rayOrigin) * invDir;
+    vec3 t1 = (boundsMax - rayOrigin) * invDir;
+    vec3 tSmall = min(t0, t1);
+    vec3 tBig = max(t0, t1);
+    tNear = max(max(tSmall.x, tSmall.y), max(tSmall.z, 0.0));
+    float tFar = min(min(tBig.x, tBig.y), min(tBig.z, tMax));
+    return tNear <= tFar;
+}
+
+// Reciprocal ray direction with zero components replaced by a tiny value to avoid 0 * inf
+vec3 inverseDirection(vec3 rayDir) {
+    vec3 safeDir = mix(rayDir, vec3(1e-20), lessThan(abs(rayDir), vec3(1e-20)));
+    return 1.0 / safeDir;
+}
+
+// Walk a subtree of the sphere BVH front to back and return the closest sphere hit in (tMin, tClosest), or -1.
+// hitLeaf is only changed by a hit.
+int traceSphereSubtree(uint root, vec3 rayOrigin, vec3 rayDir, float tMin, inout float tClosest, inout uint hitLeaf) {
+    int hitSphere = -1;
+    vec3 invDir = inverseDirection(rayDir);
+    uint nodeIndex = root;
+    float tNear;
+    if(!intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear)) return hitSphere;
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    while(true) {
+        BVHNode node = nodes[nodeIndex];
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if(intersectSphere(rayOrigin, rayDir, sphereAt(i, node), t) && t > tMin && t < tClosest) {
+                    tClosest = t;
+                    hitSphere = int(i);
+                    hitLeaf = nodeIndex;
+                }
+            }
+        } else {
+            // Visit the nearer child first and keep the other one for later
+            uint left = nodeIndex + 1;
+            uint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(rayOrigin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(rayOrigin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if(hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if(stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if(hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        // Pop the next subtree that the ray still reaches before the closest hit
+        bool found = false;
+        while(stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if(!found) break;
+    }
+    return hitSphere;
+}
+
+// Walk the sphere BVH front to back and return the closest sphere hit in (tMin, tClosest) and its leaf, or -1
+int traceSpheres(vec3 rayOrigin, vec3 rayDir, float tMin, inout float tClosest, out uint hitLeaf) {
+    hitLeaf = 0u;
+    if(sphereRoot < 0) return -1;
+    return traceSphereSubtree(uint(sphereRoot), rayOrigin, rayDir, tMin, tClosest, hitLeaf);
+}
+
+// Walk a subtree of the sphere BVH and stop at the first sphere hit in (tMin, tMax)
+bool occludedBySphereSubtree(uint root, vec3 rayOrigin, vec3 rayDir, float tMin, float tMax) {
+    vec3 invDir = inverseDirection(rayDir);
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = root;
+    while(stackSize > 0) {
+        uint nodeIndex = stack[--stackSize];
+        BVHNode node = nodes[nodeIndex];
+        float tNear;
+        if(!intersectAABB(rayOrigin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if(intersectSphere(rayOrigin, rayDir, sphereAt(i, node), t) && t > tMin && t < tMax) return true;
+            }
+        } else if(stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Walk the sphere BVH and stop at the first sphere hit in (tMin, tMax)
+bool occludedBySpheres(vec3 rayOrigin, vec3 rayDir, float tMin, float tMax) {
+    if(sphereRoot < 0) return false;
+    return occludedBySphereSubtree(uint(sphereRoot), rayOrigin, rayDir, tMin, tMax);
+}
+
+// Test the planes and return the closest one hit in (0, tClosest), or -1.
+// Planes are unbounded, so they stay outside of the BVH.
+int tracePlanes(vec3 rayOrigin, vec3 rayDir, inout float tClosest) {
+    int hitPlane = -1;
+    for(int i = 0; i < numPlanes; i++) {
+        float t;
+        if(intersectPlane(rayOrigin, rayDir, planes[i], t) && t < tClosest) {
+            tClosest = t;
+            hitPlane = i;
+        }
+    }
+    return hitPlane;
+}
+
+// Decode a vertex of a mesh from its 16-bit grid coordinates
+vec3 meshVertex(MeshInfo mesh, uint vertex) {
+    uint xy = meshWords[mesh.vertexOffset + 2u * vertex];
+    uint z = meshWords[mesh.vertexOffset + 2u * vertex + 1u];
+    return mesh.quantizationOrigin + vec3(float(xy & 0xffffu), float(xy >> 16), float(z)) * mesh.quantizationStep;
+}
+
+// Read the i-th vertex index of a mesh, three per triangle
+uint meshIndex(MeshInfo mesh, uint i) {
+    if(mesh.shortIndices == 0u) return meshWords[mesh.indexOffset + i];
+    uint word = meshWords[mesh.indexOffset + i / 2u];
+    return (i & 1u) == 0u ? word & 0xffffu : word >> 16;
+}
+
+// Define the structure for the per-ray terms of the watertight triangle test
+struct TriangleRay {
+    ivec3 axes;         // The axis of the largest direction component last, the other two keep the winding
+    vec3 shear;         // Shear that turns the ray into the +z axis of the permuted space, and 1 / dir.z
+};
+
+// Choose the permutation and shear of the watertight test for a ray direction
+TriangleRay triangleRay(vec3 rayDir) {
+    vec3 size = abs(rayDir);
+    int kz = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    if(rayDir[kz] < 0.0) {
+        int swap = kx;
+        kx = ky;
+        ky = swap;
+    }
+    return TriangleRay(ivec3(kx, ky, kz), vec3(rayDir[kx] / rayDir[kz], rayDir[ky] / rayDir[kz], 1.0 / rayDir[kz]));
+}
+
+// Watertight ray/triangle test (Woop, Benthin and Wald 2013). The edge functions are evaluated in a space
+// where the ray is the z axis, so a ray through a shared edge or vertex always hits one of its triangles.
+bool intersectTriangle(vec3 rayOrigin, TriangleRay ray, vec3 v0, vec3 v1, vec3 v2, float tMin, float tMax, out float t) {
+    vec3 a = v0 - rayOrigin;
+    vec3 b = v1 - rayOrigin;
+    vec3 c = v2 - rayOrigin;
+    precise float ax = a[ray.axes.x] - ray.shear.x * a[ray.axes.z];
+    precise float ay = a[ray.axes.y] - ray.shear.y * a[ray.axes.z];
+    precise float bx = b[ray.axes.x] - ray.shear.x * b[ray.axes.z];
+    precise float by = b[ray.axes.y] - ray.shear.y * b[ray.axes.z];
+    precise float cx = c[ray.axes.x] - ray.shear.x * c[ray.axes.z];
+    precise float cy = c[ray.axes.y] - ray.shear.y * c[ray.axes.z];
+
+    precise float u = cx * by - cy * bx;
+    precise float v = ax * cy - ay * cx;
+    precise float w = bx * ay - by * ax;
+    if((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0)) return false;
+    float det = u + v + w;
+    if(det == 0.0) return false;
+
+    t = (u * a[ray.axes.z] + v * b[ray.axes.z] + w * c[ray.axes.z]) * ray.shear.z / det;
+    return t > tMin && t < tMax;
+}
+
+// Test one triangle of a mesh, given in the leaf order of its BVH
+bool intersectMeshTriangle(MeshInfo mesh, uint triangle, vec3 rayOrigin, TriangleRay ray, float tMin, float tMax, out float t) {
+    vec3 v0 = meshVertex(mesh, meshIndex(mesh, 3u * triangle));
+    vec3 v1 = meshVertex(mesh, meshIndex(mesh, 3u * triangle + 1u));
+    vec3 v2 = meshVertex(mesh, meshIndex(mesh, 3u * triangle + 2u));
+    return intersectTriangle(rayOrigin, ray, v0, v1, v2, tMin, tMax, t);
+}
+
+// Walk the BVH of a mesh front to back with a ray in its object space and return the closest triangle hit
+// in (tMin, tClosest), or -1. The direction is not normalized, so t is the same as in world space.
+int traceMesh(MeshInfo mesh, vec3 rayOrigin, vec3 rayDir, float tMin, inout float tClosest) {
+    int hitTriangle = -1;
+    TriangleRay ray = triangleRay(rayDir);
+    vec3 invDir = inverseDirection(rayDir);
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    uint nodeIndex = mesh.nodeOffset;
+    float tNear;
+    if(!intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear)) return hitTriangle;
+    while(true) {
+        BVHNode node = nodes[nodeIndex];
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if(intersectMeshTriangle(mesh, i, rayOrigin, ray, tMin, tClosest, t)) {
+                    tClosest = t;
+                    hitTriangle = int(i);
+                }
+            }
+        } else {
+            uint left = nodeIndex + 1;
+            uint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(rayOrigin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(rayOrigin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if(hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if(stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if(hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while(stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if(!found) break;
+    }
+    return hitTriangle;
+}
+
+// Walk the BVH of a mesh with a ray in its object space and stop at the first triangle hit in (tMin, tMax)
+bool occludedByMesh(MeshInfo mesh, vec3 rayOrigin, vec3 rayDir, float tMin, float tMax) {
+    TriangleRay ray = triangleRay(rayDir);
+    vec3 invDir = inverseDirection(rayDir);
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = mesh.nodeOffset;
+    while(stackSize > 0) {
+        uint nodeIndex = stack[--stackSize];
+        BVHNode node = nodes[nodeIndex];
+        float tNear;
+        if(!intersectAABB(rayOrigin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                float t;
+                if(intersectMeshTriangle(mesh, i, rayOrigin, ray, tMin, tMax, t)) return true;
+            }
+        } else if(stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Transform a world space point (w = 1) or direction (w = 0) into the object space of an instance
+vec3 toObjectSpace(uint instance, vec4 v) {
+    return vec3(dot(instances[instance].worldToObject[0], v), dot(instances[instance].worldToObject[1], v),
+                dot(instances[instance].worldToObject[2], v));
+}
+
+// Walk the instance BVH front to back, and the mesh BVH of every instance it reaches. Returns the closest
+// instance hit in (tMin, tClosest) and its triangle, or -1.
+int traceMeshes(vec3 rayOrigin, vec3 rayDir, float tMin, inout float tClosest, out uint hitTriangle) {
+    int hitInstance = -1;
+    hitTriangle = 0u;
+    if(instanceRoot < 0) return hitInstance;
+
+    vec3 invDir = inverseDirection(rayDir);
+    uint nodeIndex = uint(instanceRoot);
+    float tNear;
+    if(!intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear)) return hitInstance;
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    while(true) {
+        BVHNode node = nodes[nodeIndex];
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                int triangle = traceMesh(instances[i].mesh, toObjectSpace(i, vec4(rayOrigin, 1.0)),
+                                         toObjectSpace(i, vec4(rayDir, 0.0)), tMin, tClosest);
+                if(triangle >= 0) {
+                    hitInstance = int(i);
+                    hitTriangle = uint(triangle);
+                }
+            }
+        } else {
+            uint left = nodeIndex + 1;
+            uint right = node.rightOrFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectAABB(rayOrigin, invDir, nodes[left].boundsMin, nodes[left].boundsMax, tClosest, tLeft);
+            bool hitRight = intersectAABB(rayOrigin, invDir, nodes[right].boundsMin, nodes[right].boundsMax, tClosest, tRight);
+            if(hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                // Never full within BVH_MAX_DEPTH, the check only keeps the array in bounds
+                if(stackSize < BVH_STACK_SIZE) stack[stackSize++] = leftFirst ? right : left;
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if(hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while(stackSize > 0 && !found) {
+            nodeIndex = stack[--stackSize];
+            found = intersectAABB(rayOrigin, invDir, nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax, tClosest, tNear);
+        }
+        if(!found) break;
+    }
+    return hitInstance;
+}
+
+// Walk the instance BVH and stop at the first triangle of any instance hit in (tMin, tMax)
+bool occludedByMeshes(vec3 rayOrigin, vec3 rayDir, float tMin, float tMax) {
+    if(instanceRoot < 0) return false;
+
+    vec3 invDir = inverseDirection(rayDir);
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = uint(instanceRoot);
+    while(stackSize > 0) {
+        uint nodeIndex = stack[--stackSize];
+        BVHNode node = nodes[nodeIndex];
+        float tNear;
+        if(!intersectAABB(rayOrigin, invDir, node.boundsMin, node.boundsMax, tMax, tNear)) continue;
+
+        if(node.count > 0) {
+            for(uint i = node.rightOrFirst; i < node.rightOrFirst + node.count; i++) {
+                if(occludedByMesh(instances[i].mesh, toObjectSpace(i, vec4(rayOrigin, 1.0)),
+                                  toObjectSpace(i, vec4(rayDir, 0.0)), tMin, tMax)) return true;
+            }
+        } else if(stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = node.rightOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// Check whether any sphere, plane or mesh lies on the ray in (tMin, tMax)
+bool occluded(vec3 rayOrigin, vec3 rayDir, float tMin, float tMax) {
+    if(occludedBySpheres(rayOrigin, rayDir, tMin, tMax)) return true;
+    for (int i = 0; i < numPlanes; i++) {
+        float t;
+        if(intersectPlane(rayOrigin, rayDir, planes[i], t) && t > tMin && t < tMax) return true;
+    }
+    return occludedByMeshes(rayOrigin, rayDir, max(tMin, MESH_EPSILON), tMax);
+}
+
+// Find the closest surface along a ray in (0, tMax). A plane hit replaces an equally close sphere hit
+// and a mesh hit replaces both.
+SurfaceHit traceClosest(vec3 rayOrigin, vec3 rayDir, float tMax) {
+    SurfaceHit hit = SurfaceHit(tMax, HIT_NONE, 0u, 0u);
+    uint leaf;
+    int sphere = traceSpheres(rayOrigin, rayDir, 0.0f, hit.t, leaf);
+    if(sphere >= 0) {
+        hit.kind = HIT_SPHERE;
+        hit.object = uint(sphere);
+        hit.triangle = leaf;
+    }
+    int plane = tracePlanes(rayOrigin, rayDir, hit.t);
+    if(plane >= 0) {
+        hit.kind = HIT_PLANE;
+        hit.object = uint(plane);
+    }
+    uint triangle;
+    int instance = traceMeshes(rayOrigin, rayDir, MESH_EPSILON, hit.t, triangle);
+    if(instance >= 0) {
+        hit.kind = HIT_MESH;
+        hit.object = uint(instance);
+        hit.triangle = triangle;
+    }
+    return hit;
+}
+
+// Position, normal and material of a surface hit, all zero for a miss
+Point surfacePoint(SurfaceHit hit, vec3 rayOrigin, vec3 rayDir) {
+    Point point = Point(vec3(0.0), vec3(0.0), vec3(0.0), 0.0);
+    if(hit.kind == HIT_NONE) return point;
+
+    point.position = rayOrigin + hit.t * rayDir;
+    if(hit.kind == HIT_PLANE) {
+        point.normal = planes[hit.object].xyz;
+    } else if(hit.kind == HIT_SPHERE) {
+        point.normal = normalize(point.position - sphereAt(hit.object, nodes[hit.triangle]).xyz);
+    } else {
+        MeshInfo mesh = instances[hit.object].mesh;
+        vec3 v0 = meshVertex(mesh, meshIndex(mesh, 3u * hit.triangle));
+        vec3 v1 = meshVertex(mesh, meshIndex(mesh, 3u * hit.triangle + 1u));
+        vec3 v2 = meshVertex(mesh, meshIndex(mesh, 3u * hit.triangle + 2u));
+        // Normals transform with the transposed inverse, and face the ray like the sphere normals
+        vec3 n = cross(v1 - v0, v2 - v0);
+        vec3 normal = normalize(n.x * instances[hit.object].worldToObject[0].xyz + n.y * instances[hit.object].worldToObject[1].xyz
+                                + n.z * instances[hit.object].worldToObject[2].xyz);
+        point.normal = dot(normal, rayDir) > 0.0 ? -normal : normal;
+    }
+    Material material = surfaceMaterial(hit.kind, hit.object);
+    point.color = material.color;
+    point.reflectivity = material.reflectivity;
+    return point;
+}
+
+// Direction of the camera ray through a point on the image plane, given in pixels
+vec3 cameraRayDirection(vec2 pixel) {
+    // Convert the pixel position in the full image to normalized device coordinates (NDC)
+    vec2 imagePixel = pixel + vec2(imageOffset);
+    float u = (imagePixel.x / float(imageSize.x)) * 2.0 - 1.0;
+    float v = (imagePixel.y / float(imageSize.y)) * 2.0 - 1.0;
+
+    vec3 cameraRight = normalize(cross(cameraDir, vec3(0.0f, 1.0f, 0.0f)));
+    vec3 cameraUp = cross(cameraRight, cameraDir);
+    float aspectRatio = float(imageSize.x) / float(imageSize.y);
+    
+    return normalize(cameraDir * focalLength 
+                     + cameraRight * u * aspectRatio 
+                     + cameraUp * v);
+}
+
+// Index of a pixel of the traced region in the full image, which seeds the per-pixel random numbers so the
+// tiles of a distributed frame get the numbers of the whole image
+uint imagePixelIndex(ivec2 pixel) {
+    ivec2 imagePixel = pixel + imageOffset;
+    return uint(imagePixel.y * imageSize.x + imagePixel.x);
+}
+
+// Gather the even bits of a Morton code into the low bits
+uint compactEvenBits(uint code) {
+    code &= 0x55555555u;
+    code = (code | (code >> 1)) & 0x33333333u;
+    code = (code | (code >> 2)) & 0x0f0f0f0fu;
+    code = (code | (code >> 4)) & 0x00ff00ffu;
+    code = (code | (code >> 8)) & 0x0000ffffu;
+    return code;
+}
+
+// Pixel of the invocation in a 2-D pass. With MORTON_ORDER every 1-D workgroup of 2^k invocations covers a tile
+// 2^ceil(k/2) pixels wide and 2^floor(k/2) high (workgroupTileSize in Shader.cpp) in Z-order, so neighbouring
+// invocations trace neighbouring pixels
+ivec2 invocationPixel() {
+#if MORTON_ORDER
+    int bits = findMSB(WORKGROUP_SIZE_X);
+    ivec2 tileSize = ivec2(1 << ((bits + 1) / 2), 1 << (bits / 2));
+    uint index = gl_LocalInvocationIndex;
+    return ivec2(gl_WorkGroupID.xy) * tileSize + ivec2(compactEvenBits(index), compactEvenBits(index >> 1));
+#else
+    return ivec2(gl_GlobalInvocationID.xy);
+#endif
+}
+
+// Light a surface gets even when no light reaches it, SHADOW_AMBIENT in LightTree.h
+const float SHADOW_AMBIENT = 0.1;
+// Light every visible light adds besides its diffuse term, LIGHT_FILL in LightTree.h
+const float LIGHT_FILL = 0.15;
+// Most shadow rays per pixel and sample, MAX_SHADOW_RAYS in LightTree.h
+const int MAX_SHADOW_RAYS = 16;
+
+// Light a surface point receives from a light if nothing blocks it, without the light color
+float lightFactor(vec3 lightPosition, vec3 position, vec3 normal) {
+    return LIGHT_FILL + max(0.0, dot(normalize(lightPosition - position), normal));
+}
+
+// Brightness of a light that its selection probability is proportional to
+float lightPower(Light light) {
+    return (light.color.x + light.color.y + light.color.z) / 3.0;
+}
+
+// Upper bound of the light a surface point receives from the lights of a node: its power times the largest
+// lightFactor of any point in the bounding sphere of the node
+float nodeImportance(LightNode node, vec3 position, vec3 normal) {
+    vec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+    float radius = 0.5 * length(node.boundsMax - node.boundsMin);
+    vec3 toCenter = center - position;
+    float dist = length(toCenter);
+    if(dist <= radius) return node.power * (LIGHT_FILL + 1.0);
+
+    // The sphere covers a cone around toCenter, the cosine is largest at its direction closest to the normal
+    float sinCone = radius / dist;
+    float cosCone = sqrt(max(0.0, 1.0 - sinCone * sinCone));
+    float cosTheta = dot(toCenter / dist, normal);
+    float cosBound = 1.0;
+    if(cosTheta < cosCone) {
+        float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+        cosBound = max(0.0, cosTheta * cosCone + sinTheta * sinCone);
+    }
+    return node.power * (LIGHT_FILL + cosBound);
+}
+
+// Walk down the light BVH, picking every child by its importance, and return the chosen light or -1 if no light
+// reaches the point. u in [0, 1) is rescaled to the chosen part at every step, pdf is the probability of the pick.
+int sampleLightTree(vec3 position, vec3 normal, float u, out float pdf) {
+    pdf = 1.0;
+    // The current node is carried through the loop, so every node is read once
+    uint nodeIndex = 0u;
+    LightNode node = lightNodes[0];
+    while(node.count == 0u) {
+        uint left = nodeIndex + 1u;
+        uint right = node.rightOrFirst;
+        float leftImportance = nodeImportance(lightNodes[left], position, normal);
+        float rightImportance = nodeImportance(lightNodes[right], position, normal);
+        float total = leftImportance + rightImportance;
+        if(total <= 0.0) return -1;
+
+        float leftProbability = leftImportance / total;
+        if(u < leftProbability) {
+            u /= leftProbability;
+            pdf *= leftProbability;
+            nodeIndex = left;
+        } else {
+            u = (u - leftProbability) / (1.0 - leftProbability);
+            pdf *= 1.0 - leftProbability;
+            nodeIndex = right;
+        }
+        u = min(u, 0.99999994);
+        node = lightNodes[nodeIndex];
+    }
+
+    // The few lights of a leaf are weighted exactly
+    uint first = node.rightOrFirst;
+    uint end = first + node.count;
+    float total = 0.0;
+    for(uint i = first; i < end; i++) {
+        total += lightPower(lights[i]) * lightFactor(lights[i].position, position, normal);
+    }
+    if(total <= 0.0) return -1;
+    // Rounding may leave target just above the sum, then the last light that can be chosen is taken
+    float target = u * total;
+    int chosen = -1;
+    float chosenImportance = 0.0;
+    for(uint i = first; i < end; i++) {
+        float importance = lightPower(lights[i]) * lightFactor(lights[i].position, position, normal);
+        if(importance <= 0.0) continue;
+        chosen = int(i);
+        chosenImportance = importance;
+        if(target < importance) break;
+        target -= importance;
+    }
+    pdf *= chosenImportance / total;
+    return chosen;
+}
+
+// Mix the bits of a number into a well distributed hash (the PCG output permutation)
+uint hashBits(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Random number in [0, 1) that picks a light sample of a pixel, lightSampleRandom in LightTree.cpp
+float lightSampleRandom(uint pixelIndex, int lightSampleIndex) {
+    uint hash = hashBits(pixelIndex ^ hashBits(uint(sampleIndex * MAX_SHADOW_RAYS + lightSampleIndex)));
+    return float(hash >> 8) / 16777216.0;
+}
+
+// Light samples, and so shadow rays, of a surface point: every light while the scene has no more than the budget
+int lightSampleCount() {
+    return min(LIGHT_COUNT, shadowRayBudget);
+}
+
+// Light of one light sample of a pixel's surface point, -1 for none. weight scales its contribution, so the sum
+// over all samples is an unbiased estimate of the light from all lights.
+int lightSample(uint pixelIndex, int lightSampleIndex, vec3 position, vec3 normal, out float weight) {
+    weight = 1.0;
+    if(LIGHT_COUNT <= shadowRayBudget) return lightSampleIndex;
+
+    float pdf;
+    int light = sampleLightTree(position, normal, lightSampleRandom(pixelIndex, lightSampleIndex), pdf);
+    weight = light >= 0 ? 1.0 / (pdf * float(shadowRayBudget)) : 0.0;
+    return light;
+}
+
+// Light a surface point receives from one light sample if nothing blocks it
+vec3 lightSampleContribution(int light, float weight, vec3 position, vec3 normal) {
+    return weight * lights[light].color * lightFactor(lights[light].position, position, normal);
+}
+
+// Ambient and diffuse lighting of the first surface seen through a pixel, given the light of the light samples
+// that reached it
+vec3 shadeSurface(vec3 color, vec3 light) {
+    if(LIGHT_COUNT == 0) return vec3(0.25) * color;
+    return (SHADOW_AMBIENT + light) * color;
+}
+
+#if TONEMAP_OUTPUT
+// Highlights above this are compressed instead of clipped, below it the colors are stored unchanged
+const float TONEMAP_KNEE = 0.8;
+
+// Map a color into [0, 1] for an 8-bit output, keeping the look of the float formats for everything but highlights
+vec3 tonemap(vec3 color) {
+    vec3 over = max(color - TONEMAP_KNEE, 0.0);
+    return min(color, TONEMAP_KNEE) + (1.0 - TONEMAP_KNEE) * (1.0 - exp(-over / (1.0 - TONEMAP_KNEE)));
+}
+#endif
+
+// Fold a sample into the running mean of the samples since the last reset and write the pixel
+void storeSample(ivec2 pixel, vec3 color) {
+    if(sampleIndex > 0) {
+        vec3 mean = imageLoad(imgAccumulation, pixel).rgb;
+        color = mean + (color - mean) / float(sampleIndex + 1);
+    }
+    imageStore(imgAccumulation, pixel, vec4(color, 1.0));
+#if TONEMAP_OUTPUT
+    color = tonemap(color);
+#endif
+    imageStore(imgOutput, pixel, vec4(color, 1.0));
+}
+
+// Relative brightness of a linear color
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Albedo the denoiser divides the color of a surface by, 1 where a channel is black, so misses and black
+// surfaces keep their color
+vec3 demodulationAlbedo(vec3 albedo) {
+    return mix(vec3(1.0), albedo, greaterThan(albedo, vec3(0.001)));
+}
+
+// Fold a sample and the first surface it saw into the feature images of the denoiser, averaged like the
+// samples so they line up with the accumulated colors at edges. A miss has a zero normal, depth and albedo.
+void storeFeatures(ivec2 pixel, vec3 color, vec3 position, vec3 normal, vec3 albedo) {
+#if DENOISE_FEATURES
+    bool hit = normal != vec3(0.0);
+    vec4 normalDepth = vec4(normal, hit ? distance(cameraPos, position) : 0.0);
+    float irradiance = luminance(color / demodulationAlbedo(albedo));
+    vec4 surfaceAlbedo = vec4(albedo, irradiance * irradiance);
+    if(sampleIndex > 0) {
+        float weight = 1.0 / float(sampleIndex + 1);
+        normalDepth = mix(imageLoad(imgNormalDepth, pixel), normalDepth, weight);
+        surfaceAlbedo = mix(imageLoad(imgAlbedo, pixel), surfaceAlbedo, weight);
+    }
+    imageStore(imgNormalDepth, pixel, normalDepth);
+    imageStore(imgAlbedo, pixel, surfaceAlbedo);
+#endif
+}
@@ -0,0 +1,233 @@
+// Packet tracing for the megakernel: the invocations of a workgroup trace their primary rays, and their shadow
+// rays toward the same light, together. One invocation walks the top levels of the sphere BVH for the whole packet
+// with a stack in shared memory, and their nodes and leaves are read from the SSBOs once per workgroup and handed to
+// the others in shared memory instead of being read by every invocation.
+// Included after common.glsl and the local size. barrier() has to be reached by every invocation, so the packet
+// functions are only called from uniform control flow, and invocations without a ray take part with tracing = false.
+
+#if PACKET_TRACING
+
+// Invocations of a workgroup, which share the loads of a packet
+const uint PACKET_SIZE = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+// Levels of the sphere BVH the packet walks together. The rays of a packet go separate ways further down, so
+// below these levels every ray that reaches a node walks its subtree alone, without barriers.
+const uint PACKET_DEPTH = 4u;
+// Subtrees the packet stack holds, at most one per level the packet walks
+const int PACKET_STACK_SIZE = int(PACKET_DEPTH) + 1;
+// Spheres of the largest BVH leaf, BVH_MAX_LEAF_SIZE is defined by loadComputeShader
+const uint PACKET_LEAF_SIZE = BVH_MAX_LEAF_SIZE;
+// Planes staged in shared memory, scenes with more planes read the others from the SSBO
+const uint PACKET_PLANES = 32u;
+// Rounds of shadow packets of a single light per light sample. Rays toward lights that did not get a round of
+// their own are traced in one mixed packet after them, so scenes with many lights do not take a round per light.
+const int PACKET_SHADOW_ROUNDS = 4;
+// Node index that ends the traversal of a packet
+const uint PACKET_DONE = 0xffffffffu;
+
+// Subtrees left to visit and their depth, only written by the first invocation
+shared uvec2 packetStack[PACKET_STACK_SIZE];
+// Node visited by the packet, its depth, the spheres of a leaf node and whether any ray of the packet reaches it.
+// All are double-buffered by the parity of the traversal step, so the next node can be staged while the other
+// invocations still read the last.
+shared uint packetNodeIndex[2];
+shared uint packetNodeDepth[2];
+shared BVHNode packetNode[2];
+shared vec4 packetSpheres[2][PACKET_LEAF_SIZE];
+shared uint packetVotes[2];
+// The first planes of the scene
+shared vec4 packetPlanes[PACKET_PLANES];
+// Lowest light of the shadow rays still waiting for a packet
+shared uint packetLight;
+
+// Center of a BVH node
+vec3 nodeCenter(uint nodeIndex) {
+    return 0.5 * (nodes[nodeIndex].boundsMin + nodes[nodeIndex].boundsMax);
+}
+
+// Stage a node of the sphere BVH, and its spheres if it is a leaf, for the traversal step of a parity
+void stagePacketNode(uint parity, uint nodeIndex, uint depth) {
+    packetNodeIndex[parity] = nodeIndex;
+    packetNodeDepth[parity] = depth;
+    packetVotes[parity] = 0u;
+    if(nodeIndex == PACKET_DONE) return;
+    BVHNode node = nodes[nodeIndex];
+    packetNode[parity] = node;
+    for(uint i = 0u; i < node.count; i++) packetSpheres[parity][i] = sphereAt(node.rightOrFirst + i, node);
+}
+
+// Walk the sphere BVH with the rays of the workgroup as one packet, visiting a node if any tracing ray reaches it.
+// Children are visited nearest to packetOrigin first, the origin the rays of the packet share or end at.
+// Returns the closest sphere hit of the ray in (tMin, tClosest) and its leaf, or -1. With anyHit the ray stops
+// at its first hit, the shadow rays only need to know that there is one, so any value >= 0 marks a hit.
+int packetTraceSpheres(bool tracing, vec3 rayOrigin, vec3 rayDir, vec3 packetOrigin, float tMin, inout float tClosest,
+                       bool anyHit, out uint hitLeaf) {
+    int hitSphere = -1;
+    hitLeaf = 0u;
+    if(sphereRoot < 0) return hitSphere;
+
+    vec3 invDir = inverseDirection(rayDir);
+    bool leader = gl_LocalInvocationIndex == 0u;
+    int stackSize = 0;
+    // The last packet may still be reading the shared state
+    barrier();
+    if(leader) stagePacketNode(0u, uint(sphereRoot), 0u);
+    for(uint traversalStep = 0u; ; traversalStep++) {
+        uint current = traversalStep & 1u;
+        uint next = current ^ 1u;
+        barrier();
+        uint nodeIndex = packetNodeIndex[current];
+        if(nodeIndex == PACKET_DONE) break;
+        uint depth = packetNodeDepth[current];
+        BVHNode node = packetNode[current];
+
+        float tNear;
+        if(tracing && intersectAABB(rayOrigin, invDir, node.boundsMin, node.boundsMax, tClosest, tNear)) {
+            packetVotes[current] = 1u;
+        }
+        barrier();
+        bool visit = packetVotes[current] != 0u;
+
+        if(visit && node.count > 0u) {
+            for(uint i = 0u; tracing && i < node.count; i++) {
+                float t;
+                if(intersectSphere(rayOrigin, rayDir, packetSpheres[current][i], t) && t > tMin && t < tClosest) {
+                    tClosest = t;
+                    hitSphere = int(node.rightOrFirst + i);
+                    hitLeaf = nodeIndex;
+                    if(anyHit) tracing = false;
+                }
+            }
+        } else if(visit && depth == PACKET_DEPTH && tracing) {
+            if(anyHit) {
+                if(occludedBySphereSubtree(nodeIndex, rayOrigin, rayDir, tMin, tClosest)) {
+                    hitSphere = 0;
+                    tracing = false;
+                }
+            } else {
+                int sphere = traceSphereSubtree(nodeIndex, rayOrigin, rayDir, tMin, tClosest, hitLeaf);
+                if(sphere >= 0) hitSphere = sphere;
+            }
+        }
+
+        if(leader) {
+            // Keep the farther child for later and visit the nearer one next
+            uvec2 nextNode = uvec2(PACKET_DONE, 0u);
+            if(visit && node.count == 0u && depth < PACKET_DEPTH) {
+                uint left = nodeIndex + 1u;
+                uint right = node.rightOrFirst;
+                bool leftFirst = distance(packetOrigin, nodeCenter(left)) <= distance(packetOrigin, nodeCenter(right));
+                packetStack[stackSize++] = uvec2(leftFirst ? right : left, depth + 1u);
+                nextNode = uvec2(leftFirst ? left : right, depth + 1u);
+            } else if(stackSize > 0) {
+                nextNode = packetStack[--stackSize];
+            }
+            stagePacketNode(next, nextNode.x, nextNode.y);
+        }
+    }
+    return hitSphere;
+}
+
+// Stage the first planes of the scene in shared memory, one per invocation, before the first packet
+void stagePacketPlanes() {
+    for(uint i = gl_LocalInvocationIndex; i < min(PACKET_PLANES, uint(numPlanes)); i += PACKET_SIZE) packetPlanes[i] = planes[i];
+    barrier();
+}
+
+// Test the planes, the staged ones from shared memory, and return the closest one the ray hits in (tMin, tClosest),
+// or -1. Unlike the BVH packets this needs no barriers, so it may also be called from divergent code.
+int packetTracePlanes(vec3 rayOrigin, vec3 rayDir, float tMin, inout float tClosest) {
+    int hitPlane = -1;
+    for(int i = 0; i < numPlanes; i++) {
+        float t;
+        vec4 plane = uint(i) < PACKET_PLANES ? packetPlanes[i] : planes[i];
+        if(intersectPlane(rayOrigin, rayDir, plane, t) && t > tMin && t < tClosest) {
+            tClosest = t;
+            hitPlane = i;
+        }
+    }
+    return hitPlane;
+}
+
+// traceClosest for the primary rays of the workgroup, which all start at the camera. Meshes are tested per ray.
+SurfaceHit packetTraceClosest(bool tracing, vec3 rayOrigin, vec3 rayDir, float tMax) {
+    SurfaceHit hit = SurfaceHit(tMax, HIT_NONE, 0u, 0u);
+    uint leaf;
+    int sphere = packetTraceSpheres(tracing, rayOrigin, rayDir, cameraPos, 0.0f, hit.t, false, leaf);
+    if(sphere >= 0) {
+        hit.kind = HIT_SPHERE;
+        hit.object = uint(sphere);
+        hit.triangle = leaf;
+    }
+    int plane = tracing ? packetTracePlanes(rayOrigin, rayDir, 0.0f, hit.t) : -1;
+    if(plane >= 0) {
+        hit.kind = HIT_PLANE;
+        hit.object = uint(plane);
+    }
+    uint triangle;
+    int instance = tracing ? traceMeshes(rayOrigin, rayDir, MESH_EPSILON, hit.t, triangle) : -1;
+    if(instance >= 0) {
+        hit.kind = HIT_MESH;
+        hit.object = uint(instance);
+        hit.triangle = triangle;
+    }
+    return hit;
+}
+
+// occluded for the shadow rays of the workgroup that end at the same light
+bool packetOccluded(bool tracing, vec3 rayOrigin, vec3 rayDir, vec3 lightPosition, float tMin, float tMax) {
+    float tClosest = tMax;
+    uint leaf;
+    bool blocked = packetTraceSpheres(tracing, rayOrigin, rayDir, lightPosition, tMin, tClosest, true, leaf) >= 0;
+    blocked = blocked || (tracing && packetTracePlanes(rayOrigin, rayDir, tMin, tClosest) >= 0);
+    return blocked || (tracing && occludedByMeshes(rayOrigin, rayDir, max(tMin, MESH_EPSILON), tMax));
+}
+
+// Check whether the shadow rays of the workgroup toward the lights of one light sample are blocked. The rays
+// are traced in packets of the rays toward the same light, starting with the lowest light any of them goes to.
+bool packetShadowed(bool tracing, int lightIndex, vec3 position, vec3 toLight, float lightDistance) {
+    bool shadowed = false;
+    bool waiting = tracing;
+    for(int batch = 0; batch < PACKET_SHADOW_ROUNDS; batch++) {
+        if(gl_LocalInvocationIndex == 0u) packetLight = PACKET_DONE;
+        barrier();
+        if(waiting) atomicMin(packetLight, uint(lightIndex));
+        barrier();
+        uint batchLight = packetLight;
+        // The next round resets packetLight
+        barrier();
+        if(batchLight == PACKET_DONE) break;
+
+        bool member = waiting && (uint(lightIndex) == batchLight || batch == PACKET_SHADOW_ROUNDS - 1);
+        if(packetOccluded(member, position, toLight / lightDistance, lights[batchLight].position, 0.001f, lightDistance)) {
+            shadowed = true;
+        }
+        if(member) waiting = false;
+    }
+    return shadowed;
+}
+
+// directLight for the surface points of the workgroup
+vec3 packetDirectLight(bool tracing, uint pixelIndex, vec3 position, vec3 normal) {
+    vec3 light = vec3(0.0);
+    for(int i = 0; i < lightSampleCount(); i++) {
+        float weight;
+        int lightIndex = tracing ? lightSample(pixelIndex, i, position, normal, weight) : -1;
+        bool lit = lightIndex >= 0;
+#if SHADOWS_ON
+        // The shadow ray ends at the light, so objects behind it cast no shadow
+        vec3 toLight = lit ? lights[lightIndex].position - position : vec3(0.0, 1.0, 0.0);
+        float lightDistance = length(toLight);
+        if(lit && countRays) atomicAdd(shadowRays, 1u);
+        if(LIGHT_COUNT <= shadowRayBudget) {
+            // Without light sampling a sample goes to the same light in every pixel, so its rays are one packet
+            if(packetOccluded(lit, position, toLight / lightDistance, lights[i].position, 0.001f, lightDistance)) lit = false;
+        } else if(packetShadowed(lit, lightIndex, position, toLight, lightDistance)) {
+            lit = false;
+        }
+#endif
+        if(lit) light += lightSampleContribution(lightIndex, weight, position, normal);
+    }
+    return light;
+}
+
+#endif
@@ -4,7 +4,46 @@ in vec2 TexCoord;
 out vec4 FragColor;
 
 uniform sampler2D screenTexture;  // Texture to be applied to the quad
+uniform bool upscale;             // Whether the texture is smaller than the window and has to be upscaled
+
+// How strongly texels whose luminance differs from the nearest texel are left out of the filter
+const float EDGE_SHARPNESS = 8.0;
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+// Function to upscale with a bilinear filter that gives less weight to texels across an edge,
+// so the edges of objects stay sharp instead of being blurred into the background
+vec4 edgeAwareUpscale(vec2 texCoord) {
+    ivec2 size = textureSize(screenTexture, 0);
+    vec2 position = texCoord * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - floor(position);
+
+    vec4 texels[4];
+    float bilinear[4];
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        texels[i] = texelFetch(screenTexture, clamp(base + offset, ivec2(0), size - 1), 0);
+        vec2 weight = mix(1.0 - f, f, vec2(offset));
+        bilinear[i] = weight.x * weight.y;
+    }
+
+    // The nearest texel decides which side of an edge the pixel is on
+    int nearest = int(f.x >= 0.5) + 2 * int(f.y >= 0.5);
+    float reference = luminance(texels[nearest].rgb);
+    vec4 sum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        float weight = bilinear[i] / (1.0 + EDGE_SHARPNESS * abs(luminance(texels[i].rgb) - reference));
+        sum += weight * texels[i];
+        weightSum += weight;
+    }
+    return sum / weightSum;
+}
 
 void main() {
-    FragColor = texture(screenTexture, TexCoord); // Sample the texture using the texture coordinates
-}
\ No newline at end of file
+    if (upscale) FragColor = edgeAwareUpscale(TexCoord);
+    else FragColor = texture(screenTexture, TexCoord); // Sample the texture using the texture coordinates
+}
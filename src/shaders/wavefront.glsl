@@ -0,0 +1,73 @@
+// Ray queues and path state shared by the passes of the wavefront pipeline, included after common.glsl.
+// Every pixel traces one path per sample, stored at the pixel index y * screenWidth + x.
+
+// Arguments of an indirect dispatch, in the layout glDispatchComputeIndirect reads them
+struct DispatchArgs {
+    uint numGroupsX;
+    uint numGroupsY;
+    uint numGroupsZ;
+};
+
+// Define the structure for a ray waiting in a queue
+struct QueuedRay {
+    vec3 origin;
+    uint path;          // Index of the path the ray belongs to, shadow rays carry their light sample above SHADOW_SAMPLE_SHIFT
+    vec3 direction;
+    float tMax;
+};
+
+// Define the structure for the state of the path of one pixel
+struct Path {
+    vec3 color;         // Surface colors gathered so far, weighted by the reflectivities on the way
+    float weight;       // Part of the final color still carried by the ray in flight
+    vec3 position;      // First surface hit, lit by the finalize pass
+    uint flags;
+    vec3 normal;
+    float pad;
+};
+
+const uint PATH_HIT = 1u;       // The camera ray hit a surface
+const uint PATH_SHADOWED = 2u;  // Shadow ray 0 of the first surface was blocked, ray i sets PATH_SHADOWED << i
+
+// Shadow rays keep the index of their light sample in the top bits of QueuedRay.path
+const uint SHADOW_SAMPLE_SHIFT = 27u;
+const uint SHADOW_PATH_MASK = (1u << SHADOW_SAMPLE_SHIFT) - 1u;
+
+// Queue counters and the indirect dispatch arguments computed from them
+layout (std430, binding = 6) buffer QueueState {
+    DispatchArgs intersectArgs;
+    DispatchArgs shadeArgs;
+    DispatchArgs shadowArgs;
+    uint inRayCount;        // Rays in the queue traced by the current bounce
+    uint outRayCount;       // Rays appended for the next bounce
+    uint shadowRayCount;
+};
+
+// The host swaps the two ray queues between bounces
+layout (std430, binding = 7) readonly buffer InRayQueue {
+    QueuedRay inRays[];
+};
+layout (std430, binding = 8) writeonly buffer OutRayQueue {
+    QueuedRay outRays[];
+};
+// Closest hit of the queued ray with the same index
+layout (std430, binding = 9) buffer HitData {
+    SurfaceHit hits[];
+};
+layout (std430, binding = 10) buffer ShadowRayQueue {
+    QueuedRay shadowQueue[];
+};
+layout (std430, binding = 11) buffer PathData {
+    Path paths[];
+};
+
+// Index of the queue entry of this invocation, indirect dispatches spread their groups over x and y
+uint queueIndex() {
+    uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    return group * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+}
+
+// Index in the full image of the pixel a path belongs to, seeds its light samples
+uint pathPixelIndex(uint path) {
+    return imagePixelIndex(ivec2(int(path % uint(screenWidth)), int(path / uint(screenWidth))));
+}